@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Acquisition stress test against the simulated sensor at every supported
+// sample rate. Compares the original one-sample-per-wakeup loop, the
+// per-sample drain, and the burst drain in polling and interrupt modes,
+// then checks gap accounting with the consumer stalled under load.
+
+#define RUN_SECONDS         10
+#define POLL_INTERVAL_NS    25000000    // SAMPLE_INTERVAL_MS in main.c
+#define WAKE_LATENCY_NS     30000       // ISR + context switch before the task runs
+#define STOPPED_POLL_NS     1000000000  // INTERRUPT_TIMEOUT_MS in main.c
+
+typedef enum {
+    PATH_LEGACY = 0,        // One max30102_read_sample() per 25 ms wakeup
+    PATH_PER_SAMPLE,        // max30102_read_sample() until the FIFO is empty
+    PATH_BURST_POLL,        // acquisition_drain() every 25 ms
+    PATH_BURST_INTERRUPT,   // acquisition_drain() on A_FULL
+    PATH_COUNT
+} bench_path_t;
+
+static const char *path_names[PATH_COUNT] = {
+    "legacy", "per-sample", "burst-poll", "burst-irq"
+};
+
+static const struct {
+    uint8_t code;
+    uint32_t hz;
+} rates[] = {
+    {MAX30102_SAMPLERATE_50, 50},
+    {MAX30102_SAMPLERATE_100, 100},
+    {MAX30102_SAMPLERATE_200, 200},
+    {MAX30102_SAMPLERATE_400, 400},
+    {MAX30102_SAMPLERATE_800, 800},
+    {MAX30102_SAMPLERATE_1000, 1000},
+    {MAX30102_SAMPLERATE_1600, 1600},
+    {MAX30102_SAMPLERATE_3200, 3200},
+};
+
+typedef struct {
+    uint64_t generated;
+    uint64_t lost_actual;   // Samples the simulated FIFO dropped
+    uint64_t lost_reported; // Samples covered by gap records
+    uint32_t gaps;
+    uint64_t seq_errors;    // Samples whose sequence number does not match the sensor's
+    uint64_t delivered;
+    uint64_t pending;       // Still in the FIFO when the run ended
+    uint32_t wakeups;
+    uint64_t latency_ns_total;
+    int64_t latency_ns_max;
+    uint32_t latency_count;
+    max30102_bus_stats_t bus;
+    int64_t bus_busy_ns;
+} bench_result_t;
+
+// Encodes the sensor's own sample index in the red channel so delivered
+// sequence numbers can be checked against it
+static void index_source(void *ctx, uint64_t index, int64_t time_ns, uint32_t *red, uint32_t *ir)
+{
+    (void)ctx;
+    (void)time_ns;
+    *red = (uint32_t)(index & 0x03FFFF);
+    *ir = 0;
+}
+
+static void bench_run(bench_path_t path, uint8_t rate_code, int64_t stall_ns, bench_result_t *result)
+{
+    static max30102_sim_t sim;
+    static max30102_dev_t dev;
+    static acquisition_t acq;
+    static max30102_sample_t samples[4 * MAX30102_FIFO_DEPTH];
+    
+    memset(result, 0, sizeof(*result));
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_sim_set_source(&sim, index_source, NULL);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = rate_code;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+    if (max30102_init(&dev, &config) != MAX30102_OK) {
+        fprintf(stderr, "init failed\n");
+        exit(1);
+    }
+    
+    acquisition_mode_t mode = (path == PATH_BURST_INTERRUPT) ? ACQUISITION_MODE_INTERRUPT
+                                                             : ACQUISITION_MODE_POLLING;
+    acquisition_start(&acq, &dev, mode, &config);
+    max30102_reset_bus_stats(&dev);
+    
+    max30102_sim_update(&sim);
+    uint64_t generated_start = sim.samples_generated;
+    uint64_t lost_start = sim.samples_lost;
+    bool have_offset = false;
+    uint32_t offset = 0;
+    int64_t bus_busy_start = sim.bus_busy_ns;
+    int64_t start_ns = host_clock_now_ns();
+    int64_t end_ns = start_ns + (int64_t)RUN_SECONDS * 1000000000;
+    int64_t next_wake_ns = start_ns + POLL_INTERVAL_NS;
+    
+    while (host_clock_now_ns() < end_ns) {
+        int64_t event_ns;
+        
+        if (path == PATH_BURST_INTERRUPT) {
+            event_ns = max30102_sim_next_interrupt_ns(&sim);
+            if (event_ns >= end_ns) {
+                break;
+            }
+            host_clock_advance_to_ns(event_ns + WAKE_LATENCY_NS);
+        } else {
+            event_ns = next_wake_ns;
+            host_clock_advance_to_ns(next_wake_ns);
+            next_wake_ns += POLL_INTERVAL_NS;
+        }
+        result->wakeups++;
+        
+        size_t count = 0;
+        if (path == PATH_LEGACY || path == PATH_PER_SAMPLE) {
+            while (max30102_read_sample(&dev, &samples[count]) == MAX30102_OK) {
+                count++;
+                if (path == PATH_LEGACY || count == sizeof(samples) / sizeof(samples[0])) {
+                    break;
+                }
+            }
+        } else {
+            max30102_gap_t gap;
+            acquisition_drain(&acq, event_ns / 1000, samples, sizeof(samples) / sizeof(samples[0]), &count, &gap);
+            if (gap.count > 0) {
+                result->gaps++;
+                result->lost_reported += gap.count;
+            }
+        }
+        
+        for (size_t i = 0; i < count; i++) {
+            uint32_t diff = (samples[i].red - samples[i].sequence) & 0x03FFFF;
+            if (!have_offset) {
+                offset = diff;
+                have_offset = true;
+            } else if (diff != offset) {
+                result->seq_errors++;
+            }
+        }
+        
+        if (count > 0) {
+            int64_t latency = host_clock_now_ns() - event_ns;
+            result->latency_count++;
+            result->latency_ns_total += latency;
+            if (latency > result->latency_ns_max) {
+                result->latency_ns_max = latency;
+            }
+        }
+        result->delivered += count;
+        
+        // Consumer stall on every 20th wakeup
+        if (stall_ns > 0 && result->wakeups % 20 == 0) {
+            host_clock_advance_ns(stall_ns);
+        }
+    }
+    
+    max30102_sim_update(&sim);
+    result->generated = sim.samples_generated - generated_start;
+    result->pending = sim.fifo_count;
+    result->lost_actual = sim.samples_lost - lost_start;
+    result->bus_busy_ns = sim.bus_busy_ns - bus_busy_start;
+    max30102_get_bus_stats(&dev, &result->bus);
+}
+
+// WR_PTR == RD_PTR with OVF_COUNTER 0 is both an empty FIFO and one that
+// has just filled up. A FIFO drained exactly full must give all of its
+// samples, and a stopped sensor must read as empty however long it sat.
+static int bench_equal_pointers(void)
+{
+    static max30102_sim_t sim;
+    static max30102_dev_t dev;
+    static acquisition_t acq;
+    static max30102_sample_t samples[2 * MAX30102_FIFO_DEPTH];
+    const size_t max_samples = sizeof(samples) / sizeof(samples[0]);
+    size_t count = 0;
+    
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_sim_set_source(&sim, index_source, NULL);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    if (max30102_init(&dev, &config) != MAX30102_OK) {
+        fprintf(stderr, "init failed\n");
+        exit(1);
+    }
+    acquisition_start(&acq, &dev, ACQUISITION_MODE_POLLING, &config);
+    host_clock_advance_ns(POLL_INTERVAL_NS);
+    acquisition_drain(&acq, 0, samples, max_samples, &count, NULL);
+    
+    // Exactly full: one more sample would overflow
+    do {
+        host_clock_advance_ns(100000);
+        max30102_sim_update(&sim);
+    } while (sim.fifo_count < MAX30102_FIFO_DEPTH);
+    size_t full = 0;
+    if (acquisition_drain(&acq, 0, samples, max_samples, &count, NULL) == MAX30102_OK) {
+        full = count;
+    }
+    
+    // Stopped: whatever arrived before the shutdown, then nothing. Polled
+    // at the interrupt-mode timeout in main.c, as no A_FULL edge comes.
+    max30102_deinit(&dev);
+    acquisition_drain(&acq, 0, samples, max_samples, &count, NULL);
+    size_t stale = 0;
+    uint32_t no_data = 0;
+    for (int i = 0; i < 100; i++) {
+        host_clock_advance_ns(STOPPED_POLL_NS);
+        max30102_err_t err = acquisition_drain(&acq, 0, samples, max_samples, &count, NULL);
+        if (err == MAX30102_OK) {
+            stale += count;
+        } else if (err == MAX30102_ERR_NO_DATA) {
+            no_data++;
+        }
+    }
+    
+    printf("\nequal pointers: full FIFO gave %zu of %d samples; stopped sensor gave %zu stale samples, "
+           "%lu of 100 polls no data\n", full, MAX30102_FIFO_DEPTH, stale, (unsigned long)no_data);
+    if (full != MAX30102_FIFO_DEPTH || stale > 0 || no_data != 100) {
+        fprintf(stderr, "FAIL: equal FIFO pointers misread\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    host_log_level = HOST_LOG_NONE;
+    
+    printf("%6s %-11s %9s %7s %9s %9s %9s %10s %10s %7s\n",
+           "rate", "path", "samples/s", "lost%", "trans/smp", "bytes/smp",
+           "wakeups/s", "lat_avg_us", "lat_max_us", "bus%");
+    
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (int p = 0; p < PATH_COUNT; p++) {
+            bench_result_t res;
+            bench_run((bench_path_t)p, rates[r].code, 0, &res);
+            
+            uint64_t accounted = res.delivered + res.pending;
+            double lost = res.generated > accounted
+                              ? 100.0 * (double)(res.generated - accounted) / (double)res.generated
+                              : 0.0;
+            
+            if (res.delivered == 0) {
+                printf("%6lu %-11s %9.1f %7.2f %9s %9s %9.1f %10s %10s %7.1f\n",
+                       (unsigned long)rates[r].hz, path_names[p], 0.0, lost, "-", "-",
+                       (double)res.wakeups / RUN_SECONDS, "-", "-",
+                       100.0 * (double)res.bus_busy_ns / (RUN_SECONDS * 1e9));
+                continue;
+            }
+            
+            double delivered = (double)res.delivered;
+            printf("%6lu %-11s %9.1f %7.2f %9.2f %9.2f %9.1f %10.1f %10.1f %7.1f\n",
+                   (unsigned long)rates[r].hz, path_names[p],
+                   (double)res.delivered / RUN_SECONDS, lost,
+                   res.bus.transactions / delivered,
+                   (res.bus.bytes_read + res.bus.bytes_written) / delivered,
+                   (double)res.wakeups / RUN_SECONDS,
+                   res.latency_count ? res.latency_ns_total / 1000.0 / res.latency_count : 0.0,
+                   res.latency_ns_max / 1000.0,
+                   100.0 * (double)res.bus_busy_ns / (RUN_SECONDS * 1e9));
+        }
+    }
+    
+    // Lossless drain under load: interrupt mode with the consumer stalled
+    // for longer than the FIFO can absorb on every 20th wakeup
+    static const int64_t stalls_ms[] = {0, 5, 20, 100};
+    int failures = 0;
+    
+    printf("\n%6s %8s %9s %7s %6s %11s %11s %10s\n",
+           "rate", "stall_ms", "samples/s", "loss%", "gaps", "lost_actual", "lost_report", "seq_errors");
+    
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (size_t st = 0; st < sizeof(stalls_ms) / sizeof(stalls_ms[0]); st++) {
+            bench_result_t res;
+            bench_run(PATH_BURST_INTERRUPT, rates[r].code, stalls_ms[st] * 1000000, &res);
+            
+            printf("%6lu %8lld %9.1f %7.3f %6lu %11llu %11llu %10llu\n",
+                   (unsigned long)rates[r].hz, (long long)stalls_ms[st],
+                   (double)res.delivered / RUN_SECONDS,
+                   res.generated ? 100.0 * (double)res.lost_actual / (double)res.generated : 0.0,
+                   (unsigned long)res.gaps, (unsigned long long)res.lost_actual,
+                   (unsigned long long)res.lost_reported, (unsigned long long)res.seq_errors);
+            
+            if (res.seq_errors > 0) {
+                failures++;
+            }
+        }
+    }
+    
+    failures += bench_equal_pointers();
+    
+    return failures ? 1 : 0;
+}
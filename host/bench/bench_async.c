@@ -0,0 +1,241 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "max30102.h"
+#include "i2c_async.h"
+#include "fake_bus.h"
+#include "host_port.h"
+
+// Blocking FIFO drains against queued ones on a bus with real latency. The
+// fake bus sleeps for each transfer's wire time, the way a task blocked in
+// the I2C driver gives up the CPU. Each block is drained and then
+// "processed" for a set time (a busy loop standing in for the DSP).
+//
+// Blocking: max30102_read_samples(), then process, for every block, so a
+// block costs bus time plus processing time. Queued: a worker thread runs
+// the i2c_async queue and the drain of block N+1 is queued before block N
+// is processed, so a block costs the larger of the two plus the queueing
+// overhead. Reported per run: bus and processing time per block, wall time
+// per block both ways, the speedup and the ideal speedup. Every delivered
+// sample is checked against the fake bus counter; with processing equal to
+// the bus time the queued path must be at least LEAST_SPEEDUP faster.
+
+#define BLOCKS              100
+#define LEAST_SPEEDUP       1.3
+
+typedef struct {
+    bool finished;
+    max30102_err_t err;
+    size_t count;
+} drain_result_t;
+
+typedef struct {
+    uint32_t next;              // Expected sequence and counter value
+    uint64_t samples;
+    uint64_t errors;
+} stream_check_t;
+
+static fake_bus_t bus;
+static max30102_dev_t dev;
+static i2c_async_t queue;
+static sem_t work_sem;
+static sem_t done_sem;
+static volatile bool worker_stop;
+static max30102_sample_t buffers[2][MAX30102_FIFO_DEPTH];
+static volatile uint32_t process_sink;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void wake_worker(void *ctx)
+{
+    sem_post((sem_t *)ctx);
+}
+
+static void wake_issuer(void *ctx)
+{
+    sem_post((sem_t *)ctx);
+}
+
+static void *worker_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        sem_wait(&work_sem);
+        if (worker_stop) {
+            break;
+        }
+        while (i2c_async_worker_step(&queue)) {
+        }
+    }
+    return NULL;
+}
+
+static void check_block(stream_check_t *check, const max30102_sample_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++, check->next++) {
+        if (samples[i].sequence != check->next || samples[i].red != fake_bus_sample_red(check->next) ||
+            samples[i].ir != fake_bus_sample_ir(check->next)) {
+            check->errors++;
+        }
+    }
+    check->samples += count;
+}
+
+// Stand-in for per-block DSP: keeps the CPU busy for 'work_ns'
+static void process_block(const max30102_sample_t *samples, size_t count, int64_t work_ns)
+{
+    int64_t end_ns = now_ns() + work_ns;
+    uint32_t acc = process_sink;
+    do {
+        for (size_t i = 0; i < count; i++) {
+            acc = acc * 31 + samples[i].red - samples[i].ir;
+        }
+    } while (now_ns() < end_ns);
+    process_sink = acc;
+}
+
+static void drain_done(void *ctx, max30102_err_t err, max30102_sample_t *samples,
+                       size_t count, const max30102_gap_t *gap)
+{
+    (void)samples;
+    (void)gap;
+    drain_result_t *result = ctx;
+    result->err = err;
+    result->count = count;
+    result->finished = true;
+}
+
+static void wait_drain(drain_result_t *result)
+{
+    while (!result->finished) {
+        sem_wait(&done_sem);
+        i2c_async_complete(&queue);
+    }
+}
+
+static void reset_device(uint8_t block)
+{
+    fake_bus_init(&bus, FAKE_BUS_HZ, FAKE_BUS_TRANSACTION_NS, block);
+    max30102_set_transport(&dev, fake_bus_transport(&bus));
+}
+
+// Wall time per block, blocking drains
+static double run_blocking(uint8_t block, int64_t work_ns, stream_check_t *check)
+{
+    reset_device(block);
+    int64_t start_ns = now_ns();
+    
+    for (int i = 0; i < BLOCKS; i++) {
+        size_t count = 0;
+        if (max30102_read_samples(&dev, buffers[0], block, &count, NULL) != MAX30102_OK) {
+            check->errors++;
+        }
+        check_block(check, buffers[0], count);
+        process_block(buffers[0], count, work_ns);
+    }
+    return (double)(now_ns() - start_ns) / BLOCKS;
+}
+
+// Wall time per block, drain of block N+1 queued before block N is processed
+static double run_queued(uint8_t block, int64_t work_ns, stream_check_t *check)
+{
+    reset_device(block);
+    drain_result_t results[2] = {{0}};
+    int64_t start_ns = now_ns();
+    
+    if (max30102_read_samples_async(&dev, &queue, buffers[0], block, drain_done, &results[0]) != MAX30102_OK) {
+        check->errors++;
+        return 0;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        drain_result_t *current = &results[i & 1];
+        wait_drain(current);
+        if (current->err != MAX30102_OK) {
+            check->errors++;
+        }
+        
+        if (i + 1 < BLOCKS) {
+            drain_result_t *next = &results[(i + 1) & 1];
+            *next = (drain_result_t){0};
+            if (max30102_read_samples_async(&dev, &queue, buffers[(i + 1) & 1], block, drain_done,
+                                            next) != MAX30102_OK) {
+                check->errors++;
+                next->finished = true;
+            }
+        }
+        
+        check_block(check, buffers[i & 1], current->count);
+        process_block(buffers[i & 1], current->count, work_ns);
+    }
+    return (double)(now_ns() - start_ns) / BLOCKS;
+}
+
+static int run(uint8_t block, double ratio)
+{
+    // Bus time of one drain: pointer read, then data read
+    reset_device(block);
+    int64_t bus_ns = fake_bus_transfer_ns(&bus, 1 + 3, 2) +
+                     fake_bus_transfer_ns(&bus, 1 + (size_t)block * 2 * MAX30102_BYTES_PER_LED, 2);
+    int64_t work_ns = (int64_t)(ratio * (double)bus_ns);
+    
+    stream_check_t blocking_check = {0};
+    stream_check_t queued_check = {0};
+    double blocking_ns = run_blocking(block, work_ns, &blocking_check);
+    double queued_ns = run_queued(block, work_ns, &queued_check);
+    
+    double speedup = queued_ns > 0 ? blocking_ns / queued_ns : 0.0;
+    double ideal = (double)(bus_ns + work_ns) / (double)(bus_ns > work_ns ? bus_ns : work_ns);
+    bool ok = blocking_check.errors == 0 && queued_check.errors == 0 &&
+              blocking_check.samples == (uint64_t)BLOCKS * block && queued_check.samples == (uint64_t)BLOCKS * block &&
+              (ratio != 1.0 || speedup >= LEAST_SPEEDUP);
+    
+    printf("%5u %6.2f %8.1f %8.1f %12.1f %11.1f %8.2f %6.2f %5s\n",
+           (unsigned)block, ratio, bus_ns / 1000.0, work_ns / 1000.0, blocking_ns / 1000.0,
+           queued_ns / 1000.0, speedup, ideal, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const uint8_t blocks[] = {4, 8, 24};
+    static const double ratios[] = {0.25, 0.5, 1.0, 2.0};
+    int failures = 0;
+    
+    host_log_level = HOST_LOG_NONE;
+    sem_init(&work_sem, 0, 0);
+    sem_init(&done_sem, 0, 0);
+    i2c_async_init(&queue);
+    i2c_async_set_worker(&queue, wake_worker, &work_sem);
+    i2c_async_set_issuer(&queue, wake_issuer, &done_sem);
+    
+    pthread_t worker;
+    pthread_create(&worker, NULL, worker_thread, NULL);
+    
+    printf("Blocking vs queued FIFO drains, %d blocks per run, %d Hz bus\n", BLOCKS, FAKE_BUS_HZ);
+    printf("%5s %6s %8s %8s %12s %11s %8s %6s %5s\n",
+           "block", "ratio", "bus_us", "work_us", "blocking_us", "queued_us", "speedup", "ideal", "check");
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++) {
+            failures += run(blocks[b], ratios[r]);
+        }
+    }
+    
+    i2c_async_stats_t stats;
+    i2c_async_get_stats(&queue, &stats);
+    printf("\nQueue: %lu submitted, %lu completed, %lu rejected, %lu errors, high water %lu\n",
+           (unsigned long)stats.submitted, (unsigned long)stats.completed, (unsigned long)stats.rejected,
+           (unsigned long)stats.errors, (unsigned long)stats.high_water);
+    
+    worker_stop = true;
+    sem_post(&work_sem);
+    pthread_join(worker, NULL);
+    return failures ? 1 : 0;
+}
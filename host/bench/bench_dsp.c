@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dsp_filters.h"
+#include "max30102_sim.h"
+
+// Filter kernel benchmark. Each filter runs over the same synthetic red/IR
+// trace as a specialized (compile-time) filter, block at a time on the
+// default path (vector where available) and the scalar path and sample at a
+// time, and as the runtime filter block and sample at a time. Reports ns
+// per red/IR pair (best of several passes) and checks that every variant
+// produces bit-identical output.
+
+#define RATE_HZ         400
+#define RUN_SECONDS     120
+#define SAMPLE_COUNT    (RATE_HZ * RUN_SECONDS)
+#define BLOCK_SIZE      32
+#define TIMING_REPEATS  9
+
+DSP_DEFINE_BIQUAD_CASCADE(band, 2,
+    DSP_BIQUAD_HIGHPASS(0.5, RATE_HZ, DSP_BUTTERWORTH_Q),
+    DSP_BIQUAD_LOWPASS(4.0, RATE_HZ, DSP_BUTTERWORTH_Q))
+DSP_DEFINE_MOVING_AVERAGE(smooth, 3)
+DSP_DEFINE_CIC_DECIMATOR(decim, 3, 3)
+
+typedef enum {
+    VARIANT_VECTOR,
+    VARIANT_SCALAR,
+    VARIANT_STEP,
+    VARIANT_RUNTIME,
+    VARIANT_RUNTIME_STEP,
+    VARIANT_COUNT
+} variant_t;
+
+static const char *const variant_names[VARIANT_COUNT] = {
+    "block", "block/scalar", "per-sample", "runtime block", "runtime per-sample",
+};
+
+static int32_t input[DSP_LANES][SAMPLE_COUNT];
+static int32_t output[VARIANT_COUNT][DSP_LANES][SAMPLE_COUNT];
+static size_t output_count[VARIANT_COUNT];
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void load_block(dsp_block_t *block, size_t start)
+{
+    size_t n = SAMPLE_COUNT - start < BLOCK_SIZE ? SAMPLE_COUNT - start : BLOCK_SIZE;
+    for (int l = 0; l < DSP_LANES; l++) {
+        memcpy(block->lane[l], &input[l][start], n * sizeof(int32_t));
+    }
+    block->count = n;
+}
+
+static size_t store_block(variant_t v, const dsp_block_t *block, size_t at)
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        memcpy(&output[v][l][at], block->lane[l], block->count * sizeof(int32_t));
+    }
+    return at + block->count;
+}
+
+static size_t store_pair(variant_t v, const int32_t pair[DSP_LANES], size_t at)
+{
+    output[v][0][at] = pair[0];
+    output[v][1][at] = pair[1];
+    return at + 1;
+}
+
+// Runs one variant of one filter; returns the number of output pairs
+static size_t run_biquad(variant_t v)
+{
+    static dsp_biquad_coef_t coef[2];
+    static dsp_biquad_cascade_t runtime;
+    band_t f;
+    dsp_block_t block;
+    size_t out = 0;
+    
+    band_init(&f);
+    dsp_biquad_design_highpass(&coef[0], 0.5, RATE_HZ, DSP_BUTTERWORTH_Q);
+    dsp_biquad_design_lowpass(&coef[1], 4.0, RATE_HZ, DSP_BUTTERWORTH_Q);
+    dsp_biquad_cascade_init(&runtime, coef, 2);
+    
+    for (size_t i = 0; i < SAMPLE_COUNT; i += BLOCK_SIZE) {
+        load_block(&block, i);
+        switch (v) {
+        case VARIANT_VECTOR:
+            band_process(&f, &block);
+            break;
+        case VARIANT_SCALAR:
+            band_process_scalar(&f, &block);
+            break;
+        case VARIANT_RUNTIME:
+            dsp_biquad_cascade_process(&runtime, &block);
+            break;
+        case VARIANT_STEP:
+        case VARIANT_RUNTIME_STEP:
+            for (size_t j = 0; j < block.count; j++) {
+                int32_t pair[DSP_LANES] = {block.lane[0][j], block.lane[1][j]};
+                if (v == VARIANT_STEP) {
+                    band_step(&f, pair);
+                } else {
+                    dsp_biquad_cascade_step(&runtime, pair);
+                }
+                out = store_pair(v, pair, out);
+            }
+            continue;
+        default:
+            break;
+        }
+        out = store_block(v, &block, out);
+    }
+    return out;
+}
+
+static size_t run_moving_average(variant_t v)
+{
+    static dsp_moving_average_t runtime;
+    smooth_t f;
+    dsp_block_t block;
+    size_t out = 0;
+    
+    smooth_init(&f);
+    dsp_moving_average_init(&runtime, smooth_LENGTH);
+    
+    for (size_t i = 0; i < SAMPLE_COUNT; i += BLOCK_SIZE) {
+        load_block(&block, i);
+        switch (v) {
+        case VARIANT_VECTOR:
+            smooth_process(&f, &block);
+            break;
+        case VARIANT_SCALAR:
+            smooth_process_scalar(&f, &block);
+            break;
+        case VARIANT_RUNTIME:
+            dsp_moving_average_process(&runtime, &block);
+            break;
+        case VARIANT_STEP:
+        case VARIANT_RUNTIME_STEP:
+            for (size_t j = 0; j < block.count; j++) {
+                int32_t pair[DSP_LANES] = {block.lane[0][j], block.lane[1][j]};
+                if (v == VARIANT_STEP) {
+                    smooth_step(&f, pair);
+                } else {
+                    dsp_moving_average_step(&runtime, pair);
+                }
+                out = store_pair(v, pair, out);
+            }
+            continue;
+        default:
+            break;
+        }
+        out = store_block(v, &block, out);
+    }
+    return out;
+}
+
+static size_t run_cic(variant_t v)
+{
+    static dsp_cic_t runtime;
+    decim_t f;
+    dsp_block_t block, decimated;
+    size_t out = 0;
+    
+    decim_init(&f);
+    dsp_cic_init(&runtime, 3, 8);
+    
+    for (size_t i = 0; i < SAMPLE_COUNT; i += BLOCK_SIZE) {
+        load_block(&block, i);
+        switch (v) {
+        case VARIANT_VECTOR:
+            decim_process(&f, &block, &decimated);
+            break;
+        case VARIANT_SCALAR:
+            decim_process_scalar(&f, &block, &decimated);
+            break;
+        case VARIANT_RUNTIME:
+            dsp_cic_process(&runtime, &block, &decimated);
+            break;
+        case VARIANT_STEP:
+        case VARIANT_RUNTIME_STEP:
+            for (size_t j = 0; j < block.count; j++) {
+                int32_t pair[DSP_LANES] = {block.lane[0][j], block.lane[1][j]};
+                bool ready = (v == VARIANT_STEP) ? decim_step(&f, pair) : dsp_cic_step(&runtime, pair);
+                if (ready) {
+                    out = store_pair(v, pair, out);
+                }
+            }
+            continue;
+        default:
+            break;
+        }
+        out = store_block(v, &decimated, out);
+    }
+    return out;
+}
+
+static int bench_filter(const char *name, size_t (*run)(variant_t))
+{
+    double ns[VARIANT_COUNT];
+    int failures = 0;
+    
+    for (int v = 0; v < VARIANT_COUNT; v++) {
+        double best = 1e30;
+        for (int r = 0; r < TIMING_REPEATS; r++) {
+            double t0 = now_ns();
+            output_count[v] = run((variant_t)v);
+            double elapsed = now_ns() - t0;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+        ns[v] = best / SAMPLE_COUNT;
+    }
+    
+    for (int v = 0; v < VARIANT_COUNT; v++) {
+        bool same = output_count[v] == output_count[0];
+        for (int l = 0; same && l < DSP_LANES; l++) {
+            same = memcmp(output[v][l], output[0][l], output_count[0] * sizeof(int32_t)) == 0;
+        }
+        printf("%-14s %-20s %8.2f %7.2fx %8lu %5s\n", v == 0 ? name : "", variant_names[v], ns[v],
+               ns[VARIANT_STEP] / ns[v], (unsigned long)output_count[v], same ? "ok" : "FAIL");
+        failures += same ? 0 : 1;
+    }
+    return failures;
+}
+
+int main(void)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = 72.0, .red_dc = 100000.0, .red_ac = 1200.0, .ir_dc = 120000.0, .ir_ac = 2400.0,
+        .noise = 50.0, .seed = 5,
+    };
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        uint32_t red, ir;
+        max30102_sim_ppg_source(&ppg, i, (int64_t)i * 1000000000 / RATE_HZ, &red, &ir);
+        input[DSP_LANE_RED][i] = (int32_t)red;
+        input[DSP_LANE_IR][i] = (int32_t)ir;
+    }
+    
+    // The folded compile-time design must match the run-time one exactly
+    dsp_biquad_coef_t hp, lp;
+    dsp_biquad_design_highpass(&hp, 0.5, RATE_HZ, DSP_BUTTERWORTH_Q);
+    dsp_biquad_design_lowpass(&lp, 4.0, RATE_HZ, DSP_BUTTERWORTH_Q);
+    int failures = 0;
+    if (memcmp(&hp, &band_coef[0], sizeof(hp)) != 0 || memcmp(&lp, &band_coef[1], sizeof(lp)) != 0) {
+        printf("compile-time and run-time biquad coefficients differ\n");
+        failures++;
+    }
+    
+    printf("%d s of red/IR at %d Hz, %d-sample blocks, vector path %s\n", RUN_SECONDS, RATE_HZ, BLOCK_SIZE,
+           DSP_VECTOR ? "enabled" : "disabled (scalar fallback)");
+    printf("%-14s %-20s %8s %8s %8s %5s\n", "filter", "variant", "ns/pair", "speedup", "outputs", "check");
+    
+    failures += bench_filter("biquad x2", run_biquad);
+    failures += bench_filter("moving avg 8", run_moving_average);
+    failures += bench_filter("cic 3/8", run_cic);
+    
+    return failures ? 1 : 0;
+}
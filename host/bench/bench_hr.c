@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hr_detector.h"
+#include "max30102_sim.h"
+
+// Heart-rate detector benchmark. Runs hr_detector over synthetic PPG at a
+// range of sample rates, heart rates and noise levels and reports CPU cost
+// per input sample, beats found against the beats in the trace, interval
+// error and BPM error once locked.
+//
+//   bench_hr                    synthetic scenarios
+//   bench_hr trace.csv RATE_HZ  a recording from `hrm_decode -c`
+
+#define RUN_SECONDS     60
+#define SETTLE_SECONDS  8           // Ignored while the detector locks
+#define MAX_RATE_HZ     3200
+#define TIMING_REPEATS  5
+
+typedef struct {
+    uint32_t rate_hz;
+    double bpm;
+    double noise;
+    bool checked;               // Must meet the accuracy limits below
+} scenario_t;
+
+#define MAX_BPM_ERROR       2.0     // Mean absolute BPM error once locked
+#define MIN_DETECTED        0.97    // Fraction of beats found
+#define MAX_EXTRA           0.02    // Spurious beats per real beat
+
+static max30102_sample_t trace[RUN_SECONDS * MAX_RATE_HZ];
+static hr_beat_t beats[RUN_SECONDS * 4];
+static hr_detector_t detector;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static size_t run_detector(const max30102_sample_t *samples, size_t count, uint32_t rate_hz,
+                           double *ns_per_sample)
+{
+    size_t found = 0;
+    double best = 1e30;
+    
+    // Take the fastest of several passes to keep scheduler noise out
+    for (int r = 0; r < TIMING_REPEATS; r++) {
+        hr_detector_init(&detector, rate_hz);
+        double t0 = now_ns();
+        found = hr_detector_process_block(&detector, samples, count, beats,
+                                          sizeof(beats) / sizeof(beats[0]));
+        double elapsed = now_ns() - t0;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    *ns_per_sample = best / (double)count;
+    return found;
+}
+
+static int run_scenario(const scenario_t *sc)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = sc->bpm, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = sc->noise, .seed = 7,
+    };
+    size_t count = (size_t)RUN_SECONDS * sc->rate_hz;
+    
+    for (size_t i = 0; i < count; i++) {
+        int64_t t = (int64_t)i * 1000000000 / sc->rate_hz;
+        max30102_sim_ppg_source(&ppg, i, t, &trace[i].red, &trace[i].ir);
+        trace[i].valid = true;
+        trace[i].sequence = (uint32_t)i;
+    }
+    
+    double ns;
+    size_t found = run_detector(trace, count, sc->rate_hz, &ns);
+    
+    // Score the beats after the settle period against the true period
+    double period = 60.0 / sc->bpm;
+    double window = RUN_SECONDS - SETTLE_SECONDS - period;
+    double expected = window / period;
+    double bpm_err_sum = 0.0, bpm_err_max = 0.0, ibi_err_sq = 0.0;
+    size_t scored = 0, locked = 0, good = 0, intervals = 0;
+    
+    for (size_t i = 0; i < found; i++) {
+        double t = (double)beats[i].sequence / sc->rate_hz;
+        if (t < SETTLE_SECONDS || t > SETTLE_SECONDS + window) {
+            continue;
+        }
+        scored++;
+        if (beats[i].interval_us) {
+            double err = beats[i].interval_us / 1e6 - period;
+            intervals++;
+            ibi_err_sq += err * err;
+            if (fabs(err) < 0.1 * period) {
+                good++;
+            }
+        }
+        if (beats[i].bpm_x10) {
+            double err = fabs(beats[i].bpm_x10 / 10.0 - sc->bpm);
+            locked++;
+            bpm_err_sum += err;
+            if (err > bpm_err_max) {
+                bpm_err_max = err;
+            }
+        }
+    }
+    
+    double detected = good / expected;
+    double extra = scored > good ? (double)(scored - good) / expected : 0.0;
+    double bpm_err = locked ? bpm_err_sum / locked : INFINITY;
+    bool ok = !sc->checked ||
+              (bpm_err <= MAX_BPM_ERROR && detected >= MIN_DETECTED && extra <= MAX_EXTRA);
+    
+    hr_stats_t stats;
+    hr_detector_get_stats(&detector, &stats);
+    printf("%6lu %5.0f %6.0f %8.1f %8.4f %8.1f %7.2f %7.1f %7.2f %7.2f %6lu %5s\n",
+           (unsigned long)sc->rate_hz, sc->bpm, sc->noise, ns, ns * sc->rate_hz / 1e7,
+           100.0 * detected, 100.0 * extra,
+           intervals ? 1000.0 * sqrt(ibi_err_sq / intervals) : 0.0,
+           bpm_err, bpm_err_max, (unsigned long)stats.resets,
+           sc->checked ? (ok ? "ok" : "FAIL") : "-");
+    
+    return ok ? 0 : 1;
+}
+
+static int run_csv(const char *path, uint32_t rate_hz)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    
+    size_t count = 0;
+    char line[128];
+    while (count < sizeof(trace) / sizeof(trace[0]) && fgets(line, sizeof(line), f)) {
+        unsigned long seq, red, ir;
+        if (sscanf(line, "%lu,%lu,%lu", &seq, &red, &ir) == 3) {
+            trace[count++] = (max30102_sample_t){
+                .red = (uint32_t)red, .ir = (uint32_t)ir, .valid = true, .sequence = (uint32_t)seq,
+            };
+        }
+    }
+    fclose(f);
+    
+    double ns;
+    size_t found = run_detector(trace, count, rate_hz, &ns);
+    for (size_t i = 0; i < found; i++) {
+        printf("[%lu] Beat: interval %lu ms, %u.%u BPM\n", (unsigned long)beats[i].sequence,
+               (unsigned long)(beats[i].interval_us / 1000), beats[i].bpm_x10 / 10, beats[i].bpm_x10 % 10);
+    }
+    printf("%zu samples, %zu beats, %.1f ns/sample\n", count, found, ns);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3) {
+        return run_csv(argv[1], (uint32_t)strtoul(argv[2], NULL, 10));
+    }
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s [trace.csv rate_hz]\n", argv[0]);
+        return 2;
+    }
+    
+    static const scenario_t scenarios[] = {
+        {50, 72, 20, true}, {100, 72, 20, true}, {400, 72, 20, true},
+        {1000, 72, 20, true}, {3200, 72, 20, true},
+        {100, 40, 20, true}, {100, 120, 20, true}, {100, 180, 20, true},
+        {400, 200, 20, true},
+        {100, 72, 0, true}, {100, 72, 200, true}, {100, 72, 800, false},
+    };
+    int failures = 0;
+    
+    printf("%d s synthetic PPG per run, first %d s ignored\n", RUN_SECONDS, SETTLE_SECONDS);
+    printf("%6s %5s %6s %8s %8s %8s %7s %7s %7s %7s %6s %5s\n",
+           "rate", "bpm", "noise", "ns/smp", "cpu%", "found%", "extra%", "ibi_ms",
+           "bpm_err", "bpm_max", "resets", "check");
+    
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failures += run_scenario(&scenarios[i]);
+    }
+    
+    return failures ? 1 : 0;
+}
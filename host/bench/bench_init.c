@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Sensor start-up cost against the simulated sensor: the original
+// max30102_init() followed by the 200 ms settle sensor_task used to add,
+// versus max30102_init_fast() from cold, re-initialized with the same and
+// with a changed configuration, after the sensor lost power behind the
+// driver's back, and after an explicit max30102_reset() as sensor_task's
+// recovery does. Reports time in init, time from init start to the first
+// sample read, and bus transactions and bytes. Each run checks that the
+// configuration registers hold what the config asks for and that samples
+// then arrive at the configured rate.
+
+#define LEGACY_SETTLE_MS    200         // vTaskDelay sensor_task used to do after init
+#define POLL_NS             1000000     // Read the FIFO every 1 ms to time the first sample
+#define RATE_CHECK_MS       1000        // Samples counted over this window after init
+
+typedef enum {
+    INIT_LEGACY = 0,
+    INIT_FAST,
+} init_path_t;
+
+typedef struct {
+    const char *name;
+    init_path_t path;
+    bool power_cycle;           // Sensor reset to power-on state before init
+    bool reset_first;           // max30102_reset() before init; init must not skip its own
+} init_step_t;
+
+static max30102_sim_t sim;
+static max30102_dev_t dev;
+
+static max30102_config_t make_config(uint8_t rate, uint8_t led)
+{
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = rate;
+    config.led1_power = led;
+    config.led2_power = led;
+    return config;
+}
+
+// Compares the sim's registers with what 'config' asks for
+static bool registers_match(const max30102_config_t *config)
+{
+    uint8_t fifo_config = (config->sample_avg & 0xE0) |
+                          (config->rollover_enable ? MAX30102_ROLLOVER_EN : 0) |
+                          (config->almost_full_threshold & MAX30102_A_FULL_MASK);
+    uint8_t spo2_config = (config->adc_range & 0x60) | (config->sample_rate & 0x1C) | (config->pulse_width & 0x03);
+    
+    return sim.regs[MAX30102_REG_FIFO_CONFIG] == fifo_config &&
+           sim.regs[MAX30102_REG_MODE_CONFIG] == config->mode &&
+           sim.regs[MAX30102_REG_SPO2_CONFIG] == spo2_config &&
+           sim.regs[MAX30102_REG_LED1_PA] == config->led1_power &&
+           sim.regs[MAX30102_REG_LED2_PA] == config->led2_power;
+}
+
+// Runs one init, then reads every POLL_NS for RATE_CHECK_MS and checks the
+// samples that arrive
+static int run_step(const init_step_t *step, const max30102_config_t *config)
+{
+    static max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+    
+    if (step->power_cycle) {
+        // Registers back to power-on values; the driver's shadow is not told
+        max30102_sim_init(&sim);
+    }
+    if (step->reset_first && max30102_reset(&dev) != MAX30102_OK) {
+        printf("%-22s reset failed\n", step->name);
+        return 1;
+    }
+    
+    max30102_err_t err = (step->path == INIT_LEGACY) ? max30102_init(&dev, config) : max30102_init_fast(&dev, config);
+    if (err != MAX30102_OK) {
+        printf("%-22s init failed: %d\n", step->name, err);
+        return 1;
+    }
+    bool regs_ok = registers_match(config);
+    
+    if (step->path == INIT_LEGACY) {
+        host_clock_advance_ns((int64_t)LEGACY_SETTLE_MS * 1000000);
+    }
+    
+    int64_t start_ns = host_clock_now_ns();
+    uint32_t delivered = 0;
+    bool sequence_ok = true;
+    uint32_t expected_sequence = 0;
+    while (host_clock_now_ns() - start_ns < (int64_t)RATE_CHECK_MS * 1000000) {
+        host_clock_advance_ns(POLL_NS);
+        size_t count = 0;
+        max30102_gap_t gap;
+        if (max30102_read_samples(&dev, samples, MAX30102_FIFO_DEPTH, &count, &gap) != MAX30102_OK) {
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (delivered > 0 && samples[i].sequence != expected_sequence) {
+                sequence_ok = false;
+            }
+            expected_sequence = samples[i].sequence + 1;
+            delivered++;
+        }
+    }
+    
+    // The legacy path's settle time lets samples pile up; only the fast
+    // path's count over the window is checked against the rate
+    uint32_t rate_hz = max30102_fifo_rate_hz(config);
+    uint32_t expected = rate_hz * RATE_CHECK_MS / 1000;
+    bool rate_ok = step->path == INIT_LEGACY || (delivered + 2 >= expected && delivered <= expected + 1);
+    
+    max30102_init_stats_t init;
+    max30102_get_init_stats(&dev, &init);
+    bool ok = regs_ok && sequence_ok && rate_ok && init.first_sample_us > 0 &&
+              !(step->reset_first && init.reset_skipped);
+    
+    printf("%-22s %9.2f %9.2f %6lu %6lu %7lu %6lu %6s %5lu %5s\n", step->name,
+           init.init_us / 1000.0, init.first_sample_us / 1000.0,
+           (unsigned long)init.transactions, (unsigned long)init.bytes,
+           (unsigned long)init.writes_skipped, (unsigned long)init.reset_polls,
+           init.reset_skipped ? "no" : "yes", (unsigned long)delivered, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+// LED changes through the shadow: repeating a level costs no transaction
+static int run_led_changes(void)
+{
+    static const struct {
+        const char *name;
+        uint8_t led1;
+        uint8_t led2;
+        uint32_t transactions;
+    } changes[] = {
+        {"led same", 0x30, 0x30, 0},
+        {"led one changed", 0x30, 0x24, 1},
+        {"led both changed", 0x10, 0x11, 1},
+    };
+    int failures = 0;
+    
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+        max30102_bus_stats_t before, after;
+        max30102_get_bus_stats(&dev, &before);
+        max30102_err_t err = max30102_set_led_power(&dev, changes[i].led1, changes[i].led2);
+        max30102_get_bus_stats(&dev, &after);
+        
+        uint32_t transactions = after.transactions - before.transactions;
+        uint32_t bytes = after.bytes_written - before.bytes_written;
+        bool ok = err == MAX30102_OK && transactions == changes[i].transactions &&
+                  sim.regs[MAX30102_REG_LED1_PA] == changes[i].led1 &&
+                  sim.regs[MAX30102_REG_LED2_PA] == changes[i].led2;
+        printf("%-22s %9s %9s %6lu %6lu %7lu %6s %6s %5s %5s\n", changes[i].name, "-", "-",
+               (unsigned long)transactions, (unsigned long)bytes,
+               (unsigned long)(after.writes_skipped - before.writes_skipped), "-", "-", "-",
+               ok ? "ok" : "FAIL");
+        failures += ok ? 0 : 1;
+    }
+    return failures;
+}
+
+int main(void)
+{
+    static const init_step_t steps[] = {
+        {"legacy cold", INIT_LEGACY, false, false},
+        {"fast cold", INIT_FAST, false, false},
+        {"fast same config", INIT_FAST, false, false},
+        {"fast new config", INIT_FAST, false, false},
+        {"fast after power loss", INIT_FAST, true, false},
+        {"fast after reset", INIT_FAST, false, true},
+    };
+    max30102_config_t configs[] = {
+        make_config(MAX30102_SAMPLERATE_100, 0x24),
+        make_config(MAX30102_SAMPLERATE_100, 0x24),
+        make_config(MAX30102_SAMPLERATE_100, 0x24),
+        make_config(MAX30102_SAMPLERATE_400, 0x30),
+        make_config(MAX30102_SAMPLERATE_400, 0x30),
+        make_config(MAX30102_SAMPLERATE_400, 0x30),
+    };
+    int failures = 0;
+    
+    host_log_level = HOST_LOG_NONE;
+    printf("%-22s %9s %9s %6s %6s %7s %6s %6s %5s %5s\n", "step", "init_ms", "first_ms", "trans",
+           "bytes", "skipped", "polls", "reset", "rx_1s", "check");
+    
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        if (i <= INIT_FAST) {
+            // Both cold runs start from a freshly powered sensor and driver
+            host_clock_reset();
+            max30102_sim_init(&sim);
+            max30102_set_transport(&dev, max30102_sim_transport(&sim));
+        }
+        failures += run_step(&steps[i], &configs[i]);
+    }
+    failures += run_led_changes();
+    
+    return failures ? 1 : 0;
+}
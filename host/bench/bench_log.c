@@ -0,0 +1,219 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "deferred_log.h"
+#include "esp_log.h"
+#include "host_port.h"
+
+// Cost of a log call on the sampling path: ESP_LOGW as the firmware had it
+// (the host stand-in writes to stderr, here redirected to /dev/null),
+// snprintf alone as the formatting part of that, and DEFERRED_LOG(), which
+// only stores the record. Formatting moves to deferred_log_flush(), timed
+// separately. The console UART is not modelled beyond an estimate of its
+// line time at CONSOLE_BAUD, which ESP_LOG spends on the calling task once
+// the UART FIFO is full.
+//
+// Checks that flushed lines match the text ESP_LOG would have printed,
+// including negative %ld arguments, that a full ring drops and counts
+// records instead of overwriting, and that a deferred call is cheaper than
+// snprintf alone.
+
+#define CALLS           2000000u
+#define REPEATS         3
+#define CONSOLE_BAUD    115200
+
+static const char *TAG = "MAX30102";
+static deferred_log_t log_ring;
+static volatile size_t sink_bytes;
+
+typedef struct {
+    char lines[8][DEFERRED_LOG_LINE];
+    char levels[8];
+    size_t count;
+} capture_t;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void null_sink(void *ctx, char level, const char *tag, int64_t time_us, const char *text)
+{
+    (void)ctx;
+    (void)level;
+    (void)tag;
+    (void)time_us;
+    sink_bytes += strlen(text);
+}
+
+static void capture_sink(void *ctx, char level, const char *tag, int64_t time_us, const char *text)
+{
+    (void)tag;
+    (void)time_us;
+    capture_t *capture = ctx;
+    if (capture->count < 8) {
+        snprintf(capture->lines[capture->count], DEFERRED_LOG_LINE, "%s", text);
+        capture->levels[capture->count] = level;
+        capture->count++;
+    }
+}
+
+// ns per ESP_LOGW call, best of REPEATS
+static double time_esp_log(void)
+{
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        int64_t start = now_ns();
+        for (uint32_t i = 0; i < CALLS; i++) {
+            ESP_LOGW(TAG, "FIFO overflow, gap of %lu samples at sequence %lu", (unsigned long)(i & 31),
+                     (unsigned long)i);
+        }
+        double ns = (double)(now_ns() - start) / CALLS;
+        best = (r == 0 || ns < best) ? ns : best;
+    }
+    return best;
+}
+
+static double time_snprintf(void)
+{
+    char line[DEFERRED_LOG_LINE];
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        int64_t start = now_ns();
+        for (uint32_t i = 0; i < CALLS; i++) {
+            int n = snprintf(line, sizeof(line), "W (%lld) %s: FIFO overflow, gap of %lu samples at sequence %lu",
+                             (long long)(host_clock_now_ns() / 1000000), TAG, (unsigned long)(i & 31),
+                             (unsigned long)i);
+            sink_bytes += (size_t)n;
+        }
+        double ns = (double)(now_ns() - start) / CALLS;
+        best = (r == 0 || ns < best) ? ns : best;
+    }
+    return best;
+}
+
+// ns per DEFERRED_LOG() and per flushed record. Records are written a
+// ring's worth at a time and flushed between batches, outside the timing
+// of the writes.
+static void time_deferred(double *write_ns, double *flush_ns)
+{
+    for (int r = 0; r < REPEATS; r++) {
+        deferred_log_init(&log_ring);
+        int64_t write_total = 0;
+        int64_t flush_total = 0;
+        for (uint32_t i = 0; i < CALLS; i += DEFERRED_LOG_CAPACITY) {
+            int64_t start = now_ns();
+            for (uint32_t j = i; j < i + DEFERRED_LOG_CAPACITY; j++) {
+                DEFERRED_LOG(&log_ring, LOG_MSG_FIFO_GAP, j & 31, j);
+            }
+            int64_t mid = now_ns();
+            deferred_log_flush(&log_ring, null_sink, NULL, 0);
+            write_total += mid - start;
+            flush_total += now_ns() - mid;
+        }
+        double write = (double)write_total / CALLS;
+        double flush = (double)flush_total / CALLS;
+        *write_ns = (r == 0 || write < *write_ns) ? write : *write_ns;
+        *flush_ns = (r == 0 || flush < *flush_ns) ? flush : *flush_ns;
+    }
+}
+
+// Flushed text matches what ESP_LOG formats from the same arguments
+static bool check_format(void)
+{
+    capture_t capture = {0};
+    deferred_log_init(&log_ring);
+    DEFERRED_LOG(&log_ring, LOG_MSG_FIFO_GAP, 17, 4000000000u);
+    DEFERRED_LOG(&log_ring, LOG_MSG_I2C_READ_FAILED, -2);
+    DEFERRED_LOG(&log_ring, LOG_MSG_MEMBER_FAILED, 3, -5);
+    DEFERRED_LOG(&log_ring, LOG_MSG_NO_DATA, 1234, 41);
+    deferred_log_flush(&log_ring, capture_sink, &capture, 0);
+    
+    char expected[4][DEFERRED_LOG_LINE];
+    snprintf(expected[0], DEFERRED_LOG_LINE, "FIFO overflow, gap of %lu samples at sequence %lu", 17ul, 4000000000ul);
+    snprintf(expected[1], DEFERRED_LOG_LINE, "I2C read failed: %d", -2);
+    snprintf(expected[2], DEFERRED_LOG_LINE, "Member %d drain failed: %d", 3, -5);
+    snprintf(expected[3], DEFERRED_LOG_LINE, "[%lu] No data available (count: %lu)", 1234ul, 41ul);
+    
+    bool ok = capture.count == 4 && capture.levels[0] == 'W' && capture.levels[1] == 'E' &&
+              capture.levels[3] == 'I';
+    for (size_t i = 0; ok && i < 4; i++) {
+        if (strcmp(capture.lines[i], expected[i]) != 0) {
+            printf("  got \"%s\", expected \"%s\"\n", capture.lines[i], expected[i]);
+            ok = false;
+        }
+    }
+    printf("Formatting of 4 records: %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Writing past a full ring keeps the oldest records and counts the rest
+static bool check_drops(void)
+{
+    capture_t capture = {0};
+    deferred_log_init(&log_ring);
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i < DEFERRED_LOG_CAPACITY + 10; i++) {
+        stored += DEFERRED_LOG(&log_ring, LOG_MSG_SENSOR_RESET, i) ? 1 : 0;
+    }
+    
+    deferred_log_stats_t stats;
+    deferred_log_get_stats(&log_ring, &stats);
+    size_t flushed = deferred_log_flush(&log_ring, capture_sink, &capture, 0);
+    bool ok = stored == DEFERRED_LOG_CAPACITY && stats.drops == 10 && flushed == DEFERRED_LOG_CAPACITY &&
+              strcmp(capture.lines[0], "10 log records dropped") == 0 &&
+              strcmp(capture.lines[1], "No data for 0 attempts. Resetting sensor...") == 0;
+    
+    // The ring is usable again and the drops are only reported once
+    capture.count = 0;
+    DEFERRED_LOG(&log_ring, LOG_MSG_SENSOR_RESET, 99);
+    ok = ok && deferred_log_flush(&log_ring, capture_sink, &capture, 0) == 1 && capture.count == 1;
+    printf("Overflow by 10 records: %lu stored, %lu dropped %s\n", (unsigned long)stored,
+           (unsigned long)stats.drops, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(void)
+{
+    int failures = 0;
+    
+    failures += check_format() ? 0 : 1;
+    failures += check_drops() ? 0 : 1;
+    
+    // Time the ESP_LOG path into /dev/null; the other paths do no I/O
+    fflush(stderr);
+    if (!freopen("/dev/null", "w", stderr)) {
+        fprintf(stdout, "cannot redirect stderr\n");
+        return 1;
+    }
+    host_log_level = HOST_LOG_WARN;
+    double esp_log = time_esp_log();
+    host_log_level = HOST_LOG_NONE;
+    double format = time_snprintf();
+    double write = 0;
+    double flush = 0;
+    time_deferred(&write, &flush);
+    
+    // Bits on the wire for one line at 8N1, as the console would send it
+    size_t line_len = strlen("W (123456) MAX30102: FIFO overflow, gap of 17 samples at sequence 123456\r\n");
+    double uart_ns = (double)line_len * 10 * 1e9 / CONSOLE_BAUD;
+    
+    printf("\nPer-call cost on the logging task, best of %d x %u calls\n", REPEATS, CALLS);
+    printf("%-28s %12s\n", "path", "ns/call");
+    printf("%-28s %12.1f\n", "ESP_LOGW to /dev/null", esp_log);
+    printf("%-28s %12.1f\n", "snprintf only", format);
+    printf("%-28s %12.1f\n", "DEFERRED_LOG", write);
+    printf("%-28s %12.1f\n", "flush, per record (later)", flush);
+    printf("%-28s %12.0f\n", "console line at 115200 baud", uart_ns);
+    
+    bool cheaper = write < format && write < esp_log;
+    printf("DEFERRED_LOG %.1fx cheaper than ESP_LOGW, %.1fx cheaper than snprintf: %s\n", esp_log / write,
+           format / write, cheaper ? "ok" : "FAIL");
+    failures += cheaper ? 0 : 1;
+    
+    return failures ? 1 : 0;
+}
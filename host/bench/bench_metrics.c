@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "metrics.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Cost of recording into metrics.h. Times metrics_record() and
+// metrics_count() against the disabled (NULL) case in a tight loop, then
+// the same polling drain loop against the simulated sensor with metrics on
+// and off, where every bus transaction, FIFO snapshot and drain records.
+// Checks that histograms count exactly, including with two threads
+// recording into the same histogram, that percentiles land in the right
+// bucket, and that one record costs less than MAX_RECORD_NS. Ends with the
+// periodic dump from the drain run.
+
+#define RECORDS             20000000u
+#define THREAD_RECORDS      2097152u    // Multiple of 256
+#define DRAINS              200000u
+#define REPEATS             3
+#define MAX_RECORD_NS       50.0
+
+static metrics_t metrics;
+static max30102_sim_t sim;
+static max30102_dev_t dev;
+static acquisition_t acq;
+static max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+static volatile uint32_t sink;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ns per call, best of REPEATS; 'target' NULL times the disabled path
+static double time_record(metrics_t *target)
+{
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        uint32_t value = 1;
+        int64_t start = now_ns();
+        for (uint32_t i = 0; i < RECORDS; i++) {
+            metrics_record(target, METRIC_I2C_US, value);
+            value = value * 1103515245u + 12345u;
+            value &= 0xFFFF;
+        }
+        double ns = (double)(now_ns() - start) / RECORDS;
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+static double time_count(metrics_t *target)
+{
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        int64_t start = now_ns();
+        for (uint32_t i = 0; i < RECORDS; i++) {
+            metrics_count(target, METRIC_RING_DROPS, (i & 7) + 1);
+        }
+        double ns = (double)(now_ns() - start) / RECORDS;
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+static void *record_thread(void *arg)
+{
+    uint32_t base = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < THREAD_RECORDS; i++) {
+        metrics_record(&metrics, METRIC_DSP_US, base + (i & 255));
+    }
+    return NULL;
+}
+
+// Histogram totals match what was recorded, from one thread and from two
+static bool check_counts(void)
+{
+    metrics_init(&metrics);
+    pthread_t threads[2];
+    pthread_create(&threads[0], NULL, record_thread, (void *)(uintptr_t)0);
+    pthread_create(&threads[1], NULL, record_thread, (void *)(uintptr_t)1000);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    
+    metrics_snapshot_t snap;
+    metrics_snapshot(&metrics, &snap);
+    const metrics_hist_snapshot_t *hist = &snap.hist[METRIC_DSP_US];
+    uint64_t bucket_total = 0;
+    for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        bucket_total += hist->buckets[b];
+    }
+    // Each thread records 0..255 (or 1000..1255) THREAD_RECORDS / 256 times
+    uint64_t per_value = THREAD_RECORDS / 256;
+    uint32_t expected_sum = (uint32_t)(per_value * (255 * 256 / 2) * 2 + per_value * 256 * 1000);
+    bool ok = hist->count == 2 * THREAD_RECORDS && bucket_total == hist->count &&
+              hist->sum == expected_sum && hist->max == 1255;
+    printf("Two-thread histogram: %lu records, bucket total %llu, max %lu %s\n",
+           (unsigned long)hist->count, (unsigned long long)bucket_total, (unsigned long)hist->max,
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Percentiles of 0..1023, each once: the 50th is in [256, 512), the 99th
+// in [512, 1024) and capped by the maximum
+static bool check_percentiles(void)
+{
+    metrics_init(&metrics);
+    for (uint32_t v = 0; v < 1024; v++) {
+        metrics_record(&metrics, METRIC_FIFO_LEVEL, v);
+    }
+    
+    metrics_snapshot_t snap;
+    metrics_snapshot(&metrics, &snap);
+    const metrics_hist_snapshot_t *hist = &snap.hist[METRIC_FIFO_LEVEL];
+    uint32_t p50 = metrics_hist_percentile(hist, 50);
+    uint32_t p99 = metrics_hist_percentile(hist, 99);
+    uint32_t p0 = metrics_hist_percentile(hist, 0);
+    bool ok = p50 == 511 && p99 == 1023 && p0 == 0 && hist->buckets[0] == 1 && hist->buckets[1] == 1 &&
+              hist->buckets[10] == 512;
+    printf("Percentiles of 0..1023: p0<=%lu p50<=%lu p99<=%lu %s\n", (unsigned long)p0, (unsigned long)p50,
+           (unsigned long)p99, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Host ns per acquisition_drain() at 1000 Hz, polled every 8 samples
+static double time_drains(bool with_metrics, uint64_t *delivered)
+{
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = MAX30102_SAMPLERATE_1000;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+    
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    if (with_metrics) {
+        metrics_init(&metrics);
+        max30102_set_metrics(&dev, &metrics);
+    }
+    if (max30102_init_fast(&dev, &config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, ACQUISITION_MODE_POLLING, &config) != MAX30102_OK) {
+        fprintf(stderr, "sensor init failed\n");
+        exit(1);
+    }
+    
+    *delivered = 0;
+    int64_t start = now_ns();
+    for (uint32_t i = 0; i < DRAINS; i++) {
+        host_clock_advance_ns(8000000);
+        size_t count = 0;
+        max30102_gap_t gap;
+        acquisition_drain(&acq, 0, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+        *delivered += count;
+        sink += count ? samples[0].red : 0;
+    }
+    return (double)(now_ns() - start) / DRAINS;
+}
+
+int main(void)
+{
+    int failures = 0;
+    host_log_level = HOST_LOG_NONE;
+    
+    metrics_init(&metrics);
+    double record_off = time_record(NULL);
+    double record_on = time_record(&metrics);
+    double count_off = time_count(NULL);
+    double count_on = time_count(&metrics);
+    bool record_ok = record_on <= MAX_RECORD_NS;
+    
+    printf("Recording cost, best of %d x %u calls\n", REPEATS, RECORDS);
+    printf("%-16s %10s %10s\n", "call", "off ns", "on ns");
+    printf("%-16s %10.2f %10.2f\n", "metrics_record", record_off, record_on);
+    printf("%-16s %10.2f %10.2f\n", "metrics_count", count_off, count_on);
+    printf("metrics_record under %.0f ns: %s\n\n", MAX_RECORD_NS, record_ok ? "ok" : "FAIL");
+    failures += record_ok ? 0 : 1;
+    
+    failures += check_counts() ? 0 : 1;
+    failures += check_percentiles() ? 0 : 1;
+    
+    uint64_t delivered_off = 0;
+    uint64_t delivered_on = 0;
+    double drain_off = 0;
+    double drain_on = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        double off = time_drains(false, &delivered_off);
+        double on = time_drains(true, &delivered_on);
+        drain_off = (r == 0 || off < drain_off) ? off : drain_off;
+        drain_on = (r == 0 || on < drain_on) ? on : drain_on;
+    }
+    
+    metrics_snapshot_t snap;
+    metrics_snapshot(&metrics, &snap);
+    const metrics_hist_snapshot_t *i2c = &snap.hist[METRIC_I2C_US];
+    const metrics_hist_snapshot_t *drains = &snap.hist[METRIC_DRAIN_SAMPLES];
+    bool drain_ok = delivered_on == delivered_off && drains->count == DRAINS && i2c->count >= 2 * DRAINS;
+    double records = (double)(i2c->count + snap.hist[METRIC_FIFO_LEVEL].count + drains->count) / DRAINS;
+    printf("\nSimulated drains at 1000 Hz, %u per run, best of %d\n", DRAINS, REPEATS);
+    printf("%-10s %12s %12s %12s %12s %6s\n", "", "off ns", "on ns", "overhead ns", "records", "check");
+    printf("%-10s %12.1f %12.1f %12.1f %12.2f %6s\n", "per drain", drain_off, drain_on, drain_on - drain_off,
+           records, drain_ok ? "ok" : "FAIL");
+    failures += drain_ok ? 0 : 1;
+    
+    printf("\nDump of the last drain run (virtual time):\n");
+    fflush(stdout);
+    metrics_snapshot_t zero;
+    memset(&zero, 0, sizeof(zero));
+    host_log_level = HOST_LOG_INFO;
+    metrics_log(&metrics, &zero);
+    
+    return failures ? 1 : 0;
+}
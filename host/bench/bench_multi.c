@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "sensor_group.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Aggregate throughput of several simulated MAX30102s against the number of
+// sensors and I2C buses. Each bus carries up to eight sensors behind a
+// simulated channel mux (one sensor is wired directly) and is drained by
+// one task, either with sensor_group_service() or with a fixed-interval
+// round robin that drains every sensor on each poll. Buses transfer in
+// parallel, so each bus runs on its own virtual timeline and the results
+// are summed. Task wakeups are rounded up to the FreeRTOS tick. A second
+// set mixes 1000 Hz and 100 Hz sensors, where the round robin has to poll
+// every sensor at the fast one's interval.
+//
+// Reported per run: offered and delivered samples/s, loss, busiest bus
+// utilization, drains/s, samples per drain and mux selects/s. Every run
+// checks sequence numbers against the sensor's own sample index; runs the
+// buses can carry must be lossless.
+
+#define RUN_SECONDS         10
+#define MAX_BUSES           2
+#define MAX_PER_BUS         SENSOR_GROUP_MAX_MEMBERS
+#define TICK_NS             10000000    // CONFIG_FREERTOS_HZ = 100
+#define WAKE_LATENCY_NS     30000       // Context switch before the task runs
+#define LOSSLESS_LOAD       6000        // Samples/s on one bus that must not lose any
+
+typedef enum {
+    POLICY_ROUND_ROBIN = 0,     // acquisition_drain() on every sensor per poll
+    POLICY_GROUP,               // sensor_group_service()
+    POLICY_COUNT
+} policy_t;
+
+static const char *policy_names[POLICY_COUNT] = {"round-robin", "group"};
+
+// One sensor's delivery check
+typedef struct {
+    bool have_offset;
+    uint32_t offset;
+    uint64_t delivered;
+    uint64_t lost_reported;
+    uint64_t seq_errors;
+} member_check_t;
+
+typedef struct {
+    uint64_t generated;
+    uint64_t delivered;
+    uint64_t lost_actual;
+    uint64_t lost_reported;
+    uint64_t pending;
+    uint64_t seq_errors;
+    uint64_t drains;
+    uint64_t selects;
+    int64_t busiest_ns;         // Bus time of the busiest bus
+} multi_result_t;
+
+static max30102_sim_t sims[MAX_PER_BUS];
+static max30102_sim_mux_t mux;
+static max30102_dev_t devs[MAX_PER_BUS];
+static acquisition_t acqs[MAX_PER_BUS];
+static sensor_group_t group;
+static member_check_t checks[MAX_PER_BUS];
+static max30102_sample_t samples[2 * MAX30102_FIFO_DEPTH];
+
+// Encodes the sensor's own sample index in the red channel so delivered
+// sequence numbers can be checked against it
+static void index_source(void *ctx, uint64_t index, int64_t time_ns, uint32_t *red, uint32_t *ir)
+{
+    (void)ctx;
+    (void)time_ns;
+    *red = (uint32_t)(index & 0x03FFFF);
+    *ir = 0;
+}
+
+static void check_sink(void *ctx, size_t index, const max30102_sample_t *drained,
+                       size_t count, const max30102_gap_t *gap)
+{
+    (void)ctx;
+    member_check_t *check = &checks[index];
+    
+    if (gap) {
+        check->lost_reported += gap->count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t diff = (drained[i].red - drained[i].sequence) & 0x03FFFF;
+        if (!check->have_offset) {
+            check->offset = diff;
+            check->have_offset = true;
+        } else if (diff != check->offset) {
+            check->seq_errors++;
+        }
+    }
+    check->delivered += count;
+}
+
+// Next tick boundary at or after 'time_ns', plus the wakeup latency
+static int64_t tick_wake_ns(int64_t time_ns)
+{
+    return (time_ns + TICK_NS - 1) / TICK_NS * TICK_NS + WAKE_LATENCY_NS;
+}
+
+// Runs one bus with 'count' sensors for RUN_SECONDS and adds its results
+static void run_bus(policy_t policy, size_t count, const max30102_config_t *const *configs,
+                    multi_result_t *result)
+{
+    host_clock_reset();
+    max30102_sim_mux_init(&mux);
+    memset(checks, 0, sizeof(checks));
+    sensor_group_init(&group, SENSOR_GROUP_BATCH, TICK_NS / 1000);
+    
+    for (size_t i = 0; i < count; i++) {
+        max30102_sim_init(&sims[i]);
+        max30102_sim_set_source(&sims[i], index_source, NULL);
+        // Oscillators differ a little from part to part
+        sims[i].odr_error_ppm = (int32_t)(i * 1500) - 5000;
+        const max30102_transport_t *transport = (count == 1) ? max30102_sim_transport(&sims[i])
+                                                             : max30102_sim_mux_attach(&mux, (uint8_t)i, &sims[i]);
+        
+        max30102_set_transport(&devs[i], transport);
+        max30102_err_t err = max30102_init_fast(&devs[i], configs[i]);
+        if (err == MAX30102_OK) {
+            err = (policy == POLICY_GROUP) ? sensor_group_add(&group, &devs[i], configs[i], NULL)
+                                           : acquisition_start(&acqs[i], &devs[i], ACQUISITION_MODE_POLLING,
+                                                               configs[i]);
+        }
+        if (err != MAX30102_OK) {
+            fprintf(stderr, "sensor %u init failed: %d\n", (unsigned)i, err);
+            exit(1);
+        }
+    }
+    
+    uint64_t generated_start[MAX_PER_BUS];
+    uint64_t lost_start[MAX_PER_BUS];
+    int64_t busy_start = mux.bus_busy_ns;
+    for (size_t i = 0; i < count; i++) {
+        max30102_sim_update(&sims[i]);
+        generated_start[i] = sims[i].samples_generated;
+        lost_start[i] = sims[i].samples_lost;
+        busy_start += sims[i].bus_busy_ns;
+    }
+    uint64_t selects_start = mux.selects;
+    uint32_t drains_start = group.stats.drains;
+    
+    // vTaskDelayUntil() with the fastest sensor's poll interval in whole ticks
+    int64_t poll_ns = INT64_MAX;
+    for (size_t i = 0; i < count; i++) {
+        int64_t interval_ns = (int64_t)acquisition_poll_interval_ms(configs[i]) * 1000000 / TICK_NS * TICK_NS;
+        if (interval_ns < poll_ns) {
+            poll_ns = interval_ns;
+        }
+    }
+    int64_t start_ns = host_clock_now_ns();
+    int64_t end_ns = start_ns + (int64_t)RUN_SECONDS * 1000000000;
+    int64_t next_poll_ns = start_ns + poll_ns;
+    uint64_t drains = 0;
+    
+    while (host_clock_now_ns() < end_ns) {
+        if (policy == POLICY_GROUP) {
+            int64_t next_due_us;
+            sensor_group_service(&group, samples, sizeof(samples) / sizeof(samples[0]),
+                                 check_sink, NULL, &next_due_us);
+            if (next_due_us * 1000 > host_clock_now_ns()) {
+                host_clock_advance_to_ns(tick_wake_ns(next_due_us * 1000));
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                size_t n = 0;
+                max30102_gap_t gap;
+                acquisition_drain(&acqs[i], 0, samples, sizeof(samples) / sizeof(samples[0]), &n, &gap);
+                check_sink(NULL, i, samples, n, gap.count > 0 ? &gap : NULL);
+                drains++;
+            }
+            host_clock_advance_to_ns(next_poll_ns + WAKE_LATENCY_NS);
+            next_poll_ns += poll_ns;
+        }
+    }
+    if (policy == POLICY_GROUP) {
+        drains = group.stats.drains - drains_start;
+    }
+    
+    int64_t busy_ns = mux.bus_busy_ns;
+    for (size_t i = 0; i < count; i++) {
+        max30102_sim_update(&sims[i]);
+        result->generated += sims[i].samples_generated - generated_start[i];
+        result->lost_actual += sims[i].samples_lost - lost_start[i];
+        result->pending += sims[i].fifo_count;
+        result->delivered += checks[i].delivered;
+        result->lost_reported += checks[i].lost_reported;
+        result->seq_errors += checks[i].seq_errors;
+        busy_ns += sims[i].bus_busy_ns;
+    }
+    result->drains += drains;
+    result->selects += mux.selects - selects_start;
+    if (busy_ns - busy_start > result->busiest_ns) {
+        result->busiest_ns = busy_ns - busy_start;
+    }
+}
+
+static int run(policy_t policy, size_t buses, size_t devices, const max30102_config_t *const *configs)
+{
+    multi_result_t result = {0};
+    const max30102_config_t *bus_configs[MAX_PER_BUS];
+    uint32_t offered = 0;
+    uint32_t busiest_load = 0;
+    
+    // Sensor n goes on bus n % buses, so a mixed set stays mixed on each bus
+    for (size_t b = 0; b < buses; b++) {
+        size_t count = 0;
+        uint32_t load = 0;
+        for (size_t n = b; n < devices; n += buses) {
+            bus_configs[count++] = configs[n];
+            load += max30102_fifo_rate_hz(configs[n]);
+        }
+        offered += load;
+        if (load > busiest_load) {
+            busiest_load = load;
+        }
+        run_bus(policy, count, bus_configs, &result);
+    }
+    
+    bool must_be_lossless = policy == POLICY_GROUP && busiest_load <= LOSSLESS_LOAD;
+    bool ok = result.seq_errors == 0 && (!must_be_lossless || result.lost_actual == 0);
+    
+    printf("%-11s %5lu %7lu %9lu %11.1f %7.2f %10llu %7.1f %9.1f %8.1f %9.1f %5s\n",
+           policy_names[policy], (unsigned long)buses, (unsigned long)devices,
+           (unsigned long)offered, (double)result.delivered / RUN_SECONDS,
+           result.generated ? 100.0 * (double)result.lost_actual / (double)result.generated : 0.0,
+           (unsigned long long)result.lost_reported,
+           100.0 * (double)result.busiest_ns / (RUN_SECONDS * 1e9),
+           (double)result.drains / RUN_SECONDS,
+           result.drains ? (double)result.delivered / (double)result.drains : 0.0,
+           (double)result.selects / RUN_SECONDS, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+static int run_set(const char *name, const max30102_config_t *const *configs)
+{
+    static const size_t device_counts[] = {1, 2, 4, 6, 8, 12, 16};
+    int failures = 0;
+    
+    printf("\n%s, %d s per run, batch %d\n", name, RUN_SECONDS, SENSOR_GROUP_BATCH);
+    printf("%-11s %5s %7s %9s %11s %7s %10s %7s %9s %8s %9s %5s\n",
+           "policy", "buses", "sensors", "offered/s", "delivered/s", "lost%", "lost_rep",
+           "bus%", "drains/s", "smp/drn", "selects/s", "check");
+    
+    for (int p = 0; p < POLICY_COUNT; p++) {
+        for (size_t buses = 1; buses <= MAX_BUSES; buses++) {
+            for (size_t d = 0; d < sizeof(device_counts) / sizeof(device_counts[0]); d++) {
+                size_t devices = device_counts[d];
+                if (devices < buses || devices > buses * MAX_PER_BUS) {
+                    continue;
+                }
+                failures += run((policy_t)p, buses, devices, configs);
+            }
+        }
+    }
+    return failures;
+}
+
+static max30102_config_t make_config(uint8_t rate)
+{
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = rate;
+    config.sample_avg = MAX30102_SAMPLEAVG_1;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+    return config;
+}
+
+int main(void)
+{
+    max30102_config_t fast = make_config(MAX30102_SAMPLERATE_1000);
+    max30102_config_t slow = make_config(MAX30102_SAMPLERATE_100);
+    const max30102_config_t *uniform[MAX_BUSES * MAX_PER_BUS];
+    const max30102_config_t *mixed[MAX_BUSES * MAX_PER_BUS];
+    int failures = 0;
+    
+    for (size_t n = 0; n < MAX_BUSES * MAX_PER_BUS; n++) {
+        uniform[n] = &fast;
+        mixed[n] = (n % 4 == 0) ? &fast : &slow;
+    }
+    
+    host_log_level = HOST_LOG_NONE;
+    failures += run_set("1000 Hz sensors", uniform);
+    failures += run_set("One in four sensors at 1000 Hz, the rest at 100 Hz", mixed);
+    
+    return failures ? 1 : 0;
+}
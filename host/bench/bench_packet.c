@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "sample_ring.h"
+#include "packetizer.h"
+#include "packet_loopback.h"
+#include "host_port.h"
+
+// Throughput and latency of the packetizer over the loopback transport, on
+// the virtual clock. Samples are converted at a fixed rate and pushed into
+// a sample ring every DRAIN_NS, as sensor_task does; the packetizer is
+// serviced after each push, at its deadline and whenever the link frees a
+// buffer. Every packet is decoded at the far end and checked against the
+// generated samples.
+//
+// The first table sweeps MTU against the flush deadline at 400 Hz on a BLE
+// link; the second sweeps MTU at 3200 Hz on each link. latency is from
+// sample conversion to packet arrival, so it includes the wait for the
+// drain.
+
+#define RUN_SECONDS         10
+#define DRAIN_NS            10000000    // sensor_task drain period
+#define MAX_SAMPLES         (3200 * RUN_SECONDS + 64)
+
+typedef struct {
+    const char *name;
+    uint32_t bps;
+    int64_t packet_ns;
+} bench_link_t;
+
+// BLE 1M PHY with one notification per connection-event slot (header, MIC,
+// inter-frame spaces and the empty ack), and 8N1 UARTs with the 5 framing
+// bytes of packet_uart
+static const bench_link_t links[] = {
+    {"ble", 1000000, 500000},
+    {"uart921k", 921600 * 8 / 10, 5 * 10 * 1000000000LL / 921600},
+    {"uart115k", 115200 * 8 / 10, 5 * 10 * 1000000000LL / 115200},
+};
+
+static const size_t mtus[] = {23, 64, 128, 185, 244, 512};
+static const uint32_t deadlines_ms[] = {5, 20, 50, 100};
+
+typedef struct {
+    uint32_t rate_hz;
+    uint32_t expected;          // Next sequence the receiver should see
+    uint32_t received;
+    uint32_t skipped;           // Samples missing between packets
+    uint32_t mismatches;
+    uint16_t next_packet;
+    uint32_t packet_gaps;
+    uint32_t decode_errors;
+    double latency_sum_us;
+    double latency_max_us;
+    uint32_t latency_count;
+    float latencies_us[MAX_SAMPLES];
+} bench_receiver_t;
+
+typedef struct {
+    uint32_t generated;
+    uint32_t drops;             // Samples the ring dropped
+    double samples_per_s;
+    double packets_per_s;
+    double efficiency;          // Sample bits over packet bits
+    double link_util;
+    double latency_avg_us;
+    double latency_p99_us;
+    double latency_max_us;
+    packetizer_stats_t pk;
+} bench_result_t;
+
+static bench_receiver_t receiver;
+
+static void sample_values(uint32_t sequence, uint32_t *red, uint32_t *ir)
+{
+    *red = (sequence * 7919u + 100000u) & 0x3FFFF;
+    *ir = (sequence * 104729u + 12345u) & 0x3FFFF;
+}
+
+static int64_t sample_time_ns(uint32_t sequence, uint32_t rate_hz)
+{
+    return (int64_t)sequence * 1000000000 / rate_hz;
+}
+
+static void bench_receive(void *ctx, const uint8_t *data, size_t len, int64_t arrival_ns)
+{
+    bench_receiver_t *rx = (bench_receiver_t *)ctx;
+    max30102_sample_t samples[PACKET_MAX_SAMPLES];
+    packet_info_t info;
+
+    if (packet_decode(data, len, &info, samples, PACKET_MAX_SAMPLES) != MAX30102_OK) {
+        rx->decode_errors++;
+        return;
+    }
+    if (info.packet_number != rx->next_packet) {
+        rx->packet_gaps++;
+    }
+    rx->next_packet = info.packet_number + 1;
+
+    if (info.first_sequence < rx->expected) {
+        rx->mismatches++;
+    } else {
+        rx->skipped += info.first_sequence - rx->expected;
+    }
+    rx->expected = info.first_sequence + (uint32_t)info.count;
+
+    for (size_t i = 0; i < info.count; i++) {
+        uint32_t red, ir;
+        sample_values(samples[i].sequence, &red, &ir);
+        if (samples[i].red != red || samples[i].ir != ir) {
+            rx->mismatches++;
+        }
+
+        double latency_us = (double)(arrival_ns - sample_time_ns(samples[i].sequence, rx->rate_hz)) / 1000.0;
+        rx->latency_sum_us += latency_us;
+        if (latency_us > rx->latency_max_us) {
+            rx->latency_max_us = latency_us;
+        }
+        if (rx->latency_count < MAX_SAMPLES) {
+            rx->latencies_us[rx->latency_count++] = (float)latency_us;
+        }
+    }
+    rx->received += (uint32_t)info.count;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static void bench_run(const bench_link_t *link, size_t mtu, uint32_t deadline_ms, uint32_t rate_hz,
+                      bench_result_t *result)
+{
+    static sample_ring_t ring;
+    static packet_loopback_t loopback;
+    static packetizer_t pk;
+    max30102_sample_t batch[64];
+
+    memset(result, 0, sizeof(*result));
+    memset(&receiver, 0, sizeof(receiver));
+    receiver.rate_hz = rate_hz;
+    host_clock_reset();
+    sample_ring_init(&ring);
+    packet_loopback_init(&loopback, mtu, link->bps, link->packet_ns);
+    if (packetizer_init(&pk, &loopback.transport, deadline_ms * 1000) != MAX30102_OK) {
+        fprintf(stderr, "packetizer_init failed for MTU %zu\n", mtu);
+        exit(1);
+    }
+
+    int64_t end_ns = (int64_t)RUN_SECONDS * 1000000000;
+    int64_t next_drain_ns = DRAIN_NS;
+    uint32_t sequence = 0;
+
+    while (1) {
+        int64_t now_ns = host_clock_now_ns();
+
+        if (now_ns >= next_drain_ns && next_drain_ns <= end_ns) {
+            // Everything converted since the last drain, in FIFO-sized batches
+            while (sample_time_ns(sequence, rate_hz) < next_drain_ns) {
+                size_t n = 0;
+                while (n < sizeof(batch) / sizeof(batch[0]) && sample_time_ns(sequence, rate_hz) < next_drain_ns) {
+                    batch[n].sequence = sequence;
+                    batch[n].valid = true;
+                    batch[n].timestamp_us = sample_time_ns(sequence, rate_hz) / 1000;
+                    sample_values(sequence, &batch[n].red, &batch[n].ir);
+                    sequence++;
+                    n++;
+                }
+                sample_ring_push_block(&ring, batch, n);
+            }
+            next_drain_ns += DRAIN_NS;
+        }
+
+        if (packet_loopback_receive(&loopback, now_ns, bench_receive, &receiver) > 0 ||
+            sample_ring_count(&ring) > 0 || packetizer_due_us(&pk) <= now_ns / 1000) {
+            packetizer_service(&pk, &ring, now_ns / 1000);
+        }
+
+        if (now_ns >= end_ns) {
+            packetizer_flush(&pk);
+            if (sample_ring_count(&ring) == 0 && packet_loopback_next_arrival_ns(&loopback) == INT64_MAX) {
+                break;
+            }
+        }
+
+        // Next event: a drain, the open packet's deadline or an arrival
+        int64_t next_ns = (next_drain_ns <= end_ns) ? next_drain_ns : INT64_MAX;
+        int64_t due_us = packetizer_due_us(&pk);
+        if (due_us != INT64_MAX && due_us * 1000 < next_ns) {
+            next_ns = due_us * 1000;
+        }
+        if (packet_loopback_next_arrival_ns(&loopback) < next_ns) {
+            next_ns = packet_loopback_next_arrival_ns(&loopback);
+        }
+        if (next_ns == INT64_MAX) {
+            next_ns = end_ns;
+        }
+        host_clock_advance_to_ns(next_ns > now_ns ? next_ns : now_ns + 1000);
+    }
+
+    sample_ring_stats_t ring_stats;
+    sample_ring_get_stats(&ring, &ring_stats);
+    packetizer_get_stats(&pk, &result->pk);
+
+    double seconds = (double)RUN_SECONDS;
+    result->generated = sequence;
+    result->drops = ring_stats.drops;
+    result->samples_per_s = (double)receiver.received / seconds;
+    result->packets_per_s = (double)loopback.stats.packets / seconds;
+    result->efficiency = loopback.stats.bytes ?
+        (double)receiver.received * PACKET_SAMPLE_BITS / (8.0 * loopback.stats.bytes) : 0.0;
+    result->link_util = (double)loopback.stats.busy_ns / ((double)host_clock_now_ns());
+    if (receiver.latency_count > 0) {
+        qsort(receiver.latencies_us, receiver.latency_count, sizeof(float), compare_float);
+        result->latency_avg_us = receiver.latency_sum_us / receiver.received;
+        result->latency_p99_us = receiver.latencies_us[(size_t)(receiver.latency_count * 0.99)];
+        result->latency_max_us = receiver.latency_max_us;
+    }
+}
+
+static void print_header(void)
+{
+    printf("%-9s %5s %4s %8s %6s %9s %6s %9s %6s %6s %6s %9s %9s %9s\n",
+           "link", "rate", "mtu", "deadline", "spp", "samples/s", "lost", "packets/s", "dl%", "eff%", "util%",
+           "avg_ms", "p99_ms", "max_ms");
+}
+
+static void print_row(const bench_link_t *link, uint32_t rate_hz, size_t mtu, uint32_t deadline_ms,
+                      const bench_result_t *r)
+{
+    printf("%-9s %5lu %4zu %8lu %6zu %9.1f %6lu %9.1f %6.1f %6.1f %6.1f %9.2f %9.2f %9.2f\n",
+           link->name, (unsigned long)rate_hz, mtu, (unsigned long)deadline_ms, packetizer_capacity(mtu),
+           r->samples_per_s, (unsigned long)r->drops, r->packets_per_s,
+           r->pk.packets ? 100.0 * r->pk.deadline / r->pk.packets : 0.0, 100.0 * r->efficiency,
+           100.0 * r->link_util, r->latency_avg_us / 1000.0, r->latency_p99_us / 1000.0,
+           r->latency_max_us / 1000.0);
+}
+
+// Every run: what arrived is what was sent, in order, and every sample is
+// either delivered or counted as dropped by the ring
+static int check_integrity(const bench_link_t *link, size_t mtu, uint32_t rate_hz, const bench_result_t *r)
+{
+    int failures = 0;
+
+    if (receiver.mismatches || receiver.decode_errors || receiver.packet_gaps) {
+        fprintf(stderr, "FAIL: %s %lu Hz MTU %zu: %lu mismatches, %lu decode errors, %lu packet gaps\n",
+                link->name, (unsigned long)rate_hz, mtu, (unsigned long)receiver.mismatches,
+                (unsigned long)receiver.decode_errors, (unsigned long)receiver.packet_gaps);
+        failures++;
+    }
+    if (receiver.received + r->drops != r->generated || receiver.skipped + receiver.received != receiver.expected) {
+        fprintf(stderr, "FAIL: %s %lu Hz MTU %zu: %lu generated, %lu received, %lu dropped, %lu skipped\n",
+                link->name, (unsigned long)rate_hz, mtu, (unsigned long)r->generated,
+                (unsigned long)receiver.received, (unsigned long)r->drops, (unsigned long)receiver.skipped);
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    host_log_level = HOST_LOG_NONE;
+
+    int failures = 0;
+    bench_result_t r;
+
+    // MTU against flush deadline at a moderate rate: the deadline sets the
+    // latency until packets fill before it
+    const bench_link_t *ble = &links[0];
+    printf("MTU and flush deadline, 400 Hz on %s\n", ble->name);
+    print_header();
+    for (size_t m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+        for (size_t d = 0; d < sizeof(deadlines_ms) / sizeof(deadlines_ms[0]); d++) {
+            bench_run(ble, mtus[m], deadlines_ms[d], 400, &r);
+            print_row(ble, 400, mtus[m], deadlines_ms[d], &r);
+            failures += check_integrity(ble, mtus[m], 400, &r);
+
+            // The link is lightly loaded here: nothing may be lost, and no
+            // sample may wait longer than a drain, the deadline and a
+            // full transmit queue
+            int64_t wire_ns = ble->packet_ns + (int64_t)mtus[m] * 8 * 1000000000 / ble->bps;
+            double bound_us = (DRAIN_NS + (int64_t)deadlines_ms[d] * 1000000 +
+                               PACKET_LOOPBACK_DEPTH * wire_ns) / 1000.0;
+            if (r.drops > 0 || r.latency_max_us > bound_us) {
+                fprintf(stderr, "FAIL: MTU %zu deadline %lu ms: %lu dropped, max latency %.2f ms over %.2f ms\n",
+                        mtus[m], (unsigned long)deadlines_ms[d], (unsigned long)r.drops,
+                        r.latency_max_us / 1000.0, bound_us / 1000.0);
+                failures++;
+            }
+        }
+    }
+
+    // MTU at the highest rate on each link: small packets spend the link on
+    // per-packet cost, and a link slower than the sample stream backs up
+    // into the ring, which drops
+    printf("\nMTU at 3200 Hz, 20 ms deadline\n");
+    print_header();
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        double prev_efficiency = 0.0;
+        for (size_t m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+            bench_run(&links[l], mtus[m], 20, 3200, &r);
+            print_row(&links[l], 3200, mtus[m], 20, &r);
+            failures += check_integrity(&links[l], mtus[m], 3200, &r);
+
+            if (r.drops == 0 && r.efficiency < prev_efficiency) {
+                fprintf(stderr, "FAIL: %s MTU %zu efficiency %.3f below the smaller MTU's %.3f\n",
+                        links[l].name, mtus[m], r.efficiency, prev_efficiency);
+                failures++;
+            }
+            prev_efficiency = r.efficiency;
+
+            if (l < 2 && mtus[m] >= 185 && r.drops > 0) {
+                fprintf(stderr, "FAIL: %s MTU %zu dropped %lu samples at 3200 Hz\n", links[l].name, mtus[m],
+                        (unsigned long)r.drops);
+                failures++;
+            }
+        }
+    }
+
+    printf("\nspp: samples per packet, lost: samples dropped by the ring while the link was backed up\n");
+    printf("dl%%: packets sent at the deadline rather than full\n");
+    printf("eff%%: sample bits over packet bits, util%%: share of time the link was sending\n");
+    printf("latency: sample conversion to packet arrival, including the %d ms drain period\n", DRAIN_NS / 1000000);
+
+    return failures ? 1 : 0;
+}
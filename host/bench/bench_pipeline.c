@@ -0,0 +1,361 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pipeline.h"
+#include "max30102_sim.h"
+
+// Throughput and latency benchmark for the three-stage pipeline. Each
+// configuration maps the acquire, dsp and output stages onto one, two or
+// three threads, the way the firmware maps them onto tasks, and pins thread
+// i to CPU i when the machine has enough of them. The trace is precomputed
+// synthetic PPG. Output goes to a memory sink that is decoded after the run
+// to check that every sample arrived once and in order, with the same
+// beats, SpO2 and spectral readouts whatever the thread layout.
+//
+// Unpaced runs push as fast as the ring accepts, retrying when it is full,
+// and report samples per second. The paced run feeds FIFO-sized bursts at
+// the sensor rate, drops like sensor_task does, and reports latency and
+// queue high-water marks.
+
+#define SAMPLE_RATE_HZ      400
+#define TRACE_SAMPLES       1000000u
+#define ACQUIRE_BURST       8           // Samples per FIFO drain
+#define PACED_RATE_HZ       3200
+#define PACED_SECONDS       3
+#define SINK_SIZE           (TRACE_SAMPLES * 8u + (1u << 20))
+#define MAX_THREADS         PIPELINE_STAGE_COUNT
+
+#define STAGE_BIT(s)        (1u << (s))
+#define ALL_STAGES          (STAGE_BIT(PIPELINE_STAGE_ACQUIRE) | STAGE_BIT(PIPELINE_STAGE_DSP) | \
+                             STAGE_BIT(PIPELINE_STAGE_OUTPUT))
+
+typedef struct {
+    const char *name;
+    size_t threads;
+    uint32_t stages[MAX_THREADS];   // Stage bits run by each thread
+} layout_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    bool overflow;
+} sink_t;
+
+// Decoded output
+typedef struct {
+    uint32_t expected;
+    uint64_t samples;
+    uint64_t order_errors;          // Samples out of order or not matching the trace
+    uint32_t gaps;
+    uint32_t beats;
+    uint32_t spo2;
+    uint32_t spectral;
+    uint32_t info;
+} check_t;
+
+typedef struct {
+    const layout_t *layout;
+    size_t thread;
+    bool paced;
+    size_t samples;
+} worker_t;
+
+static max30102_sample_t trace[TRACE_SAMPLES];
+static pipeline_t pipeline;
+static sink_t sink;
+static stream_decoder_t decoder;
+
+// Shared run state
+static size_t acquire_next;                 // Written by the acquire stage only
+static int64_t paced_start_us;
+static atomic_int acquire_done;
+static atomic_int dsp_done;
+static atomic_int output_done;
+
+static int64_t clock_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *s = ctx;
+    if (s->len + len > SINK_SIZE) {
+        s->overflow = true;
+        return;
+    }
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+}
+
+static void check_frame(void *ctx, const stream_frame_t *frame)
+{
+    check_t *c = ctx;
+    switch (frame->type) {
+    case STREAM_FRAME_SAMPLES:
+        for (uint32_t i = 0; i < frame->block.count; i++) {
+            const max30102_sample_t *s = &frame->block.samples[i];
+            if (s->sequence != c->expected || s->sequence >= TRACE_SAMPLES ||
+                s->red != trace[s->sequence].red || s->ir != trace[s->sequence].ir) {
+                c->order_errors++;
+            }
+            c->expected = s->sequence + 1;
+        }
+        c->samples += frame->block.count;
+        break;
+    case STREAM_FRAME_GAP:
+        c->gaps++;
+        break;
+    case STREAM_FRAME_INFO:
+        c->info++;
+        break;
+    case STREAM_FRAME_BEAT:
+        c->beats++;
+        break;
+    case STREAM_FRAME_SPO2:
+        c->spo2++;
+        break;
+    case STREAM_FRAME_SPECTRAL:
+        c->spectral++;
+        break;
+    }
+}
+
+// One acquire call: a burst of samples, or nothing if a paced burst is not due
+static size_t run_acquire(worker_t *w)
+{
+    if (acquire_next >= w->samples) {
+        return 0;
+    }
+    size_t n = ACQUIRE_BURST;
+    if (w->paced) {
+        size_t due = (size_t)((clock_us() - paced_start_us) * PACED_RATE_HZ / 1000000);
+        if (due < acquire_next + n) {
+            return 0;
+        }
+    }
+    if (n > w->samples - acquire_next) {
+        n = w->samples - acquire_next;
+    }
+    
+    int64_t start = clock_us();
+    size_t pushed = pipeline_acquire(&pipeline, &trace[acquire_next], n);
+    pipeline_account(&pipeline, PIPELINE_STAGE_ACQUIRE, start, pushed);
+    
+    // Unpaced runs retry what the ring refused; paced runs drop it like sensor_task
+    acquire_next += w->paced ? n : pushed;
+    if (acquire_next >= w->samples) {
+        atomic_store_explicit(&acquire_done, 1, memory_order_release);
+    }
+    return pushed ? pushed : (w->paced ? n : 0);
+}
+
+static size_t run_dsp(void)
+{
+    bool upstream_done = atomic_load_explicit(&acquire_done, memory_order_acquire);
+    size_t n = pipeline_dsp_step(&pipeline);
+    if (n == 0 && upstream_done && sample_ring_count(&pipeline.ring) == 0) {
+        atomic_store_explicit(&dsp_done, 1, memory_order_release);
+    }
+    return n;
+}
+
+static size_t run_output(void)
+{
+    bool upstream_done = atomic_load_explicit(&dsp_done, memory_order_acquire);
+    size_t n = pipeline_output_step(&pipeline);
+    if (n == 0 && upstream_done) {
+        pipeline_output_flush(&pipeline);
+        atomic_store_explicit(&output_done, 1, memory_order_release);
+    }
+    return n;
+}
+
+static void *worker_thread(void *arg)
+{
+    worker_t *w = arg;
+    uint32_t stages = w->layout->stages[w->thread];
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus >= (long)w->layout->threads) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->thread, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    
+    while (1) {
+        size_t progress = 0;
+        bool finished = true;
+        if (stages & STAGE_BIT(PIPELINE_STAGE_ACQUIRE) && !atomic_load(&acquire_done)) {
+            progress += run_acquire(w);
+            finished = false;
+        }
+        if (stages & STAGE_BIT(PIPELINE_STAGE_DSP) && !atomic_load(&dsp_done)) {
+            progress += run_dsp();
+            finished = false;
+        }
+        if (stages & STAGE_BIT(PIPELINE_STAGE_OUTPUT) && !atomic_load(&output_done)) {
+            progress += run_output();
+            finished = false;
+        }
+        if (finished) {
+            break;
+        }
+        if (progress == 0) {
+            // Paced idle stages wait as a task would for its notification
+            if (w->paced) {
+                struct timespec ts = {0, 100000};
+                nanosleep(&ts, NULL);
+            } else {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+static int run_layout(const layout_t *layout, bool paced, double baseline_rate, check_t *reference,
+                      double *rate_out)
+{
+    worker_t workers[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    size_t samples = paced ? (size_t)PACED_RATE_HZ * PACED_SECONDS : TRACE_SAMPLES;
+    
+    pipeline_config_t config = {
+        .output = PIPELINE_OUTPUT_BINARY,
+        .sample_rate_hz = paced ? PACED_RATE_HZ : SAMPLE_RATE_HZ,
+        .write = sink_write,
+        .write_ctx = &sink,
+        .clock_us = clock_us,
+    };
+    if (pipeline_init(&pipeline, &config) != MAX30102_OK) {
+        printf("%-10s pipeline_init failed\n", layout->name);
+        return 1;
+    }
+    sink.len = 0;
+    sink.overflow = false;
+    acquire_next = 0;
+    atomic_store(&acquire_done, 0);
+    atomic_store(&dsp_done, 0);
+    atomic_store(&output_done, 0);
+    
+    int64_t start = clock_us();
+    paced_start_us = start;
+    for (size_t i = 0; i < layout->threads; i++) {
+        workers[i] = (worker_t){.layout = layout, .thread = i, .paced = paced, .samples = samples};
+        pthread_create(&threads[i], NULL, worker_thread, &workers[i]);
+    }
+    for (size_t i = 0; i < layout->threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (double)(clock_us() - start) / 1e6;
+    
+    pipeline_stats_t stats;
+    pipeline_get_stats(&pipeline, &stats);
+    
+    check_t check = {0};
+    stream_decoder_init(&decoder, check_frame, &check);
+    stream_decoder_feed(&decoder, sink.data, sink.len);
+    stream_stats_t dec_stats;
+    stream_decoder_get_stats(&decoder, &dec_stats);
+    
+    // Every sample once and in order. Analysis sees the same samples in the
+    // same order in every layout, so its events must match too.
+    bool ok = !sink.overflow && check.order_errors == 0 && check.gaps == 0 && check.samples == samples &&
+              dec_stats.crc_errors == 0 && dec_stats.bytes_skipped == 0 && check.info > 0;
+    if (paced) {
+        ok = ok && stats.ring.drops == 0 && stats.latency_count > 0;
+    } else if (reference->samples == 0) {
+        ok = ok && check.beats > 0 && check.spo2 > 0 && check.spectral > 0;
+        *reference = check;
+    } else {
+        ok = ok && check.beats == reference->beats && check.spo2 == reference->spo2 &&
+             check.spectral == reference->spectral;
+    }
+    
+    double rate = samples / seconds;
+    *rate_out = rate;
+    uint64_t busy = 0;
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        busy += stats.stage[i].busy_us;
+    }
+    printf("%-12s %-7s %9.3f %7.2f %8lu %5lu/%-4lu %4lu/%d %7lu %7lu %7lu %5.0f%% %5.0f%% %5.0f%% %5s\n",
+           layout->name, paced ? "paced" : "unpaced", rate / 1e6, baseline_rate > 0 ? rate / baseline_rate : 1.0,
+           (unsigned long)stats.ring.drops, (unsigned long)stats.ring.high_water,
+           (unsigned long)stats.ring.capacity, (unsigned long)stats.queue_high_water, PIPELINE_QUEUE_DEPTH,
+           (unsigned long)stats.stage[PIPELINE_STAGE_DSP].stalls, (unsigned long)stats.latency_avg_us,
+           (unsigned long)stats.latency_max_us,
+           busy ? 100.0 * stats.stage[PIPELINE_STAGE_ACQUIRE].busy_us / busy : 0.0,
+           busy ? 100.0 * stats.stage[PIPELINE_STAGE_DSP].busy_us / busy : 0.0,
+           busy ? 100.0 * stats.stage[PIPELINE_STAGE_OUTPUT].busy_us / busy : 0.0,
+           ok ? "ok" : "FAIL");
+    if (!ok) {
+        printf("  samples %llu/%lu, order errors %llu, gaps %lu, beats %lu, spo2 %lu, spectral %lu, "
+               "crc errors %lu, skipped %lu%s\n",
+               (unsigned long long)check.samples, (unsigned long)samples,
+               (unsigned long long)check.order_errors, (unsigned long)check.gaps,
+               (unsigned long)check.beats, (unsigned long)check.spo2, (unsigned long)check.spectral,
+               (unsigned long)dec_stats.crc_errors, (unsigned long)dec_stats.bytes_skipped,
+               sink.overflow ? ", sink overflow" : "");
+    }
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const layout_t layouts[] = {
+        {"1 thread", 1, {ALL_STAGES}},
+        {"2 threads", 2, {STAGE_BIT(PIPELINE_STAGE_ACQUIRE),
+                          STAGE_BIT(PIPELINE_STAGE_DSP) | STAGE_BIT(PIPELINE_STAGE_OUTPUT)}},
+        {"3 threads", 3, {STAGE_BIT(PIPELINE_STAGE_ACQUIRE), STAGE_BIT(PIPELINE_STAGE_DSP),
+                          STAGE_BIT(PIPELINE_STAGE_OUTPUT)}},
+    };
+    max30102_sim_ppg_t ppg = {
+        .bpm = 72.0, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = 20.0, .seed = 5,
+    };
+    for (size_t i = 0; i < TRACE_SAMPLES; i++) {
+        int64_t t = (int64_t)i * 1000000000 / SAMPLE_RATE_HZ;
+        max30102_sim_ppg_source(&ppg, i, t, &trace[i].red, &trace[i].ir);
+        trace[i].valid = true;
+        trace[i].sequence = (uint32_t)i;
+    }
+    sink.data = malloc(SINK_SIZE);
+    if (!sink.data) {
+        return 1;
+    }
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%lu samples at %d Hz unpaced, %d s at %d Hz paced; %ld CPUs%s\n",
+           (unsigned long)TRACE_SAMPLES, SAMPLE_RATE_HZ, PACED_SECONDS, PACED_RATE_HZ, cpus,
+           cpus < MAX_THREADS ? " (threads share CPUs, no scaling expected)" : "");
+    printf("%-12s %-7s %9s %7s %8s %10s %6s %7s %7s %7s %6s %6s %6s %5s\n",
+           "layout", "mode", "Msamp/s", "speedup", "retries", "ring_high", "queue", "stalls",
+           "lat_avg", "lat_max", "acq", "dsp", "out", "check");
+    
+    int failures = 0;
+    check_t reference = {0};
+    double baseline = 0.0, rate;
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        failures += run_layout(&layouts[i], false, baseline, &reference, &rate);
+        if (i == 0) {
+            baseline = rate;
+        }
+    }
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        failures += run_layout(&layouts[i], true, 0.0, &reference, &rate);
+    }
+    
+    free(sink.data);
+    return failures ? 1 : 0;
+}
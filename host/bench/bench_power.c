@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Sleep/wake timeline of the sensor task on the simulated sensor. The MCU
+// light-sleeps whenever it is not draining and wakes on a timer (polling)
+// or on INT. Compares polling and interrupt acquisition with the default
+// config against ACQUISITION_MODE_LOW_POWER, with A_FULL raised only and
+// with sample averaging as well. Reports wakeups, CPU time per sample and
+// the awake share of the run, from the simulated timeline and as
+// acquisition_duty_cycle_ppm() estimates it on the device.
+
+#define RUN_SECONDS         20
+#define MAX_POLL_NS         25000000    // SAMPLE_INTERVAL_MS in main.c
+#define WAKE_LATENCY_NS     30000       // ISR + context switch after the light-sleep exit
+#define LOW_POWER_MIN_HZ    100         // Averaged rate for the lp-avg strategy
+
+// ESP32-S3 supply current, for the average below: CPU at 80 MHz with the
+// I2C peripheral active, and light sleep with RTC memory kept. The
+// sensor's own LED and AFE current is not included.
+#define ACTIVE_MA           25.0
+#define LIGHT_SLEEP_MA      0.24
+
+typedef enum {
+    STRATEGY_POLL = 0,      // Timer wakeup every poll interval, default config
+    STRATEGY_INTERRUPT,     // A_FULL wakeup, default config
+    STRATEGY_LOW_POWER,     // A_FULL wakeup, A_FULL raised to the wake budget
+    STRATEGY_LOW_POWER_AVG, // As above, averaging down to LOW_POWER_MIN_HZ
+    STRATEGY_COUNT
+} bench_strategy_t;
+
+static const char *strategy_names[STRATEGY_COUNT] = {
+    "poll", "irq", "lp", "lp-avg"
+};
+
+static const struct {
+    uint8_t code;
+    uint32_t hz;
+} rates[] = {
+    {MAX30102_SAMPLERATE_50, 50},
+    {MAX30102_SAMPLERATE_100, 100},
+    {MAX30102_SAMPLERATE_400, 400},
+    {MAX30102_SAMPLERATE_1000, 1000},
+    {MAX30102_SAMPLERATE_3200, 3200},
+};
+
+typedef struct {
+    uint32_t fifo_rate_hz;
+    uint8_t a_full;             // FIFO level that raises A_FULL
+    uint64_t generated;
+    uint64_t delivered;
+    uint64_t lost;              // Samples the simulated FIFO dropped
+    uint32_t wakeups;
+    uint32_t empty_wakeups;
+    uint32_t int_held;          // Drains that left INT asserted below the level
+    int64_t awake_ns;
+    int64_t elapsed_ns;
+    uint32_t duty_estimate_ppm;
+} bench_result_t;
+
+static void bench_run(bench_strategy_t strategy, uint8_t rate_code, bench_result_t *result)
+{
+    static max30102_sim_t sim;
+    static max30102_dev_t dev;
+    static acquisition_t acq;
+    static max30102_sample_t samples[4 * MAX30102_FIFO_DEPTH];
+    
+    memset(result, 0, sizeof(*result));
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = rate_code;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+    acquisition_mode_t mode = ACQUISITION_MODE_INTERRUPT;
+    if (strategy == STRATEGY_POLL) {
+        mode = ACQUISITION_MODE_POLLING;
+    } else if (strategy == STRATEGY_LOW_POWER || strategy == STRATEGY_LOW_POWER_AVG) {
+        uint32_t min_rate_hz = (strategy == STRATEGY_LOW_POWER) ? 0 : LOW_POWER_MIN_HZ;
+        acquisition_low_power_config(&config, min_rate_hz, &config);
+        mode = ACQUISITION_MODE_LOW_POWER;
+    }
+    
+    if (max30102_init(&dev, &config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, mode, &config) != MAX30102_OK) {
+        fprintf(stderr, "init failed\n");
+        exit(1);
+    }
+    result->fifo_rate_hz = max30102_fifo_rate_hz(&config);
+    result->a_full = MAX30102_FIFO_DEPTH - (config.almost_full_threshold & MAX30102_A_FULL_MASK);
+    
+    int64_t poll_ns = (int64_t)acquisition_poll_interval_ms(&config) * 1000000;
+    if (poll_ns == 0 || poll_ns > MAX_POLL_NS) {
+        poll_ns = MAX_POLL_NS;
+    }
+    
+    // Measure from here, not from sensor init
+    max30102_sim_update(&sim);
+    uint64_t generated_start = sim.samples_generated;
+    uint64_t lost_start = sim.samples_lost;
+    int64_t start_ns = host_clock_now_ns();
+    int64_t awake_start_ns = max30102_sim_awake_ns(&sim);
+    acquisition_t acq_start = acq;
+    int64_t end_ns = start_ns + (int64_t)RUN_SECONDS * 1000000000;
+    int64_t next_wake_ns = start_ns + poll_ns;
+    
+    while (host_clock_now_ns() < end_ns) {
+        if (strategy == STRATEGY_POLL) {
+            max30102_sim_light_sleep(&sim, next_wake_ns, false);
+            next_wake_ns += poll_ns;
+        } else if (max30102_sim_light_sleep(&sim, end_ns, true) == MAX30102_SIM_WAKE_TIMER) {
+            break;
+        }
+        host_clock_advance_ns(WAKE_LATENCY_NS);
+        
+        size_t count = 0;
+        acquisition_drain(&acq, host_clock_now_ns() / 1000, samples, sizeof(samples) / sizeof(samples[0]),
+                          &count, NULL);
+        result->delivered += count;
+        
+        // The drain read INTR_STATUS_1, so INT must be released unless the
+        // FIFO has crossed the level again since
+        if (strategy != STRATEGY_POLL && max30102_sim_int_asserted(&sim) &&
+            sim.fifo_count < result->a_full) {
+            result->int_held++;
+        }
+    }
+    
+    max30102_sim_update(&sim);
+    result->generated = sim.samples_generated - generated_start;
+    result->lost = sim.samples_lost - lost_start;
+    result->elapsed_ns = host_clock_now_ns() - start_ns;
+    result->awake_ns = max30102_sim_awake_ns(&sim) - awake_start_ns;
+    
+    acquisition_stats_t stats;
+    acquisition_get_stats(&acq, &stats);
+    stats.wakeups -= acq_start.stats.wakeups;
+    stats.empty_wakeups -= acq_start.stats.empty_wakeups;
+    stats.active_us_total -= acq_start.stats.active_us_total;
+    result->wakeups = stats.wakeups;
+    result->empty_wakeups = stats.empty_wakeups;
+    result->duty_estimate_ppm = acquisition_duty_cycle_ppm(&stats, result->elapsed_ns / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    host_log_level = HOST_LOG_NONE;
+    
+    int failures = 0;
+    
+    printf("%6s %-7s %7s %6s %9s %7s %9s %7s %10s %8s %8s %7s\n",
+           "rate", "mode", "fifo_hz", "a_full", "samples/s", "lost%", "wakeups/s", "empty",
+           "active_us", "duty%", "est%", "avg_mA");
+    
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        bench_result_t res[STRATEGY_COUNT];
+        
+        for (int s = 0; s < STRATEGY_COUNT; s++) {
+            bench_run((bench_strategy_t)s, rates[r].code, &res[s]);
+            
+            double seconds = (double)res[s].elapsed_ns / 1e9;
+            double duty = (double)res[s].awake_ns / (double)res[s].elapsed_ns;
+            printf("%6lu %-7s %7lu %6u %9.1f %7.3f %9.2f %7lu %10.1f %8.3f %8.3f %7.3f\n",
+                   (unsigned long)rates[r].hz, strategy_names[s], (unsigned long)res[s].fifo_rate_hz,
+                   (unsigned)res[s].a_full, (double)res[s].delivered / seconds,
+                   res[s].generated ? 100.0 * (double)res[s].lost / (double)res[s].generated : 0.0,
+                   (double)res[s].wakeups / seconds, (unsigned long)res[s].empty_wakeups,
+                   res[s].delivered ? (double)res[s].awake_ns / 1000.0 / (double)res[s].delivered : 0.0,
+                   100.0 * duty, res[s].duty_estimate_ppm / 10000.0,
+                   duty * ACTIVE_MA + (1.0 - duty) * LIGHT_SLEEP_MA);
+        }
+        
+        for (int s = STRATEGY_INTERRUPT; s < STRATEGY_COUNT; s++) {
+            if (res[s].int_held > 0) {
+                fprintf(stderr, "FAIL: %lu Hz %s INT still asserted after %lu drains\n",
+                        (unsigned long)rates[r].hz, strategy_names[s], (unsigned long)res[s].int_held);
+                failures++;
+            }
+        }
+        
+        // Low power must stay lossless, wake less often than the default
+        // interrupt config and stay awake less than polling
+        for (int s = STRATEGY_LOW_POWER; s < STRATEGY_COUNT; s++) {
+            if (res[s].lost > 0) {
+                fprintf(stderr, "FAIL: %lu Hz %s lost %llu samples\n", (unsigned long)rates[r].hz,
+                        strategy_names[s], (unsigned long long)res[s].lost);
+                failures++;
+            }
+            if (res[s].wakeups >= res[STRATEGY_INTERRUPT].wakeups) {
+                fprintf(stderr, "FAIL: %lu Hz %s %lu wakeups, irq %lu\n", (unsigned long)rates[r].hz,
+                        strategy_names[s], (unsigned long)res[s].wakeups,
+                        (unsigned long)res[STRATEGY_INTERRUPT].wakeups);
+                failures++;
+            }
+            if (res[s].awake_ns >= res[STRATEGY_POLL].awake_ns) {
+                fprintf(stderr, "FAIL: %lu Hz %s awake %lld ns, poll %lld ns\n", (unsigned long)rates[r].hz,
+                        strategy_names[s], (long long)res[s].awake_ns, (long long)res[STRATEGY_POLL].awake_ns);
+                failures++;
+            }
+        }
+    }
+    
+    printf("\nactive_us: awake time per delivered sample, including the light-sleep exit\n");
+    printf("duty%%: simulated awake share, est%%: acquisition_duty_cycle_ppm()\n");
+    printf("avg_mA: %.1f mA awake, %.2f mA in light sleep, sensor excluded\n", ACTIVE_MA, LIGHT_SLEEP_MA);
+    
+    return failures ? 1 : 0;
+}
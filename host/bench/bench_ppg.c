@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ppg_codec.h"
+#include "stream_codec.h"
+#include "capture.h"
+#include "max30102_sim.h"
+
+// Lossless PPG codec benchmark: compression ratio against the raw 36 bits
+// per sample, bytes per sample next to stream_codec's delta frames, and
+// encode, sequential decode and random-access decode cost, on synthetic PPG
+// across sample rates, noise levels and block sizes. Every run is decoded
+// again and compared sample by sample, random lookups go through the block
+// index, and a corrupted block must be rejected without affecting the
+// others. 'bench_ppg capture.hrm' adds a run on a recorded capture (from
+// bench_replay or the firmware's capture task).
+
+#define RUN_SAMPLES     100000
+#define DRAIN_BLOCK     32          // Samples per push, as in output_task
+#define GAP_EVERY       5000        // Drop a run of samples this often
+#define GAP_LENGTH      7
+#define LOOKUPS         2000
+#define RAW_BITS        36          // Two 18-bit channels
+#define MIN_RATIO       2.0         // At 400 Hz, 256-sample blocks and moderate noise
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} byte_buf_t;
+
+static max30102_sample_t input[RUN_SAMPLES];
+static ppg_encoder_t encoder;
+static stream_encoder_t stream_encoder;
+static ppg_block_t block;
+static ppg_index_t index_table;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void buf_write(void *ctx, const uint8_t *data, size_t len)
+{
+    byte_buf_t *buf = ctx;
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->len + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static size_t file_read(void *ctx, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, (FILE *)ctx);
+}
+
+// Synthetic PPG with a run of samples dropped every GAP_EVERY
+static size_t generate(uint32_t rate_hz, double noise)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = 72.0, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = noise, .seed = 1,
+    };
+    uint32_t sequence = 0;
+    
+    for (size_t i = 0; i < RUN_SAMPLES; i++) {
+        if (i > 0 && i % GAP_EVERY == 0) {
+            sequence += GAP_LENGTH;
+        }
+        int64_t t = (int64_t)sequence * 1000000000 / rate_hz;
+        max30102_sim_ppg_source(&ppg, sequence, t, &input[i].red, &input[i].ir);
+        input[i].valid = true;
+        input[i].sequence = sequence;
+        sequence++;
+    }
+    return RUN_SAMPLES;
+}
+
+// Samples of a recorded capture, in order
+static size_t load_capture(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    static capture_reader_t reader;
+    static capture_event_t event;
+    size_t count = 0;
+    if (capture_reader_init(&reader, file_read, f) != MAX30102_OK) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(f);
+        return 0;
+    }
+    while (count < RUN_SAMPLES && capture_reader_next(&reader, &event) == MAX30102_OK) {
+        if (event.type != CAPTURE_RECORD_SAMPLES) {
+            continue;
+        }
+        for (size_t i = 0; i < event.block.count && count < RUN_SAMPLES; i++) {
+            input[count++] = event.block.samples[i];
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+// Index of the input sample with 'sequence', or -1
+static long find_input(size_t count, uint32_t sequence)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (input[mid].sequence < sequence) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && input[lo].sequence == sequence ? (long)lo : -1;
+}
+
+static int bench_trace(const char *name, size_t count, size_t block_size)
+{
+    // Encode in drain-sized pushes, as output_task would
+    byte_buf_t stream = {0};
+    ppg_encoder_init(&encoder, block_size, buf_write, &stream);
+    double t0 = now_ns();
+    for (size_t i = 0; i < count; i += DRAIN_BLOCK) {
+        size_t n = count - i < DRAIN_BLOCK ? count - i : DRAIN_BLOCK;
+        ppg_encoder_push(&encoder, &input[i], n);
+    }
+    ppg_encoder_finish(&encoder);
+    double enc_ns = (now_ns() - t0) / (double)count;
+    ppg_codec_stats_t stats;
+    ppg_encoder_get_stats(&encoder, &stats);
+    
+    // The same samples as stream_codec frames, for comparison
+    byte_buf_t frames = {0};
+    stream_encoder_init(&stream_encoder, STREAM_MAX_BLOCK, buf_write, &frames);
+    for (size_t i = 0; i < count; i += DRAIN_BLOCK) {
+        size_t n = count - i < DRAIN_BLOCK ? count - i : DRAIN_BLOCK;
+        stream_encoder_push(&stream_encoder, &input[i], n);
+    }
+    stream_encoder_flush(&stream_encoder);
+    
+    // Sequential decode, checked against the input
+    size_t header_block = 0;
+    int decode_ok = ppg_decode_header(stream.data, stream.len, &header_block) == MAX30102_OK &&
+                    header_block == block_size;
+    size_t next = 0;
+    size_t offset = PPG_CODEC_HEADER;
+    t0 = now_ns();
+    while (decode_ok && next < count) {
+        size_t size;
+        if (ppg_decode_block(stream.data + offset, stream.len - offset, &block, &size) != MAX30102_OK) {
+            decode_ok = 0;
+            break;
+        }
+        for (size_t i = 0; i < block.count; i++) {
+            const max30102_sample_t *s = &input[next++];
+            decode_ok &= s->sequence == block.first_sequence + i && s->red == block.red[i] && s->ir == block.ir[i];
+        }
+        offset += size;
+    }
+    double dec_ns = (now_ns() - t0) / (double)count;
+    decode_ok &= next == count;
+    
+    // Random access through the index, including sequences in the gaps
+    int index_ok = ppg_read_index(stream.data, stream.len, &index_table) == MAX30102_OK;
+    uint32_t last_sequence = input[count - 1].sequence;
+    uint32_t rng = 7;
+    t0 = now_ns();
+    for (int i = 0; index_ok && i < LOOKUPS; i++) {
+        rng = rng * 1103515245u + 12345u;
+        uint32_t sequence = input[0].sequence + (rng >> 4) % (last_sequence - input[0].sequence + 1);
+        long expected = find_input(count, sequence);
+        size_t at;
+        max30102_err_t err = ppg_find_block(stream.data, stream.len, &index_table, sequence, &at);
+        if (expected < 0) {
+            index_ok = err == MAX30102_ERR_NO_DATA;
+            continue;
+        }
+        if (err != MAX30102_OK || ppg_decode_block(stream.data + at, stream.len - at, &block, NULL) != MAX30102_OK) {
+            index_ok = 0;
+            break;
+        }
+        size_t k = sequence - block.first_sequence;
+        index_ok = input[expected].red == block.red[k] && input[expected].ir == block.ir[k];
+    }
+    double lookup_ns = (now_ns() - t0) / LOOKUPS;
+    
+    // A flipped byte in the second block fails its CRC; its neighbours decode
+    uint32_t first;
+    size_t n;
+    size_t first_size;
+    size_t second_size;
+    int corrupt_ok = 0;
+    if (ppg_block_peek(stream.data + PPG_CODEC_HEADER, stream.len - PPG_CODEC_HEADER, &first, &n,
+                       &first_size) == MAX30102_OK) {
+        size_t second = PPG_CODEC_HEADER + first_size;
+        if (ppg_block_peek(stream.data + second, stream.len - second, &first, &n, &second_size) == MAX30102_OK) {
+            stream.data[second + second_size / 2] ^= 0x10;
+            corrupt_ok = ppg_decode_block(stream.data + second, stream.len - second, &block, NULL) ==
+                         MAX30102_ERR_INVALID_PARAM &&
+                         ppg_decode_block(stream.data + PPG_CODEC_HEADER, stream.len - PPG_CODEC_HEADER, &block,
+                                          NULL) == MAX30102_OK &&
+                         ppg_decode_block(stream.data + second + second_size, stream.len - second - second_size,
+                                          &block, NULL) == MAX30102_OK;
+        }
+    }
+    
+    double ppg_bps = (double)stream.len / (double)count;
+    double frame_bps = (double)frames.len / (double)count;
+    double ratio = (double)count * RAW_BITS / 8.0 / (double)stream.len;
+    int ok = decode_ok && index_ok && corrupt_ok;
+    printf("%-16s %5lu %7.3f %7.2f %7.3f %7.2fx %6.1f %6.1f %7.0f %6lu %6lu %5lu/%lu/%lu %6s\n",
+           name, (unsigned long)block_size, ppg_bps, ppg_bps * 8.0, frame_bps, ratio, enc_ns, dec_ns, lookup_ns,
+           (unsigned long)stats.escapes, (unsigned long)index_table.stride,
+           (unsigned long)stats.predictor[PPG_PREDICT_DELTA], (unsigned long)stats.predictor[PPG_PREDICT_LINEAR],
+           (unsigned long)stats.predictor[PPG_PREDICT_QUADRATIC], ok ? "ok" : "FAIL");
+    if (!ok) {
+        printf("  decode %s, index %s, corruption %s\n", decode_ok ? "ok" : "FAIL", index_ok ? "ok" : "FAIL",
+               corrupt_ok ? "ok" : "FAIL");
+    }
+    
+    free(stream.data);
+    free(frames.data);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        uint32_t rate_hz;
+        double noise;
+        size_t block_size;
+    } runs[] = {
+        {100, 20.0, 256}, {400, 20.0, 256}, {1000, 20.0, 256}, {3200, 20.0, 256},
+        {400, 0.0, 256}, {400, 200.0, 256},
+        {400, 20.0, 64}, {400, 20.0, 128},
+    };
+    int failures = 0;
+    char name[32];
+    
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [capture.hrm]\n", argv[0]);
+        return 2;
+    }
+    
+    printf("%lu samples per run, %lu-sample pushes, encoder state %lu bytes\n", (unsigned long)RUN_SAMPLES,
+           (unsigned long)DRAIN_BLOCK, (unsigned long)sizeof(ppg_encoder_t));
+    printf("%-16s %5s %7s %7s %7s %8s %6s %6s %7s %6s %6s %11s %6s\n", "trace", "block", "ppg_B", "bits",
+           "frame_B", "ratio", "enc_ns", "dec_ns", "seek_ns", "escape", "stride", "pred d/l/q", "check");
+    
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        size_t count = generate(runs[i].rate_hz, runs[i].noise);
+        snprintf(name, sizeof(name), "%luHz noise %.0f", (unsigned long)runs[i].rate_hz, runs[i].noise);
+        failures += bench_trace(name, count, runs[i].block_size);
+    }
+    
+    // Compression at the reference point
+    generate(400, 20.0);
+    byte_buf_t stream = {0};
+    ppg_encoder_init(&encoder, PPG_CODEC_MAX_BLOCK, buf_write, &stream);
+    ppg_encoder_push(&encoder, input, RUN_SAMPLES);
+    ppg_encoder_finish(&encoder);
+    double ratio = (double)RUN_SAMPLES * RAW_BITS / 8.0 / (double)stream.len;
+    free(stream.data);
+    printf("Ratio at 400 Hz, noise 20: %.2fx (minimum %.1fx) %s\n", ratio, MIN_RATIO,
+           ratio >= MIN_RATIO ? "ok" : "FAIL");
+    failures += ratio >= MIN_RATIO ? 0 : 1;
+    
+    if (argc == 2) {
+        size_t count = load_capture(argv[1]);
+        if (count == 0) {
+            return 1;
+        }
+        failures += bench_trace("capture", count, PPG_CODEC_MAX_BLOCK);
+    }
+    
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "max30102.h"
+#include "pipeline.h"
+#include "signal_quality.h"
+#include "capture.h"
+#include "max30102_sim.h"
+
+// Signal-quality gating on mixed-quality traces. A synthetic recording
+// alternates a clean pulse with no finger, motion, a weak pulse buried in
+// noise and a saturated ADC. It is replayed through the pipeline in
+// FIFO-sized drains, the way hrm_replay feeds a capture, once with
+// quality_gate off and once on. Reports the samples the gate skipped in
+// the clean and the poor stretches, beats reported in each, the BPM error
+// on the clean stretches, and dsp CPU per sample with the CPU saved.
+// Checks that the gate skips most of the poor stretches and little of the
+// clean ones, that it removes most beats reported on poor signal, and that
+// it keeps the beats on clean signal.
+//
+//   bench_quality               synthetic traces
+//   bench_quality capture.hrm   adds a replay of a recorded capture
+
+#define RUN_SECONDS         150
+#define MAX_RATE_HZ         400
+#define MAX_SAMPLES         (RUN_SECONDS * MAX_RATE_HZ)
+#define DRAIN_BLOCK         MAX30102_FIFO_DEPTH
+#define TIMING_REPEATS      5
+#define TRUE_BPM            72.0
+
+#define MIN_SKIPPED_POOR    0.80    // Share of poor-signal samples the gate must skip
+#define MAX_SKIPPED_CLEAN   0.15    // Share of clean samples it may skip
+#define MAX_BEATS_POOR      0.25    // Gated beats on poor signal, against ungated
+#define MIN_BEATS_CLEAN     0.90    // Gated beats on clean signal, against ungated
+
+typedef enum {
+    SEGMENT_CLEAN = 0,
+    SEGMENT_NO_FINGER,      // Ambient light only
+    SEGMENT_MOTION,         // Large artifacts on both channels
+    SEGMENT_WEAK,           // Pulse below the noise
+    SEGMENT_SATURATED,      // ADC at its ceiling
+    SEGMENT_COUNT
+} segment_t;
+
+static const char *segment_names[SEGMENT_COUNT] = {
+    "clean", "no-finger", "motion", "weak", "saturated"
+};
+
+// Trace layout: segment and its length
+static const struct {
+    segment_t type;
+    uint32_t seconds;
+} layout[] = {
+    {SEGMENT_CLEAN, 30}, {SEGMENT_NO_FINGER, 15}, {SEGMENT_CLEAN, 20}, {SEGMENT_MOTION, 15},
+    {SEGMENT_CLEAN, 20}, {SEGMENT_WEAK, 15}, {SEGMENT_CLEAN, 15}, {SEGMENT_SATURATED, 10},
+    {SEGMENT_CLEAN, 10},
+};
+
+typedef struct {
+    uint64_t skipped[SEGMENT_COUNT];
+    uint64_t samples[SEGMENT_COUNT];
+    uint32_t beats[2];          // Clean, poor
+    double bpm_error_sum;       // Locked beats on clean signal
+    uint32_t bpm_count;
+    double dsp_ns;              // Best of TIMING_REPEATS
+    signal_quality_stats_t quality;
+} run_result_t;
+
+static max30102_sample_t trace[MAX_SAMPLES];
+static uint8_t trace_segment[MAX_SAMPLES];
+static pipeline_t pipeline;
+static size_t trace_count;
+static bool labelled;           // trace_segment[] applies: the synthetic trace
+static run_result_t *current;   // Receives beats from sink_write()
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int64_t clock_us(void)
+{
+    return (int64_t)(now_ns() / 1000.0);
+}
+
+static uint32_t clamp_18bit(double v)
+{
+    return v < 0.0 ? 0 : v > 262143.0 ? 262143 : (uint32_t)v;
+}
+
+static size_t generate(uint32_t rate_hz)
+{
+    max30102_sim_ppg_t clean = {
+        .bpm = TRUE_BPM, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = 20.0, .seed = 11,
+    };
+    max30102_sim_ppg_t ambient = {
+        .bpm = TRUE_BPM, .red_dc = 2500.0, .red_ac = 0.0, .ir_dc = 3000.0, .ir_ac = 0.0,
+        .noise = 20.0, .seed = 12,
+    };
+    max30102_sim_ppg_t weak = clean;
+    weak.red_ac = 10.0;
+    weak.ir_ac = 20.0;
+    weak.noise = 40.0;
+    max30102_sim_ppg_t saturated = clean;
+    saturated.red_dc = 262143.0;
+    saturated.ir_dc = 262143.0;
+    
+    size_t count = 0;
+    for (size_t s = 0; s < sizeof(layout) / sizeof(layout[0]); s++) {
+        size_t n = (size_t)layout[s].seconds * rate_hz;
+        for (size_t i = 0; i < n && count < MAX_SAMPLES; i++, count++) {
+            int64_t t = (int64_t)count * 1000000000 / rate_hz;
+            double seconds = (double)t / 1e9;
+            max30102_sample_t *out = &trace[count];
+            
+            switch (layout[s].type) {
+            case SEGMENT_NO_FINGER:
+                max30102_sim_ppg_source(&ambient, count, t, &out->red, &out->ir);
+                break;
+            case SEGMENT_MOTION: {
+                // Finger sliding and pressing: slow swings far larger than the pulse
+                max30102_sim_ppg_source(&clean, count, t, &out->red, &out->ir);
+                double swing = sin(2.0 * M_PI * 0.7 * seconds) + 0.6 * sin(2.0 * M_PI * 1.9 * seconds + 1.0) +
+                               0.4 * sin(2.0 * M_PI * 3.1 * seconds + 2.0);
+                out->red = clamp_18bit(out->red + 18000.0 * swing);
+                out->ir = clamp_18bit(out->ir + 25000.0 * swing);
+                break;
+            }
+            case SEGMENT_WEAK:
+                max30102_sim_ppg_source(&weak, count, t, &out->red, &out->ir);
+                break;
+            case SEGMENT_SATURATED:
+                max30102_sim_ppg_source(&saturated, count, t, &out->red, &out->ir);
+                break;
+            default:
+                max30102_sim_ppg_source(&clean, count, t, &out->red, &out->ir);
+                break;
+            }
+            out->sequence = (uint32_t)count;
+            out->valid = true;
+            trace_segment[count] = (uint8_t)layout[s].type;
+        }
+    }
+    return count;
+}
+
+// Text output, one line per write: counts beats by the stretch they fall in
+static void sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    char line[PIPELINE_TEXT_LINE];
+    if (len >= sizeof(line) || !current) {
+        return;
+    }
+    memcpy(line, data, len);
+    line[len] = '\0';
+    
+    unsigned long sequence;
+    unsigned int ms, bpm, bpm_frac;
+    if (sscanf(line, "[%lu] Beat: interval %u ms, %u.%u BPM", &sequence, &ms, &bpm, &bpm_frac) != 4) {
+        return;
+    }
+    int poor = labelled && sequence < trace_count && trace_segment[sequence] != SEGMENT_CLEAN;
+    current->beats[poor]++;
+    if (!poor && bpm > 0) {
+        current->bpm_error_sum += fabs(bpm + bpm_frac / 10.0 - TRUE_BPM);
+        current->bpm_count++;
+    }
+}
+
+static void run(const max30102_sample_t *samples, size_t count, uint32_t rate_hz, bool gate, run_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->dsp_ns = 1e30;
+    
+    for (int r = 0; r < TIMING_REPEATS; r++) {
+        pipeline_config_t pc = {
+            .output = PIPELINE_OUTPUT_TEXT,
+            .sample_rate_hz = rate_hz,
+            .write = sink_write,
+            .clock_us = clock_us,
+            .adc_range = MAX30102_ADCRANGE_4096,
+            .quality_gate = gate,
+        };
+        pipeline_init(&pipeline, &pc);
+        
+        // Count on the first pass only
+        current = (r == 0) ? result : NULL;
+        double dsp_ns = 0.0;
+        for (size_t done = 0; done < count;) {
+            size_t n = count - done < DRAIN_BLOCK ? count - done : DRAIN_BLOCK;
+            pipeline_acquire(&pipeline, samples + done, n);
+            
+            // Attribute skips to the stretch the drained samples came from
+            uint32_t skipped = pipeline.analysis_skipped;
+            double t0 = now_ns();
+            while (pipeline_dsp_step(&pipeline) > 0) {
+            }
+            dsp_ns += now_ns() - t0;
+            while (pipeline_output_step(&pipeline) > 0) {
+            }
+            
+            if (r == 0) {
+                segment_t segment = labelled ? (segment_t)trace_segment[done] : SEGMENT_CLEAN;
+                result->skipped[segment] += pipeline.analysis_skipped - skipped;
+                result->samples[segment] += n;
+            }
+            done += n;
+        }
+        
+        if (r == 0) {
+            signal_quality_get_stats(&pipeline.quality, &result->quality);
+        }
+        if (dsp_ns < result->dsp_ns) {
+            result->dsp_ns = dsp_ns;
+        }
+    }
+    current = NULL;
+}
+
+static double share(uint64_t part, uint64_t whole)
+{
+    return whole ? (double)part / (double)whole : 0.0;
+}
+
+// Skipped share of the poor stretches, all kinds together
+static double poor_skipped(const run_result_t *res)
+{
+    uint64_t skipped = 0;
+    uint64_t samples = 0;
+    for (int s = SEGMENT_CLEAN + 1; s < SEGMENT_COUNT; s++) {
+        skipped += res->skipped[s];
+        samples += res->samples[s];
+    }
+    return share(skipped, samples);
+}
+
+static void print_run(const char *name, uint32_t rate_hz, const char *mode, const run_result_t *res, size_t count)
+{
+    printf("%-9s %5lu %-4s %7.1f %7.1f %6lu %6lu %7.2f %8.1f",
+           name, (unsigned long)rate_hz, mode, 100.0 * share(res->skipped[SEGMENT_CLEAN], res->samples[SEGMENT_CLEAN]),
+           100.0 * poor_skipped(res), (unsigned long)res->beats[0],
+           (unsigned long)res->beats[1], res->bpm_count ? res->bpm_error_sum / res->bpm_count : 0.0,
+           res->dsp_ns / (double)count);
+}
+
+static size_t file_read(void *ctx, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, (FILE *)ctx);
+}
+
+// Samples of a recorded capture, in order, and its FIFO rate
+static size_t load_capture(const char *path, uint32_t *rate_hz)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    static capture_reader_t reader;
+    static capture_event_t event;
+    size_t count = 0;
+    *rate_hz = 0;
+    if (capture_reader_init(&reader, file_read, f) != MAX30102_OK) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(f);
+        return 0;
+    }
+    while (count < MAX_SAMPLES && capture_reader_next(&reader, &event) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG && *rate_hz == 0) {
+            *rate_hz = event.config.fifo_rate_hz;
+        }
+        if (event.type != CAPTURE_RECORD_SAMPLES) {
+            continue;
+        }
+        for (size_t i = 0; i < event.block.count && count < MAX_SAMPLES; i++) {
+            trace[count++] = event.block.samples[i];
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t rates_hz[] = {100, 400};
+    int failures = 0;
+    
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [capture.hrm]\n", argv[0]);
+        return 2;
+    }
+    
+    printf("%-9s %5s %-4s %7s %7s %6s %6s %7s %8s %7s\n", "trace", "rate", "gate", "skip_c%", "skip_p%",
+           "beat_c", "beat_p", "bpm_err", "dsp_ns", "saved%");
+    
+    for (size_t i = 0; i < sizeof(rates_hz) / sizeof(rates_hz[0]); i++) {
+        trace_count = generate(rates_hz[i]);
+        labelled = true;
+        run_result_t off, on;
+        run(trace, trace_count, rates_hz[i], false, &off);
+        run(trace, trace_count, rates_hz[i], true, &on);
+        
+        print_run("mixed", rates_hz[i], "off", &off, trace_count);
+        printf("\n");
+        print_run("mixed", rates_hz[i], "on", &on, trace_count);
+        printf(" %7.1f\n", 100.0 * (1.0 - on.dsp_ns / off.dsp_ns));
+        
+        printf("  skipped by stretch:");
+        for (int s = 0; s < SEGMENT_COUNT; s++) {
+            printf(" %s %.1f%%", segment_names[s], 100.0 * share(on.skipped[s], on.samples[s]));
+        }
+        printf("\n  poor windows by flag:");
+        for (int f = 0; f < SQ_FLAG_COUNT; f++) {
+            static const char *flag_names[SQ_FLAG_COUNT] = {
+                "no-contact", "saturated", "low-perfusion", "motion", "uncorrelated"
+            };
+            printf(" %s %lu", flag_names[f], (unsigned long)on.quality.flag_windows[f]);
+        }
+        printf(", gate closed %lu times\n", (unsigned long)on.quality.gate_closes);
+        
+        if (poor_skipped(&on) < MIN_SKIPPED_POOR) {
+            fprintf(stderr, "FAIL: %lu Hz gate skipped only %.1f%% of poor signal\n",
+                    (unsigned long)rates_hz[i], 100.0 * poor_skipped(&on));
+            failures++;
+        }
+        if (share(on.skipped[SEGMENT_CLEAN], on.samples[SEGMENT_CLEAN]) > MAX_SKIPPED_CLEAN) {
+            fprintf(stderr, "FAIL: %lu Hz gate skipped %.1f%% of clean signal\n", (unsigned long)rates_hz[i],
+                    100.0 * share(on.skipped[SEGMENT_CLEAN], on.samples[SEGMENT_CLEAN]));
+            failures++;
+        }
+        if (on.beats[1] > off.beats[1] * MAX_BEATS_POOR) {
+            fprintf(stderr, "FAIL: %lu Hz %lu beats on poor signal with the gate, %lu without\n",
+                    (unsigned long)rates_hz[i], (unsigned long)on.beats[1], (unsigned long)off.beats[1]);
+            failures++;
+        }
+        if (on.beats[0] < off.beats[0] * MIN_BEATS_CLEAN) {
+            fprintf(stderr, "FAIL: %lu Hz %lu beats on clean signal with the gate, %lu without\n",
+                    (unsigned long)rates_hz[i], (unsigned long)on.beats[0], (unsigned long)off.beats[0]);
+            failures++;
+        }
+    }
+    
+    // Cost of the index itself, per sample
+    static signal_quality_t quality;
+    trace_count = generate(400);
+    double best = 1e30;
+    for (int r = 0; r < TIMING_REPEATS; r++) {
+        signal_quality_init(&quality, 400, MAX30102_ADCRANGE_4096);
+        double t0 = now_ns();
+        for (size_t i = 0; i < trace_count; i++) {
+            signal_quality_process(&quality, &trace[i]);
+        }
+        double elapsed = now_ns() - t0;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("signal_quality_process: %.1f ns per sample, state %lu bytes\n", best / (double)trace_count,
+           (unsigned long)sizeof(signal_quality_t));
+    
+    if (argc == 2) {
+        uint32_t rate_hz;
+        size_t count = load_capture(argv[1], &rate_hz);
+        if (count == 0 || rate_hz == 0) {
+            return 1;
+        }
+        labelled = false;
+        run_result_t off, on;
+        run(trace, count, rate_hz, false, &off);
+        run(trace, count, rate_hz, true, &on);
+        print_run("capture", rate_hz, "off", &off, count);
+        printf("\n");
+        print_run("capture", rate_hz, "on", &on, count);
+        printf(" %7.1f\n", 100.0 * (1.0 - on.dsp_ns / off.dsp_ns));
+    }
+    
+    return failures ? 1 : 0;
+}
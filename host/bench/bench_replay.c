@@ -0,0 +1,377 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+#include "pipeline.h"
+#include "acquisition.h"
+#include "max30102_sim.h"
+#include "capture_source.h"
+#include "host_port.h"
+
+// Record and replay of raw sample captures. Records RECORD_SECONDS of the
+// simulated sensor at 100 Hz, polled like sensor_task, with a stall every
+// STALL_EVERY_S long enough to overflow the FIFO. Every drain goes into the
+// pipeline and into a capture file. Then checks that:
+//
+//   - the capture reads back exactly: samples, sequence numbers,
+//     timestamps, gaps and config
+//   - replaying it straight into a fresh pipeline gives byte-identical
+//     output to the live run
+//   - replaying it through the simulated sensor and acquisition delivers
+//     the recorded values at the recorded sequence numbers
+//   - a paced replay takes as long as the recording
+//
+// Reports capture size per sample, and replay and decode speed as samples
+// per second and multiples of real time. With a path argument the capture
+// is kept there, as input for hrm_replay.
+
+#define RECORD_SECONDS      120
+#define STALL_EVERY_S       20
+#define STALL_MS            600         // Longer than the 32-sample FIFO at 100 Hz
+#define PACED_SECONDS       1
+#define REPEATS             3
+#define MAX_SAMPLES         (RECORD_SECONDS * 100 + 1024)
+#define MAX_GAPS            64
+#define SINK_SIZE           (1u << 20)
+
+typedef struct {
+    uint8_t data[SINK_SIZE];
+    size_t len;
+    bool overflow;
+} sink_t;
+
+static max30102_sim_t sim;
+static max30102_dev_t dev;
+static acquisition_t acq;
+static pipeline_t pipeline;
+static capture_writer_t writer;
+static capture_reader_t reader;
+static capture_event_t event;
+static capture_source_t source;
+static sink_t live_out;
+static sink_t replay_out;
+
+// Ground truth from the live run
+static max30102_sample_t recorded[MAX_SAMPLES];
+static size_t recorded_count;
+static max30102_gap_t gaps[MAX_GAPS];
+static size_t gap_count;
+static max30102_config_t config;
+
+static int64_t wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t clock_us(void)
+{
+    return host_clock_now_ns() / 1000;
+}
+
+static void sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *sink = ctx;
+    if (sink->len + len > sizeof(sink->data)) {
+        sink->overflow = true;
+        return;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+}
+
+static void file_write(void *ctx, const uint8_t *data, size_t len)
+{
+    fwrite(data, 1, len, (FILE *)ctx);
+}
+
+static size_t file_read(void *ctx, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, (FILE *)ctx);
+}
+
+static void pipeline_start(sink_t *sink, uint32_t fifo_rate_hz)
+{
+    pipeline_config_t pc = {
+        .output = PIPELINE_OUTPUT_BINARY,
+        .sample_rate_hz = fifo_rate_hz,
+        .write = sink_write,
+        .write_ctx = sink,
+        .clock_us = clock_us,
+    };
+    sink->len = 0;
+    sink->overflow = false;
+    pipeline_init(&pipeline, &pc);
+}
+
+static void pipeline_feed(const max30102_sample_t *samples, size_t count)
+{
+    size_t done = 0;
+    while (done < count) {
+        done += pipeline_acquire(&pipeline, samples + done, count - done);
+        while (pipeline_dsp_step(&pipeline) > 0 || pipeline_output_step(&pipeline) > 0) {
+        }
+    }
+}
+
+// Live run: simulated sensor into the pipeline and the capture
+static bool record(FILE *file)
+{
+    config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = MAX30102_SAMPLERATE_100;
+    
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    if (max30102_init_fast(&dev, &config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, ACQUISITION_MODE_POLLING, &config) != MAX30102_OK) {
+        return false;
+    }
+    uint32_t rate_hz = max30102_fifo_rate_hz(&config);
+    pipeline_start(&live_out, rate_hz);
+    capture_writer_init(&writer, file_write, file);
+    capture_write_config(&writer, &config, rate_hz);
+    
+    int64_t poll_ns = (int64_t)acquisition_poll_interval_ms(&config) * 1000000;
+    int64_t end_ns = (int64_t)RECORD_SECONDS * 1000000000;
+    int64_t next_stall_ns = (int64_t)STALL_EVERY_S * 1000000000;
+    max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+    while (host_clock_now_ns() < end_ns) {
+        host_clock_advance_ns(poll_ns);
+        if (host_clock_now_ns() >= next_stall_ns) {
+            host_clock_advance_ns((int64_t)STALL_MS * 1000000);
+            next_stall_ns += (int64_t)STALL_EVERY_S * 1000000000;
+        }
+        
+        size_t count = 0;
+        max30102_gap_t gap;
+        acquisition_drain(&acq, 0, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+        int64_t drained_us = clock_us();
+        if (gap.count > 0 && gap_count < MAX_GAPS) {
+            gaps[gap_count++] = gap;
+            capture_write_gap(&writer, &gap);
+        }
+        if (count > 0 && recorded_count + count <= MAX_SAMPLES) {
+            memcpy(&recorded[recorded_count], samples, count * sizeof(samples[0]));
+            recorded_count += count;
+            capture_write_samples(&writer, samples, count, drained_us);
+        }
+        pipeline_feed(samples, count);
+    }
+    capture_writer_flush(&writer);
+    pipeline_output_flush(&pipeline);
+    fflush(file);
+    return !live_out.overflow;
+}
+
+// Decoded records match what was written
+static bool check_readback(FILE *file)
+{
+    rewind(file);
+    if (capture_reader_init(&reader, file_read, file) != MAX30102_OK) {
+        return false;
+    }
+    
+    size_t samples = 0;
+    size_t gaps_seen = 0;
+    size_t mismatches = 0;
+    bool config_ok = false;
+    max30102_err_t err;
+    while ((err = capture_reader_next(&reader, &event)) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG) {
+            config_ok = memcmp(&event.config.config, &config, sizeof(config)) == 0 &&
+                        event.config.fifo_rate_hz == max30102_fifo_rate_hz(&config);
+        } else if (event.type == CAPTURE_RECORD_GAP) {
+            const max30102_gap_t *g = &gaps[gaps_seen < MAX_GAPS ? gaps_seen : 0];
+            mismatches += event.gap.sequence != g->sequence || event.gap.count != g->count ||
+                          event.gap.saturated != g->saturated;
+            gaps_seen++;
+        } else {
+            for (size_t i = 0; i < event.block.count && samples < recorded_count; i++, samples++) {
+                const max30102_sample_t *a = &event.block.samples[i];
+                const max30102_sample_t *b = &recorded[samples];
+                mismatches += a->red != b->red || a->ir != b->ir || a->sequence != b->sequence ||
+                              a->timestamp_us != b->timestamp_us;
+            }
+        }
+    }
+    
+    capture_stats_t stats;
+    capture_reader_get_stats(&reader, &stats);
+    bool ok = err == MAX30102_ERR_NO_DATA && config_ok && samples == recorded_count && gaps_seen == gap_count &&
+              mismatches == 0 && !stats.truncated && stats.crc_errors == 0 && gap_count > 0;
+    printf("Read back: %lu samples, %lu gaps, %lu mismatches %s\n", (unsigned long)samples,
+           (unsigned long)gaps_seen, (unsigned long)mismatches, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Straight into a fresh pipeline at the recorded drain times, paced to
+// wall time for 'paced_s' seconds if nonzero. Returns samples replayed.
+static size_t replay_direct(FILE *file, int paced_s)
+{
+    rewind(file);
+    capture_reader_init(&reader, file_read, file);
+    host_clock_reset();
+    
+    size_t samples = 0;
+    int64_t first_us = -1;
+    int64_t wall_start = wall_ns();
+    while (capture_reader_next(&reader, &event) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG) {
+            pipeline_start(&replay_out, event.config.fifo_rate_hz);
+        } else if (event.type == CAPTURE_RECORD_SAMPLES) {
+            if (first_us < 0) {
+                first_us = event.block.time_us;
+            }
+            if (paced_s) {
+                int64_t offset_ns = (event.block.time_us - first_us) * 1000;
+                if (offset_ns > (int64_t)paced_s * 1000000000) {
+                    break;
+                }
+                int64_t due = wall_start + offset_ns;
+                struct timespec ts = {.tv_sec = due / 1000000000, .tv_nsec = due % 1000000000};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+            host_clock_advance_to_ns(event.block.time_us * 1000);
+            pipeline_feed(event.block.samples, event.block.count);
+            samples += event.block.count;
+        }
+    }
+    pipeline_output_flush(&pipeline);
+    return samples;
+}
+
+// Reader alone; returns samples decoded
+static size_t decode_only(FILE *file)
+{
+    rewind(file);
+    capture_reader_init(&reader, file_read, file);
+    size_t samples = 0;
+    while (capture_reader_next(&reader, &event) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_SAMPLES) {
+            samples += event.block.count;
+        }
+    }
+    return samples;
+}
+
+// Capture drives the simulated sensor; every recorded sequence number comes
+// back with its recorded values
+static bool check_acquisition_replay(FILE *file)
+{
+    rewind(file);
+    capture_reader_init(&reader, file_read, file);
+    if (capture_source_load(&source, &reader) != MAX30102_OK || !source.has_config ||
+        source.recorded != recorded_count) {
+        printf("Acquisition replay: capture did not load FAIL\n");
+        return false;
+    }
+    
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_sim_set_source(&sim, capture_source_sample, &source);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    if (max30102_init_fast(&dev, &source.config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, ACQUISITION_MODE_POLLING, &source.config) != MAX30102_OK) {
+        return false;
+    }
+    
+    int64_t poll_ns = (int64_t)acquisition_poll_interval_ms(&source.config) * 1000000;
+    max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+    size_t next = 0;            // Index into recorded[]
+    size_t delivered = 0;
+    size_t mismatches = 0;
+    uint32_t lost = 0;
+    while (sim.samples_generated < source.count) {
+        host_clock_advance_ns(poll_ns);
+        size_t count = 0;
+        max30102_gap_t gap;
+        acquisition_drain(&acq, 0, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+        lost += gap.count;
+        for (size_t i = 0; i < count; i++) {
+            while (next < recorded_count && recorded[next].sequence < samples[i].sequence) {
+                next++;
+            }
+            if (next < recorded_count && recorded[next].sequence == samples[i].sequence) {
+                mismatches += recorded[next].red != samples[i].red || recorded[next].ir != samples[i].ir;
+                next++;
+            }
+        }
+        delivered += count;
+    }
+    
+    bool ok = mismatches == 0 && lost == 0 && delivered >= source.count;
+    printf("Acquisition replay: %lu samples (%lu recorded, %lu filled in), %lu mismatches, %lu lost %s\n",
+           (unsigned long)delivered, (unsigned long)source.recorded,
+           (unsigned long)(source.count - source.recorded), (unsigned long)mismatches, (unsigned long)lost,
+           ok ? "ok" : "FAIL");
+    capture_source_free(&source);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    host_log_level = HOST_LOG_ERROR;
+    
+    FILE *file = (argc > 1) ? fopen(argv[1], "w+b") : tmpfile();
+    if (!file || !record(file)) {
+        fprintf(stderr, "recording failed\n");
+        return 1;
+    }
+    capture_stats_t wstats;
+    capture_writer_get_stats(&writer, &wstats);
+    double per_sample = (double)wstats.bytes / (double)recorded_count;
+    printf("Recorded %d s at 100 Hz: %lu samples, %lu gaps (%lu samples lost), %lu records\n", RECORD_SECONDS,
+           (unsigned long)recorded_count, (unsigned long)gap_count, (unsigned long)wstats.samples_lost,
+           (unsigned long)wstats.records);
+    printf("Capture %lu bytes, %.2f bytes/sample (FIFO data and timestamp %u, max30102_sample_t %u)\n\n",
+           (unsigned long)wstats.bytes, per_sample, 2 * MAX30102_BYTES_PER_LED + 8,
+           (unsigned)sizeof(max30102_sample_t));
+    
+    failures += check_readback(file) ? 0 : 1;
+    
+    // Fast replay, best of REPEATS, then the output must match the live run
+    double replay_s = 0;
+    double decode_s = 0;
+    size_t replayed = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        int64_t start = wall_ns();
+        replayed = replay_direct(file, 0);
+        double s = (double)(wall_ns() - start) / 1e9;
+        replay_s = (r == 0 || s < replay_s) ? s : replay_s;
+        
+        start = wall_ns();
+        decode_only(file);
+        s = (double)(wall_ns() - start) / 1e9;
+        decode_s = (r == 0 || s < decode_s) ? s : decode_s;
+    }
+    bool same = replayed == recorded_count && replay_out.len == live_out.len && !replay_out.overflow &&
+                memcmp(replay_out.data, live_out.data, live_out.len) == 0;
+    printf("Pipeline replay: %lu output bytes, identical to the live run: %s\n", (unsigned long)replay_out.len,
+           same ? "ok" : "FAIL");
+    failures += same ? 0 : 1;
+    
+    failures += check_acquisition_replay(file) ? 0 : 1;
+    
+    int64_t start = wall_ns();
+    size_t paced = replay_direct(file, PACED_SECONDS);
+    double paced_s = (double)(wall_ns() - start) / 1e9;
+    bool paced_ok = paced > 0 && paced_s >= PACED_SECONDS * 0.95 && paced_s <= PACED_SECONDS * 1.5;
+    printf("Paced replay of %d s: %lu samples in %.3f s %s\n", PACED_SECONDS, (unsigned long)paced, paced_s,
+           paced_ok ? "ok" : "FAIL");
+    failures += paced_ok ? 0 : 1;
+    
+    printf("\nFast replay, best of %d\n", REPEATS);
+    printf("%-20s %12s %14s %12s\n", "path", "ms", "samples/s", "x realtime");
+    printf("%-20s %12.2f %14.0f %12.0f\n", "decode only", decode_s * 1e3, recorded_count / decode_s,
+           RECORD_SECONDS / decode_s);
+    printf("%-20s %12.2f %14.0f %12.0f\n", "decode + pipeline", replay_s * 1e3, recorded_count / replay_s,
+           RECORD_SECONDS / replay_s);
+    
+    fclose(file);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample_ring.h"
+
+// Multithreaded stress test and throughput benchmark for the SPSC sample
+// ring. A producer thread pushes sequence-numbered blocks the way
+// sensor_task does; a consumer thread drains in blocks and checks that every
+// sequence jump is exactly accounted for by the ring's drop counter. A
+// mutex-protected ring of the same shape is run alongside as a baseline.
+//
+// Throughput runs retry a full ring so every sample gets through; stress
+// runs drop like the firmware does while the consumer is slowed down.
+
+#define TOTAL_SAMPLES       20000000u
+#define MAX_PUSH_BLOCK      32
+#define POP_BLOCK           64
+
+typedef enum {
+    RING_LOCK_FREE = 0,
+    RING_MUTEX
+} ring_kind_t;
+
+// Baseline: same ring protected by a mutex
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t drops;
+    max30102_sample_t slots[SAMPLE_RING_CAPACITY];
+} mutex_ring_t;
+
+typedef struct {
+    ring_kind_t kind;
+    bool retry;                     // Producer retries instead of dropping
+    uint32_t consumer_delay_us;     // Sleep after every pop to model a slow consumer
+    volatile int producer_done;
+    uint64_t consumed;
+    uint64_t gap_samples;           // Sum of sequence jumps seen by the consumer
+    uint64_t order_errors;
+    double producer_seconds;
+} bench_ctx_t;
+
+static sample_ring_t ring;
+static mutex_ring_t mutex_ring;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t mutex_ring_push(mutex_ring_t *r, const max30102_sample_t *samples, size_t count)
+{
+    pthread_mutex_lock(&r->lock);
+    size_t free_slots = SAMPLE_RING_CAPACITY - (r->head - r->tail);
+    size_t n = count < free_slots ? count : free_slots;
+    for (size_t i = 0; i < n; i++) {
+        r->slots[(r->head + i) & (SAMPLE_RING_CAPACITY - 1)] = samples[i];
+    }
+    r->head += (uint32_t)n;
+    r->drops += (uint32_t)(count - n);
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+static size_t mutex_ring_pop(mutex_ring_t *r, max30102_sample_t *samples, size_t max_samples)
+{
+    pthread_mutex_lock(&r->lock);
+    size_t available = r->head - r->tail;
+    size_t n = max_samples < available ? max_samples : available;
+    for (size_t i = 0; i < n; i++) {
+        samples[i] = r->slots[(r->tail + i) & (SAMPLE_RING_CAPACITY - 1)];
+    }
+    r->tail += (uint32_t)n;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+static void *producer_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    max30102_sample_t block[MAX_PUSH_BLOCK];
+    uint32_t sequence = 0;
+    uint32_t rng = 12345;
+    double start = now_seconds();
+    
+    while (sequence < TOTAL_SAMPLES) {
+        rng = rng * 1103515245u + 12345u;
+        size_t n = 1 + (rng >> 16) % MAX_PUSH_BLOCK;
+        if (n > TOTAL_SAMPLES - sequence) {
+            n = TOTAL_SAMPLES - sequence;
+        }
+        for (size_t i = 0; i < n; i++) {
+            block[i].red = sequence & 0x03FFFF;
+            block[i].ir = (sequence * 7) & 0x03FFFF;
+            block[i].valid = true;
+            block[i].sequence = sequence++;
+        }
+        size_t pushed = 0;
+        do {
+            size_t done = (ctx->kind == RING_LOCK_FREE)
+                              ? sample_ring_push_block(&ring, block + pushed, n - pushed)
+                              : mutex_ring_push(&mutex_ring, block + pushed, n - pushed);
+            pushed += done;
+            if (ctx->retry && pushed < n) {
+                sched_yield();
+            }
+        } while (ctx->retry && pushed < n);
+    }
+    
+    ctx->producer_seconds = now_seconds() - start;
+    __atomic_store_n(&ctx->producer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    max30102_sample_t block[POP_BLOCK];
+    uint32_t expected = 0;
+    
+    while (1) {
+        int done = __atomic_load_n(&ctx->producer_done, __ATOMIC_ACQUIRE);
+        size_t n = (ctx->kind == RING_LOCK_FREE) ? sample_ring_pop_block(&ring, block, POP_BLOCK)
+                                                 : mutex_ring_pop(&mutex_ring, block, POP_BLOCK);
+        if (n == 0) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        
+        for (size_t i = 0; i < n; i++) {
+            if (block[i].sequence < expected ||
+                block[i].red != (block[i].sequence & 0x03FFFF) ||
+                block[i].ir != ((block[i].sequence * 7) & 0x03FFFF)) {
+                ctx->order_errors++;
+            } else {
+                ctx->gap_samples += block[i].sequence - expected;
+            }
+            expected = block[i].sequence + 1;
+        }
+        ctx->consumed += n;
+        
+        if (ctx->consumer_delay_us && n > 0) {
+            struct timespec ts = {0, (long)ctx->consumer_delay_us * 1000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    
+    ctx->gap_samples += TOTAL_SAMPLES - expected;
+    return NULL;
+}
+
+static int bench_run(ring_kind_t kind, bool retry, uint32_t consumer_delay_us)
+{
+    bench_ctx_t ctx = {.kind = kind, .retry = retry, .consumer_delay_us = consumer_delay_us};
+    pthread_t producer, consumer;
+    
+    sample_ring_init(&ring);
+    memset(&mutex_ring, 0, sizeof(mutex_ring));
+    pthread_mutex_init(&mutex_ring.lock, NULL);
+    
+    pthread_create(&consumer, NULL, consumer_thread, &ctx);
+    pthread_create(&producer, NULL, producer_thread, &ctx);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    
+    uint32_t drops, high_water = 0;
+    if (kind == RING_LOCK_FREE) {
+        sample_ring_stats_t stats;
+        sample_ring_get_stats(&ring, &stats);
+        drops = stats.drops;
+        high_water = stats.high_water;
+    } else {
+        drops = mutex_ring.drops;
+    }
+    if (retry) {
+        drops = 0;  // Retried pushes are counted as drops by the ring but were resent
+    }
+    pthread_mutex_destroy(&mutex_ring.lock);
+    
+    bool accounted = (ctx.gap_samples == drops) && (ctx.consumed + drops == TOTAL_SAMPLES);
+    printf("%-10s %-10s %9lu %12.1f %9.2f %10lu %10lu %8s %8s\n",
+           kind == RING_LOCK_FREE ? "lock-free" : "mutex",
+           retry ? "throughput" : "stress",
+           (unsigned long)consumer_delay_us,
+           TOTAL_SAMPLES / ctx.producer_seconds / 1e6,
+           ctx.producer_seconds * 1e9 / TOTAL_SAMPLES,
+           (unsigned long)drops,
+           (unsigned long)high_water,
+           ctx.order_errors ? "FAIL" : "ok",
+           accounted ? "ok" : "FAIL");
+    
+    return (ctx.order_errors == 0 && accounted) ? 0 : 1;
+}
+
+int main(void)
+{
+    static const uint32_t delays_us[] = {1, 50};
+    int failures = 0;
+    
+    printf("Ring capacity %d samples, %.2f bytes per buffered sample (mutex ring %.2f), %lu samples per run\n",
+           SAMPLE_RING_CAPACITY, (double)sizeof(sample_ring_t) / SAMPLE_RING_CAPACITY,
+           (double)sizeof(mutex_ring_t) / SAMPLE_RING_CAPACITY, (unsigned long)TOTAL_SAMPLES);
+    printf("%-10s %-10s %9s %12s %9s %10s %10s %8s %8s\n",
+           "ring", "mode", "delay_us", "Msamples/s", "ns/sample", "drops", "high_water", "order", "drops");
+    
+    failures += bench_run(RING_LOCK_FREE, true, 0);
+    failures += bench_run(RING_MUTEX, true, 0);
+    
+    for (size_t d = 0; d < sizeof(delays_us) / sizeof(delays_us[0]); d++) {
+        failures += bench_run(RING_LOCK_FREE, false, delays_us[d]);
+        failures += bench_run(RING_MUTEX, false, delays_us[d]);
+    }
+    
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hr_spectral.h"
+#include "hr_detector.h"
+#include "max30102_sim.h"
+
+// Spectral heart-rate benchmark. Runs hr_spectral over synthetic PPG and, at
+// every readout, a floating-point baseline that recomputes the window from
+// scratch: the same boxcar decimation, mean removal, Hann window, a radix-2
+// FFT of the same length and the same peak interpolation. Reports the cost
+// per input sample of the sliding DFT, of one FFT per readout, and of an FFT
+// per decimated sample (what a sliding readout would cost done naively), the
+// BPM error of both against the trace, and hr_detector's BPM error on the
+// same trace for comparison.
+
+#define RUN_SECONDS     60
+#define MAX_RATE_HZ     3200
+#define MAX_READOUTS    RUN_SECONDS
+#define TIMING_REPEATS  5
+
+#define MAX_MEAN_ERROR  1.0     // Mean |BPM error| of the readouts
+#define MAX_PEAK_ERROR  3.0     // Worst readout
+#define MAX_BASELINE    0.5     // Mean |sliding DFT - FFT baseline|
+
+typedef struct {
+    uint32_t rate_hz;
+    double bpm;
+    double noise;
+    bool checked;
+} scenario_t;
+
+static max30102_sample_t trace[RUN_SECONDS * MAX_RATE_HZ];
+static double decimated[RUN_SECONDS * HRS_INTERNAL_RATE_HZ * 2];
+static size_t readout_index[MAX_READOUTS];
+static uint16_t readout_bpm[MAX_READOUTS];
+static hr_spectral_t spectral;
+static hr_detector_t detector;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// In-place iterative radix-2 FFT
+static void fft(double *re, double *im, size_t n)
+{
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double ang = -2.0 * M_PI / (double)len;
+        double wr = cos(ang), wi = sin(ang);
+        for (size_t i = 0; i < n; i += len) {
+            double cr = 1.0, ci = 0.0;
+            for (size_t k = 0; k < len / 2; k++) {
+                size_t a = i + k, b = i + k + len / 2;
+                double tr = re[b] * cr - im[b] * ci;
+                double ti = re[b] * ci + im[b] * cr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+                double t = cr * wr - ci * wi;
+                ci = cr * wi + ci * wr;
+                cr = t;
+            }
+        }
+    }
+}
+
+// Baseline readout over the N decimated samples ending at 'last'
+static double fft_bpm(const double *x, size_t last, double rate)
+{
+    double re[HRS_WINDOW], im[HRS_WINDOW], mean = 0.0;
+    const double *w = &x[last + 1 - HRS_WINDOW];
+    for (size_t i = 0; i < HRS_WINDOW; i++) {
+        mean += w[i];
+    }
+    mean /= HRS_WINDOW;
+    for (size_t i = 0; i < HRS_WINDOW; i++) {
+        re[i] = (w[i] - mean) * (0.5 - 0.5 * cos(2.0 * M_PI * i / HRS_WINDOW));
+        im[i] = 0.0;
+    }
+    fft(re, im, HRS_WINDOW);
+    
+    size_t k_low = (size_t)ceil(HRS_LOW_HZ * HRS_WINDOW / rate);
+    size_t k_high = (size_t)floor(HRS_HIGH_HZ * HRS_WINDOW / rate);
+    size_t peak = k_low;
+    double power[HRS_WINDOW / 2];
+    for (size_t k = k_low - 1; k <= k_high + 1; k++) {
+        power[k] = re[k] * re[k] + im[k] * im[k];
+    }
+    for (size_t k = k_low; k <= k_high; k++) {
+        if (power[k] > power[peak]) {
+            peak = k;
+        }
+    }
+    double offset = 0.0;
+    if (peak > k_low && peak < k_high) {
+        double l = log(power[peak - 1] + 1.0), c = log(power[peak] + 1.0), r = log(power[peak + 1] + 1.0);
+        double denom = l - 2.0 * c + r;
+        if (denom < 0.0) {
+            offset = fmax(-0.5, fmin(0.5, 0.5 * (l - r) / denom));
+        }
+    }
+    return ((double)peak + offset) * rate / HRS_WINDOW * 60.0;
+}
+
+static int run_scenario(const scenario_t *sc)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = sc->bpm, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = sc->noise, .seed = 11,
+    };
+    size_t count = (size_t)RUN_SECONDS * sc->rate_hz;
+    for (size_t i = 0; i < count; i++) {
+        int64_t t = (int64_t)i * 1000000000 / sc->rate_hz;
+        max30102_sim_ppg_source(&ppg, i, t, &trace[i].red, &trace[i].ir);
+        trace[i].valid = true;
+        trace[i].sequence = (uint32_t)i;
+    }
+    
+    // Sliding DFT, fastest of several passes
+    size_t readouts = 0;
+    double best = 1e30;
+    for (int r = 0; r < TIMING_REPEATS; r++) {
+        readouts = 0;
+        hr_spectral_init(&spectral, sc->rate_hz);
+        double t0 = now_ns();
+        for (size_t i = 0; i < count; i++) {
+            hr_spectral_result_t result;
+            if (hr_spectral_process(&spectral, &trace[i], &result) && readouts < MAX_READOUTS) {
+                readout_index[readouts] = i;
+                readout_bpm[readouts++] = result.bpm_x10;
+            }
+        }
+        double elapsed = now_ns() - t0;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    double sdft_ns = best / count;
+    
+    // Baseline: same decimation, FFT at every readout
+    uint32_t decimation = spectral.decimation;
+    double rate = (double)sc->rate_hz / decimation;
+    size_t decimated_count = count / decimation;
+    for (size_t m = 0; m < decimated_count; m++) {
+        double sum = 0.0;
+        for (uint32_t i = 0; i < decimation; i++) {
+            sum += trace[m * decimation + i].ir;
+        }
+        decimated[m] = sum / decimation;
+    }
+    double sdft_err = 0, sdft_max = 0, fft_err = 0, diff = 0;
+    double t0 = now_ns();
+    for (size_t r = 0; r < readouts; r++) {
+        size_t last = (readout_index[r] + 1) / decimation - 1;
+        double fft = fft_bpm(decimated, last, rate);
+        double bpm = readout_bpm[r] / 10.0;
+        sdft_err += fabs(bpm - sc->bpm);
+        sdft_max = fmax(sdft_max, fabs(bpm - sc->bpm));
+        fft_err += fabs(fft - sc->bpm);
+        diff += fabs(bpm - fft);
+    }
+    double fft_ns_each = readouts ? (now_ns() - t0) / readouts : 0.0;
+    double fft_window_ns = fft_ns_each * readouts / count;
+    double fft_slide_ns = fft_ns_each / decimation;
+    
+    // Time-domain detector on the same trace
+    hr_detector_init(&detector, sc->rate_hz);
+    double hr_err = 0;
+    size_t locked = 0;
+    for (size_t i = 0; i < count; i++) {
+        hr_beat_t beat;
+        if (hr_detector_process(&detector, &trace[i], &beat) && beat.bpm_x10) {
+            hr_err += fabs(beat.bpm_x10 / 10.0 - sc->bpm);
+            locked++;
+        }
+    }
+    
+    double n = readouts ? (double)readouts : 1.0;
+    bool ok = !sc->checked || (readouts > 0 && sdft_err / n <= MAX_MEAN_ERROR &&
+                               sdft_max <= MAX_PEAK_ERROR && diff / n <= MAX_BASELINE);
+    char hr_text[16];
+    if (locked) {
+        snprintf(hr_text, sizeof(hr_text), "%.2f", hr_err / locked);
+    } else {
+        snprintf(hr_text, sizeof(hr_text), "no lock");
+    }
+    printf("%6lu %5.0f %6.0f %8.1f %8.1f %9.1f %5lu %8.2f %8.2f %8.2f %8.2f %8s %5s\n",
+           (unsigned long)sc->rate_hz, sc->bpm, sc->noise, sdft_ns, fft_window_ns, fft_slide_ns,
+           (unsigned long)readouts, sdft_err / n, sdft_max, fft_err / n, diff / n, hr_text,
+           sc->checked ? (ok ? "ok" : "FAIL") : "-");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const scenario_t scenarios[] = {
+        {100, 72, 20, true}, {100, 40, 20, true}, {100, 120, 20, true}, {100, 180, 20, true},
+        {50, 72, 20, true}, {400, 72, 20, true}, {1000, 72, 20, true}, {3200, 72, 20, true},
+        {100, 72, 400, true}, {100, 72, 800, true}, {400, 95, 1600, true}, {100, 72, 3200, true},
+    };
+    int failures = 0;
+    
+    printf("%d s synthetic PPG per run, %d-sample window at ~%d Hz, readout every %d ms\n",
+           RUN_SECONDS, HRS_WINDOW, HRS_INTERNAL_RATE_HZ, HRS_UPDATE_MS);
+    printf("%6s %5s %6s %8s %8s %9s %5s %8s %8s %8s %8s %8s %5s\n",
+           "rate", "bpm", "noise", "sdft_ns", "fft_ns", "fft/dec", "outs", "err", "max_err",
+           "fft_err", "vs_fft", "hr_err", "check");
+    
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failures += run_scenario(&scenarios[i]);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hr_detector.h"
+#include "spo2_estimator.h"
+#include "max30102_sim.h"
+
+// SpO2 estimator benchmark. Beat boundaries come from hr_detector, as on the
+// device. Every estimate is checked against a floating-point reference. The
+// reference takes the raw samples of the same beat window and computes DC
+// as the mean, AC as the RMS about a least-squares line, and the SpO2 from
+// the calibration polynomial directly. The table also shows the error
+// against the R the synthetic trace was generated with.
+
+#define RUN_SECONDS     60
+#define MAX_RATE_HZ     3200
+#define MAX_BEATS       (RUN_SECONDS * 4)
+#define TIMING_REPEATS  5
+
+#define MAX_REF_ERROR   1.0     // Worst |fixed - reference| in SpO2 percent
+#define MEAN_REF_ERROR  0.3
+
+typedef struct {
+    uint32_t rate_hz;
+    double ratio;               // R of the synthetic trace
+    double noise;
+    bool checked;
+} scenario_t;
+
+static max30102_sample_t trace[RUN_SECONDS * MAX_RATE_HZ];
+static size_t beat_index[MAX_BEATS];            // Sample index where each beat was reported
+static spo2_result_t estimates[MAX_BEATS];
+static size_t estimate_beat[MAX_BEATS];         // Beat that produced each estimate
+static hr_detector_t detector;
+static spo2_estimator_t estimator;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double calibrate(double r)
+{
+    double spo2 = SPO2_CAL_A * r * r + SPO2_CAL_B * r + SPO2_CAL_C;
+    return spo2 > 100.0 ? 100.0 : (spo2 < 0.0 ? 0.0 : spo2);
+}
+
+// RMS of x about its least-squares line, and its mean
+static void ref_ac_dc(const max30102_sample_t *s, size_t n, bool red, double *ac, double *dc)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < n; i++) {
+        double y = red ? s[i].red : s[i].ir;
+        sx += i;
+        sy += y;
+        sxx += (double)i * i;
+        sxy += i * y;
+    }
+    double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    double icept = (sy - slope * sx) / n;
+    double ss = 0;
+    for (size_t i = 0; i < n; i++) {
+        double y = red ? s[i].red : s[i].ir;
+        double e = y - (icept + slope * i);
+        ss += e * e;
+    }
+    *ac = sqrt(ss / n);
+    *dc = sy / n;
+}
+
+static int run_scenario(const scenario_t *sc)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = 72.0, .red_dc = 100000.0, .ir_dc = 120000.0, .ir_ac = 2400.0,
+        .noise = sc->noise, .seed = 3,
+    };
+    ppg.red_ac = sc->ratio * ppg.red_dc * ppg.ir_ac / ppg.ir_dc;
+    size_t count = (size_t)RUN_SECONDS * sc->rate_hz;
+    
+    for (size_t i = 0; i < count; i++) {
+        int64_t t = (int64_t)i * 1000000000 / sc->rate_hz;
+        max30102_sim_ppg_source(&ppg, i, t, &trace[i].red, &trace[i].ir);
+        trace[i].valid = true;
+        trace[i].sequence = (uint32_t)i;
+    }
+    
+    // Beat boundaries, and the cost of the heart-rate detector on its own
+    size_t beats = 0;
+    hr_detector_init(&detector, sc->rate_hz);
+    double t0 = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        if (hr_detector_process(&detector, &trace[i], NULL) && beats < MAX_BEATS) {
+            beat_index[beats++] = i;
+        }
+    }
+    double hr_ns = (now_ns() - t0) / count;
+    
+    // Estimator alone, fed the same boundaries; fastest of several passes
+    size_t estimate_count = 0;
+    double best = 1e30;
+    for (int r = 0; r < TIMING_REPEATS; r++) {
+        size_t b = 0;
+        estimate_count = 0;
+        spo2_estimator_init(&estimator, sc->rate_hz);
+        t0 = now_ns();
+        for (size_t i = 0; i < count; i++) {
+            if (b < beats && beat_index[b] == i) {
+                if (spo2_estimator_beat(&estimator, &estimates[estimate_count])) {
+                    estimate_beat[estimate_count++] = b;
+                }
+                b++;
+            }
+            spo2_estimator_process(&estimator, &trace[i]);
+        }
+        double elapsed = now_ns() - t0;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    double spo2_ns = best / count;
+    
+    // Compare every estimate with the reference over the same window
+    double true_spo2 = calibrate(sc->ratio);
+    double ref_err_sum = 0, ref_err_max = 0, r_err_sum = 0, true_err_sum = 0;
+    for (size_t e = 0; e < estimate_count; e++) {
+        size_t end = beat_index[estimate_beat[e]];
+        size_t start = beat_index[estimate_beat[e] - SPO2_WINDOW_BEATS];
+        double ac_r, dc_r, ac_i, dc_i;
+        ref_ac_dc(&trace[start], end - start, true, &ac_r, &dc_r);
+        ref_ac_dc(&trace[start], end - start, false, &ac_i, &dc_i);
+        double ref_r = (ac_r / dc_r) / (ac_i / dc_i);
+        double ref_spo2 = calibrate(ref_r);
+        double spo2 = estimates[e].spo2_x10 / 10.0;
+        
+        double err = fabs(spo2 - ref_spo2);
+        ref_err_sum += err;
+        if (err > ref_err_max) {
+            ref_err_max = err;
+        }
+        r_err_sum += fabs(estimates[e].ratio_x1000 / 1000.0 - ref_r);
+        true_err_sum += fabs(spo2 - true_spo2);
+    }
+    
+    double n = estimate_count ? (double)estimate_count : 1.0;
+    bool ok = !sc->checked || (estimate_count > 0 && ref_err_max <= MAX_REF_ERROR &&
+                               ref_err_sum / n <= MEAN_REF_ERROR);
+    printf("%6lu %5.2f %6.0f %6.1f %8.1f %8.1f %6lu %8.3f %8.2f %8.2f %8.2f %5s\n",
+           (unsigned long)sc->rate_hz, sc->ratio, sc->noise, true_spo2, spo2_ns, hr_ns,
+           (unsigned long)estimate_count, r_err_sum / n, ref_err_sum / n, ref_err_max,
+           true_err_sum / n, sc->checked ? (ok ? "ok" : "FAIL") : "-");
+    
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const scenario_t scenarios[] = {
+        {100, 0.4, 20, true}, {100, 0.6, 20, true}, {100, 0.8, 20, true},
+        {100, 1.0, 20, true}, {100, 1.4, 20, true},
+        {50, 0.6, 20, true}, {400, 0.6, 20, true}, {1000, 0.6, 20, true}, {3200, 0.6, 20, true},
+        {100, 0.6, 0, true}, {100, 0.6, 200, true}, {100, 0.6, 800, false},
+    };
+    int failures = 0;
+    
+    printf("%d s synthetic PPG per run, %d-beat window\n", RUN_SECONDS, SPO2_WINDOW_BEATS);
+    printf("%6s %5s %6s %6s %8s %8s %6s %8s %8s %8s %8s %5s\n",
+           "rate", "R", "noise", "spo2", "spo2_ns", "hr_ns", "ests", "R_err", "ref_err",
+           "ref_max", "true_err", "check");
+    
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failures += run_scenario(&scenarios[i]);
+    }
+    
+    return failures ? 1 : 0;
+}
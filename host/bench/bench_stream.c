@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stream_codec.h"
+#include "sample_ring.h"
+#include "max30102_sim.h"
+
+// Output format benchmark: bytes and CPU per sample for the per-sample
+// printf line versus stream_codec frames, on synthetic PPG at several
+// sample rates. Every binary run is decoded again and compared sample by
+// sample; a second pass corrupts the stream and mixes in log text to check
+// that the decoder resynchronizes without ever delivering a bad sample.
+
+#define RUN_SAMPLES     100000
+#define DRAIN_BLOCK     32          // Samples per ring pop, as in output_task
+#define GAP_EVERY       5000        // Drop a run of samples this often
+#define GAP_LENGTH      7
+#define LINK_BAUD       115200      // Console UART, 10 bits per byte
+#define CORRUPT_EVERY   2000        // Flip one byte in this many
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} byte_buf_t;
+
+typedef struct {
+    const max30102_sample_t *expected;  // Indexed by sequence number
+    size_t expected_count;
+    uint64_t samples;
+    uint64_t mismatches;
+    uint64_t gap_samples;
+} check_ctx_t;
+
+static max30102_sample_t input[RUN_SAMPLES];
+static max30102_sample_t reference[RUN_SAMPLES + RUN_SAMPLES / GAP_EVERY * GAP_LENGTH + 1];
+static stream_encoder_t encoder;
+static stream_decoder_t decoder;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void buf_write(void *ctx, const uint8_t *data, size_t len)
+{
+    byte_buf_t *buf = ctx;
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->len + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void check_frame(void *arg, const stream_frame_t *frame)
+{
+    check_ctx_t *ctx = arg;
+    
+    if (frame->type == STREAM_FRAME_GAP) {
+        ctx->gap_samples += frame->gap.count;
+        return;
+    }
+    if (frame->type != STREAM_FRAME_SAMPLES) {
+        return;
+    }
+    for (uint32_t i = 0; i < frame->block.count; i++) {
+        const max30102_sample_t *s = &frame->block.samples[i];
+        if (s->sequence >= ctx->expected_count ||
+            ctx->expected[s->sequence].red != s->red ||
+            ctx->expected[s->sequence].ir != s->ir) {
+            ctx->mismatches++;
+        }
+        ctx->samples++;
+    }
+}
+
+// Synthetic PPG with a run of samples dropped every GAP_EVERY, so the
+// encoder has to emit gap frames
+static size_t generate(uint32_t rate_hz, double noise)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = 72.0, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = noise, .seed = 1,
+    };
+    uint32_t sequence = 0;
+    
+    for (size_t i = 0; i < RUN_SAMPLES; i++) {
+        if (i > 0 && i % GAP_EVERY == 0) {
+            for (int g = 0; g < GAP_LENGTH; g++) {
+                reference[sequence].valid = false;
+                sequence++;
+            }
+        }
+        int64_t t = (int64_t)sequence * 1000000000 / rate_hz;
+        max30102_sim_ppg_source(&ppg, sequence, t, &input[i].red, &input[i].ir);
+        input[i].valid = true;
+        input[i].sequence = sequence;
+        reference[sequence] = input[i];
+        sequence++;
+    }
+    return sequence;
+}
+
+static int bench_rate(uint32_t rate_hz, double noise)
+{
+    static char line[64];
+    size_t sequences = generate(rate_hz, noise);
+    
+    // Text: the per-sample line output_task printed
+    size_t text_bytes = 0;
+    double t0 = now_ns();
+    for (size_t i = 0; i < RUN_SAMPLES; i++) {
+        text_bytes += (size_t)snprintf(line, sizeof(line), "[%lu] Red: %6lu, IR: %6lu\n",
+                                       (unsigned long)input[i].sequence,
+                                       (unsigned long)input[i].red, (unsigned long)input[i].ir);
+    }
+    double text_ns = (now_ns() - t0) / RUN_SAMPLES;
+    
+    // Binary: push in ring-sized pops and flush after each, as output_task does
+    byte_buf_t stream = {0};
+    stream_encoder_init(&encoder, STREAM_MAX_BLOCK, buf_write, &stream);
+    stream_encoder_info(&encoder, rate_hz);
+    t0 = now_ns();
+    for (size_t i = 0; i < RUN_SAMPLES; i += DRAIN_BLOCK) {
+        size_t n = RUN_SAMPLES - i < DRAIN_BLOCK ? RUN_SAMPLES - i : DRAIN_BLOCK;
+        stream_encoder_push(&encoder, &input[i], n);
+        stream_encoder_flush(&encoder);
+    }
+    double enc_ns = (now_ns() - t0) / RUN_SAMPLES;
+    
+    check_ctx_t check = {.expected = reference, .expected_count = sequences};
+    stream_decoder_init(&decoder, check_frame, &check);
+    t0 = now_ns();
+    stream_decoder_feed(&decoder, stream.data, stream.len);
+    double dec_ns = (now_ns() - t0) / RUN_SAMPLES;
+    
+    stream_stats_t dec_stats;
+    stream_decoder_get_stats(&decoder, &dec_stats);
+    uint64_t expected_gap = (uint64_t)(RUN_SAMPLES - 1) / GAP_EVERY * GAP_LENGTH;
+    int clean_ok = check.samples == RUN_SAMPLES && check.mismatches == 0 &&
+                   check.gap_samples == expected_gap && dec_stats.crc_errors == 0;
+    
+    // Corrupted link: flip bytes and splice in log lines every few frames
+    byte_buf_t noisy = {0};
+    static const char log_line[] = "W (12345) MAIN: Gap: 7 samples lost at 5000\r\n";
+    uint32_t rng = 99;
+    for (size_t i = 0; i < stream.len; i++) {
+        uint8_t b = stream.data[i];
+        rng = rng * 1103515245u + 12345u;
+        if ((rng >> 8) % CORRUPT_EVERY == 0) {
+            b ^= (uint8_t)(1u << ((rng >> 20) & 7));
+        }
+        buf_write(&noisy, &b, 1);
+        if (i % 1000 == 999) {
+            buf_write(&noisy, (const uint8_t *)log_line, sizeof(log_line) - 1);
+        }
+    }
+    check_ctx_t noisy_check = {.expected = reference, .expected_count = sequences};
+    stream_decoder_init(&decoder, check_frame, &noisy_check);
+    // Feed in uneven chunks as a serial read would return them
+    for (size_t off = 0; off < noisy.len;) {
+        rng = rng * 1103515245u + 12345u;
+        size_t n = 1 + (rng >> 16) % 200;
+        if (n > noisy.len - off) {
+            n = noisy.len - off;
+        }
+        stream_decoder_feed(&decoder, noisy.data + off, n);
+        off += n;
+    }
+    stream_stats_t noisy_stats;
+    stream_decoder_get_stats(&decoder, &noisy_stats);
+    int noisy_ok = noisy_check.mismatches == 0 && noisy_check.samples > 0;
+    
+    double text_bps = (double)text_bytes / RUN_SAMPLES;
+    double bin_bps = (double)stream.len / RUN_SAMPLES;
+    printf("%6lu %6.0f %9.2f %9.2f %7.1fx %8.1f %8.1f %8.1f %9.0f %9.0f %6s %7.2f %6lu %6s\n",
+           (unsigned long)rate_hz, noise, text_bps, bin_bps, text_bps / bin_bps,
+           text_ns, enc_ns, dec_ns,
+           LINK_BAUD / 10.0 / text_bps, LINK_BAUD / 10.0 / bin_bps,
+           clean_ok ? "ok" : "FAIL",
+           100.0 * (double)noisy_check.samples / RUN_SAMPLES,
+           (unsigned long)noisy_stats.crc_errors,
+           noisy_ok ? "ok" : "FAIL");
+    
+    free(stream.data);
+    free(noisy.data);
+    return clean_ok && noisy_ok ? 0 : 1;
+}
+
+// Gap frames the ring-to-encoder path sent
+typedef struct {
+    max30102_gap_t gaps[8];
+    size_t count;
+} gap_log_t;
+
+static void log_gap(void *arg, const stream_frame_t *frame)
+{
+    gap_log_t *log = arg;
+    if (frame->type == STREAM_FRAME_GAP && log->count < sizeof(log->gaps) / sizeof(log->gaps[0])) {
+        log->gaps[log->count++] = frame->gap;
+    }
+}
+
+// Pushes sequences [first, last) into the ring
+static void push_run(sample_ring_t *ring, uint32_t first, uint32_t last)
+{
+    for (uint32_t s = first; s < last; s++) {
+        max30102_sample_t sample = {.red = s, .ir = s, .valid = true, .sequence = s};
+        sample_ring_push(ring, &sample);
+    }
+}
+
+// A gap the driver could only estimate must reach the stream flagged as
+// such, through the ring and dsp-sized block pops, whether it comes before
+// the samples it was reported with (rollover) or after them
+static int bench_estimated_gaps(void)
+{
+    static sample_ring_t ring;
+    static sample_block_t block;
+    static const max30102_gap_t expected[] = {
+        {.sequence = 100, .count = 40, .saturated = true},
+        {.sequence = 200, .count = 5, .saturated = false},
+        {.sequence = 300, .count = 50, .saturated = true},
+    };
+    byte_buf_t stream = {0};
+    gap_log_t log = {0};
+    
+    sample_ring_init(&ring);
+    stream_encoder_init(&encoder, STREAM_MAX_BLOCK, buf_write, &stream);
+    push_run(&ring, 0, 100);
+    sample_ring_note_gap(&ring, &expected[0]);
+    push_run(&ring, 140, 200);
+    sample_ring_note_gap(&ring, &expected[1]);
+    push_run(&ring, 205, 230);
+    while (sample_ring_pop_run(&ring, &block, DRAIN_BLOCK) > 0) {
+        stream_encoder_push_block(&encoder, &block);
+    }
+    sample_ring_note_gap(&ring, &expected[2]);
+    push_run(&ring, 230, 300);
+    push_run(&ring, 350, 400);
+    while (sample_ring_pop_run(&ring, &block, DRAIN_BLOCK) > 0) {
+        stream_encoder_push_block(&encoder, &block);
+    }
+    stream_encoder_flush(&encoder);
+    
+    stream_decoder_init(&decoder, log_gap, &log);
+    stream_decoder_feed(&decoder, stream.data, stream.len);
+    free(stream.data);
+    
+    bool ok = log.count == sizeof(expected) / sizeof(expected[0]);
+    for (size_t i = 0; ok && i < log.count; i++) {
+        ok = log.gaps[i].sequence == expected[i].sequence && log.gaps[i].count == expected[i].count &&
+             log.gaps[i].saturated == expected[i].saturated;
+    }
+    printf("\nestimated gaps through the ring: %zu gap frames, flags %s\n", log.count, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const struct {
+        uint32_t rate_hz;
+        double noise;
+    } runs[] = {
+        {100, 20.0}, {400, 20.0}, {1000, 20.0}, {3200, 20.0}, {400, 0.0}, {400, 200.0},
+    };
+    int failures = 0;
+    
+    printf("%lu samples per run, %lu-sample drains, max %d samples per frame, link %d baud\n",
+           (unsigned long)RUN_SAMPLES, (unsigned long)DRAIN_BLOCK, STREAM_MAX_BLOCK, LINK_BAUD);
+    printf("%6s %6s %9s %9s %8s %8s %8s %8s %9s %9s %6s %7s %6s %6s\n",
+           "rate", "noise", "text_B", "bin_B", "ratio", "text_ns", "enc_ns", "dec_ns",
+           "text_max", "bin_max", "check", "noisy%", "crcerr", "noisy");
+    
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        failures += bench_rate(runs[i].rate_hz, runs[i].noise);
+    }
+    failures += bench_estimated_gaps();
+    
+    return failures ? 1 : 0;
+}
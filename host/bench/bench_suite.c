@@ -0,0 +1,377 @@
+#include <fnmatch.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "pipeline.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "memory_budget.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Regression suite: the firmware's sensor path, end to end, at every
+// MAX30102_SAMPLERATE_* setting. Each run drives the simulated sensor in
+// interrupt mode the way sensor_task does (wake on A_FULL, drain, push to
+// the pipeline) and runs the dsp and output stages after every drain, all
+// on one thread. Per rate it measures:
+//
+//   - bus transactions and bytes per sample
+//   - host CPU ns per sample for the drain (driver and acquisition, plus
+//     the simulated sensor), the ring push, dsp and output
+//   - latency from a sample's timestamp to its output being written, on
+//     the virtual clock: FIFO wait, wakeup latency and bus time
+//   - samples lost and output bytes per sample
+//
+// plus the size of the statically allocated state main.c keeps, the bytes
+// per sample the pipeline buffers take, and how far heap use grew while
+// the runs went on (glibc mallinfo2). Results
+// are written as flat JSON ("metric": value), with one entry per threshold
+// check, to stdout or the file given with -o. Thresholds come from a text
+// file (-t, default suite_thresholds.txt next to this source) with lines
+//
+//   <metric pattern> <max|min> <value>
+//
+// where the pattern may use shell wildcards, e.g. "rate_*.samples_lost max 0".
+// Any failed check makes the exit status non-zero.
+
+#define RUN_SECONDS         10
+#define WARMUP_SECONDS      2       // Excluded from latency while the sample clock settles
+#define WAKE_LATENCY_NS     30000   // ISR + context switch before sensor_task runs
+#define MAX_METRICS         256
+#define MAX_CHECKS          128
+
+#ifndef SUITE_THRESHOLDS
+#define SUITE_THRESHOLDS    "suite_thresholds.txt"
+#endif
+
+static const struct {
+    uint8_t code;
+    uint32_t hz;
+} rates[] = {
+    {MAX30102_SAMPLERATE_50, 50},
+    {MAX30102_SAMPLERATE_100, 100},
+    {MAX30102_SAMPLERATE_200, 200},
+    {MAX30102_SAMPLERATE_400, 400},
+    {MAX30102_SAMPLERATE_800, 800},
+    {MAX30102_SAMPLERATE_1000, 1000},
+    {MAX30102_SAMPLERATE_1600, 1600},
+    {MAX30102_SAMPLERATE_3200, 3200},
+};
+
+typedef struct {
+    char name[64];
+    double value;
+} metric_t;
+
+typedef struct {
+    char pattern[64];
+    bool is_max;
+    double limit;
+    size_t matched;
+    size_t failed;
+} check_t;
+
+typedef struct {
+    uint64_t bytes;
+} sink_t;
+
+static metric_t metrics_out[MAX_METRICS];
+static size_t metric_count;
+static check_t checks[MAX_CHECKS];
+static size_t check_count;
+
+static max30102_sim_t sim;
+static max30102_dev_t dev;
+static acquisition_t acq;
+static pipeline_t pipeline;
+static sink_t sink;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t clock_us(void)
+{
+    return host_clock_now_ns() / 1000;
+}
+
+static void sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)data;
+    ((sink_t *)ctx)->bytes += len;
+}
+
+static void put_metric(const char *prefix, const char *name, double value)
+{
+    if (metric_count < MAX_METRICS) {
+        metric_t *m = &metrics_out[metric_count++];
+        snprintf(m->name, sizeof(m->name), "%s%s%s", prefix, prefix[0] ? "." : "", name);
+        m->value = value;
+    }
+}
+
+// One rate, RUN_SECONDS of virtual time
+static void run_rate(uint8_t rate_code, uint32_t rate_hz)
+{
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = rate_code;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    if (max30102_init_fast(&dev, &config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, ACQUISITION_MODE_INTERRUPT, &config) != MAX30102_OK) {
+        fprintf(stderr, "sensor init failed at %lu Hz\n", (unsigned long)rate_hz);
+        exit(1);
+    }
+    pipeline_config_t pc = {
+        .output = PIPELINE_OUTPUT_BINARY,
+        .sample_rate_hz = max30102_fifo_rate_hz(&config),
+        .write = sink_write,
+        .write_ctx = &sink,
+        .clock_us = clock_us,
+        .adc_range = config.adc_range,
+        .quality_gate = true,
+    };
+    pipeline_init(&pipeline, &pc);
+    max30102_reset_bus_stats(&dev);
+    sink.bytes = 0;
+
+    max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+    int64_t stage_ns[4] = {0};
+    uint64_t delivered = 0;
+    uint64_t lost = 0;
+    uint64_t latency_sum_us = 0;
+    uint64_t latency_count = 0;
+    int64_t latency_max_us = 0;
+    uint64_t generated_start = sim.samples_generated;
+    int64_t start_ns = host_clock_now_ns();
+    int64_t warm_ns = start_ns + (int64_t)WARMUP_SECONDS * 1000000000;
+    int64_t end_ns = start_ns + (int64_t)RUN_SECONDS * 1000000000;
+
+    while (1) {
+        int64_t event_ns = max30102_sim_next_interrupt_ns(&sim);
+        if (event_ns >= end_ns) {
+            break;
+        }
+        host_clock_advance_to_ns(event_ns + WAKE_LATENCY_NS);
+
+        size_t count = 0;
+        max30102_gap_t gap;
+        int64_t t0 = now_ns();
+        acquisition_drain(&acq, event_ns / 1000, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+        int64_t t1 = now_ns();
+        size_t pushed = pipeline_acquire(&pipeline, samples, count);
+        int64_t t2 = now_ns();
+        while (pipeline_dsp_step(&pipeline) > 0) {
+        }
+        int64_t t3 = now_ns();
+        while (pipeline_output_step(&pipeline) > 0) {
+        }
+        int64_t t4 = now_ns();
+        stage_ns[0] += t1 - t0;
+        stage_ns[1] += t2 - t1;
+        stage_ns[2] += t3 - t2;
+        stage_ns[3] += t4 - t3;
+
+        delivered += count;
+        lost += gap.count + (count - pushed);
+
+        // Output is written at the current virtual time
+        if (host_clock_now_ns() >= warm_ns) {
+            int64_t out_us = clock_us();
+            for (size_t i = 0; i < count; i++) {
+                int64_t latency = out_us - samples[i].timestamp_us;
+                latency_sum_us += (uint64_t)latency;
+                latency_count++;
+                latency_max_us = latency > latency_max_us ? latency : latency_max_us;
+            }
+        }
+    }
+    pipeline_output_flush(&pipeline);
+
+    max30102_bus_stats_t bus;
+    max30102_get_bus_stats(&dev, &bus);
+    uint64_t generated = sim.samples_generated - generated_start;
+    double per = delivered ? 1.0 / (double)delivered : 0;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "rate_%lu", (unsigned long)rate_hz);
+
+    put_metric(prefix, "samples", (double)delivered);
+    put_metric(prefix, "samples_lost", (double)lost);
+    put_metric(prefix, "samples_unread", (double)(generated - delivered - lost));
+    put_metric(prefix, "bus_transactions_per_sample", (double)bus.transactions * per);
+    put_metric(prefix, "bus_bytes_per_sample", (double)(bus.bytes_written + bus.bytes_read) * per);
+    put_metric(prefix, "drain_ns_per_sample", (double)stage_ns[0] * per);
+    put_metric(prefix, "acquire_ns_per_sample", (double)stage_ns[1] * per);
+    put_metric(prefix, "dsp_ns_per_sample", (double)stage_ns[2] * per);
+    put_metric(prefix, "output_ns_per_sample", (double)stage_ns[3] * per);
+    put_metric(prefix, "total_ns_per_sample", (double)(stage_ns[0] + stage_ns[1] + stage_ns[2] + stage_ns[3]) * per);
+    put_metric(prefix, "latency_avg_us", latency_count ? (double)latency_sum_us / (double)latency_count : 0);
+    put_metric(prefix, "latency_max_us", (double)latency_max_us);
+    put_metric(prefix, "output_bytes_per_sample", (double)sink.bytes * per);
+}
+
+static void put_memory(size_t heap_growth, size_t heap_peak)
+{
+    size_t state = sizeof(max30102_dev_t) + sizeof(acquisition_t) + sizeof(pipeline_t) + sizeof(metrics_t) +
+                   sizeof(deferred_log_t) + MAX30102_FIFO_DEPTH * sizeof(max30102_sample_t);
+    put_metric("memory", "max30102_dev_t", (double)sizeof(max30102_dev_t));
+    put_metric("memory", "acquisition_t", (double)sizeof(acquisition_t));
+    put_metric("memory", "pipeline_t", (double)sizeof(pipeline_t));
+    put_metric("memory", "metrics_t", (double)sizeof(metrics_t));
+    put_metric("memory", "deferred_log_t", (double)sizeof(deferred_log_t));
+    put_metric("memory", "drain_buffer", (double)(MAX30102_FIFO_DEPTH * sizeof(max30102_sample_t)));
+    put_metric("memory", "static_total", (double)state);
+    put_metric("memory", "task_stacks", (double)(SENSOR_STACK_SIZE + DSP_STACK_SIZE + OUTPUT_STACK_SIZE +
+                                                 LOG_STACK_SIZE));
+    put_metric("memory", "sample_block_t", (double)sizeof(sample_block_t));
+    put_metric("memory", "buffered_samples", (double)PIPELINE_BUFFERED_SAMPLES);
+    put_metric("memory", "bytes_per_buffered_sample", (double)PIPELINE_BUFFER_BYTES / PIPELINE_BUFFERED_SAMPLES);
+    put_metric("memory", "heap_growth_bytes", (double)heap_growth);
+    put_metric("memory", "heap_peak_bytes", (double)heap_peak);
+}
+
+static bool load_thresholds(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    char line[160];
+    unsigned lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char pattern[64];
+        char kind[8];
+        double limit;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        int n = sscanf(line, "%63s %7s %lf", pattern, kind, &limit);
+        if (n <= 0) {
+            continue;
+        }
+        if (n != 3 || (strcmp(kind, "max") != 0 && strcmp(kind, "min") != 0) || check_count == MAX_CHECKS) {
+            fprintf(stderr, "%s:%u: expected '<metric> <max|min> <value>'\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        check_t *c = &checks[check_count++];
+        snprintf(c->pattern, sizeof(c->pattern), "%s", pattern);
+        c->is_max = strcmp(kind, "max") == 0;
+        c->limit = limit;
+    }
+    fclose(f);
+    return true;
+}
+
+// Writes the results and checks as JSON; returns the number of failures
+static size_t write_json(FILE *out)
+{
+    size_t failures = 0;
+    fprintf(out, "{\n  \"suite\": \"hrm_host\",\n  \"run_seconds\": %d,\n  \"metrics\": {\n", RUN_SECONDS);
+    for (size_t i = 0; i < metric_count; i++) {
+        fprintf(out, "    \"%s\": %.6g%s\n", metrics_out[i].name, metrics_out[i].value,
+                i + 1 < metric_count ? "," : "");
+    }
+    fprintf(out, "  },\n  \"checks\": [\n");
+
+    bool first = true;
+    for (size_t c = 0; c < check_count; c++) {
+        check_t *check = &checks[c];
+        for (size_t i = 0; i < metric_count; i++) {
+            const metric_t *m = &metrics_out[i];
+            if (fnmatch(check->pattern, m->name, 0) != 0) {
+                continue;
+            }
+            bool pass = check->is_max ? m->value <= check->limit : m->value >= check->limit;
+            check->matched++;
+            check->failed += pass ? 0 : 1;
+            failures += pass ? 0 : 1;
+            fprintf(out, "%s    {\"metric\": \"%s\", \"%s\": %.6g, \"value\": %.6g, \"pass\": %s}", first ? "" : ",\n",
+                    m->name, check->is_max ? "max" : "min", check->limit, m->value, pass ? "true" : "false");
+            first = false;
+        }
+        if (check->matched == 0) {
+            // A threshold that matches nothing is a typo, not a pass
+            fprintf(out, "%s    {\"metric\": \"%s\", \"error\": \"no such metric\", \"pass\": false}",
+                    first ? "" : ",\n", check->pattern);
+            first = false;
+            failures++;
+        }
+    }
+    fprintf(out, "\n  ],\n  \"failures\": %lu\n}\n", (unsigned long)failures);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL;
+    const char *thresholds = SUITE_THRESHOLDS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thresholds = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-o results.json] [-t thresholds.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!load_thresholds(thresholds)) {
+        return 2;
+    }
+
+    // Heap in use before the runs, and the most it grew past that after any
+    // of them. Everything the runs use is static, as in the firmware.
+    host_log_level = HOST_LOG_ERROR;
+    size_t heap_start = mallinfo2().uordblks;
+    size_t heap_peak = 0;
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        run_rate(rates[r].code, rates[r].hz);
+        size_t in_use = mallinfo2().uordblks;
+        if (in_use > heap_start && in_use - heap_start > heap_peak) {
+            heap_peak = in_use - heap_start;
+        }
+    }
+    size_t heap_end = mallinfo2().uordblks;
+    put_memory(heap_end > heap_start ? heap_end - heap_start : 0, heap_peak);
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 2;
+        }
+    }
+    size_t failures = write_json(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    // Failed checks also go to stderr so they show in a CI log
+    for (size_t c = 0; c < check_count; c++) {
+        if (checks[c].failed || !checks[c].matched) {
+            fprintf(stderr, "FAIL %s %s %g (%lu of %lu metrics)\n", checks[c].pattern,
+                    checks[c].is_max ? "max" : "min", checks[c].limit, (unsigned long)checks[c].failed,
+                    (unsigned long)checks[c].matched);
+        }
+    }
+    fprintf(stderr, "%lu metrics, %lu checks, %lu failures\n", (unsigned long)metric_count,
+            (unsigned long)check_count, (unsigned long)failures);
+    return failures ? 1 : 0;
+}
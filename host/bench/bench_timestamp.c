@@ -0,0 +1,218 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "max30102.h"
+#include "acquisition.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Timestamp reconstruction against the simulated sensor's virtual clock.
+// The sim records when it converted every sample, with its oscillator off
+// by a set number of ppm. Each scenario drains through acquisition_drain()
+// in polling mode with wakeup jitter or in interrupt mode, optionally with
+// consumer stalls that overflow the FIFO. After the loop has settled, every
+// delivered timestamp is compared with the true conversion time.
+//
+// Reported: the constant offset (bus latency), the worst deviation from it,
+// the worst error of a one-second interval, the measured ODR error, and the
+// one-second interval error of two naive schemes: stamping every sample
+// with its drain time, and counting from the first sample at the nominal
+// rate.
+
+#define RUN_SECONDS         90
+#define SETTLE_SECONDS      30          // Loop lock time excluded from the errors
+#define MAX_SAMPLES         (RUN_SECONDS * 3200 + 1024)
+#define WAKE_LATENCY_NS     30000       // ISR + context switch before the task runs
+#define MAX_POLL_NS         25000000    // SAMPLE_INTERVAL_MS in main.c
+#define POLL_JITTER_NS      2000000     // Scheduling jitter added to each poll
+
+// Limits after settling. Polling only sees the FIFO every 25 ms, so its
+// offset wanders a little with the wakeup pattern; intervals, which is what
+// beat-to-beat timing needs, stay well under a millisecond.
+#define MAX_INTERVAL_US     500.0       // Worst one-second interval error, polling
+#define MAX_DEVIATION_US    2000.0      // Worst deviation from the constant offset, polling
+#define MAX_IRQ_ERROR_US    50.0        // Both limits in interrupt mode
+#define MAX_PPM_ERROR       50          // Measured versus actual ODR error
+
+typedef struct {
+    uint8_t rate_code;
+    uint32_t rate_hz;
+    int32_t ppm;
+    acquisition_mode_t mode;
+    int64_t stall_ns;           // Stall on every 20th wakeup
+} scenario_t;
+
+static int64_t truth_ns[MAX_SAMPLES];       // Conversion time by sensor index
+static int64_t stamp_ns[MAX_SAMPLES];       // Reconstructed, -1 if not delivered
+static int64_t drain_ns[MAX_SAMPLES];       // Drain time of the sample's read
+
+// Records conversion times; the red channel carries the index so delivered
+// samples can be matched to them
+static void truth_source(void *ctx, uint64_t index, int64_t time_ns, uint32_t *red, uint32_t *ir)
+{
+    (void)ctx;
+    if (index < MAX_SAMPLES) {
+        truth_ns[index] = time_ns;
+    }
+    *red = (uint32_t)(index & 0x03FFFF);
+    *ir = 100000;
+}
+
+static int run_scenario(const scenario_t *sc)
+{
+    static max30102_sim_t sim;
+    static max30102_dev_t dev;
+    static acquisition_t acq;
+    static max30102_sample_t samples[4 * MAX30102_FIFO_DEPTH];
+    
+    host_clock_reset();
+    max30102_sim_init(&sim);
+    max30102_sim_set_source(&sim, truth_source, NULL);
+    sim.odr_error_ppm = sc->ppm;
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    config.sample_rate = sc->rate_code;
+    config.sample_avg = MAX30102_SAMPLEAVG_1;
+    config.pulse_width = MAX30102_PULSEWIDTH_69;
+    if (max30102_init(&dev, &config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, sc->mode, &config) != MAX30102_OK) {
+        fprintf(stderr, "init failed\n");
+        exit(1);
+    }
+    
+    for (size_t i = 0; i < MAX_SAMPLES; i++) {
+        stamp_ns[i] = -1;
+    }
+    
+    uint32_t rng = 2463534242u;
+    int64_t poll_ns = (int64_t)acquisition_poll_interval_ms(&config) * 1000000;
+    if (poll_ns == 0 || poll_ns > MAX_POLL_NS) {
+        poll_ns = MAX_POLL_NS;
+    }
+    int64_t start_ns = host_clock_now_ns();
+    int64_t end_ns = start_ns + (int64_t)RUN_SECONDS * 1000000000;
+    int64_t next_wake_ns = start_ns + poll_ns;
+    bool have_offset = false;
+    int64_t offset = 0;
+    uint32_t wakeups = 0;
+    
+    while (host_clock_now_ns() < end_ns) {
+        if (sc->mode == ACQUISITION_MODE_INTERRUPT) {
+            int64_t event_ns = max30102_sim_next_interrupt_ns(&sim);
+            if (event_ns >= end_ns) {
+                break;
+            }
+            host_clock_advance_to_ns(event_ns + WAKE_LATENCY_NS);
+        } else {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            host_clock_advance_to_ns(next_wake_ns + rng % POLL_JITTER_NS);
+            next_wake_ns += poll_ns;
+        }
+        wakeups++;
+        
+        int64_t drain_time = host_clock_now_ns();
+        size_t count = 0;
+        acquisition_drain(&acq, 0, samples, sizeof(samples) / sizeof(samples[0]), &count, NULL);
+        for (size_t i = 0; i < count; i++) {
+            if (!have_offset) {
+                offset = (int64_t)samples[i].red - samples[i].sequence;
+                have_offset = true;
+            }
+            int64_t index = (int64_t)samples[i].sequence + offset;
+            if (index >= 0 && index < MAX_SAMPLES) {
+                stamp_ns[index] = samples[i].timestamp_us * 1000;
+                drain_ns[index] = drain_time;
+            }
+        }
+        
+        if (sc->stall_ns > 0 && wakeups % 20 == 0) {
+            host_clock_advance_ns(sc->stall_ns);
+        }
+    }
+    
+    // Offset and deviation over samples delivered after settling
+    size_t first = 0;
+    while (first < MAX_SAMPLES && truth_ns[first] < start_ns + (int64_t)SETTLE_SECONDS * 1000000000) {
+        first++;
+    }
+    size_t last = first;
+    double sum = 0.0;
+    size_t delivered = 0;
+    for (size_t i = first; i < MAX_SAMPLES && truth_ns[i] > 0 && truth_ns[i] < end_ns; i++) {
+        if (stamp_ns[i] >= 0) {
+            sum += (double)(stamp_ns[i] - truth_ns[i]);
+            delivered++;
+        }
+        last = i;
+    }
+    double bias = delivered ? sum / delivered : 0.0;
+    double deviation = 0.0, interval = 0.0, drain_interval = 0.0, nominal_interval = 0.0;
+    size_t step = sc->rate_hz;
+    double nominal_ns = 1e9 / sc->rate_hz;
+    for (size_t i = first; i <= last; i++) {
+        if (stamp_ns[i] < 0) {
+            continue;
+        }
+        deviation = fmax(deviation, fabs((double)(stamp_ns[i] - truth_ns[i]) - bias));
+        if (i + step <= last && stamp_ns[i + step] >= 0) {
+            double actual = (double)(truth_ns[i + step] - truth_ns[i]);
+            interval = fmax(interval, fabs((double)(stamp_ns[i + step] - stamp_ns[i]) - actual));
+            drain_interval = fmax(drain_interval, fabs((double)(drain_ns[i + step] - drain_ns[i]) - actual));
+            nominal_interval = fmax(nominal_interval, fabs(step * nominal_ns - actual));
+        }
+    }
+    
+    acquisition_stats_t stats;
+    acquisition_get_stats(&acq, &stats);
+    bool irq = sc->mode == ACQUISITION_MODE_INTERRUPT;
+    bool ok = delivered > 0 &&
+              interval / 1000.0 <= (irq ? MAX_IRQ_ERROR_US : MAX_INTERVAL_US) &&
+              deviation / 1000.0 <= (irq ? MAX_IRQ_ERROR_US : MAX_DEVIATION_US) &&
+              labs((long)stats.clock.odr_error_ppm - sc->ppm) <= MAX_PPM_ERROR;
+    
+    printf("%5lu %6ld %-9s %6.0f %8lu %8.1f %8.1f %8.1f %7ld %7ld %8.1f %9.1f %5lu %5s\n",
+           (unsigned long)sc->rate_hz, (long)sc->ppm,
+           irq ? "interrupt" : "polling",
+           sc->stall_ns / 1e6, (unsigned long)stats.samples_lost,
+           bias / 1000.0, deviation / 1000.0, interval / 1000.0,
+           (long)stats.clock.odr_error_ppm, (long)stats.clock.odr_error_ppm - sc->ppm,
+           drain_interval / 1000.0, nominal_interval / 1000.0,
+           (unsigned long)stats.clock.resyncs, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const scenario_t scenarios[] = {
+        {MAX30102_SAMPLERATE_100, 100, 0, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_100, 100, 0, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_100, 100, 15000, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_100, 100, 15000, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_100, 100, -20000, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_100, 100, -20000, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_50, 50, 8000, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_50, 50, 8000, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_400, 400, -5000, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_400, 400, -5000, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_3200, 3200, 12000, ACQUISITION_MODE_POLLING, 0},
+        {MAX30102_SAMPLERATE_3200, 3200, 12000, ACQUISITION_MODE_INTERRUPT, 0},
+        {MAX30102_SAMPLERATE_400, 400, 10000, ACQUISITION_MODE_INTERRUPT, 100000000},
+        {MAX30102_SAMPLERATE_100, 100, -10000, ACQUISITION_MODE_POLLING, 300000000},
+    };
+    int failures = 0;
+    
+    host_log_level = HOST_LOG_NONE;
+    printf("%d s per run, errors after %d s, 1 s intervals\n", RUN_SECONDS, SETTLE_SECONDS);
+    printf("%5s %6s %-9s %6s %8s %8s %8s %8s %7s %7s %8s %9s %5s %5s\n",
+           "rate", "ppm", "mode", "stall", "lost", "bias_us", "dev_us", "ivl_us", "est_ppm", "ppm_err",
+           "drain_us", "nominal_us", "resync", "check");
+    
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failures += run_scenario(&scenarios[i]);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "max30102.h"
+#include "pipeline.h"
+#include "warm_profile.h"
+#include "capture.h"
+#include "max30102_sim.h"
+#include "host_port.h"
+
+// Cold against warm start. A first session runs a trace through the
+// pipeline, quality gate on, as the firmware does, and saves a warm
+// profile at its end. The profile is serialized to bytes, standing in for
+// NVS. The board then reboots at BOOTS points spread over the rest of the
+// trace, each at a different pulse phase. Each boot starts once from cold
+// and once with the decoded profile restored. Reports the time from the
+// first sample to the first beat with a BPM, and that BPM's error.
+// Warm boots on a different heart rate than the profile's show what a
+// stale prior costs.
+//
+// The sensor side runs on the simulated sensor. After an MCU reset the
+// sensor keeps power and its configuration. The bench compares a cold
+// max30102_init_fast() with one after max30102_assume_config(), and
+// covers a sensor that lost power and one that holds another
+// configuration.
+//
+//   bench_warmstart               synthetic traces
+//   bench_warmstart capture.hrm   adds a recorded capture: the profile from
+//                                 its first half, boots in the second
+
+#define SESSION_SECONDS     60          // First session, before the reboot
+#define BOOTS               10
+#define BOOT_SPACING_MS     1370        // Between reboot points, off any beat multiple
+#define BOOT_SECONDS        20          // Give up on a lock after this long
+#define MAX_RATE_HZ         400
+#define MAX_SAMPLES         ((SESSION_SECONDS + BOOTS * 2 + BOOT_SECONDS) * MAX_RATE_HZ)
+#define DRAIN_BLOCK         MAX30102_FIFO_DEPTH
+
+#define MIN_SAVED_S         1.0         // Warm must lock this much sooner on average
+#define MAX_BPM_ERROR       5.0         // First reported BPM against the true rate, or cold's if worse
+
+typedef struct {
+    double time_sum_s;
+    double time_max_s;
+    double error_sum;
+    double error_max;
+    uint32_t locked;
+    uint32_t warm_locks;
+    uint32_t priors_rejected;
+} boot_result_t;
+
+static max30102_sample_t trace[MAX_SAMPLES];
+static size_t trace_count;
+static pipeline_t pipeline;
+
+// First locked beat of the current boot, from the text output
+static bool beat_found;
+static double beat_bpm;
+
+static int64_t clock_us(void)
+{
+    return host_clock_now_ns() / 1000;
+}
+
+static size_t generate(uint32_t rate_hz, double session_bpm, double boot_bpm)
+{
+    max30102_sim_ppg_t ppg = {
+        .bpm = session_bpm, .red_dc = 100000.0, .red_ac = 1200.0,
+        .ir_dc = 120000.0, .ir_ac = 2400.0, .noise = 20.0, .seed = 21,
+    };
+    size_t session = (size_t)SESSION_SECONDS * rate_hz;
+    size_t count = (size_t)(SESSION_SECONDS + BOOTS * 2 + BOOT_SECONDS) * rate_hz;
+
+    for (size_t i = 0; i < count && i < MAX_SAMPLES; i++) {
+        if (i == session) {
+            ppg.bpm = boot_bpm;
+        }
+        int64_t t = (int64_t)i * 1000000000 / rate_hz;
+        max30102_sim_ppg_source(&ppg, i, t, &trace[i].red, &trace[i].ir);
+        trace[i].sequence = (uint32_t)i;
+        trace[i].valid = true;
+    }
+    return count;
+}
+
+static void sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    char line[PIPELINE_TEXT_LINE];
+    if (len >= sizeof(line) || beat_found) {
+        return;
+    }
+    memcpy(line, data, len);
+    line[len] = '\0';
+
+    unsigned long sequence;
+    unsigned int ms, bpm, bpm_frac;
+    if (sscanf(line, "[%lu] Beat: interval %u ms, %u.%u BPM", &sequence, &ms, &bpm, &bpm_frac) == 4 && bpm > 0) {
+        beat_found = true;
+        beat_bpm = bpm + bpm_frac / 10.0;
+    }
+}
+
+static void start_pipeline(uint32_t rate_hz)
+{
+    pipeline_config_t pc = {
+        .output = PIPELINE_OUTPUT_TEXT,
+        .sample_rate_hz = rate_hz,
+        .write = sink_write,
+        .clock_us = clock_us,
+        .adc_range = MAX30102_ADCRANGE_4096,
+        .quality_gate = true,
+    };
+    pipeline_init(&pipeline, &pc);
+}
+
+// Feeds samples [first, first + count) renumbered from 0, as after a boot,
+// in FIFO-sized drains. Returns the samples fed before the first locked
+// beat came out, or 0 if none did.
+static size_t feed(size_t first, size_t count, bool stop_at_lock)
+{
+    max30102_sample_t block[DRAIN_BLOCK];
+
+    beat_found = false;
+    for (size_t done = 0; done < count;) {
+        size_t n = count - done < DRAIN_BLOCK ? count - done : DRAIN_BLOCK;
+        for (size_t i = 0; i < n; i++) {
+            block[i] = trace[first + done + i];
+            block[i].sequence = (uint32_t)(done + i);
+        }
+        pipeline_acquire(&pipeline, block, n);
+        while (pipeline_dsp_step(&pipeline) > 0) {
+            while (pipeline_output_step(&pipeline) > 0) {
+            }
+        }
+        while (pipeline_output_step(&pipeline) > 0) {
+        }
+        done += n;
+
+        if (beat_found && stop_at_lock) {
+            return done;
+        }
+    }
+    return 0;
+}
+
+// Runs the first session and returns its profile, through the byte form
+static bool session_profile(uint32_t rate_hz, size_t session_samples, const max30102_config_t *config,
+                            warm_profile_t *profile)
+{
+    uint8_t nvs[WARM_PROFILE_SIZE];
+    warm_profile_t saved = {
+        .base_fingerprint = warm_profile_fingerprint(config),
+    };
+
+    start_pipeline(rate_hz);
+    feed(0, session_samples, false);
+    if (!pipeline_get_warm_state(&pipeline, &saved.hr)) {
+        return false;
+    }
+    size_t len = warm_profile_encode(&saved, nvs, sizeof(nvs));
+    return warm_profile_decode(nvs, len, profile) == MAX30102_OK &&
+           memcmp(&saved.hr, &profile->hr, sizeof(saved.hr)) == 0;
+}
+
+static void run_boots(uint32_t rate_hz, size_t session_samples, const warm_profile_t *profile, double true_bpm,
+                      boot_result_t *cold, boot_result_t *warm)
+{
+    memset(cold, 0, sizeof(*cold));
+    memset(warm, 0, sizeof(*warm));
+    size_t boot_samples = (size_t)BOOT_SECONDS * rate_hz;
+
+    for (int b = 0; b < BOOTS; b++) {
+        size_t first = session_samples + (size_t)b * BOOT_SPACING_MS * rate_hz / 1000;
+        if (first + boot_samples > trace_count) {
+            boot_samples = trace_count - first;
+        }
+
+        for (int w = 0; w < 2; w++) {
+            boot_result_t *res = w ? warm : cold;
+            start_pipeline(rate_hz);
+            if (w) {
+                hr_detector_restore(&pipeline.hr, &profile->hr);
+            }
+            size_t samples = feed(first, boot_samples, true);
+
+            hr_stats_t stats;
+            hr_detector_get_stats(&pipeline.hr, &stats);
+            res->warm_locks += stats.warm_locks;
+            res->priors_rejected += stats.priors_rejected;
+            if (samples == 0) {
+                continue;
+            }
+            double seconds = (double)samples / rate_hz;
+            res->locked++;
+            res->time_sum_s += seconds;
+            if (seconds > res->time_max_s) {
+                res->time_max_s = seconds;
+            }
+            if (true_bpm > 0.0) {
+                double error = fabs(beat_bpm - true_bpm);
+                res->error_sum += error;
+                if (error > res->error_max) {
+                    res->error_max = error;
+                }
+            }
+        }
+    }
+}
+
+static void print_boots(const char *trace_name, uint32_t rate_hz, const char *mode, const boot_result_t *res,
+                        bool have_truth)
+{
+    printf("%-12s %5lu %-5s %6lu/%d %8.2f %8.2f", trace_name, (unsigned long)rate_hz, mode,
+           (unsigned long)res->locked, BOOTS, res->locked ? res->time_sum_s / res->locked : 0.0, res->time_max_s);
+    if (have_truth) {
+        printf(" %8.2f %8.2f", res->locked ? res->error_sum / res->locked : 0.0, res->error_max);
+    } else {
+        printf(" %8s %8s", "-", "-");
+    }
+    printf(" %6lu %6lu\n", (unsigned long)res->warm_locks, (unsigned long)res->priors_rejected);
+}
+
+static double mean_time(const boot_result_t *res)
+{
+    return res->locked ? res->time_sum_s / res->locked : 1e9;
+}
+
+// Compares the sim's registers with what 'config' asks for
+static bool registers_match(const max30102_sim_t *sim, const max30102_config_t *config)
+{
+    uint8_t fifo_config = (config->sample_avg & 0xE0) |
+                          (config->rollover_enable ? MAX30102_ROLLOVER_EN : 0) |
+                          (config->almost_full_threshold & MAX30102_A_FULL_MASK);
+    uint8_t spo2_config = (config->adc_range & 0x60) | (config->sample_rate & 0x1C) | (config->pulse_width & 0x03);
+
+    return sim->regs[MAX30102_REG_FIFO_CONFIG] == fifo_config &&
+           sim->regs[MAX30102_REG_MODE_CONFIG] == config->mode &&
+           sim->regs[MAX30102_REG_SPO2_CONFIG] == spo2_config &&
+           sim->regs[MAX30102_REG_LED1_PA] == config->led1_power &&
+           sim->regs[MAX30102_REG_LED2_PA] == config->led2_power;
+}
+
+// Sensor init after an MCU reboot, cold and warm
+static int bench_sensor_init(void)
+{
+    static max30102_sim_t sim;
+    static max30102_dev_t dev;
+    int failures = 0;
+
+    max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+    max30102_config_t other = config;
+    other.led1_power = other.led2_power = 0x3F;
+
+    static const struct {
+        const char *name;
+        bool warm;
+        bool power_cycle;       // The sensor lost power too
+        bool other_config;      // The boot's configuration differs from the part's
+        bool expect_skip;
+    } cases[] = {
+        {"cold", false, false, false, false},
+        {"warm", true, false, false, true},
+        {"warm, power lost", true, true, false, false},
+        {"warm, other config", true, false, true, false},
+    };
+
+    printf("%-20s %8s %6s %6s %6s\n", "sensor init", "init_us", "trans", "bytes", "reset");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        host_clock_reset();
+        max30102_sim_init(&sim);
+
+        // The previous boot left the part running 'config'
+        memset(&dev, 0, sizeof(dev));
+        max30102_set_transport(&dev, max30102_sim_transport(&sim));
+        if (max30102_init_fast(&dev, &config) != MAX30102_OK) {
+            fprintf(stderr, "FAIL: first boot init\n");
+            return 1;
+        }
+        host_clock_advance_ns(500000000);
+        if (cases[c].power_cycle) {
+            max30102_sim_init(&sim);
+        }
+
+        // Reboot: the driver state starts from zero
+        const max30102_config_t *boot_config = cases[c].other_config ? &other : &config;
+        memset(&dev, 0, sizeof(dev));
+        max30102_set_transport(&dev, max30102_sim_transport(&sim));
+        if (cases[c].warm) {
+            max30102_assume_config(&dev, boot_config);
+        }
+        max30102_err_t err = max30102_init_fast(&dev, boot_config);
+
+        max30102_init_stats_t init;
+        max30102_get_init_stats(&dev, &init);
+        printf("%-20s %8lu %6lu %6lu %6s\n", cases[c].name, (unsigned long)init.init_us,
+               (unsigned long)init.transactions, (unsigned long)init.bytes, init.reset_skipped ? "no" : "yes");
+
+        if (err != MAX30102_OK || !registers_match(&sim, boot_config) || init.reset_skipped != cases[c].expect_skip) {
+            fprintf(stderr, "FAIL: %s: err %d, registers %s, reset %s\n", cases[c].name, err,
+                    registers_match(&sim, boot_config) ? "ok" : "wrong", init.reset_skipped ? "skipped" : "done");
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Round trip, and rejection of damaged or foreign profiles
+static int bench_profile_codec(void)
+{
+    int failures = 0;
+    uint8_t buf[WARM_PROFILE_SIZE];
+    warm_profile_t profile = {
+        .base_fingerprint = warm_profile_fingerprint(&MAX30102_DEFAULT_CONFIG),
+        .boot_count = 41,
+        .hr = {.interval_us = 833333, .amp = 12345},
+    };
+    warm_profile_t out;
+
+    size_t len = warm_profile_encode(&profile, buf, sizeof(buf));
+    if (len != WARM_PROFILE_SIZE || warm_profile_decode(buf, len, &out) != MAX30102_OK ||
+        out.hr.interval_us != profile.hr.interval_us || out.hr.amp != profile.hr.amp ||
+        out.base_fingerprint != profile.base_fingerprint || out.boot_count != profile.boot_count) {
+        fprintf(stderr, "FAIL: profile round trip\n");
+        failures++;
+    }
+
+    // Every single-bit flip must be caught
+    uint32_t accepted = 0;
+    for (size_t i = 0; i < len * 8; i++) {
+        buf[i / 8] ^= (uint8_t)(1u << (i % 8));
+        accepted += (warm_profile_decode(buf, len, &out) == MAX30102_OK);
+        buf[i / 8] ^= (uint8_t)(1u << (i % 8));
+    }
+
+    uint8_t other_version[WARM_PROFILE_SIZE];
+    memcpy(other_version, buf, len);
+    other_version[4] = WARM_PROFILE_VERSION + 1;
+    bool version_rejected = warm_profile_decode(other_version, len, &out) != MAX30102_OK;
+    bool truncated_rejected = warm_profile_decode(buf, len - 1, &out) != MAX30102_OK;
+
+    printf("profile: %zu bytes, %lu of %zu bit flips accepted, other version %s, truncated %s\n", len,
+           (unsigned long)accepted, len * 8, version_rejected ? "rejected" : "ACCEPTED",
+           truncated_rejected ? "rejected" : "ACCEPTED");
+    if (accepted || !version_rejected || !truncated_rejected) {
+        fprintf(stderr, "FAIL: damaged profile accepted\n");
+        failures++;
+    }
+
+    // Usable for WARM_PROFILE_MAX_AGE boots after the one that saved it,
+    // and never once the boot counter went backwards
+    bool fresh = warm_profile_fresh(&profile, profile.boot_count) &&
+                 warm_profile_fresh(&profile, profile.boot_count + WARM_PROFILE_MAX_AGE);
+    bool stale_rejected = !warm_profile_fresh(&profile, profile.boot_count + WARM_PROFILE_MAX_AGE + 1);
+    bool lost_rejected = !warm_profile_fresh(&profile, 1);
+    printf("profile age: fresh for %d boots %s, older %s, counter lost %s\n", WARM_PROFILE_MAX_AGE,
+           fresh ? "yes" : "NO", stale_rejected ? "rejected" : "ACCEPTED", lost_rejected ? "rejected" : "ACCEPTED");
+    if (!fresh || !stale_rejected || !lost_rejected) {
+        fprintf(stderr, "FAIL: profile age\n");
+        failures++;
+    }
+    return failures;
+}
+
+// A restored prior must not survive the quality gate closing before it was
+// used: no finger at boot, then a finger with another heart rate
+static int bench_prior_reset(void)
+{
+    const hr_warm_state_t state = {.interval_us = 833333, .amp = 12345};
+
+    start_pipeline(100);
+    hr_detector_restore(&pipeline.hr, &state);
+    bool armed = pipeline.hr.prior_q8 != 0;
+
+    max30102_sample_t block[DRAIN_BLOCK] = {0};
+    for (size_t done = 0; done < 4 * 100; done += DRAIN_BLOCK) {
+        for (size_t i = 0; i < DRAIN_BLOCK; i++) {
+            block[i].red = 1000;
+            block[i].ir = 1000;
+            block[i].sequence = (uint32_t)(done + i);
+            block[i].valid = true;
+        }
+        pipeline_acquire(&pipeline, block, DRAIN_BLOCK);
+        while (pipeline_dsp_step(&pipeline) > 0) {
+            while (pipeline_output_step(&pipeline) > 0) {
+            }
+        }
+    }
+
+    signal_quality_stats_t sq;
+    signal_quality_get_stats(&pipeline.quality, &sq);
+    bool cleared = pipeline.hr.prior_q8 == 0;
+    printf("prior after gate close: %s (armed %s, gate closes %lu)\n", cleared ? "cleared" : "KEPT",
+           armed ? "yes" : "no", (unsigned long)sq.gate_closes);
+    if (!armed || sq.gate_closes == 0 || !cleared) {
+        fprintf(stderr, "FAIL: stale prior kept\n");
+        return 1;
+    }
+    return 0;
+}
+
+static size_t file_read(void *ctx, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, (FILE *)ctx);
+}
+
+// Samples of a recorded capture, in order, and its FIFO rate
+static size_t load_capture(const char *path, uint32_t *rate_hz)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    static capture_reader_t reader;
+    static capture_event_t event;
+    size_t count = 0;
+    *rate_hz = 0;
+    if (capture_reader_init(&reader, file_read, f) != MAX30102_OK) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(f);
+        return 0;
+    }
+    while (count < MAX_SAMPLES && capture_reader_next(&reader, &event) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG && *rate_hz == 0) {
+            *rate_hz = event.config.fifo_rate_hz;
+        }
+        if (event.type != CAPTURE_RECORD_SAMPLES) {
+            continue;
+        }
+        for (size_t i = 0; i < event.block.count && count < MAX_SAMPLES; i++) {
+            trace[count++] = event.block.samples[i];
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t rates_hz[] = {50, 100, 400};
+    static const struct {
+        const char *name;
+        double session_bpm;
+        double boot_bpm;
+    } scenarios[] = {
+        {"55bpm", 55.0, 55.0},
+        {"72bpm", 72.0, 72.0},
+        {"110bpm", 110.0, 110.0},
+        {"72->110bpm", 72.0, 110.0},    // Prior far off: must be rejected
+    };
+    int failures = 0;
+
+    host_log_level = HOST_LOG_NONE;
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [capture.hrm]\n", argv[0]);
+        return 2;
+    }
+
+    failures += bench_sensor_init();
+    printf("\n");
+    failures += bench_profile_codec();
+    failures += bench_prior_reset();
+    printf("\n");
+
+    printf("%-12s %5s %-5s %8s %8s %8s %8s %8s %6s %6s\n", "trace", "rate", "start", "locked", "avg_s",
+           "max_s", "avg_err", "max_err", "warm", "reject");
+
+    for (size_t r = 0; r < sizeof(rates_hz) / sizeof(rates_hz[0]); r++) {
+        for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+            uint32_t rate_hz = rates_hz[r];
+            size_t session_samples = (size_t)SESSION_SECONDS * rate_hz;
+            max30102_config_t config = MAX30102_DEFAULT_CONFIG;
+            warm_profile_t profile;
+
+            trace_count = generate(rate_hz, scenarios[s].session_bpm, scenarios[s].boot_bpm);
+            if (!session_profile(rate_hz, session_samples, &config, &profile)) {
+                fprintf(stderr, "FAIL: %s %lu Hz: no profile after the first session\n", scenarios[s].name,
+                        (unsigned long)rate_hz);
+                failures++;
+                continue;
+            }
+
+            boot_result_t cold, warm;
+            run_boots(rate_hz, session_samples, &profile, scenarios[s].boot_bpm, &cold, &warm);
+            print_boots(scenarios[s].name, rate_hz, "cold", &cold, true);
+            print_boots(scenarios[s].name, rate_hz, "warm", &warm, true);
+
+            bool matched = scenarios[s].session_bpm == scenarios[s].boot_bpm;
+            if (cold.locked < BOOTS || warm.locked < BOOTS ||
+                warm.error_max > fmax(MAX_BPM_ERROR, cold.error_max)) {
+                fprintf(stderr, "FAIL: %s %lu Hz: %lu/%lu boots locked, warm max error %.2f BPM\n",
+                        scenarios[s].name, (unsigned long)rate_hz, (unsigned long)cold.locked,
+                        (unsigned long)warm.locked, warm.error_max);
+                failures++;
+            }
+            if (matched && mean_time(&warm) > mean_time(&cold) - MIN_SAVED_S) {
+                fprintf(stderr, "FAIL: %s %lu Hz: warm start %.2f s, cold %.2f s\n", scenarios[s].name,
+                        (unsigned long)rate_hz, mean_time(&warm), mean_time(&cold));
+                failures++;
+            }
+            if (!matched && warm.warm_locks > 0) {
+                fprintf(stderr, "FAIL: %s %lu Hz: stale prior confirmed %lu times\n", scenarios[s].name,
+                        (unsigned long)rate_hz, (unsigned long)warm.warm_locks);
+                failures++;
+            }
+        }
+    }
+
+    if (argc == 2) {
+        uint32_t rate_hz = 0;
+        trace_count = load_capture(argv[1], &rate_hz);
+        size_t session_samples = trace_count / 2;
+        warm_profile_t profile;
+        if (trace_count == 0 || rate_hz == 0) {
+            failures++;
+        } else if (!session_profile(rate_hz, session_samples, &MAX30102_DEFAULT_CONFIG, &profile)) {
+            printf("%-12s %5lu: detector never locked in the first half, no profile\n", "capture",
+                   (unsigned long)rate_hz);
+        } else {
+            boot_result_t cold, warm;
+            run_boots(rate_hz, session_samples, &profile, 0.0, &cold, &warm);
+            print_boots("capture", rate_hz, "cold", &cold, false);
+            print_boots("capture", rate_hz, "warm", &warm, false);
+        }
+    }
+
+    printf("\ntime: first sample after the boot to the first beat with a BPM, in %d-sample drains\n", DRAIN_BLOCK);
+    printf("warm: BPM reported early on a confirmed prior, reject: priors the first interval disagreed with\n");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+// Host stand-in for ESP-IDF logging
+
+#include <stdio.h>
+#include "host_port.h"
+
+#define HOST_LOG(level, letter, tag, format, ...) do {                          \
+        if (host_log_level >= (level)) {                                        \
+            fprintf(stderr, letter " (%lld) %s: " format "\n",                  \
+                    (long long)(host_clock_now_ns() / 1000000), tag, ##__VA_ARGS__); \
+        }                                                                       \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(HOST_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(HOST_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(HOST_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
+
+#endif // ESP_LOG_H
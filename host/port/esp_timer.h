@@ -0,0 +1,14 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+// Host stand-in for esp_timer, backed by the virtual clock
+
+#include <stdint.h>
+#include "host_port.h"
+
+static inline int64_t esp_timer_get_time(void)
+{
+    return host_clock_now_ns() / 1000;
+}
+
+#endif // ESP_TIMER_H
@@ -0,0 +1,18 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+// Host stand-in for the FreeRTOS subset used by the driver
+
+#include <stdint.h>
+
+#define configTICK_RATE_HZ      100     // Matches CONFIG_FREERTOS_HZ in sdkconfig
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#endif // FREERTOS_H
@@ -0,0 +1,11 @@
+#ifndef TASK_H
+#define TASK_H
+
+// Host stand-in: delays advance the virtual clock instead of blocking
+
+#include "freertos/FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#endif // TASK_H
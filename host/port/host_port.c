@@ -0,0 +1,41 @@
+#include "host_port.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+int host_log_level = HOST_LOG_WARN;
+
+static int64_t clock_ns = 0;
+
+int64_t host_clock_now_ns(void)
+{
+    return clock_ns;
+}
+
+void host_clock_advance_ns(int64_t ns)
+{
+    if (ns > 0) {
+        clock_ns += ns;
+    }
+}
+
+void host_clock_advance_to_ns(int64_t ns)
+{
+    if (ns > clock_ns) {
+        clock_ns = ns;
+    }
+}
+
+void host_clock_reset(void)
+{
+    clock_ns = 0;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_clock_advance_ns((int64_t)ticks * (1000000000 / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(clock_ns / (1000000000 / configTICK_RATE_HZ));
+}
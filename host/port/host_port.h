@@ -0,0 +1,22 @@
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+#include <stdint.h>
+
+// Virtual clock shared by the ESP-IDF stand-ins and the simulated sensor.
+// Nothing advances it except explicit calls, vTaskDelay() and simulated bus
+// transfers, so every run is deterministic.
+int64_t host_clock_now_ns(void);
+void host_clock_advance_ns(int64_t ns);
+void host_clock_advance_to_ns(int64_t ns);
+void host_clock_reset(void);
+
+// Log level for the ESP_LOGx stand-ins
+#define HOST_LOG_NONE   0
+#define HOST_LOG_ERROR  1
+#define HOST_LOG_WARN   2
+#define HOST_LOG_INFO   3
+
+extern int host_log_level;
+
+#endif // HOST_PORT_H
@@ -0,0 +1,114 @@
+#include "capture_source.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILL    (1u << 24)  // Longest run of missing samples to fill in
+
+// Private function prototypes
+static bool source_reserve(capture_source_t *src, size_t count, size_t *capacity);
+
+static bool source_reserve(capture_source_t *src, size_t count, size_t *capacity)
+{
+    if (count <= *capacity) {
+        return true;
+    }
+    size_t grown = *capacity ? *capacity * 2 : 4096;
+    while (grown < count) {
+        grown *= 2;
+    }
+    uint32_t *red = realloc(src->red, grown * sizeof(*red));
+    if (!red) {
+        return false;
+    }
+    src->red = red;
+    uint32_t *ir = realloc(src->ir, grown * sizeof(*ir));
+    if (!ir) {
+        return false;
+    }
+    src->ir = ir;
+    *capacity = grown;
+    return true;
+}
+
+// Reads the whole capture into memory. Returns the reader's error if a
+// record is corrupt; a truncated capture loads up to its last full record.
+max30102_err_t capture_source_load(capture_source_t *src, capture_reader_t *reader)
+{
+    memset(src, 0, sizeof(*src));
+    static capture_event_t event;
+    size_t capacity = 0;
+    size_t session_base = 0;
+    uint32_t session_first = 0;
+    bool session_started = false;
+    
+    max30102_err_t err;
+    while ((err = capture_reader_next(reader, &event)) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG) {
+            if (!src->has_config) {
+                src->config = event.config.config;
+                src->fifo_rate_hz = event.config.fifo_rate_hz;
+                src->has_config = true;
+            }
+            // A config after samples means the sensor was set up again
+            if (session_started) {
+                session_base = src->count;
+                session_started = false;
+            }
+            continue;
+        }
+        if (event.type != CAPTURE_RECORD_SAMPLES) {
+            continue;
+        }
+        
+        for (size_t i = 0; i < event.block.count; i++) {
+            const max30102_sample_t *s = &event.block.samples[i];
+            if (!session_started) {
+                session_first = s->sequence;
+                session_started = true;
+            }
+            size_t index = session_base + (size_t)(s->sequence - session_first);
+            if (index < src->count) {
+                continue;   // Out of order; keep the first copy
+            }
+            if (index - src->count > MAX_FILL || !source_reserve(src, index + 1, &capacity)) {
+                capture_source_free(src);
+                return MAX30102_ERR_INVALID_PARAM;
+            }
+            while (src->count < index) {
+                src->red[src->count] = src->count ? src->red[src->count - 1] : s->red;
+                src->ir[src->count] = src->count ? src->ir[src->count - 1] : s->ir;
+                src->count++;
+            }
+            src->red[src->count] = s->red;
+            src->ir[src->count] = s->ir;
+            src->count++;
+            src->recorded++;
+        }
+    }
+    
+    capture_reader_get_stats(reader, &src->stats);
+    return (err == MAX30102_ERR_NO_DATA) ? MAX30102_OK : err;
+}
+
+void capture_source_free(capture_source_t *src)
+{
+    free(src->red);
+    free(src->ir);
+    src->red = NULL;
+    src->ir = NULL;
+    src->count = 0;
+}
+
+void capture_source_sample(void *ctx, uint64_t index, int64_t time_ns, uint32_t *red, uint32_t *ir)
+{
+    (void)time_ns;
+    const capture_source_t *src = ctx;
+    if (src->count == 0) {
+        *red = 0;
+        *ir = 0;
+        return;
+    }
+    size_t i = (index < src->count) ? (size_t)index : src->count - 1;
+    *red = src->red[i];
+    *ir = src->ir[i];
+}
@@ -0,0 +1,33 @@
+#ifndef CAPTURE_SOURCE_H
+#define CAPTURE_SOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "capture.h"
+
+// Sample source for the simulated sensor that plays back a capture, so a
+// recording runs through the driver and acquisition again. Sample n of the
+// sim is the n-th sequence number of the capture. Samples the capture lost
+// repeat the one before them, and a capture that restarted its sequence
+// numbers after a sensor reset continues where the previous run ended.
+// Past the end the last sample repeats.
+
+typedef struct {
+    uint32_t *red;
+    uint32_t *ir;
+    size_t count;               // Samples, including filled-in gaps
+    size_t recorded;            // Samples the capture actually holds
+    max30102_config_t config;   // First config record
+    uint32_t fifo_rate_hz;
+    bool has_config;
+    capture_stats_t stats;      // Reader counters after loading
+} capture_source_t;
+
+// Function prototypes
+max30102_err_t capture_source_load(capture_source_t *src, capture_reader_t *reader);
+void capture_source_free(capture_source_t *src);
+void capture_source_sample(void *ctx, uint64_t index, int64_t time_ns, uint32_t *red, uint32_t *ir);
+
+#endif // CAPTURE_SOURCE_H
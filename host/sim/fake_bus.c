@@ -0,0 +1,129 @@
+#include "fake_bus.h"
+#include <time.h>
+
+// Private function prototypes
+static void fake_bus_wait(int64_t ns);
+static uint8_t fake_bus_read_byte(fake_bus_t *bus);
+static max30102_err_t fake_bus_write(void *ctx, const uint8_t *data, size_t len);
+static max30102_err_t fake_bus_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                          uint8_t *rx, size_t rx_len);
+
+void fake_bus_init(fake_bus_t *bus, uint32_t bus_hz, int64_t transaction_ns, uint8_t fifo_level)
+{
+    *bus = (fake_bus_t){
+        .bus_hz = bus_hz,
+        .transaction_ns = transaction_ns,
+        .fifo_level = fifo_level > MAX30102_FIFO_DEPTH ? MAX30102_FIFO_DEPTH : fifo_level,
+        .transport = {
+            .write = fake_bus_write,
+            .write_read = fake_bus_write_read,
+            .ctx = bus,
+        },
+    };
+}
+
+const max30102_transport_t *fake_bus_transport(fake_bus_t *bus)
+{
+    return &bus->transport;
+}
+
+// Same wire model as the simulator: 9 bits per byte including the address
+// byte of each phase, plus start and stop (or repeated start) per phase
+int64_t fake_bus_transfer_ns(const fake_bus_t *bus, size_t bytes, size_t address_phases)
+{
+    uint64_t bits = (uint64_t)(bytes + address_phases) * 9 + 2 * address_phases;
+    return (int64_t)(bits * 1000000000ull / bus->bus_hz) + bus->transaction_ns;
+}
+
+// Red and IR values of the sample carrying 'counter'
+uint32_t fake_bus_sample_red(uint32_t counter)
+{
+    return counter & 0x03FFFF;
+}
+
+uint32_t fake_bus_sample_ir(uint32_t counter)
+{
+    return (counter * 7 + 3) & 0x03FFFF;
+}
+
+// Sleeps until 'ns' after now
+static void fake_bus_wait(int64_t ns)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int64_t nsec = deadline.tv_nsec + ns;
+    deadline.tv_sec += nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0) {
+        // Interrupted; sleep the rest
+    }
+}
+
+static uint8_t fake_bus_read_byte(fake_bus_t *bus)
+{
+    switch (bus->reg) {
+    case MAX30102_REG_FIFO_WR_PTR:
+        bus->reg++;
+        return (bus->read_ptr + bus->fifo_level) & MAX30102_FIFO_PTR_MASK;
+    case MAX30102_REG_OVF_COUNTER:
+        bus->reg++;
+        return 0;
+    case MAX30102_REG_FIFO_RD_PTR:
+        bus->reg++;
+        return bus->read_ptr;
+    case MAX30102_REG_FIFO_DATA: {
+        uint32_t value = (bus->fifo_byte < 3) ? fake_bus_sample_red(bus->counter)
+                                               : fake_bus_sample_ir(bus->counter);
+        uint8_t byte = (uint8_t)(value >> (8 * (2 - bus->fifo_byte % 3)));
+        if (++bus->fifo_byte == 2 * MAX30102_BYTES_PER_LED) {
+            // Popped samples are replaced at once, so the level stays put
+            bus->fifo_byte = 0;
+            bus->counter++;
+            bus->samples_read++;
+            bus->read_ptr = (bus->read_ptr + 1) & MAX30102_FIFO_PTR_MASK;
+        }
+        return byte;
+    }
+    case MAX30102_REG_PART_ID:
+        bus->reg++;
+        return 0x15;
+    default:
+        bus->reg++;
+        return 0;
+    }
+}
+
+static max30102_err_t fake_bus_write(void *ctx, const uint8_t *data, size_t len)
+{
+    fake_bus_t *bus = ctx;
+    if (len == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    // Register writes are accepted and ignored
+    bus->reg = data[0];
+    bus->transactions++;
+    int64_t ns = fake_bus_transfer_ns(bus, len, 1);
+    bus->busy_ns += ns;
+    fake_bus_wait(ns);
+    return MAX30102_OK;
+}
+
+static max30102_err_t fake_bus_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                          uint8_t *rx, size_t rx_len)
+{
+    fake_bus_t *bus = ctx;
+    if (tx_len == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    bus->reg = tx[0];
+    for (size_t i = 0; i < rx_len; i++) {
+        rx[i] = fake_bus_read_byte(bus);
+    }
+    bus->transactions++;
+    int64_t ns = fake_bus_transfer_ns(bus, tx_len + rx_len, 2);
+    bus->busy_ns += ns;
+    fake_bus_wait(ns);
+    return MAX30102_OK;
+}
@@ -0,0 +1,44 @@
+#ifndef FAKE_BUS_H
+#define FAKE_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "max30102.h"
+
+// MAX30102 stand-in whose transactions take real (wall-clock) time, for
+// measuring how much of a bus transfer a caller can overlap with its own
+// work. Unlike max30102_sim_t it never touches the virtual clock and has no
+// sample timing: the FIFO always reports 'fifo_level' samples waiting and
+// every sample popped carries the next value of a counter, so delivered
+// data can be checked for order and loss. A transaction sleeps for its
+// transfer time at 'bus_hz' plus 'transaction_ns', so the calling thread
+// gives up the CPU the way a task blocked on the I2C driver does.
+
+#define FAKE_BUS_HZ                 400000
+#define FAKE_BUS_TRANSACTION_NS     20000   // Driver/ISR cost per transaction
+
+typedef struct {
+    uint32_t bus_hz;
+    int64_t transaction_ns;
+    uint8_t fifo_level;         // Samples reported waiting, up to the FIFO depth
+    uint8_t read_ptr;
+    uint8_t reg;                // Register addressed by the last write
+    uint8_t fifo_byte;          // Byte offset into the sample being read
+    uint32_t counter;           // Value of the next sample popped
+    
+    // Counters
+    uint64_t transactions;
+    uint64_t samples_read;
+    int64_t busy_ns;            // Total modelled transfer time
+    
+    max30102_transport_t transport;
+} fake_bus_t;
+
+// Function prototypes
+void fake_bus_init(fake_bus_t *bus, uint32_t bus_hz, int64_t transaction_ns, uint8_t fifo_level);
+const max30102_transport_t *fake_bus_transport(fake_bus_t *bus);
+int64_t fake_bus_transfer_ns(const fake_bus_t *bus, size_t bytes, size_t address_phases);
+uint32_t fake_bus_sample_red(uint32_t counter);
+uint32_t fake_bus_sample_ir(uint32_t counter);
+
+#endif // FAKE_BUS_H
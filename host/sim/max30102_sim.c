@@ -0,0 +1,506 @@
+#include "max30102_sim.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_port.h"
+
+#define MODE_SHDN           0x80
+#define MODE_RESET          0x40
+#define MODE_MASK           0x07
+
+static const uint32_t sample_rates_hz[8] = {50, 100, 200, 400, 800, 1000, 1600, 3200};
+
+static uint8_t sim_led_count(const max30102_sim_t *sim)
+{
+    return ((sim->regs[MAX30102_REG_MODE_CONFIG] & MODE_MASK) == MAX30102_MODE_HR_ONLY) ? 1 : 2;
+}
+
+uint32_t max30102_sim_fifo_rate_hz(const max30102_sim_t *sim)
+{
+    uint32_t rate = sample_rates_hz[(sim->regs[MAX30102_REG_SPO2_CONFIG] >> 2) & 0x07];
+    uint32_t avg = 1u << ((sim->regs[MAX30102_REG_FIFO_CONFIG] >> 5) & 0x07);
+    if (avg > 32) {
+        avg = 32;
+    }
+    return rate / avg;
+}
+
+static void sim_update_timing(max30102_sim_t *sim)
+{
+    uint8_t mode = sim->regs[MAX30102_REG_MODE_CONFIG];
+    uint8_t led_mode = mode & MODE_MASK;
+    bool running = !(mode & (MODE_SHDN | MODE_RESET)) &&
+                   (led_mode == MAX30102_MODE_HR_ONLY || led_mode == MAX30102_MODE_SPO2 ||
+                    led_mode == 0x07);
+    
+    uint32_t rate = sample_rates_hz[(sim->regs[MAX30102_REG_SPO2_CONFIG] >> 2) & 0x07];
+    uint32_t avg = 1u << ((sim->regs[MAX30102_REG_FIFO_CONFIG] >> 5) & 0x07);
+    if (avg > 32) {
+        avg = 32;
+    }
+    int64_t period_ns = (int64_t)1000000000 * avg * (1000000 + sim->odr_error_ppm) / ((int64_t)rate * 1000000);
+    
+    if (running && (!sim->running || period_ns != sim->period_ns)) {
+        // Conversion restarts from the moment sampling is (re)configured
+        sim->next_sample_ns = host_clock_now_ns() + period_ns;
+    }
+    sim->running = running;
+    sim->period_ns = period_ns;
+}
+
+static void sim_power_on_state(max30102_sim_t *sim)
+{
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[MAX30102_REG_PART_ID] = MAX30102_SIM_PART_ID;
+    sim->regs[MAX30102_REG_REV_ID] = MAX30102_SIM_REV_ID;
+    sim->fifo_count = 0;
+    sim->fifo_byte = 0;
+    sim->running = false;
+    sim_update_timing(sim);
+}
+
+static void sim_push_sample(max30102_sim_t *sim, int64_t time_ns)
+{
+    uint32_t red = 0, ir = 0;
+    sim->source(sim->source_ctx, sim->samples_generated, time_ns, &red, &ir);
+    sim->samples_generated++;
+    
+    uint8_t *wr_ptr = &sim->regs[MAX30102_REG_FIFO_WR_PTR];
+    uint8_t *rd_ptr = &sim->regs[MAX30102_REG_FIFO_RD_PTR];
+    uint8_t *ovf = &sim->regs[MAX30102_REG_OVF_COUNTER];
+    uint8_t before = sim->fifo_count;
+    bool store = true;
+    
+    if (sim->fifo_count == MAX30102_FIFO_DEPTH) {
+        sim->samples_lost++;
+        if (*ovf < MAX30102_FIFO_PTR_MASK) {
+            (*ovf)++;
+        }
+        if (sim->regs[MAX30102_REG_FIFO_CONFIG] & MAX30102_ROLLOVER_EN) {
+            // Overwrite the oldest sample; the read pointer follows
+            *rd_ptr = (*rd_ptr + 1) & MAX30102_FIFO_PTR_MASK;
+            sim->fifo_byte = 0;
+            sim->fifo_count--;
+        } else {
+            // FIFO holds its contents until it is read; the new sample is lost
+            store = false;
+        }
+    }
+    
+    if (store) {
+        sim->fifo_red[*wr_ptr] = red & 0x03FFFF;
+        sim->fifo_ir[*wr_ptr] = ir & 0x03FFFF;
+        *wr_ptr = (*wr_ptr + 1) & MAX30102_FIFO_PTR_MASK;
+        sim->fifo_count++;
+    }
+    
+    sim->regs[MAX30102_REG_INTR_STATUS_1] |= MAX30102_INTR_PPG_RDY;
+    // A_FULL latches when the FIFO reaches the level and stays set until
+    // INTR_STATUS_1 is read; a FIFO still above the level does not set it
+    // again
+    uint8_t a_full = sim->regs[MAX30102_REG_FIFO_CONFIG] & MAX30102_A_FULL_MASK;
+    if (before < MAX30102_FIFO_DEPTH - a_full && sim->fifo_count >= MAX30102_FIFO_DEPTH - a_full) {
+        sim->regs[MAX30102_REG_INTR_STATUS_1] |= MAX30102_INTR_A_FULL;
+    }
+}
+
+void max30102_sim_update(max30102_sim_t *sim)
+{
+    int64_t now = host_clock_now_ns();
+    
+    if ((sim->regs[MAX30102_REG_MODE_CONFIG] & MODE_RESET) && now >= sim->reset_done_ns) {
+        sim->regs[MAX30102_REG_MODE_CONFIG] &= ~MODE_RESET;
+        sim_update_timing(sim);
+    }
+    
+    while (sim->running && sim->next_sample_ns <= now) {
+        sim_push_sample(sim, sim->next_sample_ns);
+        sim->next_sample_ns += sim->period_ns;
+    }
+}
+
+static uint8_t sim_read_fifo_byte(max30102_sim_t *sim)
+{
+    if (sim->fifo_count == 0) {
+        return 0;
+    }
+    
+    uint8_t rd = sim->regs[MAX30102_REG_FIFO_RD_PTR];
+    uint8_t channel = sim->fifo_byte / MAX30102_BYTES_PER_LED;
+    uint8_t shift = 16 - 8 * (sim->fifo_byte % MAX30102_BYTES_PER_LED);
+    uint32_t value = (channel == 0) ? sim->fifo_red[rd] : sim->fifo_ir[rd];
+    
+    if (++sim->fifo_byte == sim_led_count(sim) * MAX30102_BYTES_PER_LED) {
+        // Sample complete: pop it, which also resets the overflow counter
+        sim->fifo_byte = 0;
+        sim->regs[MAX30102_REG_FIFO_RD_PTR] = (rd + 1) & MAX30102_FIFO_PTR_MASK;
+        sim->regs[MAX30102_REG_OVF_COUNTER] = 0;
+        sim->fifo_count--;
+        sim->samples_read++;
+    }
+    
+    return (value >> shift) & 0xFF;
+}
+
+static uint8_t sim_read_reg(max30102_sim_t *sim, uint8_t reg)
+{
+    uint8_t value;
+    
+    switch (reg) {
+    case MAX30102_REG_INTR_STATUS_1:
+    case MAX30102_REG_INTR_STATUS_2:
+        // Status registers clear on read
+        value = sim->regs[reg];
+        sim->regs[reg] = 0;
+        return value;
+    case MAX30102_REG_FIFO_DATA:
+        return sim_read_fifo_byte(sim);
+    case MAX30102_REG_TEMP_INTR:
+        return 25;
+    default:
+        return sim->regs[reg];
+    }
+}
+
+static void sim_write_reg(max30102_sim_t *sim, uint8_t reg, uint8_t value)
+{
+    switch (reg) {
+    case MAX30102_REG_FIFO_WR_PTR:
+    case MAX30102_REG_FIFO_RD_PTR:
+    case MAX30102_REG_OVF_COUNTER:
+        sim->regs[reg] = value & MAX30102_FIFO_PTR_MASK;
+        sim->fifo_count = (sim->regs[MAX30102_REG_FIFO_WR_PTR] - sim->regs[MAX30102_REG_FIFO_RD_PTR]) &
+                          MAX30102_FIFO_PTR_MASK;
+        sim->fifo_byte = 0;
+        break;
+    case MAX30102_REG_MODE_CONFIG:
+        if (value & MODE_RESET) {
+            sim_power_on_state(sim);
+            sim->regs[MAX30102_REG_MODE_CONFIG] = MODE_RESET;
+            sim->reset_done_ns = host_clock_now_ns() + MAX30102_SIM_RESET_NS;
+            return;
+        }
+        sim->regs[reg] = value;
+        sim_update_timing(sim);
+        break;
+    case MAX30102_REG_FIFO_CONFIG:
+    case MAX30102_REG_SPO2_CONFIG:
+        sim->regs[reg] = value;
+        sim_update_timing(sim);
+        break;
+    case MAX30102_REG_INTR_STATUS_1:
+    case MAX30102_REG_INTR_STATUS_2:
+    case MAX30102_REG_FIFO_DATA:
+    case MAX30102_REG_REV_ID:
+    case MAX30102_REG_PART_ID:
+        break;  // Read-only
+    default:
+        sim->regs[reg] = value;
+        break;
+    }
+}
+
+// Time a transfer occupies the bus: 9 bits per byte plus start/stop, and a
+// fixed per-transaction overhead
+static int64_t sim_bus_ns(uint32_t bus_hz, int64_t overhead_ns, size_t bytes, size_t address_phases)
+{
+    int64_t bits = (int64_t)(bytes + address_phases) * 9 + 2 * (int64_t)address_phases;
+    return bits * 1000000000 / bus_hz + overhead_ns;
+}
+
+// Advances the virtual clock by the transfer time
+static void sim_bus_transfer(max30102_sim_t *sim, size_t bytes, size_t address_phases)
+{
+    int64_t ns = sim_bus_ns(sim->bus_hz, sim->transaction_overhead_ns, bytes, address_phases);
+    
+    sim->transactions++;
+    sim->bus_busy_ns += ns;
+    host_clock_advance_ns(ns);
+}
+
+static max30102_err_t sim_write(void *ctx, const uint8_t *data, size_t len)
+{
+    max30102_sim_t *sim = ctx;
+    if (!data || len == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    max30102_sim_update(sim);
+    
+    uint8_t reg = data[0];
+    for (size_t i = 1; i < len; i++) {
+        sim_write_reg(sim, reg, data[i]);
+        if (reg != MAX30102_REG_FIFO_DATA) {
+            reg++;
+        }
+    }
+    
+    sim_bus_transfer(sim, len, 1);
+    return MAX30102_OK;
+}
+
+static max30102_err_t sim_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                     uint8_t *rx, size_t rx_len)
+{
+    max30102_sim_t *sim = ctx;
+    if (!tx || tx_len == 0 || !rx || rx_len == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    max30102_sim_update(sim);
+    
+    uint8_t reg = tx[0];
+    for (size_t i = 1; i < tx_len; i++) {
+        sim_write_reg(sim, reg, tx[i]);
+        if (reg != MAX30102_REG_FIFO_DATA) {
+            reg++;
+        }
+    }
+    
+    if (reg == MAX30102_REG_FIFO_DATA) {
+        // Reading FIFO_DATA clears PPG_RDY. A_FULL stays until INTR_STATUS_1
+        // is read.
+        sim->regs[MAX30102_REG_INTR_STATUS_1] &= ~MAX30102_INTR_PPG_RDY;
+    }
+    
+    for (size_t i = 0; i < rx_len; i++) {
+        rx[i] = sim_read_reg(sim, reg);
+        if (reg != MAX30102_REG_FIFO_DATA) {
+            reg++;
+        }
+    }
+    
+    sim_bus_transfer(sim, tx_len + rx_len, 2);
+    return MAX30102_OK;
+}
+
+void max30102_sim_init(max30102_sim_t *sim)
+{
+    memset(sim, 0, sizeof(*sim));
+    
+    sim->bus_hz = MAX30102_SIM_BUS_HZ;
+    sim->transaction_overhead_ns = MAX30102_SIM_OVERHEAD_NS;
+    
+    sim->ppg = (max30102_sim_ppg_t){
+        .bpm = 72.0,
+        .red_dc = 100000.0,
+        .red_ac = 1200.0,
+        .ir_dc = 120000.0,
+        .ir_ac = 2400.0,
+        .noise = 20.0,
+        .seed = 1,
+    };
+    sim->source = max30102_sim_ppg_source;
+    sim->source_ctx = &sim->ppg;
+    
+    sim->transport = (max30102_transport_t){
+        .write = sim_write,
+        .write_read = sim_write_read,
+        .ctx = sim,
+    };
+    
+    sim->power.start_ns = host_clock_now_ns();
+    sim->power.wake_ns = MAX30102_SIM_WAKE_NS;
+    
+    sim_power_on_state(sim);
+    sim->regs[MAX30102_REG_INTR_STATUS_1] = MAX30102_INTR_PWR_RDY;
+}
+
+void max30102_sim_set_source(max30102_sim_t *sim, max30102_sim_source_t source, void *ctx)
+{
+    if (source) {
+        sim->source = source;
+        sim->source_ctx = ctx;
+    } else {
+        sim->source = max30102_sim_ppg_source;
+        sim->source_ctx = &sim->ppg;
+    }
+}
+
+const max30102_transport_t *max30102_sim_transport(max30102_sim_t *sim)
+{
+    return &sim->transport;
+}
+
+// Routes the bus to 'port's channel, writing the mux if another is selected
+static void sim_mux_select(max30102_sim_mux_port_t *port)
+{
+    max30102_sim_mux_t *mux = port->mux;
+    if (mux->selected == port->channel) {
+        return;
+    }
+    
+    int64_t ns = sim_bus_ns(mux->bus_hz, mux->transaction_overhead_ns, 1, 1);
+    mux->selected = port->channel;
+    mux->selects++;
+    mux->bus_busy_ns += ns;
+    host_clock_advance_ns(ns);
+}
+
+static max30102_err_t sim_mux_write(void *ctx, const uint8_t *data, size_t len)
+{
+    max30102_sim_mux_port_t *port = ctx;
+    max30102_sim_t *sim = port->mux->channels[port->channel];
+    if (!sim) {
+        return MAX30102_ERR_I2C;    // Nothing acknowledges on an empty channel
+    }
+    
+    sim_mux_select(port);
+    return sim_write(sim, data, len);
+}
+
+static max30102_err_t sim_mux_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                         uint8_t *rx, size_t rx_len)
+{
+    max30102_sim_mux_port_t *port = ctx;
+    max30102_sim_t *sim = port->mux->channels[port->channel];
+    if (!sim) {
+        return MAX30102_ERR_I2C;
+    }
+    
+    sim_mux_select(port);
+    return sim_write_read(sim, tx, tx_len, rx, rx_len);
+}
+
+void max30102_sim_mux_init(max30102_sim_mux_t *mux)
+{
+    memset(mux, 0, sizeof(*mux));
+    mux->selected = -1;
+    mux->bus_hz = MAX30102_SIM_BUS_HZ;
+    mux->transaction_overhead_ns = MAX30102_SIM_OVERHEAD_NS;
+    
+    for (uint8_t i = 0; i < MAX30102_SIM_MUX_CHANNELS; i++) {
+        mux->ports[i] = (max30102_sim_mux_port_t){
+            .mux = mux,
+            .channel = i,
+            .transport = {
+                .write = sim_mux_write,
+                .write_read = sim_mux_write_read,
+                .ctx = &mux->ports[i],
+            },
+        };
+    }
+}
+
+// Puts 'sim' on 'channel' and returns the transport that reaches it
+const max30102_transport_t *max30102_sim_mux_attach(max30102_sim_mux_t *mux, uint8_t channel,
+                                                    max30102_sim_t *sim)
+{
+    if (channel >= MAX30102_SIM_MUX_CHANNELS) {
+        return NULL;
+    }
+    
+    mux->channels[channel] = sim;
+    return &mux->ports[channel].transport;
+}
+
+bool max30102_sim_int_asserted(max30102_sim_t *sim)
+{
+    max30102_sim_update(sim);
+    
+    // PWR_RDY cannot be masked
+    uint8_t enabled = sim->regs[MAX30102_REG_INTR_ENABLE_1] | MAX30102_INTR_PWR_RDY;
+    return (sim->regs[MAX30102_REG_INTR_STATUS_1] & enabled) != 0;
+}
+
+int64_t max30102_sim_next_interrupt_ns(max30102_sim_t *sim)
+{
+    if (max30102_sim_int_asserted(sim)) {
+        return host_clock_now_ns();
+    }
+    if (!sim->running) {
+        return INT64_MAX;
+    }
+    
+    uint8_t enabled = sim->regs[MAX30102_REG_INTR_ENABLE_1];
+    if (enabled & MAX30102_INTR_PPG_RDY) {
+        return sim->next_sample_ns;
+    }
+    if (enabled & MAX30102_INTR_A_FULL) {
+        // Only a FIFO below the level can cross it; one above waits for a read
+        int pending = MAX30102_FIFO_DEPTH - (sim->regs[MAX30102_REG_FIFO_CONFIG] & MAX30102_A_FULL_MASK) -
+                      sim->fifo_count;
+        if (pending < 1) {
+            return INT64_MAX;
+        }
+        return sim->next_sample_ns + (int64_t)(pending - 1) * sim->period_ns;
+    }
+    
+    return INT64_MAX;
+}
+
+// Light-sleeps the MCU until the timer at 'timer_ns' (INT64_MAX for none)
+// or, with 'int_wakeup', until INT asserts, whichever is first. Like
+// esp_light_sleep_start(), it returns at once if a wakeup is already due.
+// The exit latency after a sleep is spent awake.
+max30102_sim_wake_t max30102_sim_light_sleep(max30102_sim_t *sim, int64_t timer_ns, bool int_wakeup)
+{
+    int64_t now = host_clock_now_ns();
+    int64_t int_ns = int_wakeup ? max30102_sim_next_interrupt_ns(sim) : INT64_MAX;
+    int64_t wake_at = (int_ns <= timer_ns) ? int_ns : timer_ns;
+    if (wake_at <= now || wake_at == INT64_MAX) {
+        return MAX30102_SIM_WAKE_NONE;
+    }
+    
+    sim->power.sleeps++;
+    sim->power.asleep_ns += wake_at - now;
+    host_clock_advance_to_ns(wake_at);
+    host_clock_advance_ns(sim->power.wake_ns);
+    
+    if (int_ns <= timer_ns) {
+        sim->power.int_wakeups++;
+        return MAX30102_SIM_WAKE_INT;
+    }
+    sim->power.timer_wakeups++;
+    return MAX30102_SIM_WAKE_TIMER;
+}
+
+// Time the MCU has been awake since max30102_sim_init()
+int64_t max30102_sim_awake_ns(const max30102_sim_t *sim)
+{
+    return host_clock_now_ns() - sim->power.start_ns - sim->power.asleep_ns;
+}
+
+// Gaussian noise from a xorshift generator (Box-Muller)
+static double sim_gaussian(uint32_t *state)
+{
+    double u[2];
+    for (int i = 0; i < 2; i++) {
+        uint32_t x = *state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *state = x ? x : 1;
+        u[i] = ((double)(*state) + 1.0) / 4294967297.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
+
+static uint32_t sim_clamp_18bit(double value)
+{
+    if (value < 0.0) {
+        return 0;
+    }
+    if (value > 262143.0) {
+        return 262143;
+    }
+    return (uint32_t)value;
+}
+
+void max30102_sim_ppg_source(void *ctx, uint64_t index, int64_t time_ns,
+                             uint32_t *red, uint32_t *ir)
+{
+    max30102_sim_ppg_t *ppg = ctx;
+    (void)index;
+    
+    // Sharp systolic upstroke with a dicrotic notch; detected light dips
+    // as blood volume rises, so the pulse is subtracted from the DC level
+    double phase = 2.0 * M_PI * ppg->bpm / 60.0 * ((double)time_ns / 1e9);
+    double pulse = 0.6 * sin(phase) + 0.3 * sin(2.0 * phase - 0.8) + 0.1 * sin(3.0 * phase - 1.6);
+    
+    double noise_red = ppg->noise > 0.0 ? ppg->noise * sim_gaussian(&ppg->seed) : 0.0;
+    double noise_ir = ppg->noise > 0.0 ? ppg->noise * sim_gaussian(&ppg->seed) : 0.0;
+    
+    *red = sim_clamp_18bit(ppg->red_dc - ppg->red_ac * pulse + noise_red);
+    *ir = sim_clamp_18bit(ppg->ir_dc - ppg->ir_ac * pulse + noise_ir);
+}
@@ -0,0 +1,131 @@
+#ifndef MAX30102_SIM_H
+#define MAX30102_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Register-level model of the MAX30102 for the host build. Samples are
+// produced on the virtual clock (host_port.h) at the configured sample rate
+// and averaging, into a 32-deep FIFO with rollover and an overflow counter.
+// Every bus transaction advances the virtual clock by its transfer time.
+
+#define MAX30102_SIM_PART_ID        0x15
+#define MAX30102_SIM_REV_ID         0x03
+#define MAX30102_SIM_BUS_HZ         400000
+#define MAX30102_SIM_OVERHEAD_NS    20000   // Driver/ISR cost per transaction
+#define MAX30102_SIM_RESET_NS       1000000 // Time for the RESET bit to self-clear
+#define MAX30102_SIM_WAKE_NS        250000  // MCU light-sleep exit before code runs again
+
+// Sample source: fills in the 18-bit red/IR values for sample 'index', taken
+// at virtual time 'time_ns'
+typedef void (*max30102_sim_source_t)(void *ctx, uint64_t index, int64_t time_ns,
+                                      uint32_t *red, uint32_t *ir);
+
+// Synthetic PPG parameters for max30102_sim_ppg_source()
+typedef struct {
+    double bpm;
+    double red_dc;
+    double red_ac;
+    double ir_dc;
+    double ir_ac;
+    double noise;       // Gaussian noise, standard deviation in counts
+    uint32_t seed;
+} max30102_sim_ppg_t;
+
+// Why max30102_sim_light_sleep() returned
+typedef enum {
+    MAX30102_SIM_WAKE_NONE = 0,     // A wakeup was already due, or none was armed: no sleep
+    MAX30102_SIM_WAKE_TIMER,
+    MAX30102_SIM_WAKE_INT           // INT pin as a GPIO wakeup source
+} max30102_sim_wake_t;
+
+// Sleep and wake timeline of the MCU reading the sensor, on the virtual
+// clock. Everything outside light sleep counts as awake, including the
+// bus transfers and the exit latency after each wakeup.
+typedef struct {
+    int64_t start_ns;           // Virtual time of max30102_sim_init()
+    int64_t asleep_ns;
+    int64_t wake_ns;            // Light-sleep exit latency
+    uint32_t sleeps;
+    uint32_t timer_wakeups;
+    uint32_t int_wakeups;
+} max30102_sim_power_t;
+
+typedef struct {
+    uint8_t regs[256];
+    uint32_t fifo_red[MAX30102_FIFO_DEPTH];
+    uint32_t fifo_ir[MAX30102_FIFO_DEPTH];
+    uint8_t fifo_count;         // Unread samples (WR_PTR == RD_PTR is ambiguous)
+    uint8_t fifo_byte;          // Byte offset into the sample being read
+    
+    bool running;
+    int64_t period_ns;          // FIFO sample period after averaging
+    int32_t odr_error_ppm;      // Oscillator error: period is nominal * (1 + ppm / 1e6)
+    int64_t next_sample_ns;     // Virtual time of the next FIFO sample
+    int64_t reset_done_ns;      // Virtual time the RESET bit self-clears
+    
+    uint32_t bus_hz;
+    int64_t transaction_overhead_ns;
+    
+    max30102_sim_source_t source;
+    void *source_ctx;
+    max30102_sim_ppg_t ppg;     // Used by the default source
+    
+    // Counters
+    uint64_t samples_generated; // Samples the sensor produced (next sequence number)
+    uint64_t samples_lost;      // Samples dropped or overwritten in a full FIFO
+    uint64_t samples_read;      // Complete samples popped over the bus
+    uint64_t transactions;
+    int64_t bus_busy_ns;
+    
+    max30102_sim_power_t power;
+    
+    max30102_transport_t transport;
+} max30102_sim_t;
+
+// TCA9548A-style channel mux in front of up to eight sims on one bus. A
+// channel's transport routes the bus to it first when another channel is
+// selected, which costs a one-byte write to the mux.
+#define MAX30102_SIM_MUX_CHANNELS   8
+
+typedef struct max30102_sim_mux max30102_sim_mux_t;
+
+typedef struct {
+    max30102_sim_mux_t *mux;
+    uint8_t channel;
+    max30102_transport_t transport;
+} max30102_sim_mux_port_t;
+
+struct max30102_sim_mux {
+    max30102_sim_t *channels[MAX30102_SIM_MUX_CHANNELS];
+    max30102_sim_mux_port_t ports[MAX30102_SIM_MUX_CHANNELS];
+    int selected;               // Routed channel, -1 after power-on
+    
+    uint32_t bus_hz;
+    int64_t transaction_overhead_ns;
+    
+    // Counters for the select writes only
+    uint64_t selects;
+    int64_t bus_busy_ns;
+};
+
+// Function prototypes
+void max30102_sim_init(max30102_sim_t *sim);
+void max30102_sim_set_source(max30102_sim_t *sim, max30102_sim_source_t source, void *ctx);
+const max30102_transport_t *max30102_sim_transport(max30102_sim_t *sim);
+void max30102_sim_update(max30102_sim_t *sim);
+bool max30102_sim_int_asserted(max30102_sim_t *sim);
+int64_t max30102_sim_next_interrupt_ns(max30102_sim_t *sim);
+uint32_t max30102_sim_fifo_rate_hz(const max30102_sim_t *sim);
+max30102_sim_wake_t max30102_sim_light_sleep(max30102_sim_t *sim, int64_t timer_ns, bool int_wakeup);
+int64_t max30102_sim_awake_ns(const max30102_sim_t *sim);
+void max30102_sim_mux_init(max30102_sim_mux_t *mux);
+const max30102_transport_t *max30102_sim_mux_attach(max30102_sim_mux_t *mux, uint8_t channel,
+                                                    max30102_sim_t *sim);
+
+// Default source: synthetic PPG from sim->ppg
+void max30102_sim_ppg_source(void *ctx, uint64_t index, int64_t time_ns,
+                             uint32_t *red, uint32_t *ir);
+
+#endif // MAX30102_SIM_H
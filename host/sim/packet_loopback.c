@@ -0,0 +1,87 @@
+#include "packet_loopback.h"
+#include <string.h>
+#include "host_port.h"
+
+// Private function prototypes
+static uint8_t *loopback_reserve(void *ctx);
+static max30102_err_t loopback_send(void *ctx, size_t len);
+
+void packet_loopback_init(packet_loopback_t *lb, size_t mtu, uint32_t link_bps, int64_t packet_ns)
+{
+    memset(lb, 0, sizeof(*lb));
+    lb->link_bps = link_bps;
+    lb->packet_ns = packet_ns;
+    lb->transport.reserve = loopback_reserve;
+    lb->transport.send = loopback_send;
+    lb->transport.mtu = mtu;
+    lb->transport.ctx = lb;
+}
+
+static uint8_t *loopback_reserve(void *ctx)
+{
+    packet_loopback_t *lb = (packet_loopback_t *)ctx;
+    
+    if (lb->head - lb->tail >= PACKET_LOOPBACK_DEPTH) {
+        lb->stats.refused++;
+        return NULL;
+    }
+    return lb->slots[lb->head % PACKET_LOOPBACK_DEPTH].data;
+}
+
+// Queues the reserved packet behind the ones already on the link
+static max30102_err_t loopback_send(void *ctx, size_t len)
+{
+    packet_loopback_t *lb = (packet_loopback_t *)ctx;
+    packet_loopback_slot_t *slot = &lb->slots[lb->head % PACKET_LOOPBACK_DEPTH];
+    
+    if (lb->head - lb->tail >= PACKET_LOOPBACK_DEPTH || len > lb->transport.mtu) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    int64_t now_ns = host_clock_now_ns();
+    int64_t start_ns = (lb->link_free_ns > now_ns) ? lb->link_free_ns : now_ns;
+    int64_t wire_ns = lb->packet_ns;
+    if (lb->link_bps > 0) {
+        wire_ns += (int64_t)len * 8 * 1000000000 / lb->link_bps;
+    }
+    
+    slot->len = len;
+    slot->arrival_ns = start_ns + wire_ns;
+    lb->link_free_ns = slot->arrival_ns;
+    lb->head++;
+    
+    lb->stats.packets++;
+    lb->stats.bytes += (uint32_t)len;
+    lb->stats.busy_ns += wire_ns;
+    if (lb->head - lb->tail > lb->stats.max_in_flight) {
+        lb->stats.max_in_flight = lb->head - lb->tail;
+    }
+    return MAX30102_OK;
+}
+
+// Hands every packet that has arrived by 'now_ns' to 'receive', oldest
+// first. Returns how many.
+size_t packet_loopback_receive(packet_loopback_t *lb, int64_t now_ns, packet_receive_t receive, void *ctx)
+{
+    size_t received = 0;
+    
+    while (lb->tail != lb->head) {
+        packet_loopback_slot_t *slot = &lb->slots[lb->tail % PACKET_LOOPBACK_DEPTH];
+        if (slot->arrival_ns > now_ns) {
+            break;
+        }
+        receive(ctx, slot->data, slot->len, slot->arrival_ns);
+        lb->tail++;
+        received++;
+    }
+    return received;
+}
+
+// When the oldest packet in flight arrives, INT64_MAX if none is
+int64_t packet_loopback_next_arrival_ns(const packet_loopback_t *lb)
+{
+    if (lb->tail == lb->head) {
+        return INT64_MAX;
+    }
+    return lb->slots[lb->tail % PACKET_LOOPBACK_DEPTH].arrival_ns;
+}
@@ -0,0 +1,52 @@
+#ifndef PACKET_LOOPBACK_H
+#define PACKET_LOOPBACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "max30102.h"
+#include "packetizer.h"
+
+// Packetizer transport that hands packets back on the host after a
+// modelled link delay, in place of the UART or a BLE stack. The link sends
+// one packet at a time: a packet takes 'packet_ns' of fixed cost (a BLE
+// connection event slot, UART framing) plus its bytes at 'link_bps', and
+// waits behind the packets before it. Up to PACKET_LOOPBACK_DEPTH packets
+// can be in flight; reserve() fails beyond that, as a full TX queue does on
+// the device. Time is the host virtual clock.
+
+#define PACKET_LOOPBACK_DEPTH   8
+
+// Called for each packet as it arrives
+typedef void (*packet_receive_t)(void *ctx, const uint8_t *data, size_t len, int64_t arrival_ns);
+
+typedef struct {
+    size_t len;
+    int64_t arrival_ns;
+    uint8_t data[PACKET_MAX_MTU];
+} packet_loopback_slot_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t refused;           // reserve() calls with the queue full
+    uint32_t max_in_flight;
+    int64_t busy_ns;            // Time the link spent sending
+} packet_loopback_stats_t;
+
+typedef struct {
+    uint32_t link_bps;          // Bits per second, 0 for no byte cost
+    int64_t packet_ns;
+    int64_t link_free_ns;       // When the last queued packet is through
+    packet_loopback_slot_t slots[PACKET_LOOPBACK_DEPTH];
+    uint32_t head;              // Next slot reserve() hands out
+    uint32_t tail;              // Oldest packet not yet received
+    packet_loopback_stats_t stats;
+    packet_transport_t transport;
+} packet_loopback_t;
+
+// Function prototypes
+void packet_loopback_init(packet_loopback_t *lb, size_t mtu, uint32_t link_bps, int64_t packet_ns);
+size_t packet_loopback_receive(packet_loopback_t *lb, int64_t now_ns, packet_receive_t receive, void *ctx);
+int64_t packet_loopback_next_arrival_ns(const packet_loopback_t *lb);
+
+#endif // PACKET_LOOPBACK_H
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream_codec.h"
+
+// Decodes the firmware's binary sample stream (OUTPUT_FORMAT_BINARY) back to
+// the text format, or to CSV. Reads a capture file or a serial device that
+// has been put in raw mode, e.g.
+//
+//   stty -F /dev/ttyUSB0 115200 raw -echo && hrm_decode /dev/ttyUSB0
+//
+// Bytes outside a valid frame, such as log lines from a stream read off the
+// console, are skipped by the decoder.
+
+typedef struct {
+    FILE *out;
+    int csv;
+} decode_ctx_t;
+
+static void on_frame(void *arg, const stream_frame_t *frame)
+{
+    decode_ctx_t *ctx = arg;
+    
+    switch (frame->type) {
+    case STREAM_FRAME_SAMPLES:
+        for (uint32_t i = 0; i < frame->block.count; i++) {
+            const max30102_sample_t *s = &frame->block.samples[i];
+            if (ctx->csv) {
+                fprintf(ctx->out, "%lu,%lu,%lu\n", (unsigned long)s->sequence,
+                        (unsigned long)s->red, (unsigned long)s->ir);
+            } else {
+                fprintf(ctx->out, "[%lu] Red: %6lu, IR: %6lu\n", (unsigned long)s->sequence,
+                        (unsigned long)s->red, (unsigned long)s->ir);
+            }
+        }
+        break;
+    case STREAM_FRAME_GAP:
+        if (!ctx->csv) {
+            fprintf(ctx->out, "[%lu] Gap: %lu samples lost%s\n", (unsigned long)frame->gap.sequence,
+                    (unsigned long)frame->gap.count, frame->gap.saturated ? " (estimated)" : "");
+        }
+        break;
+    case STREAM_FRAME_INFO:
+        if (!ctx->csv) {
+            fprintf(ctx->out, "# Sample rate: %lu Hz\n", (unsigned long)frame->info.sample_rate_hz);
+        }
+        break;
+    case STREAM_FRAME_BEAT:
+        if (!ctx->csv) {
+            fprintf(ctx->out, "[%lu] Beat: interval %lu ms, %u.%u BPM\n", (unsigned long)frame->beat.sequence,
+                    (unsigned long)(frame->beat.interval_us / 1000),
+                    frame->beat.bpm_x10 / 10, frame->beat.bpm_x10 % 10);
+        }
+        break;
+    case STREAM_FRAME_SPO2:
+        if (!ctx->csv) {
+            fprintf(ctx->out, "[%lu] SpO2: %u.%u%% (R %u.%03u)\n", (unsigned long)frame->spo2.sequence,
+                    frame->spo2.spo2_x10 / 10, frame->spo2.spo2_x10 % 10,
+                    frame->spo2.ratio_x1000 / 1000, frame->spo2.ratio_x1000 % 1000);
+        }
+        break;
+    case STREAM_FRAME_SPECTRAL:
+        if (!ctx->csv) {
+            fprintf(ctx->out, "[%lu] Spectral HR: %u.%u BPM (confidence %u%%)\n",
+                    (unsigned long)frame->spectral.sequence, frame->spectral.bpm_x10 / 10,
+                    frame->spectral.bpm_x10 % 10, frame->spectral.confidence);
+        }
+        break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static stream_decoder_t decoder;
+    decode_ctx_t ctx = {.out = stdout, .csv = 0};
+    const char *path = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            ctx.csv = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "usage: %s [-c] [file]\n  -c  CSV output (sequence,red,ir)\n", argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    
+    FILE *in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        in = fopen(path, "rb");
+        if (!in) {
+            perror(path);
+            return 1;
+        }
+    }
+    
+    if (ctx.csv) {
+        fprintf(ctx.out, "sequence,red,ir\n");
+    }
+    
+    stream_decoder_init(&decoder, on_frame, &ctx);
+    uint8_t buf[4096];
+    ssize_t n;
+    // read() rather than fread() so a live serial link is decoded as it arrives
+    while ((n = read(fileno(in), buf, sizeof(buf))) > 0) {
+        stream_decoder_feed(&decoder, buf, (size_t)n);
+        fflush(ctx.out);
+    }
+    
+    stream_stats_t stats;
+    stream_decoder_get_stats(&decoder, &stats);
+    fprintf(stderr, "%lu frames, %lu samples, %lu gaps (%lu samples lost), %lu CRC errors, %lu bytes skipped\n",
+            (unsigned long)stats.frames, (unsigned long)stats.samples, (unsigned long)stats.gaps,
+            (unsigned long)stats.samples_lost, (unsigned long)stats.crc_errors,
+            (unsigned long)stats.bytes_skipped);
+    
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+#include "pipeline.h"
+#include "acquisition.h"
+#include "max30102_sim.h"
+#include "capture_source.h"
+#include "host_port.h"
+
+// Replays a raw sample capture (capture.h) through the processing pipeline,
+// as fast as possible or at the recorded pace, and prints what it found and
+// how long it took. By default the recorded samples, timestamps and gaps go
+// straight into pipeline_acquire() at their recorded drain times, so a
+// replay reproduces the original run's output exactly. With -a the capture
+// instead drives the simulated sensor, and the driver, acquisition and
+// sample clock run on it again.
+//
+//   hrm_replay capture.hrm
+//   hrm_replay -a -o out.bin capture.hrm && hrm_decode out.bin
+
+typedef struct {
+    FILE *out;
+    stream_decoder_t decoder;
+    uint32_t beats;
+    uint32_t spo2;
+    uint64_t bytes;
+} output_t;
+
+typedef struct {
+    bool realtime;
+    int64_t wall_start_ns;
+    int64_t first_us;
+    bool started;
+} pace_t;
+
+static pipeline_t pipeline;
+static capture_reader_t reader;
+static capture_event_t event;
+static output_t output;
+static max30102_sim_t sim;
+static max30102_dev_t dev;
+static acquisition_t acq;
+static capture_source_t source;
+
+static int64_t wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t file_read(void *ctx, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, (FILE *)ctx);
+}
+
+static int64_t clock_us(void)
+{
+    return host_clock_now_ns() / 1000;
+}
+
+static void on_frame(void *ctx, const stream_frame_t *frame)
+{
+    output_t *out = ctx;
+    out->beats += frame->type == STREAM_FRAME_BEAT;
+    out->spo2 += frame->type == STREAM_FRAME_SPO2;
+}
+
+static void output_write(void *ctx, const uint8_t *data, size_t len)
+{
+    output_t *out = ctx;
+    out->bytes += len;
+    stream_decoder_feed(&out->decoder, data, len);
+    if (out->out) {
+        fwrite(data, 1, len, out->out);
+    }
+}
+
+// Sleeps until 'time_us' on the recording's time base, in real time mode
+static void pace(pace_t *p, int64_t time_us)
+{
+    if (!p->started) {
+        p->first_us = time_us;
+        p->wall_start_ns = wall_ns();
+        p->started = true;
+    }
+    if (p->realtime) {
+        int64_t due_ns = p->wall_start_ns + (time_us - p->first_us) * 1000;
+        struct timespec ts = {.tv_sec = due_ns / 1000000000, .tv_nsec = due_ns % 1000000000};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+}
+
+// Set up as main.c does, quality gate included
+static void pipeline_start(const max30102_config_t *sensor_config, uint32_t fifo_rate_hz)
+{
+    pipeline_config_t config = {
+        .output = PIPELINE_OUTPUT_BINARY,
+        .sample_rate_hz = fifo_rate_hz,
+        .write = output_write,
+        .write_ctx = &output,
+        .clock_us = clock_us,
+        .adc_range = sensor_config->adc_range,
+        .quality_gate = true,
+    };
+    pipeline_init(&pipeline, &config);
+}
+
+static void pipeline_feed(const max30102_sample_t *samples, size_t count)
+{
+    size_t done = 0;
+    while (done < count) {
+        done += pipeline_acquire(&pipeline, samples + done, count - done);
+        while (pipeline_dsp_step(&pipeline) > 0 || pipeline_output_step(&pipeline) > 0) {
+        }
+    }
+}
+
+// Recorded samples straight into the pipeline
+static int replay_direct(pace_t *p)
+{
+    bool started = false;
+    max30102_err_t err;
+    while ((err = capture_reader_next(&reader, &event)) == MAX30102_OK) {
+        if (event.type == CAPTURE_RECORD_CONFIG && !started) {
+            pipeline_start(&event.config.config, event.config.fifo_rate_hz);
+            started = true;
+        } else if (event.type == CAPTURE_RECORD_SAMPLES) {
+            if (!started) {
+                fprintf(stderr, "capture has samples before its config record\n");
+                return 1;
+            }
+            host_clock_advance_to_ns(event.block.time_us * 1000);
+            pace(p, event.block.time_us);
+            pipeline_feed(event.block.samples, event.block.count);
+        }
+    }
+    if (err != MAX30102_ERR_NO_DATA) {
+        fprintf(stderr, "corrupt record after %lu records\n", (unsigned long)reader.stats.records);
+    }
+    pipeline_output_flush(&pipeline);
+    return err == MAX30102_ERR_NO_DATA ? 0 : 1;
+}
+
+// Capture drives the simulated sensor, polled like sensor_task polls
+static int replay_acquisition(pace_t *p)
+{
+    if (capture_source_load(&source, &reader) != MAX30102_OK || !source.has_config) {
+        fprintf(stderr, "cannot load capture\n");
+        return 1;
+    }
+    
+    max30102_sim_init(&sim);
+    max30102_sim_set_source(&sim, capture_source_sample, &source);
+    max30102_set_transport(&dev, max30102_sim_transport(&sim));
+    if (max30102_init_fast(&dev, &source.config) != MAX30102_OK ||
+        acquisition_start(&acq, &dev, ACQUISITION_MODE_POLLING, &source.config) != MAX30102_OK) {
+        fprintf(stderr, "simulated sensor init failed\n");
+        return 1;
+    }
+    pipeline_start(&source.config, max30102_fifo_rate_hz(&source.config));
+    
+    int64_t poll_ns = (int64_t)acquisition_poll_interval_ms(&source.config) * 1000000;
+    max30102_sample_t samples[MAX30102_FIFO_DEPTH];
+    while (sim.samples_generated < source.count) {
+        host_clock_advance_ns(poll_ns);
+        pace(p, clock_us());
+        size_t count = 0;
+        max30102_gap_t gap;
+        acquisition_drain(&acq, 0, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+        pipeline_feed(samples, count);
+    }
+    pipeline_output_flush(&pipeline);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    pace_t p = {0};
+    bool through_acquisition = false;
+    const char *path = NULL;
+    const char *out_path = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            p.realtime = true;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            through_acquisition = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-r] [-a] [-o out] capture\n"
+                    "  -r  replay at the recorded pace instead of as fast as possible\n"
+                    "  -a  replay through the simulated sensor and acquisition\n"
+                    "  -o  write the pipeline's binary stream frames to 'out'\n", argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-r] [-a] [-o out] capture\n", argv[0]);
+        return 2;
+    }
+    
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    if (out_path) {
+        output.out = fopen(out_path, "wb");
+        if (!output.out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    if (capture_reader_init(&reader, file_read, in) != MAX30102_OK) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        return 1;
+    }
+    
+    host_log_level = HOST_LOG_ERROR;
+    host_clock_reset();
+    stream_decoder_init(&output.decoder, on_frame, &output);
+    int64_t start_ns = wall_ns();
+    int rc = through_acquisition ? replay_acquisition(&p) : replay_direct(&p);
+    double wall_s = (double)(wall_ns() - start_ns) / 1e9;
+    double capture_s = (double)host_clock_now_ns() / 1e9 - (double)p.first_us / 1e6;
+    
+    capture_stats_t stats;
+    capture_reader_get_stats(&reader, &stats);
+    pipeline_stats_t pstats;
+    pipeline_get_stats(&pipeline, &pstats);
+    pipeline_readout_t readout;
+    pipeline_get_readout(&pipeline, &readout);
+    
+    printf("%lu records, %lu samples, %lu gaps (%lu samples lost)%s\n", (unsigned long)stats.records,
+           (unsigned long)stats.samples, (unsigned long)stats.gaps, (unsigned long)stats.samples_lost,
+           stats.truncated ? ", truncated" : "");
+    printf("%lu samples through the pipeline, %lu beats, %lu SpO2 readings, %llu output bytes\n",
+           (unsigned long)pstats.stage[PIPELINE_STAGE_OUTPUT].items, (unsigned long)output.beats,
+           (unsigned long)output.spo2, (unsigned long long)output.bytes);
+    printf("Final heart rate %u.%u BPM, SpO2 %u.%u%%\n", readout.bpm_x10 / 10, readout.bpm_x10 % 10,
+           readout.spo2_x10 / 10, readout.spo2_x10 % 10);
+    printf("%.2f s of capture in %.3f s (%.1fx real time)\n", capture_s, wall_s,
+           wall_s > 0 ? capture_s / wall_s : 0.0);
+    
+    if (output.out) {
+        fclose(output.out);
+    }
+    capture_source_free(&source);
+    fclose(in);
+    return rc;
+}
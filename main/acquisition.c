@@ -0,0 +1,242 @@
+#include "acquisition.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "ACQUISITION";
+
+max30102_err_t acquisition_start(acquisition_t *acq, max30102_dev_t *dev, acquisition_mode_t mode,
+                                 const max30102_config_t *config)
+{
+    if (!acq || !dev || !config) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    acq->dev = dev;
+    acq->stats = (acquisition_stats_t){0};
+    acq->stats.mode = mode;
+    acq->stats.start_time_us = esp_timer_get_time();
+    
+    max30102_err_t err = sample_clock_init(&acq->clock, max30102_fifo_rate_hz(config));
+    if (err != MAX30102_OK) return err;
+    
+    // A_FULL fires when only almost_full_threshold empty slots remain
+    uint8_t intr_mask = (mode != ACQUISITION_MODE_POLLING) ? MAX30102_INTR_A_FULL : 0;
+    err = max30102_enable_interrupts(acq->dev, intr_mask);
+    if (err != MAX30102_OK) return err;
+    
+    // Clear anything already pending (e.g. PWR_RDY) so the INT pin is released
+    uint8_t status;
+    err = max30102_read_intr_status(acq->dev, &status);
+    if (err != MAX30102_OK) return err;
+    
+    if (mode == ACQUISITION_MODE_INTERRUPT) {
+        ESP_LOGI(TAG, "Interrupt mode, A_FULL at %d samples",
+                 MAX30102_FIFO_DEPTH - (config->almost_full_threshold & MAX30102_A_FULL_MASK));
+    } else if (mode == ACQUISITION_MODE_LOW_POWER) {
+        ESP_LOGI(TAG, "Low-power mode, %lu Hz FIFO, A_FULL at %d samples every %lu us",
+                 (unsigned long)max30102_fifo_rate_hz(config),
+                 MAX30102_FIFO_DEPTH - (config->almost_full_threshold & MAX30102_A_FULL_MASK),
+                 (unsigned long)acquisition_fill_period_us(config));
+    } else {
+        ESP_LOGI(TAG, "Polling mode");
+    }
+    
+    return MAX30102_OK;
+}
+
+uint32_t acquisition_poll_interval_ms(const max30102_config_t *config)
+{
+    uint32_t rate_hz = max30102_fifo_rate_hz(config);
+    if (rate_hz == 0) {
+        return 0;
+    }
+    
+    // Poll before the FIFO is three quarters full, leaving the last quarter
+    // to absorb scheduling jitter
+    return (MAX30102_FIFO_DEPTH * 3 / 4) * 1000 / rate_hz;
+}
+
+// Derives a configuration for ACQUISITION_MODE_LOW_POWER from 'config'.
+// The sensor averages as many samples as it can while the FIFO still
+// delivers at least 'min_rate_hz' (0 keeps the averaging as it is), so the
+// FIFO fills more slowly. A_FULL is then moved up to leave only the slots
+// that fill during ACQUISITION_WAKE_BUDGET_US, so each wakeup drains as
+// close to a whole FIFO as a late wakeup allows.
+max30102_err_t acquisition_low_power_config(const max30102_config_t *config, uint32_t min_rate_hz,
+                                            max30102_config_t *out)
+{
+    if (!config || !out) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    *out = *config;
+    if (min_rate_hz > 0) {
+        while (out->sample_avg < MAX30102_SAMPLEAVG_32) {
+            max30102_config_t next = *out;
+            next.sample_avg += MAX30102_SAMPLEAVG_2;
+            if (max30102_fifo_rate_hz(&next) < min_rate_hz) {
+                break;
+            }
+            *out = next;
+        }
+    }
+    
+    uint32_t rate_hz = max30102_fifo_rate_hz(out);
+    if (rate_hz == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    // One slot more than the budget needs, for the sample being converted
+    uint32_t headroom = (rate_hz * ACQUISITION_WAKE_BUDGET_US + 999999) / 1000000 + 1;
+    if (headroom > MAX30102_A_FULL_MASK) {
+        headroom = MAX30102_A_FULL_MASK;
+    }
+    out->almost_full_threshold = (uint8_t)headroom;
+    
+    return MAX30102_OK;
+}
+
+// Time from an empty FIFO to A_FULL
+uint32_t acquisition_fill_period_us(const max30102_config_t *config)
+{
+    uint32_t rate_hz = max30102_fifo_rate_hz(config);
+    if (rate_hz == 0) {
+        return 0;
+    }
+    
+    uint32_t fill = MAX30102_FIFO_DEPTH - (config->almost_full_threshold & MAX30102_A_FULL_MASK);
+    return fill * 1000000 / rate_hz;
+}
+
+// Estimated share of 'elapsed_us' the CPU was awake for acquisition: the
+// measured drain time plus ACQUISITION_WAKE_COST_US per wakeup
+uint32_t acquisition_duty_cycle_ppm(const acquisition_stats_t *stats, int64_t elapsed_us)
+{
+    if (!stats || elapsed_us <= 0) {
+        return 0;
+    }
+    
+    uint64_t active_us = stats->active_us_total + (uint64_t)stats->wakeups * ACQUISITION_WAKE_COST_US;
+    uint64_t ppm = active_us * 1000000 / (uint64_t)elapsed_us;
+    return ppm > 1000000 ? 1000000 : (uint32_t)ppm;
+}
+
+max30102_err_t acquisition_drain(acquisition_t *acq, int64_t event_time_us, max30102_sample_t *samples,
+                                 size_t max_samples, size_t *count, max30102_gap_t *gap)
+{
+    if (!acq || !acq->dev || !samples || !count) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    acq->stats.wakeups++;
+    int64_t drain_start_us = esp_timer_get_time();
+    *count = 0;
+    if (gap) {
+        *gap = (max30102_gap_t){0};
+    }
+    
+    // Only an INTR_STATUS_1 read clears A_FULL and releases INT. Every
+    // max30102_read_samples() call reads it between the pointers and the
+    // data, so each pass of the burst below re-arms the interrupt.
+    // Keep reading while whole FIFOs come back, but stop at a gap so the
+    // caller sees it before any samples that follow it.
+    size_t total = 0;
+    max30102_err_t err = MAX30102_OK;
+    while (total < max_samples) {
+        size_t n = 0;
+        max30102_gap_t lost;
+        int64_t capture_us = esp_timer_get_time();  // Just before the pointer read
+        err = max30102_read_samples(acq->dev, samples + total, max_samples - total, &n, &lost);
+        if (lost.count > 0) {
+            acq->stats.gaps++;
+            acq->stats.samples_lost += lost.count;
+            if (gap) {
+                *gap = lost;
+            }
+        }
+        if (err != MAX30102_OK || n == 0) {
+            break;
+        }
+        
+        // A read that emptied the FIFO ends with the newest sample at the
+        // capture. Around an overflow the FIFO may have stopped or been
+        // overwritten during the read, so those reads are not observations.
+        if (lost.count == 0 && n < max_samples - total) {
+            sample_clock_update(&acq->clock, samples[total + n - 1].sequence, capture_us);
+        }
+        sample_clock_stamp(&acq->clock, samples + total, n);
+        total += n;
+        if (n < MAX30102_FIFO_DEPTH || lost.count > 0) {
+            break;  // FIFO drained
+        }
+    }
+    
+    *count = total;
+    acq->stats.samples += total;
+    acq->stats.active_us_total += (uint64_t)(esp_timer_get_time() - drain_start_us);
+    metrics_record(acq->dev->metrics, METRIC_DRAIN_SAMPLES, (uint32_t)total);
+    
+    if (total == 0) {
+        acq->stats.empty_wakeups++;
+        metrics_count(acq->dev->metrics, METRIC_EMPTY_DRAINS, 1);
+        return (err == MAX30102_OK) ? MAX30102_ERR_NO_DATA : err;
+    }
+    
+    if (event_time_us > 0) {
+        int64_t latency = esp_timer_get_time() - event_time_us;
+        if (latency >= 0) {
+            acq->stats.latency_count++;
+            acq->stats.latency_us_total += (uint64_t)latency;
+            if (latency > acq->stats.latency_us_max) {
+                acq->stats.latency_us_max = (uint32_t)latency;
+            }
+        }
+    }
+    
+    return MAX30102_OK;
+}
+
+void acquisition_get_stats(const acquisition_t *acq, acquisition_stats_t *out)
+{
+    if (out) {
+        *out = acq->stats;
+        out->sample_period_ns = sample_clock_period_ns(&acq->clock);
+        sample_clock_get_stats(&acq->clock, &out->clock);
+    }
+}
+
+void acquisition_log_stats(const acquisition_t *acq)
+{
+    const acquisition_stats_t *stats = &acq->stats;
+    int64_t elapsed_us = esp_timer_get_time() - stats->start_time_us;
+    if (elapsed_us <= 0) {
+        return;
+    }
+    
+    uint32_t wakeups_per_sec = (uint32_t)((uint64_t)stats->wakeups * 1000000 / elapsed_us);
+    uint32_t samples_per_wakeup = stats->wakeups ? stats->samples / stats->wakeups : 0;
+    uint32_t latency_avg = stats->latency_count ? (uint32_t)(stats->latency_us_total / stats->latency_count) : 0;
+    static const char *mode_names[] = {"Polling", "Interrupt", "Low-power"};
+    
+    ESP_LOGI(TAG, "%s: %lu wakeups/s, %lu empty, %lu samples/wakeup, latency avg %lu us max %lu us",
+             mode_names[stats->mode],
+             (unsigned long)wakeups_per_sec, (unsigned long)stats->empty_wakeups,
+             (unsigned long)samples_per_wakeup, (unsigned long)latency_avg,
+             (unsigned long)stats->latency_us_max);
+    ESP_LOGI(TAG, "%lu samples, %lu gaps, %lu lost",
+             (unsigned long)stats->samples, (unsigned long)stats->gaps,
+             (unsigned long)stats->samples_lost);
+    
+    // Drain time per sample in ns keeps short bus bursts visible
+    uint32_t active_ns_per_sample = stats->samples ? (uint32_t)(stats->active_us_total * 1000 / stats->samples) : 0;
+    uint32_t duty_ppm = acquisition_duty_cycle_ppm(stats, elapsed_us);
+    ESP_LOGI(TAG, "Active %lu ns/sample, estimated duty cycle %lu.%02lu%%",
+             (unsigned long)active_ns_per_sample, (unsigned long)(duty_ppm / 10000),
+             (unsigned long)(duty_ppm / 100 % 100));
+    
+    sample_clock_stats_t clock;
+    sample_clock_get_stats(&acq->clock, &clock);
+    ESP_LOGI(TAG, "Sample period %lu ns (ODR %ld ppm), phase error %ld ns, %lu resyncs",
+             (unsigned long)sample_clock_period_ns(&acq->clock), (long)clock.odr_error_ppm,
+             (long)clock.last_error_ns, (unsigned long)clock.resyncs);
+}
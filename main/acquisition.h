@@ -0,0 +1,60 @@
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "max30102.h"
+#include "sample_clock.h"
+
+// Low-power acquisition sleeps through whole FIFO fill periods. These bound
+// the wakeup it has to budget for: the time from A_FULL to the drain
+// starting (light-sleep exit, ISR, task switch) and the CPU time each
+// wakeup costs outside the drain itself.
+#define ACQUISITION_WAKE_BUDGET_US  2000    // FIFO headroom kept for a late wakeup
+#define ACQUISITION_WAKE_COST_US    300     // Light-sleep exit + ISR + context switch
+
+// Acquisition modes
+typedef enum {
+    ACQUISITION_MODE_POLLING = 0,   // Wake on a fixed interval and drain the FIFO
+    ACQUISITION_MODE_INTERRUPT,     // Wake on the FIFO almost-full interrupt
+    ACQUISITION_MODE_LOW_POWER      // As interrupt, with a config from acquisition_low_power_config()
+} acquisition_mode_t;
+
+// Acquisition counters
+typedef struct {
+    acquisition_mode_t mode;
+    int64_t start_time_us;       // Time acquisition_start() was called
+    uint32_t wakeups;            // Calls to acquisition_drain()
+    uint32_t empty_wakeups;      // Wakeups that found no data
+    uint32_t samples;            // Samples drained
+    uint32_t gaps;               // Gap records reported
+    uint32_t samples_lost;       // Samples covered by gap records
+    uint32_t latency_count;      // Drains that carried an event timestamp
+    uint64_t latency_us_total;   // Sum of event-to-drained latency
+    uint32_t latency_us_max;     // Worst event-to-drained latency
+    uint64_t active_us_total;    // Time spent inside acquisition_drain()
+    uint32_t sample_period_ns;   // Measured sample period
+    sample_clock_stats_t clock;
+} acquisition_stats_t;
+
+// Acquisition state for one sensor
+typedef struct {
+    max30102_dev_t *dev;
+    acquisition_stats_t stats;
+    sample_clock_t clock;
+} acquisition_t;
+
+// Function prototypes
+max30102_err_t acquisition_start(acquisition_t *acq, max30102_dev_t *dev, acquisition_mode_t mode,
+                                 const max30102_config_t *config);
+uint32_t acquisition_poll_interval_ms(const max30102_config_t *config);
+max30102_err_t acquisition_low_power_config(const max30102_config_t *config, uint32_t min_rate_hz,
+                                            max30102_config_t *out);
+uint32_t acquisition_fill_period_us(const max30102_config_t *config);
+uint32_t acquisition_duty_cycle_ppm(const acquisition_stats_t *stats, int64_t elapsed_us);
+max30102_err_t acquisition_drain(acquisition_t *acq, int64_t event_time_us, max30102_sample_t *samples,
+                                 size_t max_samples, size_t *count, max30102_gap_t *gap);
+void acquisition_get_stats(const acquisition_t *acq, acquisition_stats_t *stats);
+void acquisition_log_stats(const acquisition_t *acq);
+
+#endif // ACQUISITION_H
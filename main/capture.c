@@ -0,0 +1,359 @@
+#include "capture.h"
+#include <string.h>
+
+_Static_assert(CAPTURE_MAX_BLOCK <= 255, "Sample count is stored as one byte");
+_Static_assert(CAPTURE_BUFFER_SIZE >= CAPTURE_FILE_HEADER + CAPTURE_MAX_RECORD, "Buffer holds a full record");
+
+static const uint8_t file_magic[4] = {'H', 'R', 'M', 'C'};
+
+// Private function prototypes
+static void put_u16(uint8_t *p, uint16_t v);
+static void put_u32(uint8_t *p, uint32_t v);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+static size_t put_varint(uint8_t *p, uint64_t v);
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v);
+static uint8_t *writer_begin(capture_writer_t *w);
+static void writer_finish(capture_writer_t *w, capture_record_type_t type, size_t payload_len);
+static size_t write_block(capture_writer_t *w, const max30102_sample_t *samples, size_t count, int64_t time_us);
+static bool decode_block(capture_event_t *event, const uint8_t *p, size_t len);
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static inline uint64_t zigzag64(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag64(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// LEB128: seven bits per byte, low first, high bit set on all but the last
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void capture_writer_init(capture_writer_t *w, stream_write_t write, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->write = write;
+    w->ctx = ctx;
+    
+    memcpy(w->buf, file_magic, sizeof(file_magic));
+    w->buf[4] = CAPTURE_VERSION;
+    w->len = CAPTURE_FILE_HEADER;
+    w->stats.bytes = CAPTURE_FILE_HEADER;
+}
+
+// Room for one record at the end of the buffer, flushing first if needed.
+// Returns where the payload goes.
+static uint8_t *writer_begin(capture_writer_t *w)
+{
+    if (w->len + CAPTURE_MAX_RECORD > sizeof(w->buf)) {
+        capture_writer_flush(w);
+    }
+    return w->buf + w->len + CAPTURE_RECORD_HEADER;
+}
+
+static void writer_finish(capture_writer_t *w, capture_record_type_t type, size_t payload_len)
+{
+    uint8_t *record = w->buf + w->len;
+    record[0] = (uint8_t)type;
+    put_u16(record + 1, (uint16_t)payload_len);
+    size_t len = CAPTURE_RECORD_HEADER + payload_len;
+    put_u16(record + len, stream_crc16(record, len));
+    len += 2;
+    
+    w->len += len;
+    w->stats.records++;
+    w->stats.bytes += (uint32_t)len;
+}
+
+void capture_write_config(capture_writer_t *w, const max30102_config_t *config, uint32_t fifo_rate_hz)
+{
+    uint8_t *p = writer_begin(w);
+    p[0] = config->mode;
+    p[1] = config->sample_rate;
+    p[2] = config->pulse_width;
+    p[3] = config->adc_range;
+    p[4] = config->sample_avg;
+    p[5] = config->led1_power;
+    p[6] = config->led2_power;
+    p[7] = config->rollover_enable ? 1 : 0;
+    p[8] = config->almost_full_threshold;
+    put_u32(p + 9, fifo_rate_hz);
+    writer_finish(w, CAPTURE_RECORD_CONFIG, 13);
+}
+
+// Encodes the longest run of consecutive sequence numbers at the start of
+// 'samples', up to CAPTURE_MAX_BLOCK. Returns the number of samples taken.
+static size_t write_block(capture_writer_t *w, const max30102_sample_t *samples, size_t count, int64_t time_us)
+{
+    if (count > CAPTURE_MAX_BLOCK) {
+        count = CAPTURE_MAX_BLOCK;
+    }
+    size_t run = 1;
+    while (run < count && samples[run].sequence == samples[run - 1].sequence + 1) {
+        run++;
+    }
+    
+    uint8_t *start = writer_begin(w);
+    uint8_t *p = start;
+    put_u32(p, samples[0].sequence);
+    p[4] = (uint8_t)run;
+    int64_t first_us = samples[0].timestamp_us;
+    put_u32(p + 5, (uint32_t)first_us);
+    put_u32(p + 9, (uint32_t)((uint64_t)first_us >> 32));
+    p += 13;
+    p += put_varint(p, zigzag64(time_us - first_us));
+    
+    uint32_t red = 0;
+    uint32_t ir = 0;
+    int64_t timestamp = first_us;
+    int64_t interval = 0;
+    for (size_t i = 0; i < run; i++) {
+        const max30102_sample_t *s = &samples[i];
+        p += put_varint(p, zigzag64((int64_t)s->red - (int64_t)red));
+        p += put_varint(p, zigzag64((int64_t)s->ir - (int64_t)ir));
+        red = s->red;
+        ir = s->ir;
+        if (i > 0) {
+            int64_t next = s->timestamp_us - timestamp;
+            p += put_varint(p, zigzag64(next - interval));
+            interval = next;
+            timestamp = s->timestamp_us;
+        }
+    }
+    
+    writer_finish(w, CAPTURE_RECORD_SAMPLES, (size_t)(p - start));
+    w->stats.samples += (uint32_t)run;
+    return run;
+}
+
+// Records samples drained at 'time_us', split into records of consecutive
+// sequence numbers
+void capture_write_samples(capture_writer_t *w, const max30102_sample_t *samples, size_t count, int64_t time_us)
+{
+    size_t done = 0;
+    while (done < count) {
+        done += write_block(w, samples + done, count - done, time_us);
+    }
+}
+
+void capture_write_gap(capture_writer_t *w, const max30102_gap_t *gap)
+{
+    if (gap->count == 0) {
+        return;
+    }
+    
+    uint8_t *p = writer_begin(w);
+    put_u32(p, gap->sequence);
+    put_u32(p + 4, gap->count);
+    p[8] = gap->saturated ? STREAM_GAP_ESTIMATED : 0;
+    writer_finish(w, CAPTURE_RECORD_GAP, 9);
+    w->stats.gaps++;
+    w->stats.samples_lost += gap->count;
+}
+
+// Hands everything buffered to the write callback
+void capture_writer_flush(capture_writer_t *w)
+{
+    if (w->len > 0) {
+        if (w->write) {
+            w->write(w->ctx, w->buf, w->len);
+        }
+        w->len = 0;
+    }
+}
+
+void capture_writer_get_stats(const capture_writer_t *w, capture_stats_t *stats)
+{
+    if (stats) {
+        *stats = w->stats;
+    }
+}
+
+// Checks the file header
+max30102_err_t capture_reader_init(capture_reader_t *r, capture_read_t read, void *ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->read = read;
+    r->ctx = ctx;
+    
+    uint8_t header[CAPTURE_FILE_HEADER];
+    if (!read || read(ctx, header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, file_magic, sizeof(file_magic)) != 0 || header[4] != CAPTURE_VERSION) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    r->stats.bytes = CAPTURE_FILE_HEADER;
+    return MAX30102_OK;
+}
+
+static bool decode_block(capture_event_t *event, const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+    if (len < 13 || p[4] == 0 || p[4] > CAPTURE_MAX_BLOCK) {
+        return false;
+    }
+    
+    uint32_t sequence = get_u32(p);
+    size_t count = p[4];
+    int64_t timestamp = (int64_t)((uint64_t)get_u32(p + 5) | ((uint64_t)get_u32(p + 9) << 32));
+    p += 13;
+    
+    uint64_t v;
+    if (!get_varint(&p, end, &v)) {
+        return false;
+    }
+    event->block.time_us = timestamp + unzigzag64(v);
+    event->block.count = count;
+    
+    int64_t red = 0;
+    int64_t ir = 0;
+    int64_t interval = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t red_delta, ir_delta;
+        if (!get_varint(&p, end, &red_delta) || !get_varint(&p, end, &ir_delta)) {
+            return false;
+        }
+        red += unzigzag64(red_delta);
+        ir += unzigzag64(ir_delta);
+        if (i > 0) {
+            if (!get_varint(&p, end, &v)) {
+                return false;
+            }
+            interval += unzigzag64(v);
+            timestamp += interval;
+        }
+        
+        max30102_sample_t *s = &event->block.samples[i];
+        s->red = (uint32_t)red;
+        s->ir = (uint32_t)ir;
+        s->valid = true;
+        s->sequence = sequence + (uint32_t)i;
+        s->timestamp_us = timestamp;
+    }
+    return p == end;
+}
+
+// Decodes the next record into 'event'. Returns MAX30102_ERR_NO_DATA at the
+// end of the capture, including one that ends inside a record, and
+// MAX30102_ERR_INVALID_PARAM for a record that fails its CRC or does not
+// decode. Unknown record types are skipped.
+max30102_err_t capture_reader_next(capture_reader_t *r, capture_event_t *event)
+{
+    while (1) {
+        size_t got = r->read(r->ctx, r->buf, CAPTURE_RECORD_HEADER);
+        if (got != CAPTURE_RECORD_HEADER) {
+            r->stats.truncated = got > 0;
+            return MAX30102_ERR_NO_DATA;
+        }
+        
+        size_t payload_len = get_u16(r->buf + 1);
+        size_t rest = payload_len + 2;
+        if (CAPTURE_RECORD_HEADER + rest > sizeof(r->buf)) {
+            r->stats.crc_errors++;
+            return MAX30102_ERR_INVALID_PARAM;
+        }
+        if (r->read(r->ctx, r->buf + CAPTURE_RECORD_HEADER, rest) != rest) {
+            r->stats.truncated = true;
+            return MAX30102_ERR_NO_DATA;
+        }
+        size_t len = CAPTURE_RECORD_HEADER + payload_len;
+        if (stream_crc16(r->buf, len) != get_u16(r->buf + len)) {
+            r->stats.crc_errors++;
+            return MAX30102_ERR_INVALID_PARAM;
+        }
+        r->stats.records++;
+        r->stats.bytes += (uint32_t)(len + 2);
+        
+        const uint8_t *p = r->buf + CAPTURE_RECORD_HEADER;
+        event->type = (capture_record_type_t)r->buf[0];
+        switch (event->type) {
+        case CAPTURE_RECORD_CONFIG:
+            if (payload_len < 13) {
+                return MAX30102_ERR_INVALID_PARAM;
+            }
+            event->config.config.mode = p[0];
+            event->config.config.sample_rate = p[1];
+            event->config.config.pulse_width = p[2];
+            event->config.config.adc_range = p[3];
+            event->config.config.sample_avg = p[4];
+            event->config.config.led1_power = p[5];
+            event->config.config.led2_power = p[6];
+            event->config.config.rollover_enable = p[7] != 0;
+            event->config.config.almost_full_threshold = p[8];
+            event->config.fifo_rate_hz = get_u32(p + 9);
+            return MAX30102_OK;
+        case CAPTURE_RECORD_SAMPLES:
+            if (!decode_block(event, p, payload_len)) {
+                return MAX30102_ERR_INVALID_PARAM;
+            }
+            r->stats.samples += (uint32_t)event->block.count;
+            return MAX30102_OK;
+        case CAPTURE_RECORD_GAP:
+            if (payload_len < 9) {
+                return MAX30102_ERR_INVALID_PARAM;
+            }
+            event->gap.sequence = get_u32(p);
+            event->gap.count = get_u32(p + 4);
+            event->gap.saturated = (p[8] & STREAM_GAP_ESTIMATED) != 0;
+            r->stats.gaps++;
+            r->stats.samples_lost += event->gap.count;
+            return MAX30102_OK;
+        default:
+            // Written by a later version; its length lets us step over it
+            break;
+        }
+    }
+}
+
+void capture_reader_get_stats(const capture_reader_t *r, capture_stats_t *stats)
+{
+    if (stats) {
+        *stats = r->stats;
+    }
+}
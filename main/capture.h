@@ -0,0 +1,112 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "stream_codec.h"
+
+// Raw sample capture for later replay. A capture is an 8-byte file header,
+//
+//   'H' 'R' 'M' 'C' | version | 3 reserved bytes
+//
+// followed by records,
+//
+//   type | payload length (u16) | payload | CRC-16 (u16)
+//
+// little-endian, with the CRC (stream_crc16()) taken over type..payload.
+// Record payloads:
+//
+//   CONFIG   the max30102_config_t fields, one byte each, and the FIFO
+//            sample rate (u32)
+//   SAMPLES  first sequence (u32), count (u8), first timestamp (i64), then
+//            varints: drain time minus first timestamp, and per sample the
+//            red and IR deltas from the previous sample and the timestamp
+//            delta-of-delta, all zigzag-encoded
+//   GAP      sequence (u32), count (u32), flags (u8, STREAM_GAP_ESTIMATED)
+//
+// Every record decodes on its own. Timestamps are reconstructed on a fixed
+// period, so the delta-of-delta is nearly always one byte and a sample
+// takes about five. A capture cut short by a reset ends at its last
+// complete record.
+//
+// The writer encodes into a buffer and hands full buffers to a write
+// callback. It does no I/O itself, so the caller decides where the bytes
+// go: a file on the host, or a queue to a task that writes flash on the
+// device.
+
+#define CAPTURE_VERSION         1
+#define CAPTURE_FILE_HEADER     8
+#define CAPTURE_MAX_BLOCK       MAX30102_FIFO_DEPTH     // Samples per record
+#define CAPTURE_RECORD_HEADER   3
+#define CAPTURE_MAX_PAYLOAD     (4 + 1 + 8 + 10 + CAPTURE_MAX_BLOCK * (3 + 3 + 10))
+#define CAPTURE_MAX_RECORD      (CAPTURE_RECORD_HEADER + CAPTURE_MAX_PAYLOAD + 2)
+#define CAPTURE_BUFFER_SIZE     1024
+
+// Record types
+typedef enum {
+    CAPTURE_RECORD_CONFIG = 0x01,
+    CAPTURE_RECORD_SAMPLES = 0x02,
+    CAPTURE_RECORD_GAP = 0x03
+} capture_record_type_t;
+
+// Counters, for the writer or the reader
+typedef struct {
+    uint32_t records;
+    uint32_t samples;
+    uint32_t gaps;
+    uint32_t samples_lost;      // Samples covered by gap records
+    uint32_t bytes;
+    uint32_t crc_errors;        // Reader: records rejected by the CRC
+    bool truncated;             // Reader: ended inside a record
+} capture_stats_t;
+
+// One decoded record
+typedef struct {
+    capture_record_type_t type;
+    union {
+        struct {
+            max30102_config_t config;
+            uint32_t fifo_rate_hz;
+        } config;
+        struct {
+            int64_t time_us;    // When the samples were drained
+            size_t count;
+            max30102_sample_t samples[CAPTURE_MAX_BLOCK];
+        } block;
+        max30102_gap_t gap;
+    };
+} capture_event_t;
+
+typedef struct {
+    stream_write_t write;
+    void *ctx;
+    size_t len;
+    uint8_t buf[CAPTURE_BUFFER_SIZE];
+    capture_stats_t stats;
+} capture_writer_t;
+
+// Reads up to 'len' bytes, like fread(); fewer means the end of the capture
+typedef size_t (*capture_read_t)(void *ctx, uint8_t *buf, size_t len);
+
+typedef struct {
+    capture_read_t read;
+    void *ctx;
+    uint8_t buf[CAPTURE_MAX_RECORD];
+    capture_stats_t stats;
+} capture_reader_t;
+
+// Function prototypes
+void capture_writer_init(capture_writer_t *w, stream_write_t write, void *ctx);
+void capture_write_config(capture_writer_t *w, const max30102_config_t *config, uint32_t fifo_rate_hz);
+void capture_write_samples(capture_writer_t *w, const max30102_sample_t *samples, size_t count, int64_t time_us);
+void capture_write_gap(capture_writer_t *w, const max30102_gap_t *gap);
+void capture_writer_flush(capture_writer_t *w);
+void capture_writer_get_stats(const capture_writer_t *w, capture_stats_t *stats);
+
+max30102_err_t capture_reader_init(capture_reader_t *r, capture_read_t read, void *ctx);
+max30102_err_t capture_reader_next(capture_reader_t *r, capture_event_t *event);
+void capture_reader_get_stats(const capture_reader_t *r, capture_stats_t *stats);
+
+#endif // CAPTURE_H
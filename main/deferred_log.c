@@ -0,0 +1,123 @@
+#include "deferred_log.h"
+#include <stdio.h>
+
+#define DEFERRED_LOG_ENTRY(id, level, tag, format) {level, tag, format},
+
+static const struct {
+    char level;
+    const char *tag;
+    const char *format;
+} messages[LOG_MSG_COUNT] = {
+    DEFERRED_LOG_MESSAGES(DEFERRED_LOG_ENTRY)
+};
+
+void deferred_log_init(deferred_log_t *log)
+{
+    atomic_init(&log->head, 0);
+    atomic_init(&log->tail, 0);
+    atomic_init(&log->written, 0);
+    atomic_init(&log->drops, 0);
+    log->flushed = 0;
+    log->drops_reported = 0;
+}
+
+char deferred_log_level(deferred_log_id_t id)
+{
+    return (id < LOG_MSG_COUNT) ? messages[id].level : 'E';
+}
+
+const char *deferred_log_tag(deferred_log_id_t id)
+{
+    return (id < LOG_MSG_COUNT) ? messages[id].tag : "DEFERRED_LOG";
+}
+
+// Formats a record's message into 'buf'. Returns the length written.
+size_t deferred_log_format(const deferred_log_record_t *record, char *buf, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+    
+    int len;
+    if (record->id < LOG_MSG_COUNT) {
+        // Arguments for %ld are sign-extended from 32 bits; long and
+        // unsigned long are passed alike
+        const char *format = messages[record->id].format;
+        unsigned long args[DEFERRED_LOG_MAX_ARGS];
+        size_t arg = 0;
+        for (size_t i = 0; i < DEFERRED_LOG_MAX_ARGS; i++) {
+            args[i] = (unsigned long)record->args[i];
+        }
+        for (const char *p = format; *p && arg < DEFERRED_LOG_MAX_ARGS; p++) {
+            if (p[0] != '%') {
+                continue;
+            }
+            if (p[1] == '%') {
+                p++;
+                continue;
+            }
+            if (p[1] == 'l' && p[2] == 'd') {
+                args[arg] = (unsigned long)(long)(int32_t)record->args[arg];
+            }
+            arg++;
+        }
+        len = snprintf(buf, size, format, args[0], args[1], args[2], args[3]);
+    } else {
+        len = snprintf(buf, size, "Unknown message %lu", (unsigned long)record->id);
+    }
+    if (len < 0) {
+        buf[0] = '\0';
+        return 0;
+    }
+    return ((size_t)len < size) ? (size_t)len : size - 1;
+}
+
+// Formats up to 'max_records' records (0 for all) in order and passes each
+// to 'sink', after a line for any records dropped since the last flush.
+// Call from one task. Returns the number of records formatted.
+size_t deferred_log_flush(deferred_log_t *log, deferred_log_sink_t sink, void *ctx, size_t max_records)
+{
+    char line[DEFERRED_LOG_LINE];
+    
+    uint32_t drops = atomic_load_explicit(&log->drops, memory_order_relaxed);
+    if (drops != log->drops_reported) {
+        snprintf(line, sizeof(line), "%lu log records dropped", (unsigned long)(drops - log->drops_reported));
+        sink(ctx, 'W', "DEFERRED_LOG", esp_timer_get_time(), line);
+        log->drops_reported = drops;
+    }
+    
+    uint32_t tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&log->head, memory_order_acquire);
+    size_t count = 0;
+    while (tail != head && (max_records == 0 || count < max_records)) {
+        const deferred_log_record_t *record = &log->slots[tail & (DEFERRED_LOG_CAPACITY - 1)];
+        deferred_log_format(record, line, sizeof(line));
+        sink(ctx, deferred_log_level((deferred_log_id_t)record->id), deferred_log_tag((deferred_log_id_t)record->id),
+             record->time_us, line);
+        
+        // The slot is only handed back once its record has been formatted
+        tail++;
+        atomic_store_explicit(&log->tail, tail, memory_order_release);
+        count++;
+    }
+    
+    log->flushed += (uint32_t)count;
+    return count;
+}
+
+// Sink that prints lines in the ESP_LOG layout, stamped with the time the
+// record was written rather than the time it was printed
+void deferred_log_print(void *ctx, char level, const char *tag, int64_t time_us, const char *text)
+{
+    (void)ctx;
+    printf("%c (%lu) %s: %s\n", level, (unsigned long)(time_us / 1000), tag, text);
+}
+
+void deferred_log_get_stats(deferred_log_t *log, deferred_log_stats_t *stats)
+{
+    if (stats) {
+        stats->written = atomic_load_explicit(&log->written, memory_order_relaxed);
+        stats->drops = atomic_load_explicit(&log->drops, memory_order_relaxed);
+        stats->flushed = log->flushed;
+    }
+}
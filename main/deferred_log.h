@@ -0,0 +1,114 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_timer.h"
+
+// Logging for the sampling path without formatting or console I/O on it.
+// A call stores a message ID, the time and up to four integer arguments in
+// a single-producer ring; deferred_log_flush(), run from a low-priority
+// task, formats the records later and hands the lines to a sink. A full
+// ring drops the record and counts it, so logging never blocks. Use one
+// ring per producing task.
+//
+// Messages are defined once, below, with their level, tag and format. A
+// format may only use %lu and %ld, one per argument, since every argument
+// is stored as a 32-bit integer.
+
+#define DEFERRED_LOG_CAPACITY   64      // Records per ring, power of two
+#define DEFERRED_LOG_MAX_ARGS   4
+#define DEFERRED_LOG_LINE       128     // Longest formatted message
+
+#define DEFERRED_LOG_MESSAGES(X) \
+    X(LOG_MSG_FIFO_GAP,         'W', "MAX30102",     "FIFO overflow, gap of %lu samples at sequence %lu") \
+    X(LOG_MSG_I2C_WRITE_FAILED, 'E', "MAX30102",     "I2C write failed: %ld") \
+    X(LOG_MSG_I2C_READ_FAILED,  'E', "MAX30102",     "I2C read failed: %ld") \
+    X(LOG_MSG_FIFO_READ_FAILED, 'E', "MAX30102",     "FIFO read failed: %ld") \
+    X(LOG_MSG_GAP,              'W', "MAIN",         "Gap: %lu samples lost at %lu") \
+    X(LOG_MSG_GAP_ESTIMATED,    'W', "MAIN",         "Gap: %lu samples lost at %lu (estimated)") \
+    X(LOG_MSG_FIRST_SAMPLE,     'I', "MAIN",         "First sample %lu ms after sensor init started") \
+    X(LOG_MSG_NO_DATA,          'I', "MAIN",         "[%lu] No data available (count: %lu)") \
+    X(LOG_MSG_READ_ERROR,       'W', "MAIN",         "Sample read error: %ld") \
+    X(LOG_MSG_SENSOR_RESET,     'W', "MAIN",         "No data for %lu attempts. Resetting sensor...") \
+    X(LOG_MSG_MEMBER_FAILED,    'W', "SENSOR_GROUP", "Member %lu drain failed: %ld")
+
+#define DEFERRED_LOG_ENUM(id, level, tag, format) id,
+
+typedef enum {
+    DEFERRED_LOG_MESSAGES(DEFERRED_LOG_ENUM)
+    LOG_MSG_COUNT
+} deferred_log_id_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t args[DEFERRED_LOG_MAX_ARGS];
+    int64_t time_us;
+} deferred_log_record_t;
+
+// Ring counters
+typedef struct {
+    uint32_t written;       // Records stored
+    uint32_t drops;         // Records dropped because the ring was full
+    uint32_t flushed;       // Records formatted
+} deferred_log_stats_t;
+
+typedef struct {
+    // Written by the producer only
+    _Alignas(64) atomic_uint head;
+    atomic_uint written;
+    atomic_uint drops;
+    
+    // Written by the consumer only
+    _Alignas(64) atomic_uint tail;
+    uint32_t flushed;
+    uint32_t drops_reported;
+    
+    deferred_log_record_t slots[DEFERRED_LOG_CAPACITY];
+} deferred_log_t;
+
+// Receives one formatted line. 'level' is 'E', 'W' or 'I'.
+typedef void (*deferred_log_sink_t)(void *ctx, char level, const char *tag, int64_t time_us, const char *text);
+
+// Function prototypes
+void deferred_log_init(deferred_log_t *log);
+size_t deferred_log_flush(deferred_log_t *log, deferred_log_sink_t sink, void *ctx, size_t max_records);
+size_t deferred_log_format(const deferred_log_record_t *record, char *buf, size_t size);
+char deferred_log_level(deferred_log_id_t id);
+const char *deferred_log_tag(deferred_log_id_t id);
+void deferred_log_print(void *ctx, char level, const char *tag, int64_t time_us, const char *text);
+void deferred_log_get_stats(deferred_log_t *log, deferred_log_stats_t *stats);
+
+// Stores one record; false if the ring was full. Callers use
+// DEFERRED_LOG(), which pads the arguments.
+static inline bool deferred_log_write(deferred_log_t *log, deferred_log_id_t id,
+                                      uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&log->tail, memory_order_acquire) >= DEFERRED_LOG_CAPACITY) {
+        atomic_store_explicit(&log->drops, atomic_load_explicit(&log->drops, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return false;
+    }
+    
+    deferred_log_record_t *record = &log->slots[head & (DEFERRED_LOG_CAPACITY - 1)];
+    record->id = (uint32_t)id;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+    record->time_us = esp_timer_get_time();
+    
+    atomic_store_explicit(&log->head, head + 1, memory_order_release);
+    atomic_store_explicit(&log->written, atomic_load_explicit(&log->written, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    return true;
+}
+
+// DEFERRED_LOG(log, id, args...) with one to four integer arguments
+#define DEFERRED_LOG_PAD(a0, a1, a2, a3, ...) (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)
+#define DEFERRED_LOG(log, id, ...) deferred_log_write((log), (id), DEFERRED_LOG_PAD(__VA_ARGS__, 0, 0, 0, 0))
+
+#endif // DEFERRED_LOG_H
@@ -0,0 +1,229 @@
+#include "dsp_filters.h"
+#include <math.h>
+#include <string.h>
+
+// Private function prototypes
+static void dsp_biquad_design(dsp_biquad_coef_t *c, double f0, double fs, double q, bool highpass);
+
+max30102_err_t dsp_biquad_cascade_init(dsp_biquad_cascade_t *f, const dsp_biquad_coef_t *coef, size_t sections)
+{
+    if (!f || !coef || sections == 0 || sections > DSP_MAX_SECTIONS) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(f, 0, sizeof(*f));
+    f->coef = coef;
+    f->sections = sections;
+    return MAX30102_OK;
+}
+
+void dsp_biquad_cascade_process(dsp_biquad_cascade_t *f, dsp_block_t *block)
+{
+    dsp_biquad_cascade_run(f->coef, f->sections, f->state, block);
+}
+
+void dsp_biquad_cascade_step(dsp_biquad_cascade_t *f, int32_t v[DSP_LANES])
+{
+    dsp_biquad_cascade_pair(f->coef, f->sections, f->state, v);
+}
+
+// Same formulas as DSP_BIQUAD_LOWPASS/HIGHPASS, for rates known only at run time
+static void dsp_biquad_design(dsp_biquad_coef_t *c, double f0, double fs, double q, bool highpass)
+{
+    double w0 = 2.0 * DSP_PI * f0 / fs;
+    double alpha = sin(w0) / (2.0 * q);
+    double cw = cos(w0);
+    double a0 = 1.0 + alpha;
+    double b1 = highpass ? -(1.0 + cw) : (1.0 - cw);
+    double scale = (double)(1 << DSP_COEF_SHIFT);
+    
+    c->b0 = (int32_t)lround(fabs(b1) / 2.0 / a0 * scale);
+    c->b1 = (int32_t)lround(b1 / a0 * scale);
+    c->b2 = c->b0;
+    c->a1 = (int32_t)lround(-2.0 * cw / a0 * scale);
+    c->a2 = (int32_t)lround((1.0 - alpha) / a0 * scale);
+}
+
+void dsp_biquad_design_lowpass(dsp_biquad_coef_t *c, double f0, double fs, double q)
+{
+    dsp_biquad_design(c, f0, fs, q, false);
+}
+
+void dsp_biquad_design_highpass(dsp_biquad_coef_t *c, double f0, double fs, double q)
+{
+    dsp_biquad_design(c, f0, fs, q, true);
+}
+
+max30102_err_t dsp_moving_average_init(dsp_moving_average_t *f, uint32_t length)
+{
+    if (!f || length == 0 || length > DSP_MA_MAX_LENGTH) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(f, 0, sizeof(*f));
+    f->length = length;
+    f->recip = (int64_t)(((1ull << 32) + length / 2) / length);
+    if ((length & (length - 1)) == 0) {
+        while ((1u << f->shift) < length) {
+            f->shift++;
+        }
+    }
+    return MAX30102_OK;
+}
+
+static inline int32_t dsp_moving_average_scale(const dsp_moving_average_t *f, int32_t sum)
+{
+    if (f->shift > 0) {
+        // Matches the rounding of DSP_DEFINE_MOVING_AVERAGE
+        return (sum + (1 << (f->shift - 1))) >> f->shift;
+    }
+    if (f->length == 1) {
+        return sum;
+    }
+    return (int32_t)(((int64_t)sum * f->recip + (1ll << 31)) >> 32);
+}
+
+void dsp_moving_average_step(dsp_moving_average_t *f, int32_t v[DSP_LANES])
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        f->sum[l] += v[l] - f->history[f->index][l];
+        f->history[f->index][l] = v[l];
+        v[l] = dsp_moving_average_scale(f, f->sum[l]);
+    }
+    if (++f->index == f->length) {
+        f->index = 0;
+    }
+}
+
+void dsp_moving_average_process(dsp_moving_average_t *f, dsp_block_t *block)
+{
+    uint32_t start = f->index;
+    for (int l = 0; l < DSP_LANES; l++) {
+        int32_t sum = f->sum[l];
+        uint32_t index = start;
+        int32_t *data = block->lane[l];
+        for (size_t i = 0; i < block->count; i++) {
+            sum += data[i] - f->history[index][l];
+            f->history[index][l] = data[i];
+            data[i] = dsp_moving_average_scale(f, sum);
+            if (++index == f->length) {
+                index = 0;
+            }
+        }
+        f->sum[l] = sum;
+    }
+    f->index = (uint32_t)((start + block->count) % f->length);
+}
+
+max30102_err_t dsp_cic_init(dsp_cic_t *f, uint32_t order, uint32_t rate)
+{
+    if (!f || order == 0 || order > DSP_CIC_MAX_ORDER || rate < 2 || (rate & (rate - 1)) != 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    uint32_t log2_rate = 0;
+    while ((1u << log2_rate) < rate) {
+        log2_rate++;
+    }
+    if (order * log2_rate + DSP_CIC_INPUT_BITS > 32) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(f, 0, sizeof(*f));
+    f->order = order;
+    f->rate = rate;
+    f->shift = order * log2_rate;
+    return MAX30102_OK;
+}
+
+bool dsp_cic_step(dsp_cic_t *f, int32_t v[DSP_LANES])
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        uint32_t acc = (uint32_t)v[l];
+        for (uint32_t s = 0; s < f->order; s++) {
+            acc = f->integrator[s][l] += acc;
+        }
+    }
+    if (++f->phase < f->rate) {
+        return false;
+    }
+    f->phase = 0;
+    
+    for (int l = 0; l < DSP_LANES; l++) {
+        uint32_t acc = f->integrator[f->order - 1][l];
+        for (uint32_t s = 0; s < f->order; s++) {
+            uint32_t delayed = f->comb[s][l];
+            f->comb[s][l] = acc;
+            acc -= delayed;
+        }
+        v[l] = (int32_t)acc >> f->shift;
+    }
+    return true;
+}
+
+size_t dsp_cic_process(dsp_cic_t *f, const dsp_block_t *in, dsp_block_t *out)
+{
+    out->count = 0;
+    for (size_t i = 0; i < in->count; i++) {
+        int32_t v[DSP_LANES] = {in->lane[0][i], in->lane[1][i]};
+        if (dsp_cic_step(f, v)) {
+            out->lane[0][out->count] = v[0];
+            out->lane[1][out->count] = v[1];
+            out->count++;
+        }
+    }
+    return out->count;
+}
+
+// Time constant of at least 'samples', rounded up to a power of two
+void dsp_dc_tracker_init(dsp_dc_tracker_t *f, uint32_t samples)
+{
+    memset(f, 0, sizeof(*f));
+    while ((1u << f->shift) < samples) {
+        f->shift++;
+    }
+}
+
+// Starts the estimate at 'v' instead of ramping up from 0
+void dsp_dc_tracker_seed(dsp_dc_tracker_t *f, const int32_t v[DSP_LANES])
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        f->acc[l] = v[l] << f->shift;
+    }
+}
+
+// Adds 'v' to the estimate and replaces it with v minus the new estimate
+void dsp_dc_tracker_step(dsp_dc_tracker_t *f, int32_t v[DSP_LANES])
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        f->acc[l] += v[l] - (f->acc[l] >> f->shift);
+        v[l] -= f->acc[l] >> f->shift;
+    }
+}
+
+int32_t dsp_dc_tracker_level(const dsp_dc_tracker_t *f, int lane)
+{
+    return f->acc[lane] >> f->shift;
+}
+
+// floor(sqrt(v)), bit by bit, for the RMS and ratio readouts that have to
+// stay in integers
+uint32_t dsp_isqrt64(uint64_t v)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ull << 62;
+    
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (v >= result + bit) {
+            v -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
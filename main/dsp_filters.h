@@ -0,0 +1,426 @@
+#ifndef DSP_FILTERS_H
+#define DSP_FILTERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Fixed-point filter kernels for red/IR sample blocks.
+//
+// Blocks are structure-of-arrays: one int32_t array per channel (lane), so a
+// filter runs along a contiguous array with its state held in registers for
+// the whole block. Each filter comes in two forms:
+//
+//  - Specialized: DSP_DEFINE_* macros generate a state type and static
+//    inline functions with the order and coefficients fixed at compile
+//    time. The coefficients are constant expressions, and the biquad
+//    design macros below are folded by the compiler, so the kernels see
+//    literal constants and constant trip counts.
+//  - Runtime: the dsp_*_t types in dsp_filters.c take coefficients and
+//    lengths at init. They use the same arithmetic, so their output is
+//    bit-identical to the specialized form.
+//
+// Where the compiler has GCC vector extensions and the target has SIMD
+// (SSE2 or NEON), the specialized moving average and CIC process both lanes
+// in one vector. Elsewhere, Xtensa included, they use a scalar loop. Define
+// DSP_FORCE_SCALAR to always take the scalar path. The biquad is always
+// scalar: its 32x32->64-bit products have no portable vector form, and
+// emulating them costs more than the second lane saves.
+//
+// dsp_dc_tracker_t is the one-pole DC estimate the estimators subtract
+// before their band filters: a time constant of a power of two samples, so
+// the update is a shift and an add. dsp_isqrt64() is the integer square
+// root shared by the signal-quality and SpO2 readouts.
+
+#define DSP_LANES           2       // Red, IR
+#define DSP_LANE_RED        0
+#define DSP_LANE_IR         1
+#define DSP_BLOCK_MAX       64
+#define DSP_COEF_SHIFT      28      // Biquad coefficients are Q28
+#define DSP_MAX_SECTIONS    4       // Runtime biquad cascade
+#define DSP_MA_MAX_LENGTH   256     // Runtime moving average
+#define DSP_CIC_MAX_ORDER   4
+#define DSP_CIC_INPUT_BITS  19      // 18-bit samples plus sign
+
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON)) && !defined(DSP_FORCE_SCALAR)
+#define DSP_VECTOR          1
+typedef int32_t dsp_v2i32_t __attribute__((vector_size(DSP_LANES * sizeof(int32_t))));
+typedef int64_t dsp_v2i64_t __attribute__((vector_size(DSP_LANES * sizeof(int64_t))));
+#else
+#define DSP_VECTOR          0
+#endif
+
+#define DSP_ALWAYS_INLINE   inline __attribute__((always_inline))
+
+// Structure-of-arrays block
+typedef struct {
+    size_t count;
+    int32_t lane[DSP_LANES][DSP_BLOCK_MAX];
+} dsp_block_t;
+
+// Biquad section, Q28: y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+} dsp_biquad_coef_t;
+
+typedef struct {
+    int32_t x1, x2, y1, y2;
+} dsp_biquad_state_t;
+
+// Compile-time biquad design (RBJ cookbook). The math builtins fold to
+// constants, so these can initialize a static const table.
+#define DSP_PI                  3.14159265358979323846
+#define DSP_Q(x)                ((int32_t)((x) * (double)(1 << DSP_COEF_SHIFT) + ((x) >= 0 ? 0.5 : -0.5)))
+#define DSP_W0(f, fs)           (2.0 * DSP_PI * (f) / (fs))
+#define DSP_ALPHA(f, fs, q)     (__builtin_sin(DSP_W0(f, fs)) / (2.0 * (q)))
+#define DSP_COS(f, fs)          __builtin_cos(DSP_W0(f, fs))
+#define DSP_A0(f, fs, q)        (1.0 + DSP_ALPHA(f, fs, q))
+
+#define DSP_BIQUAD_LOWPASS(f, fs, q) {                                          \
+    DSP_Q((1.0 - DSP_COS(f, fs)) / 2.0 / DSP_A0(f, fs, q)),                     \
+    DSP_Q((1.0 - DSP_COS(f, fs)) / DSP_A0(f, fs, q)),                           \
+    DSP_Q((1.0 - DSP_COS(f, fs)) / 2.0 / DSP_A0(f, fs, q)),                     \
+    DSP_Q(-2.0 * DSP_COS(f, fs) / DSP_A0(f, fs, q)),                            \
+    DSP_Q((1.0 - DSP_ALPHA(f, fs, q)) / DSP_A0(f, fs, q)) }
+
+#define DSP_BIQUAD_HIGHPASS(f, fs, q) {                                         \
+    DSP_Q((1.0 + DSP_COS(f, fs)) / 2.0 / DSP_A0(f, fs, q)),                     \
+    DSP_Q(-(1.0 + DSP_COS(f, fs)) / DSP_A0(f, fs, q)),                          \
+    DSP_Q((1.0 + DSP_COS(f, fs)) / 2.0 / DSP_A0(f, fs, q)),                     \
+    DSP_Q(-2.0 * DSP_COS(f, fs) / DSP_A0(f, fs, q)),                            \
+    DSP_Q((1.0 - DSP_ALPHA(f, fs, q)) / DSP_A0(f, fs, q)) }
+
+#define DSP_BUTTERWORTH_Q       0.70710678118654752
+
+// Block conversion between max30102_sample_t arrays and SoA blocks
+static inline void dsp_block_load(dsp_block_t *block, const max30102_sample_t *samples, size_t count)
+{
+    if (count > DSP_BLOCK_MAX) {
+        count = DSP_BLOCK_MAX;
+    }
+    for (size_t i = 0; i < count; i++) {
+        block->lane[DSP_LANE_RED][i] = (int32_t)samples[i].red;
+        block->lane[DSP_LANE_IR][i] = (int32_t)samples[i].ir;
+    }
+    block->count = count;
+}
+
+// ---------------------------------------------------------------------------
+// Kernels shared by the specialized and runtime forms
+
+// One biquad section, one sample
+static DSP_ALWAYS_INLINE int32_t dsp_biquad_section(const dsp_biquad_coef_t *c, dsp_biquad_state_t *s, int32_t x)
+{
+    int64_t acc = (int64_t)c->b0 * x + (int64_t)c->b1 * s->x1 + (int64_t)c->b2 * s->x2 -
+                  (int64_t)c->a1 * s->y1 - (int64_t)c->a2 * s->y2;
+    int32_t y = (int32_t)((acc + (1 << (DSP_COEF_SHIFT - 1))) >> DSP_COEF_SHIFT);
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+    return y;
+}
+
+// Cascade over a block, in place. The loop runs sample by sample through
+// every section and lane, so the independent recursions of each section and
+// lane overlap in the pipeline. With a constant section count the local copy
+// of the state stays in registers for the whole block.
+static DSP_ALWAYS_INLINE void dsp_biquad_cascade_run(const dsp_biquad_coef_t *coef, size_t sections,
+                                                     dsp_biquad_state_t (*state)[DSP_LANES], dsp_block_t *block)
+{
+    dsp_biquad_state_t st[DSP_MAX_SECTIONS][DSP_LANES];
+    for (size_t s = 0; s < sections; s++) {
+        for (int l = 0; l < DSP_LANES; l++) {
+            st[s][l] = state[s][l];
+        }
+    }
+    for (size_t i = 0; i < block->count; i++) {
+        for (int l = 0; l < DSP_LANES; l++) {
+            int32_t x = block->lane[l][i];
+            for (size_t s = 0; s < sections; s++) {
+                x = dsp_biquad_section(&coef[s], &st[s][l], x);
+            }
+            block->lane[l][i] = x;
+        }
+    }
+    for (size_t s = 0; s < sections; s++) {
+        for (int l = 0; l < DSP_LANES; l++) {
+            state[s][l] = st[s][l];
+        }
+    }
+}
+
+static DSP_ALWAYS_INLINE void dsp_biquad_cascade_pair(const dsp_biquad_coef_t *coef, size_t sections,
+                                                      dsp_biquad_state_t (*state)[DSP_LANES], int32_t v[DSP_LANES])
+{
+    for (int l = 0; l < DSP_LANES; l++) {
+        for (size_t s = 0; s < sections; s++) {
+            v[l] = dsp_biquad_section(&coef[s], &state[s][l], v[l]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Specialized filters
+
+// Biquad cascade with coefficients fixed at compile time:
+//
+//   DSP_DEFINE_BIQUAD_CASCADE(ppg_band, 2,
+//       DSP_BIQUAD_HIGHPASS(0.5, 100.0, DSP_BUTTERWORTH_Q),
+//       DSP_BIQUAD_LOWPASS(4.0, 100.0, DSP_BUTTERWORTH_Q))
+//
+// defines ppg_band_t, ppg_band_init(), ppg_band_process() on a block and
+// ppg_band_step() on one red/IR pair.
+#define DSP_DEFINE_BIQUAD_CASCADE(name, sections, ...)                                          \
+    _Static_assert((sections) >= 1 && (sections) <= DSP_MAX_SECTIONS, #name ": too many sections"); \
+    static const dsp_biquad_coef_t name##_coef[sections] = {__VA_ARGS__};                       \
+    typedef struct {                                                                            \
+        dsp_biquad_state_t state[sections][DSP_LANES];                                          \
+    } name##_t;                                                                                 \
+    static inline void name##_init(name##_t *f)                                                 \
+    {                                                                                           \
+        *f = (name##_t){0};                                                                     \
+    }                                                                                           \
+    static inline void name##_process_scalar(name##_t *f, dsp_block_t *block)                   \
+    {                                                                                           \
+        dsp_biquad_cascade_run(name##_coef, (sections), f->state, block);                       \
+    }                                                                                           \
+    static inline void name##_process(name##_t *f, dsp_block_t *block)                          \
+    {                                                                                           \
+        name##_process_scalar(f, block);                                                        \
+    }                                                                                           \
+    static inline void name##_step(name##_t *f, int32_t v[DSP_LANES])                           \
+    {                                                                                           \
+        dsp_biquad_cascade_pair(name##_coef, (sections), f->state, v);                          \
+    }
+
+
+// Moving average over 2^log2_length samples; the divide is a shift.
+// Output starts from zero history, so the first 2^log2_length outputs ramp up.
+#define DSP_DEFINE_MOVING_AVERAGE(name, log2_length)                                            \
+    enum { name##_LENGTH = 1 << (log2_length) };                                                \
+    typedef struct {                                                                            \
+        int32_t history[name##_LENGTH][DSP_LANES];                                              \
+        int32_t sum[DSP_LANES];                                                                 \
+        uint32_t index;                                                                         \
+    } name##_t;                                                                                 \
+    static inline void name##_init(name##_t *f)                                                 \
+    {                                                                                           \
+        *f = (name##_t){0};                                                                     \
+    }                                                                                           \
+    static inline void name##_step(name##_t *f, int32_t v[DSP_LANES])                           \
+    {                                                                                           \
+        for (int l = 0; l < DSP_LANES; l++) {                                                   \
+            f->sum[l] += v[l] - f->history[f->index][l];                                        \
+            f->history[f->index][l] = v[l];                                                     \
+            v[l] = (f->sum[l] + (1 << ((log2_length) - 1))) >> (log2_length);                   \
+        }                                                                                       \
+        f->index = (f->index + 1) & (name##_LENGTH - 1);                                        \
+    }                                                                                           \
+    static inline void name##_process_scalar(name##_t *f, dsp_block_t *block)                   \
+    {                                                                                           \
+        uint32_t start = f->index;                                                              \
+        for (int l = 0; l < DSP_LANES; l++) {                                                   \
+            int32_t sum = f->sum[l];                                                            \
+            uint32_t index = start;                                                             \
+            int32_t *data = block->lane[l];                                                     \
+            for (size_t i = 0; i < block->count; i++) {                                         \
+                sum += data[i] - f->history[index][l];                                          \
+                f->history[index][l] = data[i];                                                 \
+                data[i] = (sum + (1 << ((log2_length) - 1))) >> (log2_length);                  \
+                index = (index + 1) & (name##_LENGTH - 1);                                      \
+            }                                                                                   \
+            f->sum[l] = sum;                                                                    \
+        }                                                                                       \
+        f->index = (start + (uint32_t)block->count) & (name##_LENGTH - 1);                      \
+    }                                                                                           \
+    DSP_MA_VECTOR_PROCESS(name, log2_length)
+
+#if DSP_VECTOR
+#define DSP_MA_VECTOR_PROCESS(name, log2_length)                                                \
+    static inline void name##_process_vector(name##_t *f, dsp_block_t *block)                   \
+    {                                                                                           \
+        dsp_v2i32_t sum = {f->sum[0], f->sum[1]};                                               \
+        uint32_t index = f->index;                                                              \
+        for (size_t i = 0; i < block->count; i++) {                                             \
+            dsp_v2i32_t x = {block->lane[0][i], block->lane[1][i]};                             \
+            dsp_v2i32_t old;                                                                    \
+            __builtin_memcpy(&old, f->history[index], sizeof(old));                             \
+            __builtin_memcpy(f->history[index], &x, sizeof(x));                                 \
+            sum += x - old;                                                                     \
+            dsp_v2i32_t y = (sum + (1 << ((log2_length) - 1))) >> (log2_length);                \
+            block->lane[0][i] = y[0];                                                           \
+            block->lane[1][i] = y[1];                                                           \
+            index = (index + 1) & (name##_LENGTH - 1);                                          \
+        }                                                                                       \
+        f->sum[0] = sum[0];                                                                     \
+        f->sum[1] = sum[1];                                                                     \
+        f->index = index;                                                                       \
+    }                                                                                           \
+    static inline void name##_process(name##_t *f, dsp_block_t *block)                          \
+    {                                                                                           \
+        name##_process_vector(f, block);                                                        \
+    }
+#else
+#define DSP_MA_VECTOR_PROCESS(name, log2_length)                                                \
+    static inline void name##_process(name##_t *f, dsp_block_t *block)                          \
+    {                                                                                           \
+        name##_process_scalar(f, block);                                                        \
+    }
+#endif
+
+// Decimating CIC filter of the given order, decimation 2^log2_rate and unit
+// differential delay. Integrators and combs wrap modulo 2^32, which is exact
+// as long as the gain-normalized output fits, checked at compile time.
+// process() reads one block and writes the decimated samples to another.
+#define DSP_DEFINE_CIC_DECIMATOR(name, order, log2_rate)                                        \
+    _Static_assert((order) >= 1 && (order) <= DSP_CIC_MAX_ORDER, #name ": CIC order out of range"); \
+    _Static_assert((order) * (log2_rate) + DSP_CIC_INPUT_BITS <= 32, #name ": CIC register growth exceeds 32 bits"); \
+    typedef struct {                                                                            \
+        uint32_t integrator[order][DSP_LANES];                                                  \
+        uint32_t comb[order][DSP_LANES];                                                        \
+        uint32_t phase;                                                                         \
+    } name##_t;                                                                                 \
+    static inline void name##_init(name##_t *f)                                                 \
+    {                                                                                           \
+        *f = (name##_t){0};                                                                     \
+    }                                                                                           \
+    static inline bool name##_step(name##_t *f, int32_t v[DSP_LANES])                           \
+    {                                                                                           \
+        for (int l = 0; l < DSP_LANES; l++) {                                                   \
+            uint32_t acc = (uint32_t)v[l];                                                      \
+            for (int s = 0; s < (order); s++) {                                                 \
+                acc = f->integrator[s][l] += acc;                                               \
+            }                                                                                   \
+        }                                                                                       \
+        if (++f->phase < (1u << (log2_rate))) {                                                 \
+            return false;                                                                       \
+        }                                                                                       \
+        f->phase = 0;                                                                           \
+        for (int l = 0; l < DSP_LANES; l++) {                                                   \
+            uint32_t acc = f->integrator[(order) - 1][l];                                       \
+            for (int s = 0; s < (order); s++) {                                                 \
+                uint32_t delayed = f->comb[s][l];                                               \
+                f->comb[s][l] = acc;                                                            \
+                acc -= delayed;                                                                 \
+            }                                                                                   \
+            v[l] = (int32_t)acc >> ((order) * (log2_rate));                                     \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+    static inline size_t name##_process_scalar(name##_t *f, const dsp_block_t *in, dsp_block_t *out) \
+    {                                                                                           \
+        out->count = 0;                                                                         \
+        for (size_t i = 0; i < in->count; i++) {                                                \
+            int32_t v[DSP_LANES] = {in->lane[0][i], in->lane[1][i]};                            \
+            if (name##_step(f, v)) {                                                            \
+                out->lane[0][out->count] = v[0];                                                \
+                out->lane[1][out->count] = v[1];                                                \
+                out->count++;                                                                   \
+            }                                                                                   \
+        }                                                                                       \
+        return out->count;                                                                      \
+    }                                                                                           \
+    DSP_CIC_VECTOR_PROCESS(name, order, log2_rate)
+
+#if DSP_VECTOR
+#define DSP_CIC_VECTOR_PROCESS(name, order, log2_rate)                                          \
+    static inline size_t name##_process_vector(name##_t *f, const dsp_block_t *in, dsp_block_t *out) \
+    {                                                                                           \
+        typedef uint32_t v2u32 __attribute__((vector_size(DSP_LANES * sizeof(uint32_t))));      \
+        v2u32 integ[order], comb[order];                                                        \
+        __builtin_memcpy(integ, f->integrator, sizeof(integ));                                  \
+        __builtin_memcpy(comb, f->comb, sizeof(comb));                                          \
+        uint32_t phase = f->phase;                                                              \
+        out->count = 0;                                                                         \
+        for (size_t i = 0; i < in->count; i++) {                                                \
+            v2u32 acc = {(uint32_t)in->lane[0][i], (uint32_t)in->lane[1][i]};                   \
+            for (int s = 0; s < (order); s++) {                                                 \
+                acc = integ[s] += acc;                                                          \
+            }                                                                                   \
+            if (++phase < (1u << (log2_rate))) {                                                \
+                continue;                                                                       \
+            }                                                                                   \
+            phase = 0;                                                                          \
+            for (int s = 0; s < (order); s++) {                                                 \
+                v2u32 delayed = comb[s];                                                        \
+                comb[s] = acc;                                                                  \
+                acc -= delayed;                                                                 \
+            }                                                                                   \
+            out->lane[0][out->count] = (int32_t)acc[0] >> ((order) * (log2_rate));              \
+            out->lane[1][out->count] = (int32_t)acc[1] >> ((order) * (log2_rate));              \
+            out->count++;                                                                       \
+        }                                                                                       \
+        __builtin_memcpy(f->integrator, integ, sizeof(integ));                                  \
+        __builtin_memcpy(f->comb, comb, sizeof(comb));                                          \
+        f->phase = phase;                                                                       \
+        return out->count;                                                                      \
+    }                                                                                           \
+    static inline size_t name##_process(name##_t *f, const dsp_block_t *in, dsp_block_t *out)   \
+    {                                                                                           \
+        return name##_process_vector(f, in, out);                                               \
+    }
+#else
+#define DSP_CIC_VECTOR_PROCESS(name, order, log2_rate)                                          \
+    static inline size_t name##_process(name##_t *f, const dsp_block_t *in, dsp_block_t *out)   \
+    {                                                                                           \
+        return name##_process_scalar(f, in, out);                                               \
+    }
+#endif
+
+// ---------------------------------------------------------------------------
+// Runtime-configured filters (dsp_filters.c)
+
+typedef struct {
+    const dsp_biquad_coef_t *coef;
+    size_t sections;
+    dsp_biquad_state_t state[DSP_MAX_SECTIONS][DSP_LANES];
+} dsp_biquad_cascade_t;
+
+typedef struct {
+    uint32_t length;
+    int64_t recip;                  // Q32 reciprocal of length
+    uint32_t shift;                 // log2(length) if a power of two, else 0
+    int32_t history[DSP_MA_MAX_LENGTH][DSP_LANES];
+    int32_t sum[DSP_LANES];
+    uint32_t index;
+} dsp_moving_average_t;
+
+typedef struct {
+    uint32_t order;
+    uint32_t rate;
+    uint32_t shift;                 // order * log2(rate)
+    uint32_t integrator[DSP_CIC_MAX_ORDER][DSP_LANES];
+    uint32_t comb[DSP_CIC_MAX_ORDER][DSP_LANES];
+    uint32_t phase;
+} dsp_cic_t;
+
+typedef struct {
+    uint32_t shift;                 // Time constant of 2^shift samples
+    int32_t acc[DSP_LANES];         // DC estimate << shift
+} dsp_dc_tracker_t;
+
+// Function prototypes
+max30102_err_t dsp_biquad_cascade_init(dsp_biquad_cascade_t *f, const dsp_biquad_coef_t *coef, size_t sections);
+void dsp_biquad_cascade_process(dsp_biquad_cascade_t *f, dsp_block_t *block);
+void dsp_biquad_cascade_step(dsp_biquad_cascade_t *f, int32_t v[DSP_LANES]);
+void dsp_biquad_design_lowpass(dsp_biquad_coef_t *c, double f0, double fs, double q);
+void dsp_biquad_design_highpass(dsp_biquad_coef_t *c, double f0, double fs, double q);
+
+max30102_err_t dsp_moving_average_init(dsp_moving_average_t *f, uint32_t length);
+void dsp_moving_average_process(dsp_moving_average_t *f, dsp_block_t *block);
+void dsp_moving_average_step(dsp_moving_average_t *f, int32_t v[DSP_LANES]);
+
+max30102_err_t dsp_cic_init(dsp_cic_t *f, uint32_t order, uint32_t rate);
+size_t dsp_cic_process(dsp_cic_t *f, const dsp_block_t *in, dsp_block_t *out);
+bool dsp_cic_step(dsp_cic_t *f, int32_t v[DSP_LANES]);
+
+void dsp_dc_tracker_init(dsp_dc_tracker_t *f, uint32_t samples);
+void dsp_dc_tracker_seed(dsp_dc_tracker_t *f, const int32_t v[DSP_LANES]);
+void dsp_dc_tracker_step(dsp_dc_tracker_t *f, int32_t v[DSP_LANES]);
+int32_t dsp_dc_tracker_level(const dsp_dc_tracker_t *f, int lane);
+
+uint32_t dsp_isqrt64(uint64_t v);
+
+#endif // DSP_FILTERS_H
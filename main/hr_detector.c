@@ -0,0 +1,326 @@
+#include "hr_detector.h"
+#include <math.h>
+#include <string.h>
+
+#define HR_LOW_HZ           0.5     // Bandpass edges
+#define HR_HIGH_HZ          4.0
+#define HR_OUTLIER_PCT      40      // Interval deviation from the average that counts as an outlier
+#define HR_MAX_OUTLIERS     3       // Consecutive outliers before the average is restarted
+#define HR_PRIOR_PCT        15      // First-interval deviation from a warm-start prior that confirms it
+
+// Private function prototypes
+static void hr_clear_beats(hr_detector_t *det);
+static bool hr_step(hr_detector_t *det, int32_t x, hr_beat_t *beat);
+static bool hr_emit_beat(hr_detector_t *det, hr_beat_t *beat);
+
+max30102_err_t hr_detector_init(hr_detector_t *det, uint32_t sample_rate_hz)
+{
+    if (!det || sample_rate_hz < HR_MIN_RATE_HZ) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(det, 0, sizeof(*det));
+    det->sample_rate_hz = sample_rate_hz;
+    det->decimation = (sample_rate_hz >= 2 * HR_INTERNAL_RATE_HZ) ? sample_rate_hz / HR_INTERNAL_RATE_HZ : 1;
+    det->decimation_recip = (int32_t)(((1u << 16) + det->decimation / 2) / det->decimation);
+    
+    // Time constants of about 1 s (DC) and 2.5 s (peak envelope)
+    double rate = (double)sample_rate_hz / det->decimation;
+    while ((double)(1u << det->dc_shift) < rate) {
+        det->dc_shift++;
+    }
+    det->amp_shift = det->dc_shift + 1;
+    
+    // Bandpass biquad, constant 0 dB peak gain, designed once at init
+    double f0 = sqrt(HR_LOW_HZ * HR_HIGH_HZ);
+    double q = f0 / (HR_HIGH_HZ - HR_LOW_HZ);
+    double w0 = 2.0 * M_PI * f0 / rate;
+    double alpha = sin(w0) / (2.0 * q);
+    double a0 = 1.0 + alpha;
+    det->b0 = (int32_t)lround(alpha / a0 * (1 << HR_COEF_SHIFT));
+    det->a1 = (int32_t)lround(-2.0 * cos(w0) / a0 * (1 << HR_COEF_SHIFT));
+    det->a2 = (int32_t)lround((1.0 - alpha) / a0 * (1 << HR_COEF_SHIFT));
+    
+    det->refractory_q8 = (sample_rate_hz * 60 / HR_MAX_BPM) << 8;
+    det->min_interval_q8 = det->refractory_q8;
+    det->max_interval_q8 = (sample_rate_hz * 60 / HR_MIN_BPM) << 8;
+    
+    hr_detector_reset(det);
+    return MAX30102_OK;
+}
+
+void hr_detector_reset(hr_detector_t *det)
+{
+    det->box_sum = 0;
+    det->box_count = 0;
+    det->started = false;
+    det->x1 = det->x2 = det->y1 = det->y2 = 0;
+    det->settle = det->sample_rate_hz / det->decimation;   // Let the filters settle for 1 s
+    det->prev = 0;
+    det->amp = 0;
+    det->above = false;
+    det->need_right = false;
+    det->prior_q8 = 0;
+    hr_clear_beats(det);
+}
+
+static void hr_clear_beats(hr_detector_t *det)
+{
+    det->have_beat = false;
+    det->interval_sum_q8 = 0;
+    det->interval_head = 0;
+    det->interval_count = 0;
+    det->outliers = 0;
+    det->bpm_x10 = 0;
+}
+
+bool hr_detector_process(hr_detector_t *det, const max30102_sample_t *sample, hr_beat_t *beat)
+{
+    det->stats.samples++;
+    
+    if (det->started) {
+        uint32_t step = sample->sequence - det->last_sequence;
+        if (step > det->sample_rate_hz) {
+            // More than a second lost: the filters and beat history are stale
+            hr_detector_reset(det);
+            det->stats.resets++;
+        } else {
+            det->position += step;
+        }
+    }
+    if (!det->started) {
+        det->position = sample->sequence;
+        det->started = true;
+        det->dc_acc = (int32_t)(sample->ir << HR_SIGNAL_SHIFT) << det->dc_shift;
+        det->x1 = det->x2 = 0;
+    }
+    det->last_sequence = sample->sequence;
+    
+    // Boxcar decimation; only every decimation-th sample reaches the filters
+    det->box_sum += (int32_t)sample->ir;
+    if (++det->box_count < det->decimation) {
+        return false;
+    }
+    int32_t x = (int32_t)(((int64_t)det->box_sum * det->decimation_recip) >> (16 - HR_SIGNAL_SHIFT));
+    det->box_sum = 0;
+    det->box_count = 0;
+    
+    return hr_step(det, x, beat);
+}
+
+// One decimated sample, x in counts << HR_SIGNAL_SHIFT
+static bool hr_step(hr_detector_t *det, int32_t x, hr_beat_t *beat)
+{
+    // DC removal
+    det->dc_acc += x - (det->dc_acc >> det->dc_shift);
+    int32_t dc = det->dc_acc >> det->dc_shift;
+    int32_t ac = x - dc;
+    
+    // Bandpass, direct form I with b1 = 0 and b2 = -b0
+    int64_t acc = (int64_t)det->b0 * (ac - det->x2) - (int64_t)det->a1 * det->y1 -
+                  (int64_t)det->a2 * det->y2;
+    int32_t y = (int32_t)((acc + (1 << (HR_COEF_SHIFT - 1))) >> HR_COEF_SHIFT);
+    det->x2 = det->x1;
+    det->x1 = ac;
+    det->y2 = det->y1;
+    det->y1 = y;
+    
+    // Absorption rises with blood volume, so systolic peaks are minima of
+    // the detected light
+    int32_t v = -y;
+    
+    // Centre of the boxcar, in input samples Q8
+    uint64_t position_q8 = (det->position << 8) - ((uint64_t)(det->decimation - 1) << 7);
+    
+    if (dc < (HR_MIN_DC << HR_SIGNAL_SHIFT)) {
+        // No finger: hold off until the signal has been back for a while
+        if (det->have_beat) {
+            hr_clear_beats(det);
+            det->stats.resets++;
+        }
+        det->settle = det->sample_rate_hz / det->decimation;
+        det->above = false;
+    }
+    if (det->settle > 0) {
+        det->settle--;
+        det->prev = v;
+        return false;
+    }
+    
+    if (det->have_beat && position_q8 - det->last_beat_q8 > det->max_interval_q8) {
+        // Dropout: no beat for longer than the slowest allowed interval
+        hr_clear_beats(det);
+        det->stats.resets++;
+    }
+    
+    // Threshold at half the recent peak height, never below the noise floor
+    det->amp -= det->amp >> det->amp_shift;
+    int32_t threshold = det->amp >> 1;
+    int32_t floor = dc >> 11;
+    if (threshold < floor) {
+        threshold = floor;
+    }
+    
+    bool found = false;
+    if (det->need_right) {
+        det->seg_right = v;
+        det->need_right = false;
+    }
+    
+    if (!det->above) {
+        if (v > threshold &&
+            (!det->have_beat || position_q8 - det->last_beat_q8 >= det->refractory_q8)) {
+            det->above = true;
+            det->seg_max = v;
+            det->seg_left = det->prev;
+            det->seg_position = position_q8;
+            det->need_right = true;
+        }
+    } else if (v > det->seg_max) {
+        det->seg_max = v;
+        det->seg_left = det->prev;
+        det->seg_position = position_q8;
+        det->need_right = true;
+    } else if (v < threshold) {
+        // Segment over: the beat is at its maximum
+        det->above = false;
+        found = hr_emit_beat(det, beat);
+    }
+    
+    det->prev = v;
+    return found;
+}
+
+static bool hr_emit_beat(hr_detector_t *det, hr_beat_t *beat)
+{
+    // Parabolic interpolation of the peak between decimated samples
+    int32_t denom = det->seg_left - 2 * det->seg_max + det->seg_right;
+    int32_t offset_q8 = 0;
+    if (denom < 0) {
+        offset_q8 = (int32_t)(((int64_t)(det->seg_left - det->seg_right) << 7) / denom);
+        if (offset_q8 > 128) offset_q8 = 128;
+        if (offset_q8 < -128) offset_q8 = -128;
+    }
+    uint64_t beat_q8 = det->seg_position + (int64_t)offset_q8 * (int32_t)det->decimation;
+    
+    det->amp += (det->seg_max - det->amp) >> 2;
+    
+    uint32_t interval_q8 = 0;
+    if (det->have_beat) {
+        interval_q8 = (uint32_t)(beat_q8 - det->last_beat_q8);
+        uint32_t count = det->interval_count;
+        
+        if (interval_q8 < det->min_interval_q8 || interval_q8 > det->max_interval_q8) {
+            det->stats.intervals_rejected++;
+        } else if (count >= HR_MIN_BEATS &&
+                   (uint64_t)interval_q8 * count * 100 <
+                       (uint64_t)det->interval_sum_q8 * (100 - HR_OUTLIER_PCT)) {
+            // Much shorter than the average: a noise or dicrotic peak, not a beat
+            det->stats.intervals_rejected++;
+            if (++det->outliers < HR_MAX_OUTLIERS) {
+                return false;
+            }
+            hr_clear_beats(det);
+            det->stats.resets++;
+        } else if (count >= HR_MIN_BEATS &&
+                   (uint64_t)interval_q8 * count * 100 >
+                       (uint64_t)det->interval_sum_q8 * (100 + HR_OUTLIER_PCT)) {
+            // Much longer: probably a missed beat; keep the beat, drop the interval
+            det->stats.intervals_rejected++;
+            if (++det->outliers >= HR_MAX_OUTLIERS) {
+                hr_clear_beats(det);
+                det->stats.resets++;
+            }
+        } else {
+            if (count == HR_AVG_BEATS) {
+                det->interval_sum_q8 -= det->intervals_q8[det->interval_head];
+            } else {
+                det->interval_count++;
+            }
+            det->intervals_q8[det->interval_head] = interval_q8;
+            det->interval_sum_q8 += interval_q8;
+            det->interval_head = (det->interval_head + 1) % HR_AVG_BEATS;
+            det->outliers = 0;
+        }
+        
+        // A warm-start prior is checked against the first interval only
+        bool confirmed = false;
+        if (det->prior_q8 && det->interval_count > 0) {
+            uint64_t diff = (interval_q8 > det->prior_q8) ? interval_q8 - det->prior_q8 : det->prior_q8 - interval_q8;
+            confirmed = (diff * 100 <= (uint64_t)det->prior_q8 * HR_PRIOR_PCT);
+            if (confirmed) {
+                det->stats.warm_locks++;
+            } else {
+                det->stats.priors_rejected++;
+            }
+            det->prior_q8 = 0;
+        }
+        
+        if (det->interval_count >= HR_MIN_BEATS || (confirmed && det->interval_count > 0)) {
+            det->bpm_x10 = (uint16_t)((600ull * det->sample_rate_hz * 256 * det->interval_count +
+                                       det->interval_sum_q8 / 2) / det->interval_sum_q8);
+        }
+    }
+    
+    det->last_beat_q8 = beat_q8;
+    det->have_beat = true;
+    det->stats.beats++;
+    
+    if (beat) {
+        beat->sequence = (uint32_t)((beat_q8 + 128) >> 8);
+        beat->interval_us = interval_q8 ? (uint32_t)((uint64_t)interval_q8 * 1000000 /
+                                                     ((uint64_t)det->sample_rate_hz << 8)) : 0;
+        beat->bpm_x10 = det->bpm_x10;
+    }
+    return true;
+}
+
+size_t hr_detector_process_block(hr_detector_t *det, const max30102_sample_t *samples, size_t count,
+                                 hr_beat_t *beats, size_t max_beats)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        hr_beat_t beat;
+        if (hr_detector_process(det, &samples[i], &beat) && found < max_beats) {
+            beats[found++] = beat;
+        }
+    }
+    return found;
+}
+
+uint16_t hr_detector_bpm_x10(const hr_detector_t *det)
+{
+    return det->bpm_x10;
+}
+
+// Warm-start state, once the detector has locked
+bool hr_detector_save(const hr_detector_t *det, hr_warm_state_t *state)
+{
+    if (det->interval_count < HR_MIN_BEATS || det->interval_sum_q8 == 0) {
+        return false;
+    }
+    
+    uint64_t interval_q8 = det->interval_sum_q8 / det->interval_count;
+    state->interval_us = (uint32_t)(interval_q8 * 1000000 / ((uint64_t)det->sample_rate_hz << 8));
+    state->amp = det->amp;
+    return true;
+}
+
+// Seeds a freshly reset detector from an earlier run. Call before the
+// first sample. A prior outside the BPM range is ignored.
+void hr_detector_restore(hr_detector_t *det, const hr_warm_state_t *state)
+{
+    uint64_t prior_q8 = ((uint64_t)state->interval_us * det->sample_rate_hz << 8) / 1000000;
+    if (prior_q8 < det->min_interval_q8 || prior_q8 > det->max_interval_q8 || state->amp <= 0) {
+        return;
+    }
+    
+    det->prior_q8 = (uint32_t)prior_q8;
+    det->amp = state->amp;
+    det->settle = det->sample_rate_hz / det->decimation * HR_WARM_SETTLE_MS / 1000;
+}
+
+void hr_detector_get_stats(const hr_detector_t *det, hr_stats_t *stats)
+{
+    *stats = det->stats;
+}
@@ -0,0 +1,116 @@
+#ifndef HR_DETECTOR_H
+#define HR_DETECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Streaming heart-rate detector on the IR channel. Per input sample it costs
+// one add into a boxcar that decimates to about HR_INTERNAL_RATE_HZ; per
+// decimated sample it runs DC removal, a 0.5-4 Hz bandpass biquad and an
+// adaptive-threshold peak search. Everything on the sample path is integer
+// arithmetic on state held in hr_detector_t, so there is no heap use.
+// Beat times are in input sample sequence numbers, so FIFO gaps do not skew
+// the intervals.
+
+#define HR_INTERNAL_RATE_HZ     100     // Decimated processing rate
+#define HR_MIN_RATE_HZ          25      // Lowest input rate the filters are designed for
+#define HR_AVG_BEATS            8       // Intervals averaged into the BPM
+#define HR_MIN_BEATS            3       // Intervals needed before a BPM is reported
+#define HR_MIN_BPM              30
+#define HR_MAX_BPM              240     // Also sets the refractory period
+#define HR_MIN_DC               20000   // IR level below which no finger is assumed
+#define HR_COEF_SHIFT           28      // Biquad coefficients are Q28
+#define HR_SIGNAL_SHIFT         4       // Extra fraction bits carried through the filters
+#define HR_WARM_SETTLE_MS       500     // Filter settling after a warm start, instead of 1 s
+
+// Detected beat
+typedef struct {
+    uint32_t sequence;      // Input sample nearest the systolic peak
+    uint32_t interval_us;   // Time since the previous beat, 0 for the first
+    uint16_t bpm_x10;       // Averaged heart rate after this beat, 0 until locked
+} hr_beat_t;
+
+// What a warm start carries over from an earlier run: the average beat
+// interval and the peak envelope the threshold follows. The interval is
+// only a prior, and no BPM is ever reported from it. When the first
+// measured interval agrees with it to within 15 %, the BPM is reported
+// from that interval alone. The detector does not wait for HR_MIN_BEATS
+// intervals. A first interval that disagrees drops the prior, and the
+// detector then locks as from cold. hr_detector_reset() drops an unused
+// prior too, so it never outlives the signal it was restored for.
+typedef struct {
+    uint32_t interval_us;
+    int32_t amp;
+} hr_warm_state_t;
+
+// Detector counters
+typedef struct {
+    uint32_t samples;
+    uint32_t beats;
+    uint32_t intervals_rejected;    // Outside the BPM range or far from the average
+    uint32_t resets;                // History cleared after a gap, lost finger or dropout
+    uint32_t warm_locks;            // BPM reported early on a confirmed prior
+    uint32_t priors_rejected;       // Priors the first interval disagreed with
+} hr_stats_t;
+
+typedef struct {
+    // Configuration, fixed at init
+    uint32_t sample_rate_hz;
+    uint32_t decimation;
+    int32_t decimation_recip;       // Q16 reciprocal of decimation
+    uint8_t dc_shift;               // DC tracker time constant, 2^dc_shift decimated samples
+    uint8_t amp_shift;              // Peak envelope decay, 2^amp_shift decimated samples
+    int32_t b0, a1, a2;             // Bandpass (b1 = 0, b2 = -b0), Q28
+    uint32_t refractory_q8;         // Minimum beat spacing, input samples Q8
+    uint32_t min_interval_q8;
+    uint32_t max_interval_q8;
+    
+    // Decimation
+    int32_t box_sum;
+    uint32_t box_count;
+    uint64_t position;              // Unwrapped input sequence of the current sample
+    uint32_t last_sequence;
+    bool started;
+    
+    // Filters
+    int32_t dc_acc;                 // DC estimate << dc_shift
+    int32_t x1, x2, y1, y2;
+    uint32_t settle;                // Decimated samples left before peaks count
+    
+    // Peak search on the inverted, filtered signal
+    int32_t prev;
+    int32_t amp;                    // Envelope of recent peak heights
+    bool above;
+    int32_t seg_max;
+    int32_t seg_left, seg_right;    // Neighbours of seg_max for interpolation
+    uint64_t seg_position;
+    bool need_right;
+    
+    // Beat history
+    bool have_beat;
+    uint64_t last_beat_q8;          // Position of the last beat, input samples Q8
+    uint32_t intervals_q8[HR_AVG_BEATS];
+    uint32_t interval_sum_q8;
+    uint8_t interval_head;
+    uint8_t interval_count;
+    uint8_t outliers;
+    uint16_t bpm_x10;
+    uint32_t prior_q8;              // Warm-start interval, input samples Q8, 0 if none
+    
+    hr_stats_t stats;
+} hr_detector_t;
+
+// Function prototypes
+max30102_err_t hr_detector_init(hr_detector_t *det, uint32_t sample_rate_hz);
+void hr_detector_reset(hr_detector_t *det);
+bool hr_detector_process(hr_detector_t *det, const max30102_sample_t *sample, hr_beat_t *beat);
+size_t hr_detector_process_block(hr_detector_t *det, const max30102_sample_t *samples, size_t count,
+                                 hr_beat_t *beats, size_t max_beats);
+uint16_t hr_detector_bpm_x10(const hr_detector_t *det);
+bool hr_detector_save(const hr_detector_t *det, hr_warm_state_t *state);
+void hr_detector_restore(hr_detector_t *det, const hr_warm_state_t *state);
+void hr_detector_get_stats(const hr_detector_t *det, hr_stats_t *stats);
+
+#endif // HR_DETECTOR_H
@@ -0,0 +1,208 @@
+#include "hr_spectral.h"
+#include <math.h>
+#include <string.h>
+
+#define HRS_MASK            (HRS_WINDOW - 1)
+#define HRS_QUARTER         (HRS_WINDOW / 4)
+
+// Private function prototypes
+static void hrs_clear_window(hr_spectral_t *est);
+static void hrs_update(hr_spectral_t *est, int32_t x);
+static bool hrs_readout(hr_spectral_t *est, hr_spectral_result_t *result);
+
+max30102_err_t hr_spectral_init(hr_spectral_t *est, uint32_t sample_rate_hz)
+{
+    if (!est || sample_rate_hz < HRS_MIN_RATE_HZ) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(est, 0, sizeof(*est));
+    est->sample_rate_hz = sample_rate_hz;
+    est->decimation = 1;
+    while (est->decimation * 2 * HRS_INTERNAL_RATE_HZ <= sample_rate_hz) {
+        est->decimation *= 2;
+    }
+    est->readout_interval = (uint32_t)((uint64_t)sample_rate_hz * HRS_UPDATE_MS / 1000);
+    
+    // DC time constant of about 1 s
+    double rate = (double)sample_rate_hz / est->decimation;
+    dsp_dc_tracker_init(&est->dc, (uint32_t)ceil(rate));
+    
+    // Band bins plus a guard bin each side for the Hann combination
+    uint32_t k_low = (uint32_t)ceil(HRS_LOW_HZ * HRS_WINDOW / rate);
+    uint32_t k_high = (uint32_t)floor(HRS_HIGH_HZ * HRS_WINDOW / rate);
+    est->bin_first = (uint16_t)(k_low - 1);
+    est->bin_count = (uint16_t)(k_high - k_low + 3);
+    if (est->bin_count > HRS_MAX_BINS) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    for (uint32_t i = 0; i < HRS_WINDOW; i++) {
+        est->twiddle[i] = (int16_t)lround(cos(2.0 * M_PI * i / HRS_WINDOW) * (1 << HRS_TWIDDLE_SHIFT));
+    }
+    
+    hr_spectral_reset(est);
+    return MAX30102_OK;
+}
+
+void hr_spectral_reset(hr_spectral_t *est)
+{
+    if (est->decimation > 1) {
+        dsp_cic_init(&est->decimator, 1, est->decimation);
+    }
+    est->started = false;
+    est->since_readout = 0;
+    est->last.bpm_x10 = 0;
+    est->last.confidence = 0;
+    hrs_clear_window(est);
+}
+
+static void hrs_clear_window(hr_spectral_t *est)
+{
+    memset(est->history, 0, sizeof(est->history));
+    memset(est->re, 0, sizeof(est->re));
+    memset(est->im, 0, sizeof(est->im));
+    est->filled = 0;
+    est->settle = est->sample_rate_hz / est->decimation;   // Let the DC tracker settle for 1 s
+}
+
+bool hr_spectral_process(hr_spectral_t *est, const max30102_sample_t *sample, hr_spectral_result_t *result)
+{
+    est->stats.samples++;
+    
+    if (est->started && sample->sequence - est->last_sequence > est->sample_rate_hz) {
+        // More than a second lost: the window no longer holds a continuous signal
+        hr_spectral_reset(est);
+        est->stats.resets++;
+    }
+    int32_t v[DSP_LANES] = {0, (int32_t)sample->ir << HRS_SIGNAL_SHIFT};
+    if (!est->started) {
+        est->started = true;
+        dsp_dc_tracker_seed(&est->dc, v);
+    }
+    est->last_sequence = sample->sequence;
+    est->since_readout++;
+    
+    // Boxcar decimation, with the fraction bits already in the input
+    if (est->decimation > 1 && !dsp_cic_step(&est->decimator, v)) {
+        return false;
+    }
+    
+    // DC removal
+    dsp_dc_tracker_step(&est->dc, v);
+    if (dsp_dc_tracker_level(&est->dc, DSP_LANE_IR) < (HRS_MIN_DC << HRS_SIGNAL_SHIFT)) {
+        // No finger: start the window over once it is back
+        if (est->filled > 0) {
+            hrs_clear_window(est);
+            est->last.bpm_x10 = 0;
+            est->stats.resets++;
+        }
+        est->settle = est->sample_rate_hz / est->decimation;
+        return false;
+    }
+    if (est->settle > 0) {
+        est->settle--;
+        return false;
+    }
+    
+    hrs_update(est, v[DSP_LANE_IR]);
+    
+    if (est->filled < HRS_WINDOW || est->since_readout < est->readout_interval) {
+        return false;
+    }
+    est->since_readout = 0;
+    return hrs_readout(est, result);
+}
+
+// Slides the window by one decimated sample
+static void hrs_update(hr_spectral_t *est, int32_t x)
+{
+    uint32_t head = est->head;
+    int32_t delta = x - est->history[head];
+    est->history[head] = x;
+    
+    // Twiddle index k * head for consecutive k
+    uint32_t p = (est->bin_first * head) & HRS_MASK;
+    for (uint32_t j = 0; j < est->bin_count; j++) {
+        est->re[j] += (int64_t)delta * est->twiddle[p];
+        est->im[j] -= (int64_t)delta * est->twiddle[(p - HRS_QUARTER) & HRS_MASK];
+        p = (p + head) & HRS_MASK;
+    }
+    
+    est->head = (head + 1) & HRS_MASK;
+    if (est->filled < HRS_WINDOW) {
+        est->filled++;
+    }
+    est->stats.updates++;
+}
+
+static bool hrs_readout(hr_spectral_t *est, hr_spectral_result_t *result)
+{
+    float xr[HRS_MAX_BINS], xi[HRS_MAX_BINS], power[HRS_MAX_BINS];
+    uint32_t count = est->bin_count;
+    
+    // Rotate to the window start: the oldest sample has index head mod N
+    uint32_t p = (est->bin_first * est->head) & HRS_MASK;
+    for (uint32_t j = 0; j < count; j++) {
+        float c = est->twiddle[p];
+        float s = est->twiddle[(p - HRS_QUARTER) & HRS_MASK];
+        float re = (float)est->re[j];
+        float im = (float)est->im[j];
+        xr[j] = re * c - im * s;
+        xi[j] = re * s + im * c;
+        p = (p + est->head) & HRS_MASK;
+    }
+    
+    // Hann window as a three-tap combination of neighbouring bins
+    float total = 0.0f;
+    uint32_t peak = 1;
+    for (uint32_t j = 1; j + 1 < count; j++) {
+        float yr = 0.5f * xr[j] - 0.25f * (xr[j - 1] + xr[j + 1]);
+        float yi = 0.5f * xi[j] - 0.25f * (xi[j - 1] + xi[j + 1]);
+        power[j] = yr * yr + yi * yi;
+        total += power[j];
+        if (power[j] > power[peak]) {
+            peak = j;
+        }
+    }
+    if (total <= 0.0f) {
+        return false;
+    }
+    
+    // Gaussian interpolation between the peak bin and its neighbours
+    float offset = 0.0f;
+    float peak_power = power[peak];
+    if (peak > 1 && peak + 2 < count) {
+        float l = logf(power[peak - 1] + 1.0f);
+        float c = logf(power[peak] + 1.0f);
+        float r = logf(power[peak + 1] + 1.0f);
+        float denom = l - 2.0f * c + r;
+        if (denom < 0.0f) {
+            offset = 0.5f * (l - r) / denom;
+            offset = offset > 0.5f ? 0.5f : (offset < -0.5f ? -0.5f : offset);
+        }
+        peak_power += power[peak - 1] + power[peak + 1];
+    }
+    
+    float rate = (float)est->sample_rate_hz / est->decimation;
+    float hz = ((float)(est->bin_first + peak) + offset) * rate / HRS_WINDOW;
+    est->last.sequence = est->last_sequence;
+    est->last.bpm_x10 = (uint16_t)lroundf(hz * 600.0f);
+    est->last.confidence = (uint8_t)lroundf(100.0f * peak_power / total);
+    est->stats.readouts++;
+    
+    if (result) {
+        *result = est->last;
+    }
+    return true;
+}
+
+uint16_t hr_spectral_bpm_x10(const hr_spectral_t *est)
+{
+    return est->last.bpm_x10;
+}
+
+void hr_spectral_get_stats(const hr_spectral_t *est, hr_spectral_stats_t *stats)
+{
+    *stats = est->stats;
+}
@@ -0,0 +1,93 @@
+#ifndef HR_SPECTRAL_H
+#define HR_SPECTRAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "dsp_filters.h"
+
+// Spectral heart-rate estimator on the IR channel, a cross-check for the
+// peak-picking hr_detector that holds up better on noisy signals. Samples
+// are boxcar-decimated (a first-order dsp_cic_t) by the largest power of two
+// that keeps at least HRS_INTERNAL_RATE_HZ, then DC-removed. A sliding DFT over the last HRS_WINDOW decimated samples is kept for every
+// bin in the 0.5-4 Hz band.
+//
+// Bins are stored relative to absolute sample time, so an update is one
+// multiply-add per bin for the real part and one for the imaginary part
+// with the difference of the newest and oldest sample:
+//
+//   S_k += (x[n] - x[n - N]) * e^(-j 2 pi k n / N)
+//
+// The update is exact integer arithmetic: the term a sample adds is the
+// same term removed when it leaves the window, so there is no drift and no
+// damping factor. Once every HRS_UPDATE_MS the bins are rotated to the
+// window start, Hann-windowed by combining neighbours, and the peak is
+// refined by Gaussian interpolation. Only that readout uses floating point.
+
+#define HRS_INTERNAL_RATE_HZ    25
+#define HRS_MIN_RATE_HZ         25
+#define HRS_WINDOW_LOG2         8       // 256 decimated samples, about 10 s
+#define HRS_WINDOW              (1 << HRS_WINDOW_LOG2)
+#define HRS_LOW_HZ              0.5
+#define HRS_HIGH_HZ             4.0
+#define HRS_MAX_BINS            44      // Band plus one guard bin each side at the lowest internal rate
+#define HRS_UPDATE_MS           1000    // Readout interval
+#define HRS_MIN_DC              20000   // IR level below which no finger is assumed
+#define HRS_SIGNAL_SHIFT        4       // Fraction bits carried through decimation and DC removal
+#define HRS_TWIDDLE_SHIFT       14      // Twiddle table is Q14
+
+// Readout
+typedef struct {
+    uint32_t sequence;      // Input sample at the end of the window
+    uint16_t bpm_x10;       // Dominant frequency in 0.1 BPM steps
+    uint8_t confidence;     // Share of band power in the peak, percent
+} hr_spectral_result_t;
+
+// Estimator counters
+typedef struct {
+    uint32_t samples;
+    uint32_t updates;       // Decimated samples added to the bins
+    uint32_t readouts;
+    uint32_t resets;        // Window cleared after a gap or lost finger
+} hr_spectral_stats_t;
+
+typedef struct {
+    // Configuration, fixed at init
+    uint32_t sample_rate_hz;
+    uint32_t decimation;            // Power of two
+    uint16_t bin_first;             // Lowest stored bin, one below the band
+    uint16_t bin_count;
+    uint32_t readout_interval;      // Input samples between readouts
+    int16_t twiddle[HRS_WINDOW];    // cos(2 pi i / N), Q14
+    
+    // Decimation, IR lane only
+    dsp_cic_t decimator;            // Unused when decimation is 1
+    uint32_t last_sequence;
+    bool started;
+    
+    // DC removal
+    dsp_dc_tracker_t dc;            // About 1 s
+    uint32_t settle;                // Decimated samples left before bins update
+    
+    // Sliding DFT
+    int32_t history[HRS_WINDOW];    // Last N DC-removed samples
+    uint32_t head;                  // Absolute index of the next sample, mod N
+    uint32_t filled;                // Samples in the window
+    int64_t re[HRS_MAX_BINS];
+    int64_t im[HRS_MAX_BINS];
+    
+    // Readout
+    uint32_t since_readout;
+    hr_spectral_result_t last;
+    hr_spectral_stats_t stats;
+} hr_spectral_t;
+
+// Function prototypes
+max30102_err_t hr_spectral_init(hr_spectral_t *est, uint32_t sample_rate_hz);
+void hr_spectral_reset(hr_spectral_t *est);
+bool hr_spectral_process(hr_spectral_t *est, const max30102_sample_t *sample, hr_spectral_result_t *result);
+uint16_t hr_spectral_bpm_x10(const hr_spectral_t *est);
+void hr_spectral_get_stats(const hr_spectral_t *est, hr_spectral_stats_t *stats);
+
+#endif // HR_SPECTRAL_H
@@ -0,0 +1,134 @@
+#include "i2c_async.h"
+#include <string.h>
+
+void i2c_async_init(i2c_async_t *queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->done, 0);
+    queue->tail = 0;
+    queue->stats = (i2c_async_stats_t){0};
+    queue->wake_worker = NULL;
+    queue->worker_ctx = NULL;
+    queue->wake_issuer = NULL;
+    queue->issuer_ctx = NULL;
+}
+
+// 'wake' is called after every submit; the worker should then call
+// i2c_async_worker_step() until it returns false
+void i2c_async_set_worker(i2c_async_t *queue, i2c_async_wake_t wake, void *ctx)
+{
+    queue->wake_worker = wake;
+    queue->worker_ctx = ctx;
+}
+
+// 'wake' is called from the worker after every transaction; the issuing
+// task should then call i2c_async_complete()
+void i2c_async_set_issuer(i2c_async_t *queue, i2c_async_wake_t wake, void *ctx)
+{
+    queue->wake_issuer = wake;
+    queue->issuer_ctx = ctx;
+}
+
+// Queues a write of 'tx' followed, if 'rx' is not NULL, by a read of
+// 'rx_len' bytes into 'rx' in the same transaction. 'rx' must stay valid
+// until 'done' has run. 'chain' and 'done' may be NULL. Returns
+// MAX30102_ERR_BUSY when the queue is full.
+max30102_err_t i2c_async_submit(i2c_async_t *queue, const max30102_transport_t *transport,
+                                const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len,
+                                i2c_async_chain_t chain, i2c_async_done_t done, void *ctx)
+{
+    if (!queue || !transport || !tx || tx_len == 0 || tx_len > I2C_ASYNC_MAX_TX || (rx && rx_len == 0)) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t queued = head - queue->tail;
+    if (queued >= I2C_ASYNC_DEPTH) {
+        queue->stats.rejected++;
+        return MAX30102_ERR_BUSY;
+    }
+    
+    i2c_async_txn_t *txn = &queue->slots[head & (I2C_ASYNC_DEPTH - 1)];
+    txn->transport = transport;
+    memcpy(txn->tx, tx, tx_len);
+    txn->tx_len = tx_len;
+    txn->rx = rx;
+    txn->rx_len = rx ? rx_len : 0;
+    txn->chain = chain;
+    txn->done = done;
+    txn->ctx = ctx;
+    txn->err = MAX30102_OK;
+    
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    
+    queue->stats.submitted++;
+    if (queued + 1 > queue->stats.high_water) {
+        queue->stats.high_water = queued + 1;
+    }
+    if (queue->wake_worker) {
+        queue->wake_worker(queue->worker_ctx);
+    }
+    return MAX30102_OK;
+}
+
+// Runs the oldest queued entry, and whatever transfers its chain hook adds,
+// on the calling (worker) task. Returns false if there was nothing to run.
+bool i2c_async_worker_step(i2c_async_t *queue)
+{
+    uint32_t done = atomic_load_explicit(&queue->done, memory_order_relaxed);
+    if (done == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return false;
+    }
+    
+    i2c_async_txn_t *txn = &queue->slots[done & (I2C_ASYNC_DEPTH - 1)];
+    const max30102_transport_t *transport = txn->transport;
+    do {
+        if (txn->rx) {
+            txn->err = transport->write_read(transport->ctx, txn->tx, txn->tx_len, txn->rx, txn->rx_len);
+        } else {
+            txn->err = transport->write(transport->ctx, txn->tx, txn->tx_len);
+        }
+    } while (txn->chain && txn->chain(txn->ctx, txn));
+    
+    atomic_store_explicit(&queue->done, done + 1, memory_order_release);
+    if (queue->wake_issuer) {
+        queue->wake_issuer(queue->issuer_ctx);
+    }
+    return true;
+}
+
+// Runs the callbacks of finished transactions, oldest first, on the calling
+// (issuing) task. Returns how many ran.
+size_t i2c_async_complete(i2c_async_t *queue)
+{
+    size_t completed = 0;
+    uint32_t done = atomic_load_explicit(&queue->done, memory_order_acquire);
+    
+    while (queue->tail != done) {
+        // Copied out so the callback can submit into the freed slot
+        i2c_async_txn_t txn = queue->slots[queue->tail & (I2C_ASYNC_DEPTH - 1)];
+        queue->tail++;
+        queue->stats.completed++;
+        completed++;
+        if (txn.err != MAX30102_OK) {
+            queue->stats.errors++;  // The callback reports it
+        }
+        if (txn.done) {
+            txn.done(txn.ctx, &txn);
+        }
+    }
+    return completed;
+}
+
+// Entries submitted and not yet completed
+size_t i2c_async_pending(i2c_async_t *queue)
+{
+    return atomic_load_explicit(&queue->head, memory_order_relaxed) - queue->tail;
+}
+
+void i2c_async_get_stats(i2c_async_t *queue, i2c_async_stats_t *stats)
+{
+    if (stats) {
+        *stats = queue->stats;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "max30102.h"
+
+// Queue of bus transactions run by a worker task, so the task that issues
+// them can process the previous block while the bus is busy. Each entry is
+// one call on a max30102_transport_t; the worker runs them in order through
+// the blocking transport and the issuing task collects the results with
+// i2c_async_complete(), which runs each transaction's 'done' callback in
+// the issuing task.
+//
+// A transfer that depends on the one before it (the FIFO data read needs
+// the pointer read's count) cannot wait for the issuing task, which is busy
+// processing. An entry's 'chain' hook runs on the worker right after its
+// transfer and may rewrite the entry into the next transfer, which the
+// worker then runs before the entry completes. That is how
+// max30102_read_samples_async() does a whole drain as one entry.
+//
+// One task submits and completes, one worker executes. The queue holds no
+// OS objects: the wake hooks are how the worker gets told about new work
+// and the issuing task about finished work (a task notification on the
+// firmware, a semaphore on the host). i2c_bus_start_async() runs a worker
+// task on the firmware.
+
+#define I2C_ASYNC_DEPTH         8       // Transactions in flight, power of two
+#define I2C_ASYNC_MAX_TX        8       // Bytes written per transaction
+#define I2C_ASYNC_CACHE_LINE    64      // Keeps the submitter and worker indices apart
+
+typedef struct i2c_async_txn i2c_async_txn_t;
+
+// Runs in the issuing task from i2c_async_complete()
+typedef void (*i2c_async_done_t)(void *ctx, const i2c_async_txn_t *txn);
+
+// Runs on the worker after each transfer of the entry. Returns true after
+// rewriting 'txn' (tx, rx and chain) to put it on the bus again.
+typedef bool (*i2c_async_chain_t)(void *ctx, i2c_async_txn_t *txn);
+
+// Wakes the worker or the issuing task
+typedef void (*i2c_async_wake_t)(void *ctx);
+
+struct i2c_async_txn {
+    const max30102_transport_t *transport;
+    uint8_t tx[I2C_ASYNC_MAX_TX];
+    size_t tx_len;
+    uint8_t *rx;                // NULL for a write
+    size_t rx_len;
+    i2c_async_chain_t chain;    // NULL if the entry is a single transfer
+    i2c_async_done_t done;
+    void *ctx;
+    max30102_err_t err;         // Set by the worker
+};
+
+// Queue counters
+typedef struct {
+    uint32_t submitted;         // Entries accepted
+    uint32_t rejected;          // Submits refused because the queue was full
+    uint32_t completed;         // Entries completed
+    uint32_t errors;            // Entries whose last transfer failed
+    uint32_t high_water;        // Most entries queued at once
+} i2c_async_stats_t;
+
+typedef struct i2c_async {
+    // Written by the issuing task only
+    _Alignas(I2C_ASYNC_CACHE_LINE) atomic_uint head;   // Next slot to submit into
+    uint32_t tail;                                      // Next slot to complete
+    i2c_async_stats_t stats;
+    
+    // Written by the worker only
+    _Alignas(I2C_ASYNC_CACHE_LINE) atomic_uint done;   // Next slot to execute
+    
+    _Alignas(I2C_ASYNC_CACHE_LINE) i2c_async_txn_t slots[I2C_ASYNC_DEPTH];
+    
+    i2c_async_wake_t wake_worker;
+    void *worker_ctx;
+    i2c_async_wake_t wake_issuer;
+    void *issuer_ctx;
+} i2c_async_t;
+
+// Function prototypes
+void i2c_async_init(i2c_async_t *queue);
+void i2c_async_set_worker(i2c_async_t *queue, i2c_async_wake_t wake, void *ctx);
+void i2c_async_set_issuer(i2c_async_t *queue, i2c_async_wake_t wake, void *ctx);
+max30102_err_t i2c_async_submit(i2c_async_t *queue, const max30102_transport_t *transport,
+                                const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len,
+                                i2c_async_chain_t chain, i2c_async_done_t done, void *ctx);
+bool i2c_async_worker_step(i2c_async_t *queue);
+size_t i2c_async_complete(i2c_async_t *queue);
+size_t i2c_async_pending(i2c_async_t *queue);
+void i2c_async_get_stats(i2c_async_t *queue, i2c_async_stats_t *stats);
+
+#endif // I2C_ASYNC_H
@@ -1,72 +1,222 @@
 #include "sdkconfig.h"
 #include "i2c_config.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 static const char *TAG = "I2C_CONFIG";
 
-// Global handles
-i2c_master_bus_handle_t i2c_bus_handle = NULL;
-i2c_master_dev_handle_t max30102_dev_handle = NULL;
+// Private function prototypes
+static esp_err_t i2c_select_channel(i2c_sensor_t *sensor);
+static max30102_err_t max30102_i2c_write(void *ctx, const uint8_t *data, size_t len);
+static max30102_err_t max30102_i2c_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                              uint8_t *rx, size_t rx_len);
+static void i2c_async_task(void *arg);
+static void i2c_async_wake_task(void *ctx);
 
-esp_err_t i2c_master_init(void)
+// Routes the bus to the sensor's mux channel unless it already is
+static esp_err_t i2c_select_channel(i2c_sensor_t *sensor)
 {
+    i2c_bus_t *bus = sensor->bus;
+    if (sensor->mux_channel == I2C_MUX_NONE || bus->mux_channel == sensor->mux_channel) {
+        return ESP_OK;
+    }
+    
+    uint8_t mask = 1u << sensor->mux_channel;
+    esp_err_t err = i2c_master_transmit(bus->mux, &mask, 1, pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    bus->mux_channel = (err == ESP_OK) ? sensor->mux_channel : I2C_MUX_NONE;
+    return err;
+}
+
+static max30102_err_t max30102_i2c_write(void *ctx, const uint8_t *data, size_t len)
+{
+    i2c_sensor_t *sensor = ctx;
+    if (!sensor->handle) {
+        return MAX30102_ERR_INIT;
+    }
+    
+    esp_err_t err = i2c_select_channel(sensor);
+    if (err == ESP_OK) {
+        err = i2c_master_transmit(sensor->handle, data, len, pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    }
+    // No log here: this runs on the sensor task, and the driver reports the
+    // failure through its deferred log
+    if (err != ESP_OK) {
+        return err == ESP_ERR_TIMEOUT ? MAX30102_ERR_TIMEOUT : MAX30102_ERR_I2C;
+    }
+    
+    return MAX30102_OK;
+}
+
+static max30102_err_t max30102_i2c_write_read(void *ctx, const uint8_t *tx, size_t tx_len,
+                                              uint8_t *rx, size_t rx_len)
+{
+    i2c_sensor_t *sensor = ctx;
+    if (!sensor->handle) {
+        return MAX30102_ERR_INIT;
+    }
+    
+    esp_err_t err = i2c_select_channel(sensor);
+    if (err == ESP_OK) {
+        err = i2c_master_transmit_receive(sensor->handle, tx, tx_len, rx, rx_len,
+                                          pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    }
+    if (err != ESP_OK) {
+        return err == ESP_ERR_TIMEOUT ? MAX30102_ERR_TIMEOUT : MAX30102_ERR_I2C;
+    }
+    
+    return MAX30102_OK;
+}
+
+esp_err_t i2c_bus_init(i2c_bus_t *bus, i2c_port_num_t port, int sda_io, int scl_io)
+{
+    *bus = (i2c_bus_t){.mux_channel = I2C_MUX_NONE};
+    
     // Configure I2C bus
     i2c_master_bus_config_t bus_config = {
         .clk_source = I2C_CLK_SRC_DEFAULT,
-        .i2c_port = I2C_NUM_0,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_io_num = I2C_MASTER_SDA_IO,
+        .i2c_port = port,
+        .scl_io_num = scl_io,
+        .sda_io_num = sda_io,
         .glitch_ignore_cnt = 7,
         .flags.enable_internal_pullup = true,
     };
     
-    esp_err_t err = i2c_new_master_bus(&bus_config, &i2c_bus_handle);
+    esp_err_t err = i2c_new_master_bus(&bus_config, &bus->handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C bus initialization failed: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "I2C bus %d initialization failed: %s", port, esp_err_to_name(err));
         return err;
     }
     
-    // Configure MAX30102 device
+    ESP_LOGI(TAG, "I2C bus %d initialized - SDA: %d, SCL: %d, Freq: %d Hz",
+             port, sda_io, scl_io, I2C_MASTER_FREQ_HZ);
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_add_mux(i2c_bus_t *bus, uint8_t address)
+{
     i2c_device_config_t dev_config = {
         .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = 0x57,  // MAX30102 I2C address
+        .device_address = address,
         .scl_speed_hz = I2C_MASTER_FREQ_HZ,
     };
     
-    err = i2c_master_bus_add_device(i2c_bus_handle, &dev_config, &max30102_dev_handle);
+    esp_err_t err = i2c_master_bus_add_device(bus->handle, &dev_config, &bus->mux);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C device add failed: %s", esp_err_to_name(err));
-        i2c_del_master_bus(i2c_bus_handle);
-        i2c_bus_handle = NULL;
+        ESP_LOGE(TAG, "I2C mux add failed: %s", esp_err_to_name(err));
         return err;
     }
     
-    ESP_LOGI(TAG, "I2C master initialized - SDA: %d, SCL: %d, Freq: %d Hz", 
-             I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO, I2C_MASTER_FREQ_HZ);
+    bus->mux_channel = I2C_MUX_NONE;
+    return ESP_OK;
+}
+
+// Adds a MAX30102 at 'address', behind mux channel 'mux_channel' or wired
+// directly (I2C_MUX_NONE), and fills in its transport
+esp_err_t i2c_bus_add_max30102(i2c_bus_t *bus, i2c_sensor_t *sensor, uint8_t address, int8_t mux_channel)
+{
+    if (mux_channel != I2C_MUX_NONE && (!bus->mux || mux_channel < 0 || mux_channel >= I2C_MUX_CHANNELS)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *sensor = (i2c_sensor_t){
+        .bus = bus,
+        .mux_channel = mux_channel,
+        .transport = {
+            .write = max30102_i2c_write,
+            .write_read = max30102_i2c_write_read,
+            .ctx = sensor,
+        },
+    };
+    
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = I2C_MASTER_FREQ_HZ,
+    };
+    
+    esp_err_t err = i2c_master_bus_add_device(bus->handle, &dev_config, &sensor->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "I2C device add failed: %s", esp_err_to_name(err));
+        sensor->handle = NULL;
+        return err;
+    }
     
     return ESP_OK;
 }
 
-esp_err_t i2c_master_deinit(void)
+esp_err_t i2c_bus_remove_max30102(i2c_sensor_t *sensor)
 {
     esp_err_t err = ESP_OK;
     
-    if (max30102_dev_handle) {
-        err = i2c_master_bus_rm_device(max30102_dev_handle);
+    if (sensor->handle) {
+        err = i2c_master_bus_rm_device(sensor->handle);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "I2C device remove failed: %s", esp_err_to_name(err));
         }
-        max30102_dev_handle = NULL;
+        sensor->handle = NULL;
     }
+    return err;
+}
+
+// Sensors on the bus must be removed first
+esp_err_t i2c_bus_deinit(i2c_bus_t *bus)
+{
+    esp_err_t err = ESP_OK;
     
-    if (i2c_bus_handle) {
-        err = i2c_del_master_bus(i2c_bus_handle);
+    if (bus->mux) {
+        err = i2c_master_bus_rm_device(bus->mux);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "I2C mux remove failed: %s", esp_err_to_name(err));
+        }
+        bus->mux = NULL;
+    }
+    
+    if (bus->handle) {
+        err = i2c_del_master_bus(bus->handle);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "I2C bus delete failed: %s", esp_err_to_name(err));
         }
-        i2c_bus_handle = NULL;
+        bus->handle = NULL;
     }
     
     ESP_LOGI(TAG, "I2C master deinitialized");
     return err;
 }
+
+static void i2c_async_task(void *arg)
+{
+    i2c_async_t *queue = arg;
+    
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (i2c_async_worker_step(queue)) {
+        }
+    }
+}
+
+static void i2c_async_wake_task(void *ctx)
+{
+    xTaskNotifyGive((TaskHandle_t)ctx);
+}
+
+// Starts a task that runs the transactions on an initialized 'queue', so
+// the task submitting them can process while the bus is busy. Only that
+// task may then use the sensors the queue's transactions go to. It still
+// has to set how it wants to be woken with i2c_async_set_issuer(). 'stack'
+// holds I2C_ASYNC_STACK_SIZE bytes; it and 'tcb' are static, like the other
+// task stacks in memory_budget.h.
+esp_err_t i2c_bus_start_async(i2c_async_t *queue, UBaseType_t priority, BaseType_t core, StackType_t *stack,
+                              StaticTask_t *tcb)
+{
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(i2c_async_task, "i2c_async", I2C_ASYNC_STACK_SIZE, queue,
+                                                      priority, stack, tcb, core);
+    if (!task) {
+        ESP_LOGE(TAG, "Failed to create I2C async task");
+        return ESP_ERR_NO_MEM;
+    }
+    
+    i2c_async_set_worker(queue, i2c_async_wake_task, task);
+    ESP_LOGI(TAG, "I2C async worker started on core %d", (int)core);
+    return ESP_OK;
+}
@@ -3,6 +3,10 @@
 
 #include "driver/i2c_master.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "max30102.h"
+#include "i2c_async.h"
+#include "memory_budget.h"
 
 // I2C Configuration
 #define I2C_MASTER_SDA_IO       18      // GPIO pin for SDA (adjust for your board)
@@ -10,12 +14,39 @@
 #define I2C_MASTER_FREQ_HZ      400000  // 400kHz
 #define I2C_MASTER_TIMEOUT_MS   1000
 
-// Global I2C bus and device handles
-extern i2c_master_bus_handle_t i2c_bus_handle;
-extern i2c_master_dev_handle_t max30102_dev_handle;
+// MAX30102 interrupt line (open-drain, active low)
+#define MAX30102_INT_IO         16      // GPIO pin for INT (adjust for your board)
+
+// Channel mux (TCA9548A or compatible). Every MAX30102 answers at 0x57, so
+// more than one per bus needs a mux.
+#define I2C_MUX_ADDR            0x70
+#define I2C_MUX_CHANNELS        8
+#define I2C_MUX_NONE            -1      // Sensor wired straight to the bus
+
+// One I2C controller and the mux on it, if any. The selected channel is
+// remembered so back-to-back transactions to one sensor do not reselect it.
+// A bus and its sensors are used from one task.
+typedef struct {
+    i2c_master_bus_handle_t handle;
+    i2c_master_dev_handle_t mux;
+    int8_t mux_channel;         // Selected channel, I2C_MUX_NONE if unknown
+} i2c_bus_t;
+
+// A MAX30102 on a bus. 'transport' is what max30102_set_transport() takes.
+typedef struct {
+    i2c_bus_t *bus;
+    i2c_master_dev_handle_t handle;
+    int8_t mux_channel;
+    max30102_transport_t transport;
+} i2c_sensor_t;
 
 // Function prototypes
-esp_err_t i2c_master_init(void);
-esp_err_t i2c_master_deinit(void);
+esp_err_t i2c_bus_init(i2c_bus_t *bus, i2c_port_num_t port, int sda_io, int scl_io);
+esp_err_t i2c_bus_add_mux(i2c_bus_t *bus, uint8_t address);
+esp_err_t i2c_bus_add_max30102(i2c_bus_t *bus, i2c_sensor_t *sensor, uint8_t address, int8_t mux_channel);
+esp_err_t i2c_bus_remove_max30102(i2c_sensor_t *sensor);
+esp_err_t i2c_bus_deinit(i2c_bus_t *bus);
+esp_err_t i2c_bus_start_async(i2c_async_t *queue, UBaseType_t priority, BaseType_t core, StackType_t *stack,
+                              StaticTask_t *tcb);
 
-#endif // I2C_CONFIG_H
\ No newline at end of file
+#endif // I2C_CONFIG_H
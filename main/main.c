@@ -3,69 +3,721 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "max30102.h"
 #include "i2c_config.h"
+#include "acquisition.h"
+#include "pipeline.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "capture.h"
+#include "warm_profile.h"
+#include "memory_budget.h"
 
 static const char *TAG = "MAIN";
 
-#define SAMPLE_INTERVAL_MS  25   // Even faster reading - 40Hz
-#define STACK_SIZE          4096
+#define SAMPLE_INTERVAL_MS  25   // Longest polling interval - 40Hz
 #define TASK_PRIORITY       5
+#define SENSOR_CORE         0       // Acquisition has core 0 to itself
 
-// Task handle for sensor reading
+// Acquisition mode: ACQUISITION_MODE_POLLING or ACQUISITION_MODE_INTERRUPT
+#define ACQUISITION_MODE        ACQUISITION_MODE_INTERRUPT
+#define INTERRUPT_TIMEOUT_MS    1000    // Drain anyway if no interrupt arrives
+
+// Low power: with ACQUISITION_LOW_POWER set, sensor_task runs in
+// ACQUISITION_MODE_LOW_POWER instead of ACQUISITION_MODE. The sensor
+// averages down to LOW_POWER_MIN_RATE_HZ and raises A_FULL so each wakeup
+// drains a nearly full FIFO, and the chip light-sleeps in between, woken by
+// the INT pin. Light sleep needs CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE; without them only the wakeup rate
+// drops. The processing tasks' idle timeouts are lengthened so they do not
+// wake the chip on their own.
+#define ACQUISITION_LOW_POWER   0
+#define LOW_POWER_MIN_RATE_HZ   50
+#define LOW_POWER_MIN_FREQ_MHZ  40
+
+// Processing tasks: dsp_task analyzes blocks from the sample ring and
+// output_task formats them, both off the sampling core. Set a core to
+// tskNO_AFFINITY to let the scheduler place the task. Stack sizes are in
+// memory_budget.h.
+#define DSP_TASK_PRIORITY       4
+#define DSP_CORE                1
+#define OUTPUT_TASK_PRIORITY    3
+#define OUTPUT_CORE             1
+#if ACQUISITION_LOW_POWER
+#define OUTPUT_TIMEOUT_MS       1000
+#else
+#define OUTPUT_TIMEOUT_MS       100
+#endif
+
+// Deferred log: sensor_task writes log records to a ring and log_task
+// formats and prints them
+#define LOG_TASK_PRIORITY       1
+#define LOG_CORE                1
+#if ACQUISITION_LOW_POWER
+#define LOG_FLUSH_MS            1000
+#else
+#define LOG_FLUSH_MS            100
+#endif
+
+// Raw capture: with CAPTURE_ENABLED set, every drain, gap and sensor
+// configuration is recorded to CAPTURE_PATH for replay on the host with
+// hrm_replay. The file lives on a SPIFFS data partition labelled
+// CAPTURE_PARTITION, which the partition table has to provide. sensor_task
+// only encodes; capture_task writes the file.
+#define CAPTURE_ENABLED         0
+#define CAPTURE_PARTITION       "storage"
+#define CAPTURE_BASE_PATH       "/capture"
+#define CAPTURE_PATH            CAPTURE_BASE_PATH "/capture.hrm"
+#define CAPTURE_TASK_PRIORITY   2
+#define CAPTURE_CORE            1
+#define CAPTURE_SYNC_MS         1000
+
+#if CAPTURE_ENABLED
+#include <unistd.h>
+#include "freertos/stream_buffer.h"
+#include "esp_spiffs.h"
+#endif
+
+// Warm start: with WARM_START_ENABLED set, a marker that the sensor holds
+// the build's configuration and the heart-rate detector state are saved to
+// NVS while the signal is good, at most every PROFILE_SAVE_INTERVAL_S. The
+// next boot restores them: init
+// checks the still-powered sensor instead of resetting it, and the
+// detector reports a BPM after two beats that match the saved rate. NVS
+// also counts boots, so a profile not refreshed for WARM_PROFILE_MAX_AGE
+// boots is dropped.
+#define WARM_START_ENABLED      1
+#define PROFILE_NAMESPACE       "hrm"
+#define PROFILE_KEY             "profile"
+#define BOOT_COUNT_KEY          "boots"
+#define PROFILE_SAVE_INTERVAL_S 300
+
+// Output format: OUTPUT_FORMAT_TEXT prints one line per sample on the
+// console, OUTPUT_FORMAT_BINARY sends stream_codec frames on a UART of their
+// own. The console VFS writes log lines and printf output straight to its
+// UART, so frames on the console port could be split by a log line.
+#define OUTPUT_FORMAT_TEXT      0
+#define OUTPUT_FORMAT_BINARY    1
+#define OUTPUT_FORMAT           OUTPUT_FORMAT_BINARY
+#define STREAM_UART_NUM         UART_NUM_2
+#define STREAM_UART_TX_IO       15      // GPIO pin for stream TX (adjust for your board)
+#define STREAM_UART_BAUD        115200
+#define STREAM_UART_TX_BUFFER   4096
+
+// Sample packets: with PACKETS_ENABLED set, sensor_task also queues every
+// sample for packet_task, which packs them into PACKET_MTU-byte packets
+// on a second UART. A packet goes out when full or PACKET_DEADLINE_US
+// after its first sample, whichever is first.
+#define PACKETS_ENABLED         0
+#define PACKET_UART_NUM         UART_NUM_1
+#define PACKET_UART_TX_IO       43      // GPIO pin for packet TX (adjust for your board)
+#define PACKET_UART_BAUD        921600
+#define PACKET_MTU              244
+#define PACKET_DEADLINE_US      20000
+#define PACKET_TASK_PRIORITY    3
+#define PACKET_CORE             1
+
+#if PACKETS_ENABLED
+#include "packet_uart.h"
+#endif
+
+// Task handles
 static TaskHandle_t sensor_task_handle = NULL;
+static TaskHandle_t dsp_task_handle = NULL;
+static TaskHandle_t output_task_handle = NULL;
+static TaskHandle_t log_task_handle = NULL;
+
+// Task stacks and control blocks; no task is created from the heap
+static StackType_t sensor_stack[SENSOR_STACK_SIZE];
+static StackType_t dsp_stack[DSP_STACK_SIZE];
+static StackType_t output_stack[OUTPUT_STACK_SIZE];
+static StackType_t log_stack[LOG_STACK_SIZE];
+static StaticTask_t sensor_tcb;
+static StaticTask_t dsp_tcb;
+static StaticTask_t output_tcb;
+static StaticTask_t log_tcb;
+
+// Stages and queues from sensor_task through dsp_task to output_task
+static pipeline_t pipeline;
+
+// Hot-path metrics, dumped with the status line
+static metrics_t metrics;
+static metrics_snapshot_t metrics_logged;
+
+// Log records from sensor_task and the driver calls it makes
+static deferred_log_t sensor_log;
+
+#if CAPTURE_ENABLED
+// Written by sensor_task, drained to the file by capture_task
+static capture_writer_t capture_writer;
+static StreamBufferHandle_t capture_stream = NULL;
+static StaticStreamBuffer_t capture_stream_buffer;
+static uint8_t capture_stream_storage[CAPTURE_STREAM_SIZE + 1];
+static TaskHandle_t capture_task_handle = NULL;
+static StackType_t capture_stack[CAPTURE_STACK_SIZE];
+static StaticTask_t capture_tcb;
+static FILE *capture_file = NULL;
+static uint32_t capture_bytes_dropped = 0;
+#endif
+
+#if PACKETS_ENABLED
+// Filled by sensor_task, packed and sent by packet_task
+static sample_ring_t packet_ring;
+static packet_uart_t packet_link;
+static packetizer_t packetizer;
+static TaskHandle_t packet_task_handle = NULL;
+static StackType_t packet_stack[PACKET_STACK_SIZE];
+static StaticTask_t packet_tcb;
+#endif
+
+// Sensor on I2C_NUM_0 and its driver and acquisition state
+static i2c_bus_t i2c_bus;
+static i2c_sensor_t i2c_sensor;
+static max30102_dev_t sensor;
+static acquisition_t acquisition;
+
+// Active sensor configuration, also used when the sensor is re-initialized
+static const max30102_config_t *sensor_config = &MAX30102_DEFAULT_CONFIG;
+
+#if ACQUISITION_LOW_POWER
+// Derived from MAX30102_DEFAULT_CONFIG by acquisition_low_power_config()
+static max30102_config_t low_power_config;
+#endif
+
+#if WARM_START_ENABLED
+// Profile loaded at boot, and the build configuration it has to match
+static warm_profile_t warm_profile;
+static bool warm_start = false;
+static uint16_t base_fingerprint;
+static uint32_t boot_count;
+static int64_t profile_saved_us = 0;
+#endif
+
+// Free heap once every task is running; it should not fall after that
+static uint32_t heap_after_start = 0;
+
+// The statics above, against the limits in memory_budget.h
+#define STATE_BYTES     (sizeof(pipeline) + sizeof(metrics) + sizeof(metrics_logged) + sizeof(sensor_log) + \
+                         sizeof(i2c_bus) + sizeof(i2c_sensor) + sizeof(sensor) + sizeof(acquisition))
+// Sensor, dsp, output, log, capture, packet and the I2C async worker
+#define TASK_COUNT      7
+#define STACK_BYTES     (SENSOR_STACK_SIZE + DSP_STACK_SIZE + OUTPUT_STACK_SIZE + LOG_STACK_SIZE + \
+                         CAPTURE_STACK_SIZE + PACKET_STACK_SIZE + I2C_ASYNC_STACK_SIZE + \
+                         TASK_COUNT * sizeof(StaticTask_t))
+_Static_assert(STATE_BYTES <= MEMORY_BUDGET_STATE, "Static state over MEMORY_BUDGET_STATE");
+_Static_assert(STACK_BYTES <= MEMORY_BUDGET_STACKS, "Task stacks over MEMORY_BUDGET_STACKS");
+#if CAPTURE_ENABLED
+_Static_assert(sizeof(capture_writer) + sizeof(capture_stream_storage) + CAPTURE_BUFFER_SIZE
+#if PACKETS_ENABLED
+               + sizeof(packet_ring) + sizeof(packet_link) + sizeof(packetizer)
+#endif
+               <= MEMORY_BUDGET_OPTIONAL, "Capture and packet state over MEMORY_BUDGET_OPTIONAL");
+#elif PACKETS_ENABLED
+_Static_assert(sizeof(packet_ring) + sizeof(packet_link) + sizeof(packetizer) <= MEMORY_BUDGET_OPTIONAL,
+               "Packet state over MEMORY_BUDGET_OPTIONAL");
+#endif
+
+// Time of the last INT falling edge, set from the ISR
+static volatile int64_t last_interrupt_us = 0;
+
+static void IRAM_ATTR max30102_int_isr(void *arg)
+{
+    TaskHandle_t task = (TaskHandle_t)arg;
+    BaseType_t higher_priority_woken = pdFALSE;
+    
+    last_interrupt_us = esp_timer_get_time();
+#if ACQUISITION_LOW_POWER
+    // Level-triggered for the light-sleep wakeup: mask until the drain
+    // releases INT
+    gpio_intr_disable(MAX30102_INT_IO);
+#endif
+    vTaskNotifyGiveFromISR(task, &higher_priority_woken);
+    portYIELD_FROM_ISR(higher_priority_woken);
+}
+
+static esp_err_t init_interrupt_gpio(TaskHandle_t task)
+{
+    gpio_config_t io_config = {
+        .pin_bit_mask = 1ULL << MAX30102_INT_IO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+#if ACQUISITION_LOW_POWER
+        .intr_type = GPIO_INTR_LOW_LEVEL,
+#else
+        .intr_type = GPIO_INTR_NEGEDGE,
+#endif
+    };
+    
+    esp_err_t ret = gpio_config(&io_config);
+    if (ret != ESP_OK) return ret;
+    
+#if ACQUISITION_LOW_POWER
+    // INT is active low and stays asserted until INTR_STATUS_1 is read
+    ret = gpio_wakeup_enable(MAX30102_INT_IO, GPIO_INTR_LOW_LEVEL);
+    if (ret == ESP_OK) {
+        ret = esp_sleep_enable_gpio_wakeup();
+    }
+    if (ret != ESP_OK) return ret;
+#endif
+    
+    ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) return ret;  // Already installed is fine
+    
+    return gpio_isr_handler_add(MAX30102_INT_IO, max30102_int_isr, task);
+}
 
 static void sensor_task(void *pvParameters)
 {
-    max30102_sample_t sample;
+    max30102_sample_t samples[MAX30102_FIFO_DEPTH];
     TickType_t last_wake_time = xTaskGetTickCount();
     uint32_t sample_count = 0;
     uint32_t no_data_count = 0;
+    acquisition_mode_t mode = ACQUISITION_LOW_POWER ? ACQUISITION_MODE_LOW_POWER : ACQUISITION_MODE;
+    
+    // Poll often enough that the FIFO never fills at the configured rate
+    uint32_t poll_interval_ms = acquisition_poll_interval_ms(sensor_config);
+    if (poll_interval_ms == 0 || poll_interval_ms > SAMPLE_INTERVAL_MS) {
+        poll_interval_ms = SAMPLE_INTERVAL_MS;
+    }
+    TickType_t poll_ticks = pdMS_TO_TICKS(poll_interval_ms);
+    if (poll_ticks == 0) {
+        poll_ticks = 1;
+    }
+    int64_t poll_period_us = (int64_t)poll_ticks * portTICK_PERIOD_MS * 1000;
+    int64_t last_work_us = 0;
+    
+    bool first_sample_logged = false;
     
     ESP_LOGI(TAG, "Starting sensor reading task...");
-    ESP_LOGI(TAG, "Waiting for sensor to stabilize...");
     
-    // Give sensor extra time to stabilize after initialization
-    vTaskDelay(pdMS_TO_TICKS(200));
+    if (mode != ACQUISITION_MODE_POLLING &&
+        init_interrupt_gpio(xTaskGetCurrentTaskHandle()) != ESP_OK) {
+        ESP_LOGW(TAG, "INT GPIO setup failed, falling back to polling");
+        mode = ACQUISITION_MODE_POLLING;
+    }
+    
+    max30102_err_t err = acquisition_start(&acquisition, &sensor, mode, sensor_config);
+    if (err != MAX30102_OK) {
+        ESP_LOGW(TAG, "Acquisition start failed: %d", err);
+    }
     
-    ESP_LOGI(TAG, "Sample format: [COUNT] Red: XXXXXX, IR: XXXXXX");
+#if OUTPUT_FORMAT == OUTPUT_FORMAT_BINARY
+    ESP_LOGI(TAG, "Sample format: binary stream frames on UART %d (decode with hrm_decode)", STREAM_UART_NUM);
+#else
+    ESP_LOGI(TAG, "Sample format: [SEQ] Red: XXXXXX, IR: XXXXXX");
+#endif
     ESP_LOGI(TAG, "----------------------------------------");
+#if CAPTURE_ENABLED
+    capture_write_config(&capture_writer, sensor_config, max30102_fifo_rate_hz(sensor_config));
+#endif
     
     while (1) {
-        max30102_err_t err = max30102_read_sample(&sample);
+        int64_t event_time_us;
+        int64_t work_start_us;
+        
+        if (mode != ACQUISITION_MODE_POLLING) {
+            // Block until A_FULL; on timeout drain anyway in case an edge was missed
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INTERRUPT_TIMEOUT_MS)) > 0) {
+                event_time_us = last_interrupt_us;
+            } else {
+                event_time_us = 0;
+            }
+        } else {
+            // Wait for next sample interval
+            vTaskDelayUntil(&last_wake_time, poll_ticks);
+            event_time_us = esp_timer_get_time();
+        }
+        work_start_us = esp_timer_get_time();
+        
+        // How late this wakeup ran: after the interrupt, or against the
+        // polling period
+        if (mode != ACQUISITION_MODE_POLLING) {
+            if (event_time_us > 0) {
+                metrics_record(&metrics, METRIC_LOOP_JITTER_US, (uint32_t)(work_start_us - event_time_us));
+            }
+        } else if (last_work_us > 0) {
+            int64_t error_us = work_start_us - last_work_us - poll_period_us;
+            metrics_record(&metrics, METRIC_LOOP_JITTER_US, (uint32_t)(error_us < 0 ? -error_us : error_us));
+        }
+        last_work_us = work_start_us;
+        
+        size_t count = 0;
+        max30102_gap_t gap;
+        err = acquisition_drain(&acquisition, event_time_us, samples, MAX30102_FIFO_DEPTH, &count, &gap);
+#if ACQUISITION_LOW_POWER
+        if (mode == ACQUISITION_MODE_LOW_POWER) {
+            // The drain reads INTR_STATUS_1, but not if it failed before the
+            // status read. Release INT first, or the level wakeup fires again
+            // at once.
+            if (gpio_get_level(MAX30102_INT_IO) == 0) {
+                uint8_t status;
+                max30102_read_intr_status(&sensor, &status);
+            }
+            gpio_intr_enable(MAX30102_INT_IO);
+        }
+#endif
         
-        if (err == MAX30102_OK && sample.valid) {
-            sample_count++;
+        if (gap.count > 0) {
+            DEFERRED_LOG(&sensor_log, gap.saturated ? LOG_MSG_GAP_ESTIMATED : LOG_MSG_GAP, gap.count, gap.sequence);
+            pipeline_acquire_gap(&pipeline, &gap);
+        }
+#if CAPTURE_ENABLED
+        capture_write_gap(&capture_writer, &gap);
+        capture_write_samples(&capture_writer, samples, count, esp_timer_get_time());
+#endif
+        
+        if (err == MAX30102_OK) {
             no_data_count = 0;  // Reset no-data counter
-            printf("[%lu] Red: %6lu, IR: %6lu\n", 
-                   sample_count, sample.red, sample.ir);
+            sample_count += count;
+            
+            if (!first_sample_logged) {
+                max30102_init_stats_t init;
+                max30102_get_init_stats(&sensor, &init);
+                DEFERRED_LOG(&sensor_log, LOG_MSG_FIRST_SAMPLE, init.first_sample_us / 1000);
+                first_sample_logged = true;
+            }
+            
+            pipeline_acquire(&pipeline, samples, count);
+            pipeline_account(&pipeline, PIPELINE_STAGE_ACQUIRE, work_start_us, count);
+            if (dsp_task_handle) {
+                xTaskNotifyGive(dsp_task_handle);
+            }
+#if PACKETS_ENABLED
+            sample_ring_push_block(&packet_ring, samples, count);
+            if (packet_task_handle) {
+                xTaskNotifyGive(packet_task_handle);
+            }
+#endif
         } else if (err == MAX30102_ERR_NO_DATA) {
             // No data available, this is normal but track it
             no_data_count++;
             if (no_data_count % 40 == 1) {  // Print every 40 no-data events (less frequent)
-                printf("[%lu] No data available (count: %lu)\n", sample_count, no_data_count);
+                DEFERRED_LOG(&sensor_log, LOG_MSG_NO_DATA, sample_count, no_data_count);
             }
-        } else {
-            ESP_LOGW(TAG, "Sample read error: %d", err);
+        }
+        
+        if (err != MAX30102_OK && err != MAX30102_ERR_NO_DATA) {
+            DEFERRED_LOG(&sensor_log, LOG_MSG_READ_ERROR, err);
             // Try to recover by clearing FIFO
-            max30102_clear_fifo();
+            max30102_clear_fifo(&sensor);
             vTaskDelay(pdMS_TO_TICKS(100));  // Brief pause for recovery
         }
         
         // Check if we've been getting no data for too long
         if (no_data_count > 100) {
-            ESP_LOGW(TAG, "No data for %lu attempts. Resetting sensor...", no_data_count);
-            max30102_reset();
-            vTaskDelay(pdMS_TO_TICKS(100));
-            max30102_init(&MAX30102_DEFAULT_CONFIG);
+            DEFERRED_LOG(&sensor_log, LOG_MSG_SENSOR_RESET, no_data_count);
+            max30102_reset(&sensor);
+            max30102_init_fast(&sensor, sensor_config);
+            acquisition_start(&acquisition, &sensor, mode, sensor_config);
+#if CAPTURE_ENABLED
+            capture_write_config(&capture_writer, sensor_config, max30102_fifo_rate_hz(sensor_config));
+#endif
             no_data_count = 0;
+            first_sample_logged = false;
+        }
+    }
+}
+
+// Analyzes blocks from the sample ring. Woken by sensor_task when samples
+// arrive and by output_task when it frees queue space.
+static void dsp_task(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OUTPUT_TIMEOUT_MS));
+        
+        while (pipeline_dsp_step(&pipeline) > 0) {
+            if (output_task_handle) {
+                xTaskNotifyGive(output_task_handle);
+            }
+        }
+    }
+}
+
+// Formats and prints what sensor_task logged, at the lowest priority so
+// console output never delays sampling
+static void log_task(void *pvParameters)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(LOG_FLUSH_MS));
+        deferred_log_flush(&sensor_log, deferred_log_print, NULL, 0);
+    }
+}
+
+#if CAPTURE_ENABLED
+// Capture writer output, on sensor_task. A chunk that does not fit is
+// dropped whole so the file never holds part of a record.
+static void capture_stream_write(void *ctx, const uint8_t *data, size_t len)
+{
+    if (xStreamBufferSpacesAvailable(capture_stream) < len ||
+        xStreamBufferSend(capture_stream, data, len, 0) != len) {
+        capture_bytes_dropped += len;
+    }
+}
+
+// Writes captured bytes to the file and syncs it every CAPTURE_SYNC_MS, so
+// a reset loses at most that much
+static void capture_task(void *pvParameters)
+{
+    static uint8_t buf[CAPTURE_BUFFER_SIZE];
+    int64_t last_sync_us = esp_timer_get_time();
+    
+    while (1) {
+        size_t len = xStreamBufferReceive(capture_stream, buf, sizeof(buf), pdMS_TO_TICKS(CAPTURE_SYNC_MS));
+        if (len > 0 && fwrite(buf, 1, len, capture_file) != len) {
+            ESP_LOGE(TAG, "Capture write failed, stopping capture");
+            fclose(capture_file);
+            capture_file = NULL;
+            vTaskSuspend(NULL);
         }
         
-        // Wait for next sample interval
-        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(SAMPLE_INTERVAL_MS));
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_sync_us >= (int64_t)CAPTURE_SYNC_MS * 1000) {
+            fflush(capture_file);
+            fsync(fileno(capture_file));
+            last_sync_us = now_us;
+        }
+    }
+}
+
+static esp_err_t init_capture(void)
+{
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = CAPTURE_BASE_PATH,
+        .partition_label = CAPTURE_PARTITION,
+        .max_files = 2,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Capture partition '%s' not mounted: %s", CAPTURE_PARTITION, esp_err_to_name(ret));
+        return ret;
     }
+    
+    capture_file = fopen(CAPTURE_PATH, "wb");
+    capture_stream = xStreamBufferCreateStatic(CAPTURE_STREAM_SIZE, 1, capture_stream_storage,
+                                               &capture_stream_buffer);
+    if (!capture_file || !capture_stream) {
+        ESP_LOGE(TAG, "Cannot open %s", CAPTURE_PATH);
+        return ESP_FAIL;
+    }
+    capture_writer_init(&capture_writer, capture_stream_write, NULL);
+    
+    capture_task_handle = xTaskCreateStaticPinnedToCore(capture_task, "capture_task", CAPTURE_STACK_SIZE, NULL,
+                                                        CAPTURE_TASK_PRIORITY, capture_stack, &capture_tcb,
+                                                        CAPTURE_CORE);
+    if (!capture_task_handle) {
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Capturing raw samples to %s", CAPTURE_PATH);
+    return ESP_OK;
 }
+#endif
+
+#if PACKETS_ENABLED
+// Packs samples as sensor_task queues them and sleeps until the open
+// packet's deadline. When the UART backs up, samples wait in packet_ring
+// and the next wakeup retries.
+static void packet_task(void *pvParameters)
+{
+    while (1) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t due_us = packetizer_due_us(&packetizer);
+        TickType_t wait = pdMS_TO_TICKS(OUTPUT_TIMEOUT_MS);
+        if (due_us != INT64_MAX) {
+            TickType_t due_ticks = pdMS_TO_TICKS((due_us > now_us ? due_us - now_us : 0) / 1000);
+            wait = (due_ticks < wait) ? due_ticks : wait;
+        }
+        if (wait == 0) {
+            wait = 1;
+        }
+        
+        ulTaskNotifyTake(pdTRUE, wait);
+        packetizer_service(&packetizer, &packet_ring, esp_timer_get_time());
+    }
+}
+
+static esp_err_t init_packets(void)
+{
+    sample_ring_init(&packet_ring);
+    esp_err_t ret = packet_uart_init(&packet_link, PACKET_UART_NUM, PACKET_UART_TX_IO, PACKET_UART_BAUD, PACKET_MTU);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (packetizer_init(&packetizer, &packet_link.transport, PACKET_DEADLINE_US) != MAX30102_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    packet_task_handle = xTaskCreateStaticPinnedToCore(packet_task, "packet_task", PACKET_STACK_SIZE, NULL,
+                                                       PACKET_TASK_PRIORITY, packet_stack, &packet_tcb, PACKET_CORE);
+    if (!packet_task_handle) {
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Sample packets on UART %d, %d-byte MTU, %lu samples per packet", PACKET_UART_NUM, PACKET_MTU,
+             (unsigned long)packetizer_capacity(PACKET_MTU));
+    return ESP_OK;
+}
+#endif
+
+#if OUTPUT_FORMAT == OUTPUT_FORMAT_BINARY
+static void output_write(void *ctx, const uint8_t *data, size_t len)
+{
+    // Written straight to the UART driver: stdout would expand 0x0A to CRLF
+    uart_write_bytes(STREAM_UART_NUM, data, len);
+}
+#else
+static void output_write(void *ctx, const uint8_t *data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+}
+#endif
+
+#if OUTPUT_FORMAT == OUTPUT_FORMAT_BINARY
+// Installed from app_main, so the driver's buffers are on the heap before
+// heap_after_start is sampled
+static esp_err_t init_stream_uart(void)
+{
+    uart_config_t uart_config = {
+        .baud_rate = STREAM_UART_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    esp_err_t ret = uart_driver_install(STREAM_UART_NUM, 256, STREAM_UART_TX_BUFFER, 0, NULL, 0);
+    if (ret == ESP_OK) {
+        ret = uart_param_config(STREAM_UART_NUM, &uart_config);
+    }
+    if (ret == ESP_OK) {
+        ret = uart_set_pin(STREAM_UART_NUM, STREAM_UART_TX_IO, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
+                           UART_PIN_NO_CHANGE);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Stream UART %d setup failed: %s", STREAM_UART_NUM, esp_err_to_name(ret));
+    }
+    return ret;
+}
+#endif
+
+static void output_task(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OUTPUT_TIMEOUT_MS));
+        
+        while (pipeline_output_step(&pipeline) > 0) {
+            if (dsp_task_handle) {
+                xTaskNotifyGive(dsp_task_handle);
+            }
+        }
+        pipeline_output_flush(&pipeline);
+    }
+}
+
+#if WARM_START_ENABLED
+// Counts this boot and reads the profile from NVS. False on a first boot,
+// or if the stored profile is corrupt, of another version, from another
+// build config or stale.
+static bool load_profile(const max30102_config_t *base)
+{
+    uint8_t buf[WARM_PROFILE_SIZE];
+    size_t len = sizeof(buf);
+    nvs_handle_t handle;
+    
+    base_fingerprint = warm_profile_fingerprint(base);
+    if (nvs_open(PROFILE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return false;
+    }
+    boot_count = 0;
+    nvs_get_u32(handle, BOOT_COUNT_KEY, &boot_count);
+    boot_count++;
+    if (nvs_set_u32(handle, BOOT_COUNT_KEY, boot_count) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Boot count not saved");
+    }
+    esp_err_t ret = nvs_get_blob(handle, PROFILE_KEY, buf, &len);
+    nvs_close(handle);
+    if (ret != ESP_OK) {
+        ESP_LOGI(TAG, "No warm-start profile, cold start");
+        return false;
+    }
+    
+    if (warm_profile_decode(buf, len, &warm_profile) != MAX30102_OK) {
+        ESP_LOGW(TAG, "Warm-start profile invalid, cold start");
+        return false;
+    }
+    if (warm_profile.base_fingerprint != base_fingerprint) {
+        ESP_LOGI(TAG, "Warm-start profile is from another sensor configuration, cold start");
+        return false;
+    }
+    if (!warm_profile_fresh(&warm_profile, boot_count)) {
+        ESP_LOGI(TAG, "Warm-start profile is %lu boots old, cold start",
+                 (unsigned long)(boot_count - warm_profile.boot_count));
+        return false;
+    }
+    return true;
+}
+
+// Saves the state dsp last published while the detector was locked on a
+// good signal
+static void save_profile(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (profile_saved_us != 0 && now_us - profile_saved_us < (int64_t)PROFILE_SAVE_INTERVAL_S * 1000000) {
+        return;
+    }
+    
+    warm_profile_t profile = {
+        .base_fingerprint = base_fingerprint,
+        .boot_count = boot_count,
+    };
+    if (!pipeline_get_warm_state(&pipeline, &profile.hr)) {
+        return;
+    }
+    
+    uint8_t buf[WARM_PROFILE_SIZE];
+    size_t len = warm_profile_encode(&profile, buf, sizeof(buf));
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(PROFILE_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, PROFILE_KEY, buf, len);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Warm-start profile not saved: %s", esp_err_to_name(ret));
+    }
+    profile_saved_us = now_us;
+}
+#endif
+
+#if ACQUISITION_LOW_POWER
+// Lets the idle task light-sleep whenever every task is blocked
+static void init_low_power(void)
+{
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = LOW_POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Light sleep unavailable (%s), enable CONFIG_PM_ENABLE and "
+                 "CONFIG_FREERTOS_USE_TICKLESS_IDLE", esp_err_to_name(ret));
+        return;
+    }
+    ESP_LOGI(TAG, "Light sleep enabled, %d-%d MHz", LOW_POWER_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+#endif
 
 static esp_err_t init_system(void)
 {
@@ -77,22 +729,44 @@ static esp_err_t init_system(void)
     }
     ESP_ERROR_CHECK(ret);
     
+#if WARM_START_ENABLED
+    warm_start = load_profile(sensor_config);
+#endif
+    
     // Initialize I2C
     ESP_LOGI(TAG, "Initializing I2C...");
-    ret = i2c_master_init();
+    ret = i2c_bus_init(&i2c_bus, I2C_NUM_0, I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO);
+    if (ret == ESP_OK) {
+        ret = i2c_bus_add_max30102(&i2c_bus, &i2c_sensor, MAX30102_I2C_ADDR, I2C_MUX_NONE);
+    }
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "I2C initialization failed");
         return ret;
     }
     
+    max30102_set_transport(&sensor, &i2c_sensor.transport);
+    max30102_set_metrics(&sensor, &metrics);
+    max30102_set_log(&sensor, &sensor_log);
+#if WARM_START_ENABLED
+    if (warm_start) {
+        max30102_assume_config(&sensor, sensor_config);
+    }
+#endif
+    
     // Initialize MAX30102 sensor
     ESP_LOGI(TAG, "Initializing MAX30102 sensor...");
-    max30102_err_t max_err = max30102_init(&MAX30102_DEFAULT_CONFIG);
+    max30102_err_t max_err = max30102_init_fast(&sensor, sensor_config);
     if (max_err != MAX30102_OK) {
         ESP_LOGE(TAG, "MAX30102 initialization failed: %d", max_err);
         return ESP_FAIL;
     }
     
+    max30102_init_stats_t init;
+    max30102_get_init_stats(&sensor, &init);
+    ESP_LOGI(TAG, "Sensor init: %lu us, %lu bus transactions, %lu bytes, %lu reset polls",
+             (unsigned long)init.init_us, (unsigned long)init.transactions,
+             (unsigned long)init.bytes, (unsigned long)init.reset_polls);
+    
     ESP_LOGI(TAG, "System initialization complete");
     return ESP_OK;
 }
@@ -101,17 +775,36 @@ static void cleanup_system(void)
 {
     ESP_LOGI(TAG, "Cleaning up system resources...");
     
-    // Stop sensor task if running
+    // Stop tasks if running
     if (sensor_task_handle) {
         vTaskDelete(sensor_task_handle);
         sensor_task_handle = NULL;
     }
+    if (dsp_task_handle) {
+        vTaskDelete(dsp_task_handle);
+        dsp_task_handle = NULL;
+    }
+    if (output_task_handle) {
+        vTaskDelete(output_task_handle);
+        output_task_handle = NULL;
+    }
+    if (log_task_handle) {
+        vTaskDelete(log_task_handle);
+        log_task_handle = NULL;
+    }
+#if PACKETS_ENABLED
+    if (packet_task_handle) {
+        vTaskDelete(packet_task_handle);
+        packet_task_handle = NULL;
+    }
+#endif
     
     // Deinitialize MAX30102
-    max30102_deinit();
+    max30102_deinit(&sensor);
     
     // Deinitialize I2C
-    i2c_master_deinit();
+    i2c_bus_remove_max30102(&i2c_sensor);
+    i2c_bus_deinit(&i2c_bus);
     
     ESP_LOGI(TAG, "System cleanup complete");
 }
@@ -119,39 +812,181 @@ static void cleanup_system(void)
 void app_main(void)
 {
     esp_log_level_set("*", ESP_LOG_INFO);
+    metrics_init(&metrics);
+    metrics_snapshot(&metrics, &metrics_logged);
+    deferred_log_init(&sensor_log);
     
     ESP_LOGI(TAG, "=== MAX30102 Sensor Reader ===");
     ESP_LOGI(TAG, "ESP32-S3 with MAX30102 Heart Rate & SpO2 Sensor");
     ESP_LOGI(TAG, "Sample Rate: %d ms", SAMPLE_INTERVAL_MS);
     
+#if ACQUISITION_LOW_POWER
+    acquisition_low_power_config(&MAX30102_DEFAULT_CONFIG, LOW_POWER_MIN_RATE_HZ, &low_power_config);
+    sensor_config = &low_power_config;
+    init_low_power();
+#endif
+    
     // Initialize system components
     if (init_system() != ESP_OK) {
         ESP_LOGE(TAG, "System initialization failed");
         return;
     }
     
+    pipeline_config_t pipeline_config = {
+        .output = (OUTPUT_FORMAT == OUTPUT_FORMAT_BINARY) ? PIPELINE_OUTPUT_BINARY : PIPELINE_OUTPUT_TEXT,
+        .sample_rate_hz = max30102_fifo_rate_hz(sensor_config),
+        .write = output_write,
+        .write_ctx = NULL,
+        .clock_us = esp_timer_get_time,
+        .metrics = &metrics,
+        .adc_range = sensor_config->adc_range,
+        .quality_gate = true,
+    };
+    pipeline_init(&pipeline, &pipeline_config);
+    if (!pipeline.analysis_enabled) {
+        ESP_LOGW(TAG, "Sample rate too low for heart-rate and SpO2 estimation");
+    }
+#if WARM_START_ENABLED
+    if (warm_start) {
+        hr_detector_restore(&pipeline.hr, &warm_profile.hr);
+        ESP_LOGI(TAG, "Warm start: %lu ms beat interval", (unsigned long)(warm_profile.hr.interval_us / 1000));
+    }
+#endif
+    
+    log_task_handle = xTaskCreateStaticPinnedToCore(
+        log_task,
+        "log_task",
+        LOG_STACK_SIZE,
+        NULL,
+        LOG_TASK_PRIORITY,
+        log_stack,
+        &log_tcb,
+        LOG_CORE
+    );
+    
+    if (!log_task_handle) {
+        ESP_LOGW(TAG, "Failed to create log task, sensor task messages will not be printed");
+    }
+    
+#if CAPTURE_ENABLED
+    if (init_capture() != ESP_OK) {
+        ESP_LOGW(TAG, "Raw capture disabled");
+    }
+#endif
+#if PACKETS_ENABLED
+    if (init_packets() != ESP_OK) {
+        ESP_LOGW(TAG, "Sample packets disabled");
+    }
+#endif
+    
+#if OUTPUT_FORMAT == OUTPUT_FORMAT_BINARY
+    if (init_stream_uart() != ESP_OK) {
+        ESP_LOGW(TAG, "Binary stream disabled");
+    }
+#endif
+    
+    // Create the consumer tasks first so the sensor task can notify them
+    output_task_handle = xTaskCreateStaticPinnedToCore(
+        output_task,
+        "output_task",
+        OUTPUT_STACK_SIZE,
+        NULL,
+        OUTPUT_TASK_PRIORITY,
+        output_stack,
+        &output_tcb,
+        OUTPUT_CORE
+    );
+    
+    if (!output_task_handle) {
+        ESP_LOGE(TAG, "Failed to create output task");
+        cleanup_system();
+        return;
+    }
+    
+    dsp_task_handle = xTaskCreateStaticPinnedToCore(
+        dsp_task,
+        "dsp_task",
+        DSP_STACK_SIZE,
+        NULL,
+        DSP_TASK_PRIORITY,
+        dsp_stack,
+        &dsp_tcb,
+        DSP_CORE
+    );
+    
+    if (!dsp_task_handle) {
+        ESP_LOGE(TAG, "Failed to create DSP task");
+        cleanup_system();
+        return;
+    }
+    
     // Create sensor reading task
-    BaseType_t task_result = xTaskCreate(
+    sensor_task_handle = xTaskCreateStaticPinnedToCore(
         sensor_task,
         "sensor_task",
-        STACK_SIZE,
+        SENSOR_STACK_SIZE,
         NULL,
         TASK_PRIORITY,
-        &sensor_task_handle
+        sensor_stack,
+        &sensor_tcb,
+        SENSOR_CORE
     );
     
-    if (task_result != pdPASS) {
+    if (!sensor_task_handle) {
         ESP_LOGE(TAG, "Failed to create sensor task");
         cleanup_system();
         return;
     }
     
     ESP_LOGI(TAG, "Application started successfully");
+    heap_after_start = esp_get_free_heap_size();
+    ESP_LOGI(TAG, "Static RAM: %u bytes state, %u bytes stacks; pipeline buffers %u bytes for %u samples "
+             "(%u.%02u bytes per buffered sample)", (unsigned)STATE_BYTES, (unsigned)STACK_BYTES,
+             (unsigned)PIPELINE_BUFFER_BYTES, (unsigned)PIPELINE_BUFFERED_SAMPLES,
+             (unsigned)(PIPELINE_BUFFER_BYTES / PIPELINE_BUFFERED_SAMPLES),
+             (unsigned)(PIPELINE_BUFFER_BYTES * 100 / PIPELINE_BUFFERED_SAMPLES % 100));
     
     // Main loop - could add additional functionality here
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(5000));  // Print status every 5 seconds
-        ESP_LOGI(TAG, "System running... Free heap: %lu bytes", 
-                 esp_get_free_heap_size());
+        // Heap use should stay flat once the tasks are running
+        ESP_LOGI(TAG, "System running... Free heap: %lu bytes, lowest %lu, %ld since start",
+                 esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+                 (long)esp_get_free_heap_size() - (long)heap_after_start);
+        acquisition_log_stats(&acquisition);
+        pipeline_log_stats(&pipeline);
+        metrics_log(&metrics, &metrics_logged);
+#if CAPTURE_ENABLED
+        capture_stats_t capture_stats;
+        capture_writer_get_stats(&capture_writer, &capture_stats);
+        ESP_LOGI(TAG, "Capture: %lu samples, %lu gaps, %lu bytes, %lu bytes dropped",
+                 (unsigned long)capture_stats.samples, (unsigned long)capture_stats.gaps,
+                 (unsigned long)capture_stats.bytes, (unsigned long)capture_bytes_dropped);
+#endif
+#if PACKETS_ENABLED
+        packetizer_stats_t packet_stats;
+        sample_ring_stats_t packet_ring_stats;
+        packetizer_get_stats(&packetizer, &packet_stats);
+        sample_ring_get_stats(&packet_ring, &packet_ring_stats);
+        ESP_LOGI(TAG, "Packets: %lu sent (%lu full, %lu at deadline), %lu samples, %lu bytes, %lu stalls, "
+                 "%lu samples dropped", (unsigned long)packet_stats.packets, (unsigned long)packet_stats.full,
+                 (unsigned long)packet_stats.deadline, (unsigned long)packet_stats.samples,
+                 (unsigned long)packet_stats.bytes, (unsigned long)packet_stats.stalls,
+                 (unsigned long)packet_ring_stats.drops);
+#endif
+        
+        // Published by dsp on the other core; the estimators are not read here
+        pipeline_readout_t readout;
+        pipeline_get_readout(&pipeline, &readout);
+        if (readout.bpm_x10) {
+            ESP_LOGI(TAG, "Heart rate: %u.%u BPM (spectral %u.%u), SpO2: %u.%u%%", readout.bpm_x10 / 10,
+                     readout.bpm_x10 % 10, readout.spectral_bpm_x10 / 10, readout.spectral_bpm_x10 % 10,
+                     readout.spo2_x10 / 10, readout.spo2_x10 % 10);
+        } else if (pipeline.analysis_enabled) {
+            ESP_LOGI(TAG, "Heart rate: no lock");
+        }
+#if WARM_START_ENABLED
+        save_profile();
+#endif
     }
 }
@@ -1,6 +1,8 @@
 #include "max30102.h"
-#include "i2c_config.h"
+#include <string.h>
+#include "i2c_async.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -19,81 +21,254 @@ const max30102_config_t MAX30102_DEFAULT_CONFIG = {
     .almost_full_threshold = 10  // Lower threshold
 };
 
+// Configuration registers the shadow covers, as a bitmask over register
+// addresses. Pointers, status and FIFO data are never shadowed.
+#define SHADOW_BIT(reg)     (1u << (reg))
+#define SHADOW_CACHED       (SHADOW_BIT(MAX30102_REG_INTR_ENABLE_1) | SHADOW_BIT(MAX30102_REG_INTR_ENABLE_2) | \
+                             SHADOW_BIT(MAX30102_REG_FIFO_CONFIG) | SHADOW_BIT(MAX30102_REG_MODE_CONFIG) | \
+                             SHADOW_BIT(MAX30102_REG_SPO2_CONFIG) | SHADOW_BIT(MAX30102_REG_LED1_PA) | \
+                             SHADOW_BIT(MAX30102_REG_LED2_PA) | SHADOW_BIT(MAX30102_REG_MULTI_LED_CTRL1) | \
+                             SHADOW_BIT(MAX30102_REG_MULTI_LED_CTRL2))
+#define SHADOW_CONFIG_BLOCK (SHADOW_BIT(MAX30102_REG_FIFO_CONFIG) | SHADOW_BIT(MAX30102_REG_MODE_CONFIG) | \
+                             SHADOW_BIT(MAX30102_REG_SPO2_CONFIG) | SHADOW_BIT(MAX30102_REG_LED1_PA) | \
+                             SHADOW_BIT(MAX30102_REG_LED2_PA))
+#define MAX_BURST_WRITE     8
+
 // Private function prototypes
-static max30102_err_t max30102_write_reg(uint8_t reg, uint8_t data);
-static max30102_err_t max30102_read_reg(uint8_t reg, uint8_t *data);
-static max30102_err_t max30102_read_fifo_data(uint8_t *data, size_t len);
+static max30102_err_t max30102_write_reg(max30102_dev_t *dev, uint8_t reg, uint8_t data);
+static max30102_err_t max30102_write_regs(max30102_dev_t *dev, uint8_t reg, const uint8_t *data, size_t len);
+static void max30102_account_transfer(max30102_dev_t *dev, int64_t start_us, max30102_err_t ret);
+static max30102_err_t max30102_write_config(max30102_dev_t *dev, uint8_t reg, const uint8_t *data, size_t len);
+static bool max30102_shadow_matches(const max30102_dev_t *dev, uint8_t reg, uint8_t value);
+static void max30102_config_regs(const max30102_config_t *config, uint8_t *fifo_config, uint8_t *spo2_config);
+static void max30102_init_begin(max30102_dev_t *dev);
+static void max30102_init_end(max30102_dev_t *dev);
+static void max30102_forget_fifo(max30102_dev_t *dev);
+static max30102_err_t max30102_read_reg(max30102_dev_t *dev, uint8_t reg, uint8_t *data);
+static max30102_err_t max30102_read_regs(max30102_dev_t *dev, uint8_t reg, uint8_t *data, size_t len);
+static max30102_err_t max30102_read_fifo_data(max30102_dev_t *dev, uint8_t *data, size_t len);
+static void max30102_unpack_samples(max30102_dev_t *dev, const uint8_t *raw, size_t count,
+                                    max30102_sample_t *samples);
+static uint32_t max30102_next_sequence(max30102_dev_t *dev);
+static max30102_err_t max30102_fifo_overrun_fixup(max30102_dev_t *dev, uint8_t read_ptr, size_t popped,
+                                                  max30102_gap_t *gap);
+static bool max30102_fifo_needs_fixup(const max30102_dev_t *dev, const max30102_gap_t *lost, size_t pending);
+static void max30102_fifo_overrun_apply(max30102_dev_t *dev, uint8_t read_ptr, uint8_t read_ptr_after,
+                                        size_t popped, max30102_gap_t *gap);
+static size_t max30102_fifo_pending(max30102_dev_t *dev, uint8_t write_ptr, uint8_t read_ptr,
+                                    uint8_t overflow_counter, uint8_t status, max30102_gap_t *gap);
+static size_t max30102_fifo_snapshot(max30102_dev_t *dev, const uint8_t ptrs[3], uint8_t status,
+                                     max30102_gap_t *lost);
+static void max30102_fifo_deliver(max30102_dev_t *dev, const uint8_t *raw, size_t count, size_t pending,
+                                  max30102_sample_t *samples);
+static void max30102_drain_next(max30102_dev_t *dev, i2c_async_txn_t *txn, uint8_t reg, uint8_t *rx, size_t len,
+                                i2c_async_chain_t chain);
+static bool max30102_drain_on_pointers(void *ctx, i2c_async_txn_t *txn);
+static bool max30102_drain_on_status(void *ctx, i2c_async_txn_t *txn);
+static bool max30102_drain_start_data(max30102_dev_t *dev, i2c_async_txn_t *txn);
+static bool max30102_drain_on_data(void *ctx, i2c_async_txn_t *txn);
+static bool max30102_drain_on_read_ptr(void *ctx, i2c_async_txn_t *txn);
+static void max30102_drain_done(void *ctx, const i2c_async_txn_t *txn);
+
+// Binds 'dev' to the bus its sensor is on and starts it from a clean state:
+// nothing is assumed about the sensor's registers until it is initialized
+max30102_err_t max30102_set_transport(max30102_dev_t *dev, const max30102_transport_t *new_transport)
+{
+    if (!dev || (new_transport && (!new_transport->write || !new_transport->write_read))) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(dev, 0, sizeof(*dev));
+    dev->transport = new_transport;
+    dev->fifo_sample_bytes = 2 * MAX30102_BYTES_PER_LED;
+    dev->rollover_enabled = true;
+    return MAX30102_OK;
+}
+
+// Records bus transaction times and errors, and lets acquisition record
+// drain metrics, into 'metrics'. NULL stops recording. Call after
+// max30102_set_transport(), which clears it.
+void max30102_set_metrics(max30102_dev_t *dev, metrics_t *metrics)
+{
+    if (dev) {
+        dev->metrics = metrics;
+    }
+}
+
+// Sends the driver's sampling-path warnings and errors (bus failures and
+// FIFO gaps) to 'log' instead of ESP_LOG, so they cost a ring write on the
+// calling task. NULL goes back to ESP_LOG. Call after
+// max30102_set_transport(), which clears it.
+void max30102_set_log(max30102_dev_t *dev, deferred_log_t *log)
+{
+    if (dev) {
+        dev->log = log;
+    }
+}
+
+// Records one transaction's duration and outcome. The clock is only read
+// when metrics are on.
+static void max30102_account_transfer(max30102_dev_t *dev, int64_t start_us, max30102_err_t ret)
+{
+    if (!dev->metrics) {
+        return;
+    }
+    
+    metrics_record(dev->metrics, METRIC_I2C_US, (uint32_t)(esp_timer_get_time() - start_us));
+    if (ret != MAX30102_OK) {
+        metrics_count(dev->metrics, METRIC_I2C_ERRORS, 1);
+    }
+}
 
-static max30102_err_t max30102_write_reg(uint8_t reg, uint8_t data)
+static max30102_err_t max30102_write_reg(max30102_dev_t *dev, uint8_t reg, uint8_t data)
 {
-    if (!max30102_dev_handle) {
-        ESP_LOGE(TAG, "MAX30102 device handle not initialized");
+    return max30102_write_regs(dev, reg, &data, 1);
+}
+
+// Writes len consecutive registers starting at reg in one transaction and
+// keeps the shadow in step. A failed write leaves the registers unknown.
+static max30102_err_t max30102_write_regs(max30102_dev_t *dev, uint8_t reg, const uint8_t *data, size_t len)
+{
+    if (!dev->transport) {
+        ESP_LOGE(TAG, "MAX30102 transport not initialized");
         return MAX30102_ERR_INIT;
     }
+    if (!data || len == 0 || len > MAX_BURST_WRITE) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
     
-    uint8_t write_data[2] = {reg, data};
+    uint8_t write_data[1 + MAX_BURST_WRITE];
+    write_data[0] = reg;
+    memcpy(&write_data[1], data, len);
     
-    esp_err_t ret = i2c_master_transmit(max30102_dev_handle, write_data, 2, 
-                                      pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    int64_t start_us = dev->metrics ? esp_timer_get_time() : 0;
+    max30102_err_t ret = dev->transport->write(dev->transport->ctx, write_data, 1 + len);
+    max30102_account_transfer(dev, start_us, ret);
+    dev->bus_stats.transactions++;
+    dev->bus_stats.bytes_written += 1 + len;
     
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "I2C write failed: %s", esp_err_to_name(ret));
+    if (ret != MAX30102_OK) {
+        dev->shadow_valid = 0;
+        if (dev->log) {
+            DEFERRED_LOG(dev->log, LOG_MSG_I2C_WRITE_FAILED, ret);
+        } else {
+            ESP_LOGE(TAG, "I2C write failed: %d", ret);
+        }
         return MAX30102_ERR_I2C;
     }
     
+    for (size_t i = 0; i < len; i++) {
+        uint32_t r = reg + i;
+        if (r < MAX30102_SHADOW_REGS && (SHADOW_CACHED & SHADOW_BIT(r))) {
+            dev->shadow[r] = data[i];
+            dev->shadow_valid |= SHADOW_BIT(r);
+        }
+    }
     return MAX30102_OK;
 }
 
-static max30102_err_t max30102_read_reg(uint8_t reg, uint8_t *data)
+static bool max30102_shadow_matches(const max30102_dev_t *dev, uint8_t reg, uint8_t value)
+{
+    return reg < MAX30102_SHADOW_REGS && (dev->shadow_valid & SHADOW_BIT(reg)) && dev->shadow[reg] == value;
+}
+
+// Writes only the span of registers that the shadow says would change
+static max30102_err_t max30102_write_config(max30102_dev_t *dev, uint8_t reg, const uint8_t *data, size_t len)
+{
+    size_t first = len;
+    size_t last = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!max30102_shadow_matches(dev, reg + i, data[i])) {
+            if (first == len) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    
+    if (first == len) {
+        dev->bus_stats.writes_skipped += len;
+        return MAX30102_OK;
+    }
+    dev->bus_stats.writes_skipped += len - (last - first + 1);
+    return max30102_write_regs(dev, reg + first, data + first, last - first + 1);
+}
+
+static max30102_err_t max30102_read_reg(max30102_dev_t *dev, uint8_t reg, uint8_t *data)
 {
-    if (!data || !max30102_dev_handle) {
+    return max30102_read_regs(dev, reg, data, 1);
+}
+
+// Reads len consecutive registers starting at reg in one transaction (the
+// register address auto-increments on every register except FIFO_DATA)
+static max30102_err_t max30102_read_regs(max30102_dev_t *dev, uint8_t reg, uint8_t *data, size_t len)
+{
+    if (!data || len == 0 || !dev->transport) {
         return MAX30102_ERR_INVALID_PARAM;
     }
     
-    esp_err_t ret = i2c_master_transmit_receive(max30102_dev_handle, &reg, 1, data, 1,
-                                              pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    int64_t start_us = dev->metrics ? esp_timer_get_time() : 0;
+    max30102_err_t ret = dev->transport->write_read(dev->transport->ctx, &reg, 1, data, len);
+    max30102_account_transfer(dev, start_us, ret);
+    dev->bus_stats.transactions++;
+    dev->bus_stats.bytes_written += 1;
+    dev->bus_stats.bytes_read += len;
     
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "I2C read failed: %s", esp_err_to_name(ret));
+    if (ret != MAX30102_OK) {
+        if (dev->log) {
+            DEFERRED_LOG(dev->log, LOG_MSG_I2C_READ_FAILED, ret);
+        } else {
+            ESP_LOGE(TAG, "I2C read failed: %d", ret);
+        }
         return MAX30102_ERR_I2C;
     }
     
     return MAX30102_OK;
 }
 
-static max30102_err_t max30102_read_fifo_data(uint8_t *data, size_t len)
+static max30102_err_t max30102_read_fifo_data(max30102_dev_t *dev, uint8_t *data, size_t len)
 {
-    if (!data || len == 0 || !max30102_dev_handle) {
+    if (!data || len == 0 || !dev->transport) {
         return MAX30102_ERR_INVALID_PARAM;
     }
     
     uint8_t reg = MAX30102_REG_FIFO_DATA;
     
-    esp_err_t ret = i2c_master_transmit_receive(max30102_dev_handle, &reg, 1, data, len,
-                                              pdMS_TO_TICKS(MAX30102_I2C_TIMEOUT_MS));
+    int64_t start_us = dev->metrics ? esp_timer_get_time() : 0;
+    max30102_err_t ret = dev->transport->write_read(dev->transport->ctx, &reg, 1, data, len);
+    max30102_account_transfer(dev, start_us, ret);
+    dev->bus_stats.transactions++;
+    dev->bus_stats.bytes_written += 1;
+    dev->bus_stats.bytes_read += len;
     
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "FIFO read failed: %s", esp_err_to_name(ret));
+    if (ret != MAX30102_OK) {
+        if (dev->log) {
+            DEFERRED_LOG(dev->log, LOG_MSG_FIFO_READ_FAILED, ret);
+        } else {
+            ESP_LOGE(TAG, "FIFO read failed: %d", ret);
+        }
         return MAX30102_ERR_I2C;
     }
     
     return MAX30102_OK;
 }
 
-max30102_err_t max30102_init(const max30102_config_t *config)
+max30102_err_t max30102_init(max30102_dev_t *dev, const max30102_config_t *config)
 {
-    if (!config) {
+    if (!dev || !config) {
         return MAX30102_ERR_INVALID_PARAM;
     }
     
-    // Check if I2C device handle is available
-    if (!max30102_dev_handle) {
-        ESP_LOGE(TAG, "I2C device handle not initialized. Call i2c_master_init() first.");
+    // Check if a bus transport is available
+    if (!dev->transport) {
+        ESP_LOGE(TAG, "Transport not initialized. Call max30102_set_transport() first.");
         return MAX30102_ERR_INIT;
     }
     
+    max30102_init_begin(dev);
+    
     // Put sensor in shutdown mode first to stop any ongoing sampling
-    max30102_err_t err = max30102_write_reg(MAX30102_REG_MODE_CONFIG, 0x80);
+    max30102_err_t err = max30102_write_reg(dev, MAX30102_REG_MODE_CONFIG, MAX30102_MODE_SHDN);
     if (err != MAX30102_OK) {
         ESP_LOGE(TAG, "Failed to put sensor in shutdown mode");
         return err;
@@ -102,7 +277,7 @@ max30102_err_t max30102_init(const max30102_config_t *config)
     vTaskDelay(pdMS_TO_TICKS(50));
     
     // Reset the sensor
-    err = max30102_reset();
+    err = max30102_reset(dev);
     if (err != MAX30102_OK) {
         return err;
     }
@@ -112,7 +287,7 @@ max30102_err_t max30102_init(const max30102_config_t *config)
     
     // Verify part ID
     uint8_t part_id;
-    err = max30102_get_part_id(&part_id);
+    err = max30102_get_part_id(dev, &part_id);
     if (err != MAX30102_OK) {
         return err;
     }
@@ -125,14 +300,14 @@ max30102_err_t max30102_init(const max30102_config_t *config)
     ESP_LOGI(TAG, "MAX30102 detected, Part ID: 0x%02X", part_id);
     
     // Clear FIFO thoroughly
-    err = max30102_clear_fifo();
+    err = max30102_clear_fifo(dev);
     if (err != MAX30102_OK) return err;
     
     // Configure FIFO with more conservative settings
     uint8_t fifo_config = (config->sample_avg & 0xE0) | 
                          (config->rollover_enable ? MAX30102_ROLLOVER_EN : 0) |
                          (config->almost_full_threshold & MAX30102_A_FULL_MASK);
-    err = max30102_write_reg(MAX30102_REG_FIFO_CONFIG, fifo_config);
+    err = max30102_write_reg(dev, MAX30102_REG_FIFO_CONFIG, fifo_config);
     if (err != MAX30102_OK) return err;
     
     ESP_LOGI(TAG, "FIFO config written: 0x%02X", fifo_config);
@@ -141,47 +316,194 @@ max30102_err_t max30102_init(const max30102_config_t *config)
     uint8_t spo2_config = (config->adc_range & 0x60) | 
                          (config->sample_rate & 0x1C) |
                          (config->pulse_width & 0x03);
-    err = max30102_write_reg(MAX30102_REG_SPO2_CONFIG, spo2_config);
+    err = max30102_write_reg(dev, MAX30102_REG_SPO2_CONFIG, spo2_config);
     if (err != MAX30102_OK) return err;
     
     ESP_LOGI(TAG, "SpO2 config written: 0x%02X", spo2_config);
     
     // Set LED power levels
-    err = max30102_set_led_power(config->led1_power, config->led2_power);
+    err = max30102_set_led_power(dev, config->led1_power, config->led2_power);
     if (err != MAX30102_OK) return err;
     
     ESP_LOGI(TAG, "LED power set - Red: 0x%02X, IR: 0x%02X", config->led1_power, config->led2_power);
     
     // Clear FIFO again before starting
-    err = max30102_clear_fifo();
+    err = max30102_clear_fifo(dev);
     if (err != MAX30102_OK) return err;
     
     // Start the sensor in the specified mode (this should be LAST)
-    err = max30102_write_reg(MAX30102_REG_MODE_CONFIG, config->mode);
+    err = max30102_write_reg(dev, MAX30102_REG_MODE_CONFIG, config->mode);
     if (err != MAX30102_OK) return err;
     
     ESP_LOGI(TAG, "Mode config written: 0x%02X", config->mode);
     
+    dev->fifo_sample_bytes = (config->mode == MAX30102_MODE_HR_ONLY ? 1 : 2) * MAX30102_BYTES_PER_LED;
+    dev->rollover_enabled = config->rollover_enable;
+    dev->fifo_rate_hz = max30102_fifo_rate_hz(config);
+    dev->config = *config;
+    
     // Wait a moment for sensor to start
     vTaskDelay(pdMS_TO_TICKS(50));
     
     // Final FIFO clear to remove any startup samples
-    err = max30102_clear_fifo();
+    err = max30102_clear_fifo(dev);
     if (err != MAX30102_OK) return err;
     
+    max30102_init_end(dev);
     ESP_LOGI(TAG, "MAX30102 initialized successfully");
     return MAX30102_OK;
 }
 
-max30102_err_t max30102_deinit(void)
+// Fast-start init. It polls the RESET bit instead of sleeping, writes
+// FIFO_CONFIG..SPO2_CONFIG and LED1_PA..LED2_PA as bursts and leaves out
+// FIFO clears that the reset already did. If the configuration registers
+// read back as the shadow expects, the part is still set up from an earlier
+// init: the reset is skipped and only registers that differ are written.
+max30102_err_t max30102_init_fast(max30102_dev_t *dev, const max30102_config_t *config)
+{
+    if (!dev || !config) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    if (!dev->transport) {
+        ESP_LOGE(TAG, "Transport not initialized. Call max30102_set_transport() first.");
+        return MAX30102_ERR_INIT;
+    }
+    
+    max30102_init_begin(dev);
+    max30102_err_t err;
+    
+    // One read of FIFO_CONFIG..LED2_PA checks the shadow against the part,
+    // which may have been power-cycled since (0x0B is reserved)
+    bool configured = false;
+    if ((dev->shadow_valid & SHADOW_CONFIG_BLOCK) == SHADOW_CONFIG_BLOCK) {
+        uint8_t block[MAX30102_REG_LED2_PA - MAX30102_REG_FIFO_CONFIG + 1];
+        err = max30102_read_regs(dev, MAX30102_REG_FIFO_CONFIG, block, sizeof(block));
+        if (err != MAX30102_OK) return err;
+        
+        configured = true;
+        for (size_t i = 0; i < sizeof(block); i++) {
+            uint8_t reg = MAX30102_REG_FIFO_CONFIG + i;
+            if ((SHADOW_CONFIG_BLOCK & SHADOW_BIT(reg)) && block[i] != dev->shadow[reg]) {
+                configured = false;
+            }
+        }
+    }
+    
+    if (!configured) {
+        err = max30102_reset(dev);
+        if (err != MAX30102_OK) return err;
+        
+        uint8_t part_id;
+        err = max30102_get_part_id(dev, &part_id);
+        if (err != MAX30102_OK) return err;
+        
+        if (part_id != 0x15) {  // Expected part ID for MAX30102
+            ESP_LOGE(TAG, "Unexpected part ID: 0x%02X", part_id);
+            return MAX30102_ERR_INIT;
+        }
+    }
+    dev->init_stats.reset_skipped = configured;
+    
+    uint8_t fifo_config;
+    uint8_t spo2_config;
+    max30102_config_regs(config, &fifo_config, &spo2_config);
+    
+    // Sampling is stopped only if its timing or FIFO format changes; the
+    // same burst that sets them holds the part in shutdown
+    bool restart = !max30102_shadow_matches(dev, MAX30102_REG_FIFO_CONFIG, fifo_config) ||
+                   !max30102_shadow_matches(dev, MAX30102_REG_MODE_CONFIG, config->mode) ||
+                   !max30102_shadow_matches(dev, MAX30102_REG_SPO2_CONFIG, spo2_config);
+    if (restart) {
+        uint8_t block[3] = {fifo_config, MAX30102_MODE_SHDN | config->mode, spo2_config};
+        err = max30102_write_config(dev, MAX30102_REG_FIFO_CONFIG, block, sizeof(block));
+        if (err != MAX30102_OK) return err;
+    }
+    
+    err = max30102_set_led_power(dev, config->led1_power, config->led2_power);
+    if (err != MAX30102_OK) return err;
+    
+    // A reset leaves the FIFO empty; otherwise it holds stale samples
+    if (configured) {
+        err = max30102_clear_fifo(dev);
+        if (err != MAX30102_OK) return err;
+    } else {
+        max30102_forget_fifo(dev);
+    }
+    
+    if (restart) {
+        err = max30102_write_config(dev, MAX30102_REG_MODE_CONFIG, &config->mode, 1);
+        if (err != MAX30102_OK) return err;
+    }
+    
+    dev->fifo_sample_bytes = (config->mode == MAX30102_MODE_HR_ONLY ? 1 : 2) * MAX30102_BYTES_PER_LED;
+    dev->rollover_enabled = config->rollover_enable;
+    dev->fifo_rate_hz = max30102_fifo_rate_hz(config);
+    dev->config = *config;
+    
+    max30102_init_end(dev);
+    ESP_LOGI(TAG, "MAX30102 initialized in %lu us, %lu bus transactions%s",
+             (unsigned long)dev->init_stats.init_us, (unsigned long)dev->init_stats.transactions,
+             configured ? " (no reset needed)" : "");
+    return MAX30102_OK;
+}
+
+static void max30102_config_regs(const max30102_config_t *config, uint8_t *fifo_config, uint8_t *spo2_config)
+{
+    *fifo_config = (config->sample_avg & 0xE0) |
+                   (config->rollover_enable ? MAX30102_ROLLOVER_EN : 0) |
+                   (config->almost_full_threshold & MAX30102_A_FULL_MASK);
+    *spo2_config = (config->adc_range & 0x60) |
+                   (config->sample_rate & 0x1C) |
+                   (config->pulse_width & 0x03);
+}
+
+// For a warm start: the part is probably still running 'config' from before
+// the MCU reset, which leaves the sensor powered. Loads the shadow with the
+// registers max30102_init_fast() would have written, so its one-read check
+// can skip the reset and part ID probe. If the part was power-cycled or
+// reconfigured since, the check fails and init runs from cold.
+void max30102_assume_config(max30102_dev_t *dev, const max30102_config_t *config)
+{
+    uint8_t fifo_config;
+    uint8_t spo2_config;
+    max30102_config_regs(config, &fifo_config, &spo2_config);
+    
+    dev->shadow[MAX30102_REG_FIFO_CONFIG] = fifo_config;
+    dev->shadow[MAX30102_REG_MODE_CONFIG] = config->mode;
+    dev->shadow[MAX30102_REG_SPO2_CONFIG] = spo2_config;
+    dev->shadow[MAX30102_REG_LED1_PA] = config->led1_power;
+    dev->shadow[MAX30102_REG_LED2_PA] = config->led2_power;
+    dev->shadow_valid |= SHADOW_CONFIG_BLOCK;
+}
+
+static void max30102_init_begin(max30102_dev_t *dev)
+{
+    dev->init_stats = (max30102_init_stats_t){0};
+    dev->init_bus_start = dev->bus_stats;
+    dev->init_start_us = esp_timer_get_time();
+    dev->awaiting_first_sample = false;
+}
+
+static void max30102_init_end(max30102_dev_t *dev)
+{
+    dev->init_stats.transactions = dev->bus_stats.transactions - dev->init_bus_start.transactions;
+    dev->init_stats.bytes = (dev->bus_stats.bytes_written - dev->init_bus_start.bytes_written) +
+                       (dev->bus_stats.bytes_read - dev->init_bus_start.bytes_read);
+    dev->init_stats.writes_skipped = dev->bus_stats.writes_skipped - dev->init_bus_start.writes_skipped;
+    dev->init_stats.init_us = esp_timer_get_time() - dev->init_start_us;
+    dev->awaiting_first_sample = true;
+}
+
+max30102_err_t max30102_deinit(max30102_dev_t *dev)
 {
     // Put sensor in shutdown mode
-    return max30102_write_reg(MAX30102_REG_MODE_CONFIG, 0x80);
+    return max30102_write_reg(dev, MAX30102_REG_MODE_CONFIG, MAX30102_MODE_SHDN);
 }
 
-max30102_err_t max30102_read_sample(max30102_sample_t *sample)
+max30102_err_t max30102_read_sample(max30102_dev_t *dev, max30102_sample_t *sample)
 {
-    if (!sample) {
+    if (!dev || !sample) {
         return MAX30102_ERR_INVALID_PARAM;
     }
     
@@ -189,101 +511,554 @@ max30102_err_t max30102_read_sample(max30102_sample_t *sample)
     
     // Read FIFO pointers and overflow counter
     uint8_t write_ptr, read_ptr, overflow_counter;
-    max30102_err_t err = max30102_read_reg(MAX30102_REG_FIFO_WR_PTR, &write_ptr);
+    max30102_err_t err = max30102_read_reg(dev, MAX30102_REG_FIFO_WR_PTR, &write_ptr);
+    if (err != MAX30102_OK) return err;
+    
+    err = max30102_read_reg(dev, MAX30102_REG_FIFO_RD_PTR, &read_ptr);
     if (err != MAX30102_OK) return err;
     
-    err = max30102_read_reg(MAX30102_REG_FIFO_RD_PTR, &read_ptr);
+    err = max30102_read_reg(dev, MAX30102_REG_OVF_COUNTER, &overflow_counter);
     if (err != MAX30102_OK) return err;
     
-    err = max30102_read_reg(MAX30102_REG_OVF_COUNTER, &overflow_counter);
+    // Latched after the pointers, so A_FULL tells a full FIFO from an empty one
+    uint8_t status;
+    err = max30102_read_reg(dev, MAX30102_REG_INTR_STATUS_1, &status);
     if (err != MAX30102_OK) return err;
     
-    // Debug log FIFO state more frequently when there are issues
-    static uint32_t debug_counter = 0;
-    debug_counter++;
-    if (debug_counter % 10 == 0 || overflow_counter > 0) {
-        ESP_LOGI(TAG, "FIFO Debug [%lu] - WR: %d, RD: %d, OVF: %d", 
-                 debug_counter, write_ptr, read_ptr, overflow_counter);
+    // Calculate number of samples available; lost samples become a gap
+    max30102_gap_t gap;
+    size_t samples_available = max30102_fifo_pending(dev, write_ptr, read_ptr, overflow_counter, status, &gap);
+    if (gap.count > 0) {
+        if (dev->log) {
+            DEFERRED_LOG(dev->log, LOG_MSG_FIFO_GAP, gap.count, gap.sequence);
+        } else {
+            ESP_LOGW(TAG, "FIFO overflow, gap of %lu samples at sequence %lu",
+                     (unsigned long)gap.count, (unsigned long)gap.sequence);
+        }
+    }
+    
+    if (samples_available == 0) {
+        return MAX30102_ERR_NO_DATA;
+    }
+    
+    // Read one sample (3 bytes per LED channel)
+    uint8_t fifo_data[2 * MAX30102_BYTES_PER_LED];
+    err = max30102_read_fifo_data(dev, fifo_data, dev->fifo_sample_bytes);
+    if (err != MAX30102_OK) return err;
+    
+    if (max30102_fifo_needs_fixup(dev, &gap, samples_available)) {
+        err = max30102_fifo_overrun_fixup(dev, read_ptr, 1, &gap);
+        if (err != MAX30102_OK) return err;
+    }
+    
+    max30102_fifo_deliver(dev, fifo_data, 1, samples_available, sample);
+    return MAX30102_OK;
+}
+
+// Returns the sequence number for the next sample popped from the FIFO,
+// stepping over a pending gap when it is reached
+static uint32_t max30102_next_sequence(max30102_dev_t *dev)
+{
+    if (dev->gap_skip_count > 0 && dev->next_sequence == dev->gap_skip_at) {
+        dev->next_sequence += dev->gap_skip_count;
+        dev->gap_skip_count = 0;
+    }
+    return dev->next_sequence++;
+}
+
+// Works out how many samples are waiting from a pointer snapshot and turns
+// a non-zero OVF_COUNTER into a gap record. 'status' is INTR_STATUS_1,
+// read after the pointers. With rollover enabled the oldest samples were
+// overwritten, so the gap comes before what is in the FIFO; without
+// rollover new samples were dropped, so it comes after.
+//
+// OVF_COUNTER saturates at 31. When it does, the loss is reconstructed from
+// how far WR_PTR moved (exact modulo 32) and the time since the previous
+// snapshot at the configured rate (which resolves the multiple of 32).
+static size_t max30102_fifo_pending(max30102_dev_t *dev, uint8_t write_ptr, uint8_t read_ptr,
+                                    uint8_t overflow_counter, uint8_t status, max30102_gap_t *gap)
+{
+    int64_t now_us = esp_timer_get_time();
+    size_t available = (write_ptr - read_ptr) & MAX30102_FIFO_PTR_MASK;
+    
+    *gap = (max30102_gap_t){0};
+    
+    // Equal pointers with no overflow are both an empty FIFO and a full
+    // one. Every drain reads INTR_STATUS_1 between its pointer and data
+    // reads, and that read clears A_FULL. Since the previous drain, a full
+    // FIFO has either crossed the A_FULL level, which latched the flag
+    // again, or it still holds samples that drain left unread. An empty
+    // FIFO has done neither. A stopped sensor so reads as empty, however
+    // long it sat.
+    if (available == 0 && overflow_counter == 0 &&
+        ((status & MAX30102_INTR_A_FULL) || dev->fifo_unread > 0)) {
+        available = MAX30102_FIFO_DEPTH;
     }
     
-    // Handle overflow - this might indicate continuous overflow
     if (overflow_counter > 0) {
-        ESP_LOGW(TAG, "FIFO OVERFLOW! Counter: %d - Clearing and stopping sensor", overflow_counter);
+        if (available == 0) {
+            available = MAX30102_FIFO_DEPTH;  // Pointers are equal because the FIFO is full
+        }
         
-        // Stop sensor temporarily
-        max30102_write_reg(MAX30102_REG_MODE_CONFIG, 0x80); // Shutdown
-        vTaskDelay(pdMS_TO_TICKS(10));
+        uint32_t lost = overflow_counter;
+        if (overflow_counter == MAX30102_FIFO_PTR_MASK && dev->last_snapshot_us > 0 && dev->fifo_rate_hz > 0) {
+            int64_t expected = (now_us - dev->last_snapshot_us) * dev->fifo_rate_hz / 1000000;
+            int64_t produced = expected;
+            if (dev->rollover_enabled) {
+                int64_t moved = (write_ptr - dev->last_write_ptr) & MAX30102_FIFO_PTR_MASK;
+                int64_t wraps = (expected - moved + MAX30102_FIFO_DEPTH / 2) / MAX30102_FIFO_DEPTH;
+                produced = moved + (wraps > 0 ? wraps : 0) * MAX30102_FIFO_DEPTH;
+            }
+            int64_t estimate = (int64_t)dev->fifo_unread + produced - MAX30102_FIFO_DEPTH;
+            if (estimate > lost) {
+                lost = (uint32_t)estimate;
+            }
+        }
         
-        // Clear FIFO
-        max30102_clear_fifo();
-        vTaskDelay(pdMS_TO_TICKS(10));
+        if (dev->gap_skip_count > 0) {
+            // The previous gap has not been reached yet; fold this one into it
+            dev->gap_skip_count += lost;
+        } else {
+            dev->gap_skip_at = dev->next_sequence + (dev->rollover_enabled ? 0 : (uint32_t)available);
+            dev->gap_skip_count = lost;
+        }
         
-        // Restart sensor
-        max30102_write_reg(MAX30102_REG_MODE_CONFIG, MAX30102_MODE_SPO2);
+        gap->sequence = dev->gap_skip_at;
+        gap->count = dev->gap_skip_count;
+        gap->saturated = (overflow_counter == MAX30102_FIFO_PTR_MASK);
         
-        return MAX30102_ERR_NO_DATA;
+        dev->fifo_stats.gaps++;
+        dev->fifo_stats.samples_lost += lost;
+        dev->fifo_stats.last_gap = *gap;
+        metrics_count(dev->metrics, METRIC_FIFO_GAPS, 1);
+        metrics_count(dev->metrics, METRIC_SAMPLES_LOST, lost);
     }
     
-    // Calculate number of samples available (handle rollover)
-    int8_t samples_available;
-    if (write_ptr >= read_ptr) {
-        samples_available = write_ptr - read_ptr;
-    } else {
-        samples_available = (32 - read_ptr) + write_ptr;  // FIFO is 32 deep
+    metrics_record(dev->metrics, METRIC_FIFO_LEVEL, (uint32_t)available);
+    dev->last_snapshot_us = now_us;
+    dev->last_write_ptr = write_ptr;
+    return available;
+}
+
+// A full FIFO with rollover keeps overwriting its oldest sample until the
+// first pop, and that pop clears OVF_COUNTER, so samples overwritten between
+// the pointer snapshot and the read are otherwise never counted. After
+// draining a FIFO that was full or overflowing RD_PTR has moved by the
+// samples popped plus the samples overwritten; the difference is added to
+// the gap before sequence numbers are assigned. A FIFO that was exactly
+// full at the snapshot has no gap open yet, so one is opened here.
+static max30102_err_t max30102_fifo_overrun_fixup(max30102_dev_t *dev, uint8_t read_ptr, size_t popped,
+                                                  max30102_gap_t *gap)
+{
+    uint8_t read_ptr_after;
+    max30102_err_t err = max30102_read_reg(dev, MAX30102_REG_FIFO_RD_PTR, &read_ptr_after);
+    if (err != MAX30102_OK) return err;
+    
+    max30102_fifo_overrun_apply(dev, read_ptr, read_ptr_after, popped, gap);
+    return MAX30102_OK;
+}
+
+// Whether the FIFO was full or overflowing at the snapshot, so RD_PTR has
+// to be read back after the data to catch overwrites during the read
+static bool max30102_fifo_needs_fixup(const max30102_dev_t *dev, const max30102_gap_t *lost, size_t pending)
+{
+    return dev->rollover_enabled && (lost->count > 0 || pending == MAX30102_FIFO_DEPTH);
+}
+
+static void max30102_fifo_overrun_apply(max30102_dev_t *dev, uint8_t read_ptr, uint8_t read_ptr_after,
+                                        size_t popped, max30102_gap_t *gap)
+{
+    uint32_t overwritten = (read_ptr_after - read_ptr - popped) & MAX30102_FIFO_PTR_MASK;
+    if (overwritten > 0) {
+        if (dev->gap_skip_count == 0) {
+            dev->gap_skip_at = dev->next_sequence;
+            gap->sequence = dev->gap_skip_at;
+            gap->saturated = false;
+            dev->fifo_stats.gaps++;
+            metrics_count(dev->metrics, METRIC_FIFO_GAPS, 1);
+        }
+        dev->gap_skip_count += overwritten;
+        gap->count = dev->gap_skip_count;
+        dev->fifo_stats.samples_lost += overwritten;
+        dev->fifo_stats.last_gap = *gap;
+        metrics_count(dev->metrics, METRIC_SAMPLES_LOST, overwritten);
     }
+}
+
+// Parses a WR_PTR/OVF_COUNTER/RD_PTR read, plus INTR_STATUS_1 if it was
+// needed, and returns the samples pending
+static size_t max30102_fifo_snapshot(max30102_dev_t *dev, const uint8_t ptrs[3], uint8_t status,
+                                     max30102_gap_t *lost)
+{
+    uint8_t write_ptr = ptrs[0] & MAX30102_FIFO_PTR_MASK;
+    uint8_t overflow_counter = ptrs[1] & MAX30102_FIFO_PTR_MASK;
+    uint8_t read_ptr = ptrs[2] & MAX30102_FIFO_PTR_MASK;
     
-    if (samples_available <= 0) {
-        return MAX30102_ERR_NO_DATA;
+    return max30102_fifo_pending(dev, write_ptr, read_ptr, overflow_counter, status, lost);
+}
+
+// Turns 'count' samples read out of 'pending' into numbered samples
+static void max30102_fifo_deliver(max30102_dev_t *dev, const uint8_t *raw, size_t count, size_t pending,
+                                  max30102_sample_t *samples)
+{
+    max30102_unpack_samples(dev, raw, count, samples);
+    dev->fifo_unread = pending - count;
+    dev->bus_stats.samples += count;
+}
+
+// Unpacks a block of raw FIFO bytes into samples. Each LED channel is 3 bytes,
+// MSB first, with the 18-bit value right-justified. The loop body is branch-free
+// so the compiler can unroll it across the block.
+static void max30102_unpack_samples(max30102_dev_t *dev, const uint8_t *raw, size_t count,
+                                    max30102_sample_t *samples)
+{
+    if (dev->awaiting_first_sample && count > 0) {
+        dev->init_stats.first_sample_us = esp_timer_get_time() - dev->init_start_us;
+        dev->awaiting_first_sample = false;
+    }
+    
+    if (dev->fifo_sample_bytes == MAX30102_BYTES_PER_LED) {
+        // HR-only mode: only the red channel is in the FIFO
+        for (size_t i = 0; i < count; i++, raw += 3) {
+            samples[i].red = (((uint32_t)raw[0] << 16) | ((uint32_t)raw[1] << 8) | raw[2]) & 0x03FFFF;
+            samples[i].ir = 0;
+            samples[i].valid = true;
+            samples[i].sequence = max30102_next_sequence(dev);
+        }
+        return;
+    }
+    
+    for (size_t i = 0; i < count; i++, raw += 6) {
+        samples[i].red = (((uint32_t)raw[0] << 16) | ((uint32_t)raw[1] << 8) | raw[2]) & 0x03FFFF;
+        samples[i].ir  = (((uint32_t)raw[3] << 16) | ((uint32_t)raw[4] << 8) | raw[5]) & 0x03FFFF;
+        samples[i].valid = true;
+        samples[i].sequence = max30102_next_sequence(dev);
+    }
+}
+
+max30102_err_t max30102_read_samples(max30102_dev_t *dev, max30102_sample_t *samples, size_t max_samples,
+                                     size_t *count, max30102_gap_t *gap)
+{
+    if (!dev || !samples || max_samples == 0 || !count) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    *count = 0;
+    if (gap) {
+        *gap = (max30102_gap_t){0};
     }
     
-    // If too many samples, clear some to prevent overflow
-    if (samples_available > 8) {
-        ESP_LOGW(TAG, "FIFO getting full (%d samples). Clearing excess.", samples_available);
-        max30102_clear_fifo();
+    // WR_PTR, OVF_COUNTER and RD_PTR are consecutive registers, so one
+    // 3-byte read replaces the three single-register reads
+    uint8_t ptrs[3];
+    max30102_err_t err = max30102_read_regs(dev, MAX30102_REG_FIFO_WR_PTR, ptrs, sizeof(ptrs));
+    if (err != MAX30102_OK) return err;
+    
+    // Read after the pointers and before the data: it latches A_FULL for
+    // max30102_fifo_pending() and releases the INT pin
+    uint8_t status;
+    err = max30102_read_reg(dev, MAX30102_REG_INTR_STATUS_1, &status);
+    if (err != MAX30102_OK) return err;
+    
+    max30102_gap_t lost;
+    size_t pending = max30102_fifo_snapshot(dev, ptrs, status, &lost);
+    
+    size_t available = pending;
+    if (available == 0) {
+        if (gap) {
+            *gap = lost;
+        }
         return MAX30102_ERR_NO_DATA;
     }
     
-    // Read one sample (6 bytes: 3 bytes red + 3 bytes IR)
-    uint8_t fifo_data[6];
-    err = max30102_read_fifo_data(fifo_data, 6);
+    if (available > max_samples) {
+        available = max_samples;
+    }
+    
+    // Pull every pending sample in a single FIFO_DATA transaction
+    uint8_t fifo_data[MAX30102_FIFO_DEPTH * 2 * MAX30102_BYTES_PER_LED];
+    err = max30102_read_fifo_data(dev, fifo_data, available * dev->fifo_sample_bytes);
     if (err != MAX30102_OK) return err;
     
-    // Convert to 18-bit values (only upper 18 bits are valid)
-    sample->red = ((uint32_t)fifo_data[0] << 16) | ((uint32_t)fifo_data[1] << 8) | fifo_data[2];
-    sample->red &= 0x03FFFF;  // Mask to 18 bits
+    if (max30102_fifo_needs_fixup(dev, &lost, pending)) {
+        err = max30102_fifo_overrun_fixup(dev, ptrs[2] & MAX30102_FIFO_PTR_MASK, available, &lost);
+        if (err != MAX30102_OK) return err;
+    }
+    if (gap) {
+        *gap = lost;
+    }
+    
+    max30102_fifo_deliver(dev, fifo_data, available, pending, samples);
+    *count = available;
+    return MAX30102_OK;
+}
+
+// max30102_read_samples() as one entry on 'queue': the pointer read, the
+// FIFO data read and, after a full FIFO, the RD_PTR read-back run back to
+// back on the queue's worker, which also numbers the samples. Returns once
+// the drain is queued; 'done' runs from i2c_async_complete() with
+// 'samples' filled in, so 'samples' must stay valid until then. One drain
+// per device can be in flight (MAX30102_ERR_BUSY otherwise), and no other
+// call may use the device meanwhile.
+max30102_err_t max30102_read_samples_async(max30102_dev_t *dev, i2c_async_t *queue,
+                                           max30102_sample_t *samples, size_t max_samples,
+                                           max30102_drain_done_t done, void *ctx)
+{
+    if (!dev || !queue || !samples || max_samples == 0 || !done) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    if (!dev->transport) {
+        return MAX30102_ERR_INIT;
+    }
+    if (dev->drain.busy) {
+        return MAX30102_ERR_BUSY;
+    }
+    
+    max30102_drain_t *drain = &dev->drain;
+    drain->samples = samples;
+    drain->max_samples = max_samples;
+    drain->done = done;
+    drain->ctx = ctx;
+    drain->err = MAX30102_OK;
+    drain->pending = 0;
+    drain->available = 0;
+    drain->status = 0;
+    drain->gap = (max30102_gap_t){0};
     
-    sample->ir = ((uint32_t)fifo_data[3] << 16) | ((uint32_t)fifo_data[4] << 8) | fifo_data[5];
-    sample->ir &= 0x03FFFF;   // Mask to 18 bits
+    uint8_t reg = MAX30102_REG_FIFO_WR_PTR;
+    max30102_err_t err = i2c_async_submit(queue, dev->transport, &reg, 1, drain->ptrs, sizeof(drain->ptrs),
+                                          max30102_drain_on_pointers, max30102_drain_done, dev);
+    if (err != MAX30102_OK) {
+        return err;
+    }
     
-    sample->valid = true;
+    drain->busy = true;
+    dev->bus_stats.transactions++;
+    dev->bus_stats.bytes_written += 1;
+    dev->bus_stats.bytes_read += sizeof(drain->ptrs);
     return MAX30102_OK;
 }
 
-max30102_err_t max30102_reset(void)
+// Rewrites the drain's entry into a read of 'len' bytes from 'reg'
+static void max30102_drain_next(max30102_dev_t *dev, i2c_async_txn_t *txn, uint8_t reg, uint8_t *rx, size_t len,
+                                i2c_async_chain_t chain)
 {
-    return max30102_write_reg(MAX30102_REG_MODE_CONFIG, 0x40);
+    txn->tx[0] = reg;
+    txn->tx_len = 1;
+    txn->rx = rx;
+    txn->rx_len = len;
+    txn->chain = chain;
+    
+    dev->bus_stats.transactions++;
+    dev->bus_stats.bytes_written += 1;
+    dev->bus_stats.bytes_read += len;
 }
 
-max30102_err_t max30102_get_part_id(uint8_t *part_id)
+// Chain hooks, run on the worker
+static bool max30102_drain_on_pointers(void *ctx, i2c_async_txn_t *txn)
 {
-    return max30102_read_reg(MAX30102_REG_PART_ID, part_id);
+    max30102_dev_t *dev = ctx;
+    max30102_drain_t *drain = &dev->drain;
+    if (txn->err != MAX30102_OK) {
+        drain->err = MAX30102_ERR_I2C;
+        return false;
+    }
+    
+    max30102_drain_next(dev, txn, MAX30102_REG_INTR_STATUS_1, &drain->status, 1, max30102_drain_on_status);
+    return true;
 }
 
-max30102_err_t max30102_clear_fifo(void)
+static bool max30102_drain_on_status(void *ctx, i2c_async_txn_t *txn)
 {
-    max30102_err_t err = max30102_write_reg(MAX30102_REG_FIFO_WR_PTR, 0x00);
-    if (err != MAX30102_OK) return err;
+    max30102_dev_t *dev = ctx;
+    max30102_drain_t *drain = &dev->drain;
+    if (txn->err != MAX30102_OK) {
+        drain->err = MAX30102_ERR_I2C;
+        return false;
+    }
     
-    err = max30102_write_reg(MAX30102_REG_OVF_COUNTER, 0x00);
-    if (err != MAX30102_OK) return err;
+    return max30102_drain_start_data(dev, txn);
+}
+
+// Queues the FIFO_DATA read for what the snapshot found pending
+static bool max30102_drain_start_data(max30102_dev_t *dev, i2c_async_txn_t *txn)
+{
+    max30102_drain_t *drain = &dev->drain;
+    drain->pending = max30102_fifo_snapshot(dev, drain->ptrs, drain->status, &drain->gap);
+    if (drain->pending == 0) {
+        drain->err = MAX30102_ERR_NO_DATA;
+        return false;
+    }
     
-    return max30102_write_reg(MAX30102_REG_FIFO_RD_PTR, 0x00);
+    drain->available = drain->pending < drain->max_samples ? drain->pending : drain->max_samples;
+    max30102_drain_next(dev, txn, MAX30102_REG_FIFO_DATA, drain->raw, drain->available * dev->fifo_sample_bytes,
+                        max30102_drain_on_data);
+    return true;
 }
 
-max30102_err_t max30102_set_led_power(uint8_t led1_power, uint8_t led2_power)
+static bool max30102_drain_on_data(void *ctx, i2c_async_txn_t *txn)
 {
-    max30102_err_t err = max30102_write_reg(MAX30102_REG_LED1_PA, led1_power);
+    max30102_dev_t *dev = ctx;
+    max30102_drain_t *drain = &dev->drain;
+    if (txn->err != MAX30102_OK) {
+        drain->err = MAX30102_ERR_I2C;
+        return false;
+    }
+    
+    if (max30102_fifo_needs_fixup(dev, &drain->gap, drain->pending)) {
+        max30102_drain_next(dev, txn, MAX30102_REG_FIFO_RD_PTR, &drain->read_ptr_after, 1,
+                            max30102_drain_on_read_ptr);
+        return true;
+    }
+    
+    max30102_fifo_deliver(dev, drain->raw, drain->available, drain->pending, drain->samples);
+    return false;
+}
+
+static bool max30102_drain_on_read_ptr(void *ctx, i2c_async_txn_t *txn)
+{
+    max30102_dev_t *dev = ctx;
+    max30102_drain_t *drain = &dev->drain;
+    if (txn->err != MAX30102_OK) {
+        drain->err = MAX30102_ERR_I2C;
+        return false;
+    }
+    
+    max30102_fifo_overrun_apply(dev, drain->ptrs[2] & MAX30102_FIFO_PTR_MASK,
+                                drain->read_ptr_after & MAX30102_FIFO_PTR_MASK, drain->available, &drain->gap);
+    max30102_fifo_deliver(dev, drain->raw, drain->available, drain->pending, drain->samples);
+    return false;
+}
+
+// Runs in the issuing task. The drain ends before the callback, so 'done'
+// can start the next one.
+static void max30102_drain_done(void *ctx, const i2c_async_txn_t *txn)
+{
+    (void)txn;
+    max30102_dev_t *dev = ctx;
+    max30102_drain_t *drain = &dev->drain;
+    drain->busy = false;
+    
+    size_t count = (drain->err == MAX30102_OK) ? drain->available : 0;
+    max30102_gap_t gap = drain->gap;
+    drain->done(drain->ctx, drain->err, drain->samples, count, &gap);
+}
+
+// Resets the part and waits for the RESET bit to self-clear. The registers
+// are then at their power-on values (all zero), which the shadow takes on.
+max30102_err_t max30102_reset(max30102_dev_t *dev)
+{
+    max30102_err_t err = max30102_write_reg(dev, MAX30102_REG_MODE_CONFIG, MAX30102_MODE_RESET);
+    dev->shadow_valid = 0;
     if (err != MAX30102_OK) return err;
     
-    return max30102_write_reg(MAX30102_REG_LED2_PA, led2_power);
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)MAX30102_RESET_TIMEOUT_MS * 1000;
+    do {
+        uint8_t mode;
+        err = max30102_read_reg(dev, MAX30102_REG_MODE_CONFIG, &mode);
+        if (err != MAX30102_OK) return err;
+        dev->init_stats.reset_polls++;
+        
+        if (!(mode & MAX30102_MODE_RESET)) {
+            // Registers are 0 after a reset, but the config block stays
+            // unmarked: max30102_init_fast() takes a valid block to mean the
+            // part was configured, and would skip its part-ID check
+            memset(dev->shadow, 0, sizeof(dev->shadow));
+            dev->shadow_valid = SHADOW_CACHED & ~SHADOW_CONFIG_BLOCK;
+            max30102_forget_fifo(dev);
+            return MAX30102_OK;
+        }
+    } while (esp_timer_get_time() < deadline_us);
+    
+    ESP_LOGE(TAG, "Reset did not complete");
+    return MAX30102_ERR_TIMEOUT;
+}
+
+max30102_err_t max30102_get_part_id(max30102_dev_t *dev, uint8_t *part_id)
+{
+    return max30102_read_reg(dev, MAX30102_REG_PART_ID, part_id);
+}
+
+// Discarded samples are not accounted for; drop any pending gap with them
+static void max30102_forget_fifo(max30102_dev_t *dev)
+{
+    dev->gap_skip_count = 0;
+    dev->fifo_unread = 0;
+    dev->last_snapshot_us = 0;
+}
+
+max30102_err_t max30102_clear_fifo(max30102_dev_t *dev)
+{
+    max30102_forget_fifo(dev);
+    
+    // WR_PTR, OVF_COUNTER and RD_PTR are consecutive: one 3-register write
+    static const uint8_t zeros[3] = {0, 0, 0};
+    return max30102_write_regs(dev, MAX30102_REG_FIFO_WR_PTR, zeros, sizeof(zeros));
+}
+
+// LED1_PA and LED2_PA are consecutive; unchanged levels are not rewritten
+max30102_err_t max30102_set_led_power(max30102_dev_t *dev, uint8_t led1_power, uint8_t led2_power)
+{
+    uint8_t levels[2] = {led1_power, led2_power};
+    return max30102_write_config(dev, MAX30102_REG_LED1_PA, levels, sizeof(levels));
+}
+
+max30102_err_t max30102_enable_interrupts(max30102_dev_t *dev, uint8_t intr_mask)
+{
+    uint8_t enable = intr_mask & 0xE0;
+    return max30102_write_config(dev, MAX30102_REG_INTR_ENABLE_1, &enable, 1);
+}
+
+max30102_err_t max30102_read_intr_status(max30102_dev_t *dev, uint8_t *status)
+{
+    // Reading INTR_STATUS_1 clears the pending interrupt and releases the INT pin
+    return max30102_read_reg(dev, MAX30102_REG_INTR_STATUS_1, status);
+}
+
+void max30102_get_bus_stats(const max30102_dev_t *dev, max30102_bus_stats_t *stats)
+{
+    if (stats) {
+        *stats = dev->bus_stats;
+    }
+}
+
+void max30102_reset_bus_stats(max30102_dev_t *dev)
+{
+    dev->bus_stats = (max30102_bus_stats_t){0};
+}
+
+void max30102_get_init_stats(const max30102_dev_t *dev, max30102_init_stats_t *stats)
+{
+    if (stats) {
+        *stats = dev->init_stats;
+    }
+}
+
+void max30102_get_fifo_stats(const max30102_dev_t *dev, max30102_fifo_stats_t *stats)
+{
+    if (stats) {
+        *stats = dev->fifo_stats;
+    }
+}
+
+void max30102_reset_fifo_stats(max30102_dev_t *dev)
+{
+    dev->fifo_stats = (max30102_fifo_stats_t){0};
+}
+
+uint32_t max30102_fifo_rate_hz(const max30102_config_t *config)
+{
+    static const uint16_t rates_hz[8] = {50, 100, 200, 400, 800, 1000, 1600, 3200};
+    
+    if (!config) {
+        return 0;
+    }
+    
+    uint32_t rate = rates_hz[(config->sample_rate >> 2) & 0x07];
+    uint32_t avg_shift = (config->sample_avg >> 5) & 0x07;
+    if (avg_shift > 5) {
+        avg_shift = 5;  // 0xA0 and above all mean 32 samples
+    }
+    
+    return rate >> avg_shift;
 }
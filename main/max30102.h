@@ -3,11 +3,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "driver/i2c_master.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include <stddef.h>
 
 // MAX30102 I2C Configuration
 #define MAX30102_I2C_ADDR           0x57
 #define MAX30102_I2C_TIMEOUT_MS     1000
+#define MAX30102_RESET_TIMEOUT_MS   50      // RESET normally self-clears in under 1 ms
 
 // MAX30102 Register Addresses
 #define MAX30102_REG_INTR_STATUS_1  0x00
@@ -34,6 +37,8 @@
 #define MAX30102_REG_PART_ID        0xFF
 
 // Configuration values
+#define MAX30102_MODE_SHDN          0x80
+#define MAX30102_MODE_RESET         0x40
 #define MAX30102_MODE_HR_ONLY       0x02
 #define MAX30102_MODE_SPO2          0x03
 #define MAX30102_SAMPLEAVG_1        0x00
@@ -46,6 +51,17 @@
 #define MAX30102_ROLLOVER_EN        0x10
 #define MAX30102_A_FULL_MASK        0x0F
 
+// Interrupt bits (INTR_STATUS_1 / INTR_ENABLE_1)
+#define MAX30102_INTR_A_FULL        0x80
+#define MAX30102_INTR_PPG_RDY       0x40
+#define MAX30102_INTR_ALC_OVF       0x20
+#define MAX30102_INTR_PWR_RDY       0x01
+
+// FIFO geometry
+#define MAX30102_FIFO_DEPTH         32
+#define MAX30102_FIFO_PTR_MASK      0x1F
+#define MAX30102_BYTES_PER_LED      3
+
 // Sample rates
 #define MAX30102_SAMPLERATE_50      0x00
 #define MAX30102_SAMPLERATE_100     0x04
@@ -75,7 +91,8 @@ typedef enum {
     MAX30102_ERR_I2C,
     MAX30102_ERR_TIMEOUT,
     MAX30102_ERR_INVALID_PARAM,
-    MAX30102_ERR_NO_DATA
+    MAX30102_ERR_NO_DATA,
+    MAX30102_ERR_BUSY           // Queue full or a queued read already in flight
 } max30102_err_t;
 
 // Configuration structure
@@ -96,16 +113,145 @@ typedef struct {
     uint32_t red;
     uint32_t ir;
     bool valid;
+    uint32_t sequence;      // Monotonic sample number, including lost samples
+    int64_t timestamp_us;   // Reconstructed conversion time (esp_timer), 0 if unknown
 } max30102_sample_t;
 
+// Samples lost to a FIFO overflow. The samples numbered sequence to
+// sequence + count - 1 were never delivered.
+typedef struct {
+    uint32_t sequence;      // Sequence number of the first lost sample
+    uint32_t count;         // Samples lost (0 = no gap)
+    bool saturated;         // OVF_COUNTER saturated, count was estimated
+} max30102_gap_t;
+
+// FIFO loss counters
+typedef struct {
+    uint32_t gaps;          // Overflows detected
+    uint32_t samples_lost;  // Total samples in all gaps
+    max30102_gap_t last_gap;
+} max30102_fifo_stats_t;
+
+// Bus traffic counters, used to compare the per-sample and burst read paths
+typedef struct {
+    uint32_t transactions;   // I2C transactions issued
+    uint32_t bytes_written;  // Bytes sent, including register addresses
+    uint32_t bytes_read;     // Bytes received
+    uint32_t samples;        // Samples returned to the caller
+    uint32_t writes_skipped; // Register writes the shadow showed were redundant
+} max30102_bus_stats_t;
+
+// Cost of the last max30102_init() or max30102_init_fast()
+typedef struct {
+    uint32_t transactions;      // Bus transactions issued by init
+    uint32_t bytes;             // Bytes on the bus, both directions
+    uint32_t writes_skipped;    // Register writes the shadow showed were redundant
+    uint32_t reset_polls;       // MODE_CONFIG reads until RESET self-cleared
+    bool reset_skipped;         // Registers matched the shadow, so no reset
+    int64_t init_us;            // Time spent in init
+    int64_t first_sample_us;    // Init start to the first sample read, 0 until then
+} max30102_init_stats_t;
+
+// Bus transport. Each call is one bus transaction; the first byte written is
+// the register address. The ESP-IDF I2C transport lives in i2c_config.c and
+// the host build supplies a simulated device.
+typedef struct {
+    max30102_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    max30102_err_t (*write_read)(void *ctx, const uint8_t *tx, size_t tx_len,
+                                 uint8_t *rx, size_t rx_len);
+    void *ctx;
+} max30102_transport_t;
+
+#define MAX30102_SHADOW_REGS        (MAX30102_REG_MULTI_LED_CTRL2 + 1)
+
+struct i2c_async;
+
+// Completion of max30102_read_samples_async(), run in the task that calls
+// i2c_async_complete(). 'samples', 'count' and 'gap' are what
+// max30102_read_samples() would have returned; 'gap' is never NULL.
+typedef void (*max30102_drain_done_t)(void *ctx, max30102_err_t err, max30102_sample_t *samples,
+                                      size_t count, const max30102_gap_t *gap);
+
+// A queued FIFO drain, from the submit to the completion callback. Owned
+// by the queue's worker while busy.
+typedef struct {
+    bool busy;
+    max30102_err_t err;
+    max30102_sample_t *samples;
+    size_t max_samples;
+    max30102_drain_done_t done;
+    void *ctx;
+    uint8_t ptrs[3];                    // WR_PTR, OVF_COUNTER, RD_PTR
+    uint8_t status;                     // INTR_STATUS_1, read between the pointers and the data
+    uint8_t read_ptr_after;             // RD_PTR after the data read
+    size_t pending;
+    size_t available;
+    max30102_gap_t gap;
+    uint8_t raw[MAX30102_FIFO_DEPTH * 2 * MAX30102_BYTES_PER_LED];
+} max30102_drain_t;
+
+// Driver state for one sensor. Every call takes the device it acts on and
+// nothing is shared between devices, so several sensors can run on one or
+// more buses. Allocate one per sensor (statically is fine) and bind it to
+// its bus with max30102_set_transport().
+typedef struct {
+    const max30102_transport_t *transport;
+    max30102_config_t config;           // Set by a successful init
+    max30102_bus_stats_t bus_stats;
+    metrics_t *metrics;                 // Optional, see max30102_set_metrics()
+    deferred_log_t *log;                // Optional, see max30102_set_log()
+    
+    // FIFO layout and sequence numbering
+    size_t fifo_sample_bytes;           // 3 in HR-only mode, 6 in SpO2 mode
+    uint32_t fifo_rate_hz;              // FIFO sample rate after averaging
+    bool rollover_enabled;
+    uint32_t next_sequence;
+    uint32_t gap_skip_at;               // Sequence number where a pending gap starts
+    uint32_t gap_skip_count;            // Samples to step over at gap_skip_at
+    size_t fifo_unread;                 // Samples left in the FIFO by the last read
+    uint8_t last_write_ptr;             // WR_PTR at the last pointer snapshot
+    int64_t last_snapshot_us;           // Time of the last pointer snapshot
+    max30102_fifo_stats_t fifo_stats;
+    max30102_drain_t drain;             // max30102_read_samples_async() in flight
+    
+    // Shadow of the configuration registers; bit n of shadow_valid is set
+    // while shadow[n] is known to match register n
+    uint8_t shadow[MAX30102_SHADOW_REGS];
+    uint32_t shadow_valid;
+    
+    // Init cost accounting
+    max30102_init_stats_t init_stats;
+    max30102_bus_stats_t init_bus_start;
+    int64_t init_start_us;
+    bool awaiting_first_sample;
+} max30102_dev_t;
+
 // Function prototypes
-max30102_err_t max30102_init(const max30102_config_t *config);
-max30102_err_t max30102_deinit(void);
-max30102_err_t max30102_read_sample(max30102_sample_t *sample);
-max30102_err_t max30102_reset(void);
-max30102_err_t max30102_get_part_id(uint8_t *part_id);
-max30102_err_t max30102_clear_fifo(void);
-max30102_err_t max30102_set_led_power(uint8_t led1_power, uint8_t led2_power);
+max30102_err_t max30102_set_transport(max30102_dev_t *dev, const max30102_transport_t *transport);
+void max30102_set_metrics(max30102_dev_t *dev, metrics_t *metrics);
+void max30102_set_log(max30102_dev_t *dev, deferred_log_t *log);
+max30102_err_t max30102_init(max30102_dev_t *dev, const max30102_config_t *config);
+max30102_err_t max30102_init_fast(max30102_dev_t *dev, const max30102_config_t *config);
+void max30102_assume_config(max30102_dev_t *dev, const max30102_config_t *config);
+max30102_err_t max30102_deinit(max30102_dev_t *dev);
+max30102_err_t max30102_read_sample(max30102_dev_t *dev, max30102_sample_t *sample);
+max30102_err_t max30102_read_samples(max30102_dev_t *dev, max30102_sample_t *samples, size_t max_samples,
+                                     size_t *count, max30102_gap_t *gap);
+max30102_err_t max30102_read_samples_async(max30102_dev_t *dev, struct i2c_async *queue,
+                                           max30102_sample_t *samples, size_t max_samples,
+                                           max30102_drain_done_t done, void *ctx);
+max30102_err_t max30102_reset(max30102_dev_t *dev);
+max30102_err_t max30102_get_part_id(max30102_dev_t *dev, uint8_t *part_id);
+max30102_err_t max30102_clear_fifo(max30102_dev_t *dev);
+max30102_err_t max30102_set_led_power(max30102_dev_t *dev, uint8_t led1_power, uint8_t led2_power);
+max30102_err_t max30102_enable_interrupts(max30102_dev_t *dev, uint8_t intr_mask);
+max30102_err_t max30102_read_intr_status(max30102_dev_t *dev, uint8_t *status);
+void max30102_get_bus_stats(const max30102_dev_t *dev, max30102_bus_stats_t *stats);
+void max30102_reset_bus_stats(max30102_dev_t *dev);
+void max30102_get_init_stats(const max30102_dev_t *dev, max30102_init_stats_t *stats);
+void max30102_get_fifo_stats(const max30102_dev_t *dev, max30102_fifo_stats_t *stats);
+void max30102_reset_fifo_stats(max30102_dev_t *dev);
+uint32_t max30102_fifo_rate_hz(const max30102_config_t *config);
 
 // Default configuration
 extern const max30102_config_t MAX30102_DEFAULT_CONFIG;
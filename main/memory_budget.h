@@ -0,0 +1,27 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+// Compile-time RAM budget for the firmware. Every task stack, queue and
+// sample buffer main.c uses is a static object sized here. So the link map
+// shows the whole footprint, and after start-up the heap only holds what
+// the ESP-IDF drivers allocated when they were installed. main.c fails the
+// build if its statics outgrow these limits.
+
+// Task stacks, in bytes (ESP-IDF counts StackType_t in bytes)
+#define SENSOR_STACK_SIZE       4096
+#define DSP_STACK_SIZE          4096
+#define OUTPUT_STACK_SIZE       4096
+#define LOG_STACK_SIZE          3072
+#define CAPTURE_STACK_SIZE      3072
+#define PACKET_STACK_SIZE       3072
+#define I2C_ASYNC_STACK_SIZE    3072    // Worker for i2c_bus_start_async()
+
+// Encoded capture bytes waiting for capture_task
+#define CAPTURE_STREAM_SIZE     8192
+
+// Limits
+#define MEMORY_BUDGET_STACKS    (28 * 1024)     // All task stacks and TCBs, optional tasks included
+#define MEMORY_BUDGET_STATE     (20 * 1024)     // Sensor, pipeline, metrics and log state
+#define MEMORY_BUDGET_OPTIONAL  (16 * 1024)     // Capture and packet state, when enabled
+
+#endif // MEMORY_BUDGET_H
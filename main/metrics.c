@@ -0,0 +1,131 @@
+#include "metrics.h"
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "METRICS";
+
+static const char *hist_names[METRIC_HIST_COUNT] = {
+    "i2c_us", "fifo_level", "drain_samples", "loop_jitter_us", "acquire_us", "dsp_us", "output_us",
+};
+
+static const char *counter_names[METRIC_COUNTER_COUNT] = {
+    "i2c_errors", "fifo_gaps", "samples_lost", "ring_drops", "empty_drains",
+};
+
+void metrics_init(metrics_t *metrics)
+{
+    for (size_t h = 0; h < METRIC_HIST_COUNT; h++) {
+        metrics_hist_t *hist = &metrics->hist[h];
+        for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            atomic_init(&hist->buckets[b], 0);
+        }
+        atomic_init(&hist->count, 0);
+        atomic_init(&hist->sum, 0);
+        atomic_init(&hist->max, 0);
+    }
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        atomic_init(&metrics->counters[c], 0);
+    }
+}
+
+void metrics_snapshot(metrics_t *metrics, metrics_snapshot_t *snapshot)
+{
+    snapshot->time_us = esp_timer_get_time();
+    for (size_t h = 0; h < METRIC_HIST_COUNT; h++) {
+        metrics_hist_t *hist = &metrics->hist[h];
+        metrics_hist_snapshot_t *copy = &snapshot->hist[h];
+        for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            copy->buckets[b] = atomic_load_explicit(&hist->buckets[b], memory_order_relaxed);
+        }
+        copy->count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+        copy->sum = atomic_load_explicit(&hist->sum, memory_order_relaxed);
+        copy->max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+    }
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        snapshot->counters[c] = atomic_load_explicit(&metrics->counters[c], memory_order_relaxed);
+    }
+}
+
+// What was recorded between two snapshots. Maxima cannot be differenced,
+// so 'delta' keeps the later one.
+void metrics_diff(const metrics_snapshot_t *now, const metrics_snapshot_t *before, metrics_snapshot_t *delta)
+{
+    delta->time_us = now->time_us - before->time_us;
+    for (size_t h = 0; h < METRIC_HIST_COUNT; h++) {
+        for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            delta->hist[h].buckets[b] = now->hist[h].buckets[b] - before->hist[h].buckets[b];
+        }
+        delta->hist[h].count = now->hist[h].count - before->hist[h].count;
+        delta->hist[h].sum = now->hist[h].sum - before->hist[h].sum;
+        delta->hist[h].max = now->hist[h].max;
+    }
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        delta->counters[c] = now->counters[c] - before->counters[c];
+    }
+}
+
+// Upper bound of the bucket holding the 'percent'th percentile value, so
+// within a factor of two above it. The last bucket is bounded by the max.
+uint32_t metrics_hist_percentile(const metrics_hist_snapshot_t *hist, uint32_t percent)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = ((uint64_t)hist->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < METRICS_HIST_BUCKETS - 1; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = (1u << b) - 1;
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+const char *metrics_hist_name(metrics_hist_id_t id)
+{
+    return (id < METRIC_HIST_COUNT) ? hist_names[id] : "?";
+}
+
+const char *metrics_counter_name(metrics_counter_id_t id)
+{
+    return (id < METRIC_COUNTER_COUNT) ? counter_names[id] : "?";
+}
+
+// Logs what was recorded since 'last' and updates it: one line per
+// histogram that saw records and one line of counters. Call from one task.
+void metrics_log(metrics_t *metrics, metrics_snapshot_t *last)
+{
+    metrics_snapshot_t now;
+    metrics_snapshot_t delta;
+    metrics_snapshot(metrics, &now);
+    metrics_diff(&now, last, &delta);
+    *last = now;
+    
+    ESP_LOGI(TAG, "Last %lu ms:", (unsigned long)(delta.time_us / 1000));
+    for (size_t h = 0; h < METRIC_HIST_COUNT; h++) {
+        const metrics_hist_snapshot_t *hist = &delta.hist[h];
+        if (hist->count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "  %-14s n=%lu avg=%lu p50<=%lu p99<=%lu max=%lu", hist_names[h],
+                 (unsigned long)hist->count, (unsigned long)(hist->sum / hist->count),
+                 (unsigned long)metrics_hist_percentile(hist, 50),
+                 (unsigned long)metrics_hist_percentile(hist, 99), (unsigned long)hist->max);
+    }
+    
+    char line[160];
+    size_t len = 0;
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT && len < sizeof(line); c++) {
+        int n = snprintf(line + len, sizeof(line) - len, "%s%s=%lu", c ? " " : "", counter_names[c],
+                         (unsigned long)delta.counters[c]);
+        if (n < 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    ESP_LOGI(TAG, "  %s", line);
+}
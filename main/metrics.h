@@ -0,0 +1,109 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Hot-path counters and histograms. Recording is a relaxed atomic add or
+// two, with no locks and no allocation, so it is safe from any task and
+// cheap enough for every bus transaction. Histograms have fixed log2
+// buckets: bucket 0 counts zeros, bucket b counts values in
+// [2^(b-1), 2^b) and the last bucket everything above. Snapshots are taken
+// while recording goes on, so a snapshot may be a few records out of step
+// across metrics, never within a counter.
+//
+// Modules record into a metrics_t they are given (NULL turns recording
+// off), and metrics_log() prints what changed since the previous call.
+
+#define METRICS_HIST_BUCKETS    16
+
+typedef enum {
+    METRIC_I2C_US = 0,          // Duration of each driver bus transaction
+    METRIC_FIFO_LEVEL,          // Samples in the FIFO at each drain
+    METRIC_DRAIN_SAMPLES,       // Samples returned by each drain
+    METRIC_LOOP_JITTER_US,      // Sensor task lateness: interval error or INT-to-task latency
+    METRIC_ACQUIRE_US,          // CPU time per pipeline acquire run, then dsp and
+                                // output in pipeline_stage_t order
+    METRIC_DSP_US,              // CPU time per pipeline dsp run
+    METRIC_OUTPUT_US,           // CPU time per pipeline output run
+    METRIC_HIST_COUNT
+} metrics_hist_id_t;
+
+typedef enum {
+    METRIC_I2C_ERRORS = 0,      // Driver bus transactions that failed
+    METRIC_FIFO_GAPS,           // Gap records from FIFO overflows
+    METRIC_SAMPLES_LOST,        // Samples covered by gap records
+    METRIC_RING_DROPS,          // Samples dropped at a full sample ring
+    METRIC_EMPTY_DRAINS,        // Drains that found the FIFO empty
+    METRIC_COUNTER_COUNT
+} metrics_counter_id_t;
+
+typedef struct {
+    atomic_uint buckets[METRICS_HIST_BUCKETS];
+    atomic_uint count;
+    atomic_uint sum;            // Wraps; only differences are meaningful
+    atomic_uint max;            // Largest value since init
+} metrics_hist_t;
+
+typedef struct {
+    metrics_hist_t hist[METRIC_HIST_COUNT];
+    atomic_uint counters[METRIC_COUNTER_COUNT];
+} metrics_t;
+
+// Plain copy of one histogram
+typedef struct {
+    uint32_t buckets[METRICS_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t sum;
+    uint32_t max;
+} metrics_hist_snapshot_t;
+
+typedef struct {
+    int64_t time_us;
+    metrics_hist_snapshot_t hist[METRIC_HIST_COUNT];
+    uint32_t counters[METRIC_COUNTER_COUNT];
+} metrics_snapshot_t;
+
+// Function prototypes
+void metrics_init(metrics_t *metrics);
+void metrics_snapshot(metrics_t *metrics, metrics_snapshot_t *snapshot);
+void metrics_diff(const metrics_snapshot_t *now, const metrics_snapshot_t *before, metrics_snapshot_t *delta);
+uint32_t metrics_hist_percentile(const metrics_hist_snapshot_t *hist, uint32_t percent);
+void metrics_log(metrics_t *metrics, metrics_snapshot_t *last);
+const char *metrics_hist_name(metrics_hist_id_t id);
+const char *metrics_counter_name(metrics_counter_id_t id);
+
+static inline uint32_t metrics_bucket(uint32_t value)
+{
+    uint32_t bucket = value ? 32 - (uint32_t)__builtin_clz(value) : 0;
+    return bucket < METRICS_HIST_BUCKETS ? bucket : METRICS_HIST_BUCKETS - 1;
+}
+
+static inline void metrics_record(metrics_t *metrics, metrics_hist_id_t id, uint32_t value)
+{
+    if (!metrics) {
+        return;
+    }
+    
+    metrics_hist_t *hist = &metrics->hist[id];
+    atomic_fetch_add_explicit(&hist->buckets[metrics_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+    
+    // A new maximum is rare, so the compare-exchange is off the common path
+    uint32_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max, &max, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+static inline void metrics_count(metrics_t *metrics, metrics_counter_id_t id, uint32_t n)
+{
+    if (metrics && n > 0) {
+        atomic_fetch_add_explicit(&metrics->counters[id], n, memory_order_relaxed);
+    }
+}
+
+#endif // METRICS_H
@@ -0,0 +1,80 @@
+#include "packet_uart.h"
+#include "stream_codec.h"
+#include "esp_log.h"
+
+#define PACKET_UART_RX_BUFFER   256     // Smallest the driver accepts; nothing is received
+#define PACKET_UART_TX_FRAMES   8       // Frames the driver's TX ring holds
+
+static const char *TAG = "PACKET_UART";
+
+// Private function prototypes
+static uint8_t *packet_uart_reserve(void *ctx);
+static max30102_err_t packet_uart_send(void *ctx, size_t len);
+
+esp_err_t packet_uart_init(packet_uart_t *link, uart_port_t port, int tx_io, uint32_t baud_rate, size_t mtu)
+{
+    if (mtu < PACKET_MIN_MTU || mtu > PACKET_MAX_MTU) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uart_config_t uart_config = {
+        .baud_rate = (int)baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    
+    esp_err_t ret = uart_driver_install(port, PACKET_UART_RX_BUFFER,
+                                        PACKET_UART_TX_FRAMES * (PACKET_UART_OVERHEAD + mtu), 0, NULL, 0);
+    if (ret == ESP_OK) {
+        ret = uart_param_config(port, &uart_config);
+    }
+    if (ret == ESP_OK) {
+        ret = uart_set_pin(port, tx_io, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "UART %d setup failed: %s", port, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    link->port = port;
+    link->transport.reserve = packet_uart_reserve;
+    link->transport.send = packet_uart_send;
+    link->transport.mtu = mtu;
+    link->transport.ctx = link;
+    return ESP_OK;
+}
+
+// The packet goes after the sync byte and length
+static uint8_t *packet_uart_reserve(void *ctx)
+{
+    packet_uart_t *link = (packet_uart_t *)ctx;
+    size_t free_bytes = 0;
+    
+    if (uart_get_tx_buffer_free_size(link->port, &free_bytes) != ESP_OK ||
+        free_bytes < PACKET_UART_OVERHEAD + link->transport.mtu) {
+        return NULL;
+    }
+    return &link->frame[3];
+}
+
+static max30102_err_t packet_uart_send(void *ctx, size_t len)
+{
+    packet_uart_t *link = (packet_uart_t *)ctx;
+    uint8_t *frame = link->frame;
+    
+    frame[0] = PACKET_UART_SYNC;
+    frame[1] = (uint8_t)len;
+    frame[2] = (uint8_t)(len >> 8);
+    uint16_t crc = stream_crc16(&frame[3], len);
+    frame[3 + len] = (uint8_t)crc;
+    frame[4 + len] = (uint8_t)(crc >> 8);
+    
+    size_t frame_len = PACKET_UART_OVERHEAD + len;
+    if (uart_write_bytes(link->port, frame, frame_len) != (int)frame_len) {
+        return MAX30102_ERR_BUSY;
+    }
+    return MAX30102_OK;
+}
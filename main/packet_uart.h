@@ -0,0 +1,34 @@
+#ifndef PACKET_UART_H
+#define PACKET_UART_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/uart.h"
+#include "packetizer.h"
+
+// Packetizer transport on a UART. Each packet goes out as one frame,
+//
+//   PACKET_UART_SYNC | length (u16) | packet | CRC-16 of the packet
+//
+// little-endian, with the CRC from stream_crc16(). The receiver hunts for
+// the sync byte and checks the CRC, so a byte lost on the line costs one
+// packet. Packets are built in the frame buffer here and handed to the
+// driver's TX ring in one write. reserve() fails while that ring has no
+// room for a full frame, which leaves the samples in the sample ring
+// instead of blocking the task.
+
+#define PACKET_UART_SYNC        0xA7
+#define PACKET_UART_OVERHEAD    5       // Sync, length and CRC
+
+// A packetizer link on a UART port. 'transport' is what packetizer_init()
+// takes.
+typedef struct {
+    uart_port_t port;
+    uint8_t frame[PACKET_UART_OVERHEAD + PACKET_MAX_MTU];
+    packet_transport_t transport;
+} packet_uart_t;
+
+// Function prototypes
+esp_err_t packet_uart_init(packet_uart_t *link, uart_port_t port, int tx_io, uint32_t baud_rate, size_t mtu);
+
+#endif // PACKET_UART_H
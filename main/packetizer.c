@@ -0,0 +1,222 @@
+#include "packetizer.h"
+#include <string.h>
+
+#define PACKET_SAMPLE_MASK      0x3FFFFu
+
+// Private function prototypes
+static void put_u16(uint8_t *p, uint16_t v);
+static void put_u32(uint8_t *p, uint32_t v);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+static bool packet_open(packetizer_t *pk, uint32_t sequence, int64_t now_us);
+static void packet_add(packetizer_t *pk, uint32_t red, uint32_t ir);
+static void packet_send(packetizer_t *pk);
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+// Samples that fit one packet of 'mtu' bytes
+size_t packetizer_capacity(size_t mtu)
+{
+    if (mtu < PACKET_MIN_MTU) {
+        return 0;
+    }
+    if (mtu > PACKET_MAX_MTU) {
+        mtu = PACKET_MAX_MTU;
+    }
+    return (mtu - PACKET_HEADER_SIZE) * 8 / PACKET_SAMPLE_BITS;
+}
+
+max30102_err_t packetizer_init(packetizer_t *pk, const packet_transport_t *transport, uint32_t deadline_us)
+{
+    if (!pk || !transport || !transport->reserve || !transport->send ||
+        transport->mtu < PACKET_MIN_MTU || transport->mtu > PACKET_MAX_MTU) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(pk, 0, sizeof(*pk));
+    pk->transport = transport;
+    pk->deadline_us = deadline_us;
+    pk->capacity = packetizer_capacity(transport->mtu);
+    return MAX30102_OK;
+}
+
+// Starts a packet in the next transport buffer. False if the link has none.
+static bool packet_open(packetizer_t *pk, uint32_t sequence, int64_t now_us)
+{
+    uint8_t *frame = pk->transport->reserve(pk->transport->ctx);
+    if (!frame) {
+        return false;
+    }
+    
+    pk->frame = frame;
+    pk->count = 0;
+    pk->len = PACKET_HEADER_SIZE;
+    pk->first_sequence = sequence;
+    pk->opened_us = now_us;
+    pk->bits = 0;
+    pk->bit_count = 0;
+    return true;
+}
+
+// Appends red then IR, 18 bits each, flushing whole bytes as they complete
+static void packet_add(packetizer_t *pk, uint32_t red, uint32_t ir)
+{
+    pk->bits |= (uint64_t)(red & PACKET_SAMPLE_MASK) << pk->bit_count;
+    pk->bits |= (uint64_t)(ir & PACKET_SAMPLE_MASK) << (pk->bit_count + 18);
+    pk->bit_count += PACKET_SAMPLE_BITS;
+    
+    while (pk->bit_count >= 8) {
+        pk->frame[pk->len++] = (uint8_t)pk->bits;
+        pk->bits >>= 8;
+        pk->bit_count -= 8;
+    }
+    pk->count++;
+}
+
+static void packet_send(packetizer_t *pk)
+{
+    if (pk->bit_count > 0) {
+        pk->frame[pk->len++] = (uint8_t)pk->bits;
+        pk->bits = 0;
+        pk->bit_count = 0;
+    }
+    
+    pk->frame[0] = PACKET_TYPE_SAMPLES;
+    put_u16(&pk->frame[1], pk->packet_number);
+    put_u32(&pk->frame[3], pk->first_sequence);
+    pk->frame[7] = (uint8_t)pk->count;
+    
+    if (pk->transport->send(pk->transport->ctx, pk->len) == MAX30102_OK) {
+        pk->stats.packets++;
+        pk->stats.samples += (uint32_t)pk->count;
+        pk->stats.bytes += (uint32_t)pk->len;
+    } else {
+        pk->stats.send_errors++;
+    }
+    pk->packet_number++;
+    pk->frame = NULL;
+}
+
+// Moves queued samples from the ring into packets, sending each one that
+// fills, then sends the open packet if its deadline has passed. Returns
+// the samples taken from the ring; fewer than were queued if the
+// transport ran out of buffers.
+size_t packetizer_service(packetizer_t *pk, sample_ring_t *ring, int64_t now_us)
+{
+    size_t taken = 0;
+    const sample_block_t *block;
+    size_t first;
+    size_t n;
+    
+    while ((n = sample_ring_peek(ring, &block, &first)) > 0) {
+        size_t i;
+        for (i = 0; i < n; i++) {
+            uint32_t sequence = block->sequence + (uint32_t)(first + i);
+            
+            if (pk->frame && sequence != pk->first_sequence + (uint32_t)pk->count) {
+                pk->stats.breaks++;
+                packet_send(pk);
+            }
+            if (!pk->frame && !packet_open(pk, sequence, now_us)) {
+                break;
+            }
+            
+            packet_add(pk, block->red[first + i], block->ir[first + i]);
+            if (pk->count == pk->capacity) {
+                pk->stats.full++;
+                packet_send(pk);
+            }
+        }
+        
+        sample_ring_consume(ring, i);
+        taken += i;
+        if (i < n) {
+            pk->stats.stalls++;
+            break;
+        }
+    }
+    
+    if (pk->frame && now_us - pk->opened_us >= (int64_t)pk->deadline_us) {
+        pk->stats.deadline++;
+        packet_send(pk);
+    }
+    return taken;
+}
+
+// Sends the open packet now, whatever its size
+void packetizer_flush(packetizer_t *pk)
+{
+    if (pk->frame) {
+        packet_send(pk);
+    }
+}
+
+// When the open packet is due, INT64_MAX if none is open
+int64_t packetizer_due_us(const packetizer_t *pk)
+{
+    return pk->frame ? pk->opened_us + (int64_t)pk->deadline_us : INT64_MAX;
+}
+
+void packetizer_get_stats(const packetizer_t *pk, packetizer_stats_t *stats)
+{
+    if (stats) {
+        *stats = pk->stats;
+    }
+}
+
+// Unpacks one packet. The decoded samples carry their sequence numbers and
+// no timestamp.
+max30102_err_t packet_decode(const uint8_t *data, size_t len, packet_info_t *info, max30102_sample_t *samples,
+                             size_t max_samples)
+{
+    if (!data || !info || len < PACKET_HEADER_SIZE || data[0] != PACKET_TYPE_SAMPLES) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    info->packet_number = get_u16(&data[1]);
+    info->first_sequence = get_u32(&data[3]);
+    info->count = data[7];
+    
+    size_t payload = (info->count * PACKET_SAMPLE_BITS + 7) / 8;
+    if (len != PACKET_HEADER_SIZE + payload || info->count > max_samples) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    const uint8_t *p = &data[PACKET_HEADER_SIZE];
+    uint64_t bits = 0;
+    uint32_t bit_count = 0;
+    for (size_t i = 0; i < info->count; i++) {
+        while (bit_count < PACKET_SAMPLE_BITS) {
+            bits |= (uint64_t)*p++ << bit_count;
+            bit_count += 8;
+        }
+        samples[i].red = (uint32_t)bits & PACKET_SAMPLE_MASK;
+        samples[i].ir = (uint32_t)(bits >> 18) & PACKET_SAMPLE_MASK;
+        samples[i].sequence = info->first_sequence + (uint32_t)i;
+        samples[i].valid = true;
+        samples[i].timestamp_us = 0;
+        bits >>= PACKET_SAMPLE_BITS;
+        bit_count -= PACKET_SAMPLE_BITS;
+    }
+    return MAX30102_OK;
+}
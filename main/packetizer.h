@@ -0,0 +1,95 @@
+#ifndef PACKETIZER_H
+#define PACKETIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "sample_ring.h"
+
+// Packs samples from a sample ring into packets of at most one MTU, for a
+// link that delivers whole packets: a BLE notification, or a UART frame.
+// Each packet carries a block of consecutive sequence numbers,
+//
+//   PACKET_TYPE_SAMPLES | packet number (u16) | first sequence (u32) |
+//   count (u8) | count * (red, IR), 18 bits each, LSB first
+//
+// with multi-byte fields little-endian. A jump in sequence numbers starts a
+// new packet, so the receiver sees lost samples as a gap between packets
+// and lost packets as a gap in packet numbers.
+//
+// A packet goes out when it is full or when the first sample in it has
+// waited 'deadline_us', whichever is first. At high rates packets fill
+// before the deadline and go out at full size. At low rates the deadline
+// bounds the latency instead. Samples are read in place from the ring and
+// packed straight into the transport's transmit buffer, so nothing is
+// copied on the way. When the transport has no buffer free, the samples
+// stay in the ring; if it then fills, the ring drops and counts them.
+
+#define PACKET_TYPE_SAMPLES     0x01
+#define PACKET_HEADER_SIZE      8
+#define PACKET_SAMPLE_BITS      36
+#define PACKET_MIN_MTU          (PACKET_HEADER_SIZE + (PACKET_SAMPLE_BITS + 7) / 8)
+#define PACKET_MAX_MTU          512     // Longest BLE attribute value
+#define PACKET_MAX_SAMPLES      ((PACKET_MAX_MTU - PACKET_HEADER_SIZE) * 8 / PACKET_SAMPLE_BITS)
+
+_Static_assert(PACKET_MAX_SAMPLES <= UINT8_MAX, "Packet sample count must fit its u8 field");
+
+// Link the packetizer sends on. reserve() returns the buffer for the next
+// packet, 'mtu' bytes long, or NULL while the link is backed up. send()
+// transmits the first 'len' bytes of the buffer last reserved.
+typedef struct {
+    uint8_t *(*reserve)(void *ctx);
+    max30102_err_t (*send)(void *ctx, size_t len);
+    size_t mtu;
+    void *ctx;
+} packet_transport_t;
+
+// Decoded packet header
+typedef struct {
+    uint16_t packet_number;
+    uint32_t first_sequence;
+    size_t count;
+} packet_info_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t samples;
+    uint32_t bytes;
+    uint32_t full;              // Packets sent because they were full
+    uint32_t deadline;          // Packets sent at the latency deadline
+    uint32_t breaks;            // Packets cut short by a sequence jump
+    uint32_t stalls;            // Services stopped by a busy transport
+    uint32_t send_errors;       // Packets the transport failed to send
+} packetizer_stats_t;
+
+typedef struct {
+    const packet_transport_t *transport;
+    uint32_t deadline_us;
+    size_t capacity;            // Samples per packet at the transport's MTU
+    uint16_t packet_number;
+    
+    // Open packet, NULL frame when none
+    uint8_t *frame;
+    size_t count;
+    size_t len;
+    uint32_t first_sequence;
+    int64_t opened_us;
+    uint64_t bits;              // Bits not yet written to the frame
+    uint32_t bit_count;
+    
+    packetizer_stats_t stats;
+} packetizer_t;
+
+// Function prototypes
+max30102_err_t packetizer_init(packetizer_t *pk, const packet_transport_t *transport, uint32_t deadline_us);
+size_t packetizer_capacity(size_t mtu);
+size_t packetizer_service(packetizer_t *pk, sample_ring_t *ring, int64_t now_us);
+void packetizer_flush(packetizer_t *pk);
+int64_t packetizer_due_us(const packetizer_t *pk);
+void packetizer_get_stats(const packetizer_t *pk, packetizer_stats_t *stats);
+
+max30102_err_t packet_decode(const uint8_t *data, size_t len, packet_info_t *info, max30102_sample_t *samples,
+                             size_t max_samples);
+
+#endif // PACKETIZER_H
@@ -0,0 +1,473 @@
+#include "pipeline.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+static const char *TAG = "PIPELINE";
+
+#define QUEUE_MASK      (PIPELINE_QUEUE_DEPTH - 1)
+
+_Static_assert((PIPELINE_QUEUE_DEPTH & QUEUE_MASK) == 0, "PIPELINE_QUEUE_DEPTH must be a power of two");
+_Static_assert(PIPELINE_BLOCK_SIZE <= SAMPLE_BLOCK_CAPACITY, "PIPELINE_BLOCK_SIZE must fit a sample block");
+
+static const char *const stage_names[PIPELINE_STAGE_COUNT] = {"acquire", "dsp", "output"};
+
+// Private function prototypes
+static pipeline_block_t *queue_reserve(pipeline_queue_t *q);
+static void queue_commit(pipeline_queue_t *q);
+static pipeline_block_t *queue_peek(pipeline_queue_t *q);
+static void queue_release(pipeline_queue_t *q);
+static void analyze_block(pipeline_t *p, pipeline_block_t *block);
+static void publish_warm_state(pipeline_t *p);
+static void publish_readout(pipeline_t *p);
+static void output_binary(pipeline_t *p, const pipeline_block_t *block);
+static void output_text(pipeline_t *p, const pipeline_block_t *block);
+static void output_line(pipeline_t *p, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void complete_probe(pipeline_t *p, const pipeline_block_t *block);
+
+max30102_err_t pipeline_init(pipeline_t *p, const pipeline_config_t *config)
+{
+    if (!p || !config || !config->write || !config->clock_us) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(p, 0, sizeof(*p));
+    p->config = *config;
+    p->first_sample = true;
+    sample_ring_init(&p->ring);
+    atomic_init(&p->queue.head, 0);
+    atomic_init(&p->queue.tail, 0);
+    atomic_init(&p->queue.high_water, 0);
+    atomic_init(&p->probe_armed, 0);
+    atomic_init(&p->warm_seq, 0);
+    atomic_init(&p->warm_interval_us, 0);
+    atomic_init(&p->warm_amp, 0);
+    atomic_init(&p->readout_seq, 0);
+    atomic_init(&p->readout_bpm_x10, 0);
+    atomic_init(&p->readout_spectral_x10, 0);
+    atomic_init(&p->readout_spo2_x10, 0);
+    
+    // Analysis is skipped, not fatal, when the rate is too low for it
+    p->analysis_enabled = (hr_detector_init(&p->hr, config->sample_rate_hz) == MAX30102_OK &&
+                           hr_spectral_init(&p->spectral, config->sample_rate_hz) == MAX30102_OK &&
+                           spo2_estimator_init(&p->spo2, config->sample_rate_hz) == MAX30102_OK &&
+                           signal_quality_init(&p->quality, config->sample_rate_hz, config->adc_range) == MAX30102_OK);
+    
+    if (config->output == PIPELINE_OUTPUT_BINARY) {
+        stream_encoder_init(&p->encoder, STREAM_MAX_BLOCK, config->write, config->write_ctx);
+    }
+    p->logged_us = config->clock_us();
+    return MAX30102_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Block queue. head is written by dsp only and tail by output only, so the
+// stages synchronize with one acquire load and one release store per block.
+
+static pipeline_block_t *queue_reserve(pipeline_queue_t *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail >= PIPELINE_QUEUE_DEPTH) {
+        return NULL;
+    }
+    return &q->slots[head & QUEUE_MASK];
+}
+
+static void queue_commit(pipeline_queue_t *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed) + 1;
+    atomic_store_explicit(&q->head, head, memory_order_release);
+    
+    uint32_t depth = head - atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (depth > atomic_load_explicit(&q->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&q->high_water, depth, memory_order_relaxed);
+    }
+}
+
+static pipeline_block_t *queue_peek(pipeline_queue_t *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    return &q->slots[tail & QUEUE_MASK];
+}
+
+static void queue_release(pipeline_queue_t *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// acquire
+
+size_t pipeline_acquire(pipeline_t *p, const max30102_sample_t *samples, size_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    
+    // Hand off without blocking; a full ring drops and counts the samples
+    size_t pushed = sample_ring_push_block(&p->ring, samples, count);
+    metrics_count(p->config.metrics, METRIC_RING_DROPS, (uint32_t)(count - pushed));
+    
+    // Arm the latency probe on the newest sample if the last one has completed
+    if (atomic_load_explicit(&p->probe_armed, memory_order_acquire) == 0) {
+        p->probe_sequence = samples[count - 1].sequence;
+        p->probe_time_us = p->config.clock_us();
+        atomic_store_explicit(&p->probe_armed, 1, memory_order_release);
+    }
+    return pushed;
+}
+
+// Passes on a gap the driver reported, so output can mark an estimated
+// one. Call from the acquire thread, before pipeline_acquire() of the
+// samples the gap came with.
+void pipeline_acquire_gap(pipeline_t *p, const max30102_gap_t *gap)
+{
+    sample_ring_note_gap(&p->ring, gap);
+}
+
+// ---------------------------------------------------------------------------
+// dsp
+
+size_t pipeline_dsp_step(pipeline_t *p)
+{
+    pipeline_block_t *block = queue_reserve(&p->queue);
+    if (!block) {
+        // Output is behind: leave the samples in the ring
+        if (sample_ring_count(&p->ring) > 0) {
+            p->stats[PIPELINE_STAGE_DSP].stalls++;
+        }
+        return 0;
+    }
+    
+    int64_t start = p->config.clock_us();
+    size_t count = sample_ring_pop_run(&p->ring, &block->samples, PIPELINE_BLOCK_SIZE);
+    if (count == 0) {
+        return 0;
+    }
+    analyze_block(p, block);
+    publish_warm_state(p);
+    publish_readout(p);
+    queue_commit(&p->queue);
+    
+    pipeline_account(p, PIPELINE_STAGE_DSP, start, count);
+    return count;
+}
+
+// Each beat closes an SpO2 window before the sample that revealed it. The
+// spectral readout comes at most once per HRS_UPDATE_MS. When the quality
+// gate closes, the estimators are reset, so the BPM and SpO2 readouts clear
+// and analysis restarts from scratch once the gate opens again.
+static void analyze_block(pipeline_t *p, pipeline_block_t *block)
+{
+    block->beat_count = 0;
+    block->spectral_valid = false;
+    
+    if (!p->analysis_enabled) {
+        return;
+    }
+    
+    for (size_t i = 0; i < block->samples.count; i++) {
+        max30102_sample_t sample;
+        sample_block_get(&block->samples, i, &sample);
+        
+        if (signal_quality_process(&p->quality, &sample) && p->config.quality_gate) {
+            bool paused = !signal_quality_gate_open(&p->quality);
+            if (paused && !p->analysis_paused) {
+                hr_detector_reset(&p->hr);
+                hr_spectral_reset(&p->spectral);
+                spo2_estimator_reset(&p->spo2);
+            }
+            p->analysis_paused = paused;
+        }
+        if (p->analysis_paused) {
+            p->analysis_skipped++;
+            continue;
+        }
+        
+        hr_beat_t beat;
+        if (hr_detector_process(&p->hr, &sample, &beat) && block->beat_count < PIPELINE_MAX_BEATS) {
+            pipeline_beat_t *event = &block->beats[block->beat_count++];
+            event->beat = beat;
+            event->spo2_valid = spo2_estimator_beat(&p->spo2, &event->spo2);
+        }
+        spo2_estimator_process(&p->spo2, &sample);
+        if (hr_spectral_process(&p->spectral, &sample, &block->spectral)) {
+            block->spectral_valid = true;
+        }
+    }
+}
+
+// Snapshots the detector's warm-start state while the quality gate is
+// open, so readers never see the detector mid-update
+static void publish_warm_state(pipeline_t *p)
+{
+    hr_warm_state_t state = {0};
+    if (p->analysis_enabled && signal_quality_gate_open(&p->quality)) {
+        hr_detector_save(&p->hr, &state);
+    }
+    if (state.interval_us == atomic_load_explicit(&p->warm_interval_us, memory_order_relaxed) &&
+        state.amp == atomic_load_explicit(&p->warm_amp, memory_order_relaxed)) {
+        return;
+    }
+    
+    uint32_t seq = atomic_load_explicit(&p->warm_seq, memory_order_relaxed);
+    atomic_store_explicit(&p->warm_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&p->warm_interval_us, state.interval_us, memory_order_relaxed);
+    atomic_store_explicit(&p->warm_amp, state.amp, memory_order_relaxed);
+    atomic_store_explicit(&p->warm_seq, seq + 2, memory_order_release);
+}
+
+// Snapshots the BPM, spectral BPM and SpO2 readouts for the status log
+static void publish_readout(pipeline_t *p)
+{
+    uint16_t bpm_x10 = hr_detector_bpm_x10(&p->hr);
+    uint16_t spectral_x10 = hr_spectral_bpm_x10(&p->spectral);
+    uint16_t spo2_x10 = spo2_estimator_spo2_x10(&p->spo2);
+    if (bpm_x10 == atomic_load_explicit(&p->readout_bpm_x10, memory_order_relaxed) &&
+        spectral_x10 == atomic_load_explicit(&p->readout_spectral_x10, memory_order_relaxed) &&
+        spo2_x10 == atomic_load_explicit(&p->readout_spo2_x10, memory_order_relaxed)) {
+        return;
+    }
+    
+    uint32_t seq = atomic_load_explicit(&p->readout_seq, memory_order_relaxed);
+    atomic_store_explicit(&p->readout_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&p->readout_bpm_x10, bpm_x10, memory_order_relaxed);
+    atomic_store_explicit(&p->readout_spectral_x10, spectral_x10, memory_order_relaxed);
+    atomic_store_explicit(&p->readout_spo2_x10, spo2_x10, memory_order_relaxed);
+    atomic_store_explicit(&p->readout_seq, seq + 2, memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// output
+
+size_t pipeline_output_step(pipeline_t *p)
+{
+    const pipeline_block_t *block = queue_peek(&p->queue);
+    if (!block) {
+        return 0;
+    }
+    
+    int64_t start = p->config.clock_us();
+    if (p->config.output == PIPELINE_OUTPUT_BINARY) {
+        output_binary(p, block);
+    } else {
+        output_text(p, block);
+    }
+    complete_probe(p, block);
+    size_t count = block->samples.count;
+    queue_release(&p->queue);
+    
+    pipeline_account(p, PIPELINE_STAGE_OUTPUT, start, count);
+    return count;
+}
+
+// Sends the partial frame now rather than holding it for the next block
+void pipeline_output_flush(pipeline_t *p)
+{
+    if (p->config.output == PIPELINE_OUTPUT_BINARY) {
+        stream_encoder_flush(&p->encoder);
+    }
+}
+
+static void output_binary(pipeline_t *p, const pipeline_block_t *block)
+{
+    int64_t now = p->config.clock_us();
+    if (!p->info_sent || now - p->last_info_us >= PIPELINE_INFO_INTERVAL_US) {
+        stream_encoder_info(&p->encoder, p->config.sample_rate_hz);
+        p->last_info_us = now;
+        p->info_sent = true;
+    }
+    
+    // Sequence jumps become gap frames inside the encoder
+    stream_encoder_push_block(&p->encoder, &block->samples);
+    
+    for (size_t i = 0; i < block->beat_count; i++) {
+        const pipeline_beat_t *event = &block->beats[i];
+        stream_encoder_beat(&p->encoder, event->beat.sequence, event->beat.interval_us, event->beat.bpm_x10);
+        if (event->spo2_valid) {
+            stream_encoder_spo2(&p->encoder, event->beat.sequence, event->spo2.spo2_x10,
+                                event->spo2.ratio_x1000);
+        }
+    }
+    if (block->spectral_valid) {
+        stream_encoder_spectral(&p->encoder, block->spectral.sequence, block->spectral.bpm_x10,
+                                block->spectral.confidence);
+    }
+}
+
+static void output_line(pipeline_t *p, const char *format, ...)
+{
+    char line[PIPELINE_TEXT_LINE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0) {
+        p->config.write(p->config.write_ctx, (const uint8_t *)line,
+                        (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+    }
+}
+
+static void output_text(pipeline_t *p, const pipeline_block_t *block)
+{
+    const sample_block_t *samples = &block->samples;
+    
+    // Sensor overflows and ring drops both show up as sequence jumps, which
+    // only happen between blocks
+    if (samples->count > 0 && !p->first_sample && samples->sequence != p->expected_sequence) {
+        output_line(p, "[%lu] Gap: %lu samples lost%s\n", (unsigned long)p->expected_sequence,
+                    (unsigned long)(samples->sequence - p->expected_sequence),
+                    samples->gap_estimated ? " (estimated)" : "");
+    }
+    for (size_t i = 0; i < samples->count; i++) {
+        output_line(p, "[%lu] Red: %6lu, IR: %6lu\n", (unsigned long)(samples->sequence + i),
+                    (unsigned long)samples->red[i], (unsigned long)samples->ir[i]);
+        p->expected_sequence = samples->sequence + (uint32_t)i + 1;
+        p->first_sample = false;
+    }
+    
+    for (size_t i = 0; i < block->beat_count; i++) {
+        const pipeline_beat_t *event = &block->beats[i];
+        output_line(p, "[%lu] Beat: interval %lu ms, %u.%u BPM\n", (unsigned long)event->beat.sequence,
+                    (unsigned long)(event->beat.interval_us / 1000), event->beat.bpm_x10 / 10,
+                    event->beat.bpm_x10 % 10);
+        if (event->spo2_valid) {
+            output_line(p, "[%lu] SpO2: %u.%u%% (R %u.%03u)\n", (unsigned long)event->beat.sequence,
+                        event->spo2.spo2_x10 / 10, event->spo2.spo2_x10 % 10,
+                        event->spo2.ratio_x1000 / 1000, event->spo2.ratio_x1000 % 1000);
+        }
+    }
+    if (block->spectral_valid) {
+        output_line(p, "[%lu] Spectral HR: %u.%u BPM (confidence %u%%)\n",
+                    (unsigned long)block->spectral.sequence, block->spectral.bpm_x10 / 10,
+                    block->spectral.bpm_x10 % 10, block->spectral.confidence);
+    }
+}
+
+// The probe completes at the first block that reaches its sample. If that
+// sample was dropped, a later one stands in, so the figure errs high.
+static void complete_probe(pipeline_t *p, const pipeline_block_t *block)
+{
+    if (block->samples.count == 0 || atomic_load_explicit(&p->probe_armed, memory_order_acquire) == 0) {
+        return;
+    }
+    uint32_t last = block->samples.sequence + block->samples.count - 1;
+    if ((int32_t)(last - p->probe_sequence) < 0) {
+        return;
+    }
+    
+    uint32_t latency = (uint32_t)(p->config.clock_us() - p->probe_time_us);
+    p->latency_sum_us += latency;
+    p->latency_count++;
+    if (latency > p->latency_max_us) {
+        p->latency_max_us = latency;
+    }
+    atomic_store_explicit(&p->probe_armed, 0, memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Statistics
+
+void pipeline_account(pipeline_t *p, pipeline_stage_t stage, int64_t start_us, size_t items)
+{
+    pipeline_stage_stats_t *s = &p->stats[stage];
+    uint32_t elapsed = (uint32_t)(p->config.clock_us() - start_us);
+    s->runs++;
+    s->items += (uint32_t)items;
+    s->busy_us += elapsed;
+    if (elapsed > s->max_run_us) {
+        s->max_run_us = elapsed;
+    }
+    metrics_record(p->config.metrics, METRIC_ACQUIRE_US + stage, elapsed);
+}
+
+// Counters are read while the stages run, so the snapshot is approximate
+void pipeline_get_stats(pipeline_t *p, pipeline_stats_t *stats)
+{
+    memcpy(stats->stage, p->stats, sizeof(stats->stage));
+    sample_ring_get_stats(&p->ring, &stats->ring);
+    stats->queue_depth = atomic_load(&p->queue.head) - atomic_load(&p->queue.tail);
+    stats->queue_high_water = atomic_load(&p->queue.high_water);
+    stats->latency_count = p->latency_count;
+    stats->latency_avg_us = p->latency_count ? (uint32_t)(p->latency_sum_us / p->latency_count) : 0;
+    stats->latency_max_us = p->latency_max_us;
+    stats->analysis_skipped = p->analysis_skipped;
+    signal_quality_get(&p->quality, &stats->quality);
+}
+
+// Latest warm-start state dsp published. Safe from any thread. Returns
+// false while the detector is unlocked or the quality gate is closed.
+bool pipeline_get_warm_state(pipeline_t *p, hr_warm_state_t *state)
+{
+    uint32_t seq;
+    
+    do {
+        seq = atomic_load_explicit(&p->warm_seq, memory_order_acquire);
+        state->interval_us = atomic_load_explicit(&p->warm_interval_us, memory_order_relaxed);
+        state->amp = atomic_load_explicit(&p->warm_amp, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) != 0 || atomic_load_explicit(&p->warm_seq, memory_order_relaxed) != seq);
+    
+    return state->interval_us != 0;
+}
+
+// Latest readouts dsp published. Safe from any thread.
+void pipeline_get_readout(pipeline_t *p, pipeline_readout_t *readout)
+{
+    uint32_t seq;
+    
+    do {
+        seq = atomic_load_explicit(&p->readout_seq, memory_order_acquire);
+        readout->bpm_x10 = (uint16_t)atomic_load_explicit(&p->readout_bpm_x10, memory_order_relaxed);
+        readout->spectral_bpm_x10 = (uint16_t)atomic_load_explicit(&p->readout_spectral_x10, memory_order_relaxed);
+        readout->spo2_x10 = (uint16_t)atomic_load_explicit(&p->readout_spo2_x10, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) != 0 || atomic_load_explicit(&p->readout_seq, memory_order_relaxed) != seq);
+}
+
+// Logs per-stage CPU load since the previous call, queue depths and latency
+void pipeline_log_stats(pipeline_t *p)
+{
+    pipeline_stats_t stats;
+    pipeline_get_stats(p, &stats);
+    int64_t now = p->config.clock_us();
+    int64_t interval = now - p->logged_us;
+    
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        const pipeline_stage_stats_t *s = &stats.stage[i];
+        const pipeline_stage_stats_t *prev = &p->logged[i];
+        uint32_t runs = s->runs - prev->runs;
+        uint64_t busy = s->busy_us - prev->busy_us;
+        uint32_t load_x10 = interval > 0 ? (uint32_t)(busy * 1000 / (uint64_t)interval) : 0;
+        ESP_LOGI(TAG, "%-7s load %lu.%lu%%, %lu runs, %lu samples, avg %lu us, max %lu us, %lu stalls",
+                 stage_names[i], (unsigned long)(load_x10 / 10), (unsigned long)(load_x10 % 10),
+                 (unsigned long)runs, (unsigned long)(s->items - prev->items),
+                 (unsigned long)(runs ? busy / runs : 0), (unsigned long)s->max_run_us,
+                 (unsigned long)(s->stalls - prev->stalls));
+    }
+    ESP_LOGI(TAG, "Queues: ring %lu/%lu (high %lu, %lu dropped), blocks %lu/%d (high %lu)",
+             (unsigned long)stats.ring.count, (unsigned long)stats.ring.capacity,
+             (unsigned long)stats.ring.high_water, (unsigned long)stats.ring.drops,
+             (unsigned long)stats.queue_depth, PIPELINE_QUEUE_DEPTH, (unsigned long)stats.queue_high_water);
+    ESP_LOGI(TAG, "Latency: avg %lu us, max %lu us over %lu probes",
+             (unsigned long)stats.latency_avg_us, (unsigned long)stats.latency_max_us,
+             (unsigned long)stats.latency_count);
+    if (p->analysis_enabled) {
+        ESP_LOGI(TAG, "Signal quality: index %u, flags 0x%02x, PI %u.%02u%%, IR DC %lu nA, %lu samples not analyzed",
+                 stats.quality.index, stats.quality.flags, stats.quality.perfusion_x100 / 100,
+                 stats.quality.perfusion_x100 % 100, (unsigned long)stats.quality.dc_na,
+                 (unsigned long)stats.analysis_skipped);
+    }
+    
+    memcpy(p->logged, stats.stage, sizeof(p->logged));
+    p->logged_us = now;
+}
@@ -0,0 +1,189 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "max30102.h"
+#include "sample_ring.h"
+#include "stream_codec.h"
+#include "hr_detector.h"
+#include "hr_spectral.h"
+#include "spo2_estimator.h"
+#include "signal_quality.h"
+#include "metrics.h"
+
+// Three-stage sample pipeline:
+//
+//   acquire --sample_ring--> dsp --block queue--> output
+//
+// acquire pushes samples from the sensor into the SPSC sample ring, which
+// drops and counts samples when full. dsp pops a block, runs heart-rate,
+// spectral and SpO2 analysis, and fills a slot of the block queue in place.
+// With quality_gate set, a signal-quality index (signal_quality.h) sees
+// every sample first, and the analysis is skipped while it reports a poor
+// signal: no finger, clipping, motion or no pulse.
+// output formats the block as text lines or binary stream frames and hands
+// the bytes to a write callback. The block queue is bounded and never
+// drops: when it is full, dsp leaves the samples in the ring. So back
+// pressure ends at the ring, and all loss shows up as sequence gaps.
+//
+// The stage functions hold no OS objects. The firmware runs each stage in
+// its own FreeRTOS task pinned to a core; the host build runs them on
+// pthreads. Each stage must be driven from a single thread, and each stage's
+// statistics are written only by that thread.
+
+#define PIPELINE_BLOCK_SIZE         32      // Samples per dsp/output block
+#define PIPELINE_QUEUE_DEPTH        8       // Blocks between dsp and output, power of two
+#define PIPELINE_MAX_BEATS          4       // Beats per block; a 32-sample block spans < 1 s
+#define PIPELINE_INFO_INTERVAL_US   5000000 // Repeat the info frame for late-joining readers
+#define PIPELINE_TEXT_LINE          96
+
+typedef enum {
+    PIPELINE_OUTPUT_TEXT = 0,       // One line per sample
+    PIPELINE_OUTPUT_BINARY          // stream_codec frames
+} pipeline_output_t;
+
+typedef enum {
+    PIPELINE_STAGE_ACQUIRE = 0,
+    PIPELINE_STAGE_DSP,
+    PIPELINE_STAGE_OUTPUT,
+    PIPELINE_STAGE_COUNT
+} pipeline_stage_t;
+
+// Microsecond clock used for stage timing and latency
+typedef int64_t (*pipeline_clock_t)(void);
+
+typedef struct {
+    pipeline_output_t output;
+    uint32_t sample_rate_hz;
+    stream_write_t write;           // Receives formatted output
+    void *write_ctx;
+    pipeline_clock_t clock_us;
+    metrics_t *metrics;             // Optional: stage times and ring drops
+    uint8_t adc_range;              // MAX30102_ADCRANGE_*, for the signal-quality DC check
+    bool quality_gate;              // Skip analysis while signal quality is poor
+} pipeline_config_t;
+
+// A detected beat and the SpO2 estimate it completed, if any
+typedef struct {
+    hr_beat_t beat;
+    spo2_result_t spo2;
+    bool spo2_valid;
+} pipeline_beat_t;
+
+// Latest readouts from the dsp stage, 0 while there is none
+typedef struct {
+    uint16_t bpm_x10;
+    uint16_t spectral_bpm_x10;
+    uint16_t spo2_x10;
+} pipeline_readout_t;
+
+// Unit of work between dsp and output: a run of consecutive samples plus
+// their analysis. A sequence jump in the ring ends the run early.
+typedef struct {
+    sample_block_t samples;
+    size_t beat_count;
+    pipeline_beat_t beats[PIPELINE_MAX_BEATS];
+    hr_spectral_result_t spectral;  // Latest spectral readout in the block
+    bool spectral_valid;
+} pipeline_block_t;
+
+// Bounded SPSC queue of blocks, filled and drained in place
+typedef struct {
+    _Alignas(SAMPLE_RING_CACHE_LINE) atomic_uint head;
+    atomic_uint high_water;
+    _Alignas(SAMPLE_RING_CACHE_LINE) atomic_uint tail;
+    _Alignas(SAMPLE_RING_CACHE_LINE) pipeline_block_t slots[PIPELINE_QUEUE_DEPTH];
+} pipeline_queue_t;
+
+// Per-stage counters, written only by the thread running the stage
+typedef struct {
+    uint32_t runs;          // Calls that did work
+    uint32_t items;         // Samples handled
+    uint32_t stalls;        // Calls that found the next queue full
+    uint64_t busy_us;       // Time spent doing work
+    uint32_t max_run_us;
+} pipeline_stage_stats_t;
+
+typedef struct {
+    pipeline_stage_stats_t stage[PIPELINE_STAGE_COUNT];
+    sample_ring_stats_t ring;
+    uint32_t queue_depth;           // Blocks waiting for output
+    uint32_t queue_high_water;
+    uint32_t latency_count;         // Probes completed
+    uint32_t latency_avg_us;        // Acquire push to output written
+    uint32_t latency_max_us;
+    uint32_t analysis_skipped;      // Samples not analyzed for poor signal quality
+    signal_quality_result_t quality;
+} pipeline_stats_t;
+
+typedef struct {
+    pipeline_config_t config;
+    bool analysis_enabled;
+    
+    // Queues
+    sample_ring_t ring;
+    pipeline_queue_t queue;
+    
+    // dsp stage
+    hr_detector_t hr;
+    hr_spectral_t spectral;
+    spo2_estimator_t spo2;
+    signal_quality_t quality;
+    bool analysis_paused;           // Quality gate closed
+    uint32_t analysis_skipped;
+    
+    // Warm-start state, published by dsp after each block for other
+    // threads. A seqlock: warm_seq is odd while dsp rewrites the fields.
+    atomic_uint warm_seq;
+    atomic_uint warm_interval_us;   // 0 while the detector has nothing to save
+    atomic_int warm_amp;
+    
+    // Readouts, published by dsp after each block the same way
+    atomic_uint readout_seq;
+    atomic_uint readout_bpm_x10;
+    atomic_uint readout_spectral_x10;
+    atomic_uint readout_spo2_x10;
+    
+    // output stage
+    stream_encoder_t encoder;
+    int64_t last_info_us;
+    bool info_sent;
+    uint32_t expected_sequence;
+    bool first_sample;
+    
+    // Latency probe: one sample in flight at a time, armed by acquire and
+    // completed by output
+    atomic_uint probe_armed;
+    uint32_t probe_sequence;
+    int64_t probe_time_us;
+    uint64_t latency_sum_us;
+    uint32_t latency_count;
+    uint32_t latency_max_us;
+    
+    pipeline_stage_stats_t stats[PIPELINE_STAGE_COUNT];
+    pipeline_stage_stats_t logged[PIPELINE_STAGE_COUNT];   // Snapshot at the last log
+    int64_t logged_us;
+} pipeline_t;
+
+// Samples the ring and block queue hold between acquire and output, and
+// the bytes they take
+#define PIPELINE_BUFFERED_SAMPLES   (SAMPLE_RING_CAPACITY + PIPELINE_QUEUE_DEPTH * PIPELINE_BLOCK_SIZE)
+#define PIPELINE_BUFFER_BYTES       (sizeof(sample_ring_t) + sizeof(pipeline_queue_t))
+
+// Function prototypes
+max30102_err_t pipeline_init(pipeline_t *p, const pipeline_config_t *config);
+size_t pipeline_acquire(pipeline_t *p, const max30102_sample_t *samples, size_t count);
+void pipeline_acquire_gap(pipeline_t *p, const max30102_gap_t *gap);
+size_t pipeline_dsp_step(pipeline_t *p);
+size_t pipeline_output_step(pipeline_t *p);
+void pipeline_output_flush(pipeline_t *p);
+void pipeline_account(pipeline_t *p, pipeline_stage_t stage, int64_t start_us, size_t items);
+void pipeline_get_stats(pipeline_t *p, pipeline_stats_t *stats);
+bool pipeline_get_warm_state(pipeline_t *p, hr_warm_state_t *state);
+void pipeline_get_readout(pipeline_t *p, pipeline_readout_t *readout);
+void pipeline_log_stats(pipeline_t *p);
+
+#endif // PIPELINE_H
@@ -0,0 +1,524 @@
+#include "ppg_codec.h"
+#include <string.h>
+
+_Static_assert(PPG_CODEC_MAX_PAYLOAD <= 0xFFFF, "Payload length is a u16");
+_Static_assert(PPG_CODEC_MAX_RECORD >= PPG_BLOCK_HEADER + PPG_INDEX_MAX_PAYLOAD + 2 + PPG_TRAILER_SIZE,
+               "Output buffer holds the index and trailer");
+_Static_assert((PPG_CODEC_INDEX_SIZE & 1) == 0, "Index thins by halves");
+
+#define SAMPLE_MASK     0x3FFFF
+
+static const uint8_t stream_magic[4] = {'H', 'R', 'M', 'P'};
+static const uint8_t trailer_magic[4] = {'H', 'R', 'M', 'I'};
+
+// MSB-first bit writer over a buffer sized for the worst case
+typedef struct {
+    uint8_t *p;
+    uint64_t acc;
+    unsigned bits;
+} bit_writer_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;
+    unsigned bits;
+    unsigned past_end;          // Zero bytes shifted in after 'end'
+} bit_reader_t;
+
+// Private function prototypes
+static void put_u16(uint8_t *p, uint16_t v);
+static void put_u24(uint8_t *p, uint32_t v);
+static void put_u32(uint8_t *p, uint32_t v);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u24(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+static void encoder_emit(ppg_encoder_t *enc, size_t len);
+static void index_add(ppg_encoder_t *enc);
+static ppg_predictor_t choose_predictor(const int32_t *x, size_t n);
+static void encode_channel(ppg_encoder_t *enc, bit_writer_t *w, const int32_t *x, size_t n, ppg_predictor_t order);
+static bool decode_channel(bit_reader_t *r, uint32_t *x, size_t n, ppg_predictor_t order);
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u24(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    p[2] = (uint8_t)(v >> 16);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u24(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)p[2] << 16);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static inline uint32_t zigzag32(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag32(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Appends the low 'n' bits of 'value', n <= 56
+static inline void bw_put(bit_writer_t *w, uint64_t value, unsigned n)
+{
+    w->acc = (w->acc << n) | (value & ((1ULL << n) - 1));
+    w->bits += n;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        *w->p++ = (uint8_t)(w->acc >> w->bits);
+    }
+}
+
+// Pads the last byte with zeros
+static inline void bw_flush(bit_writer_t *w)
+{
+    if (w->bits > 0) {
+        *w->p++ = (uint8_t)(w->acc << (8 - w->bits));
+        w->bits = 0;
+    }
+}
+
+// Makes at least 'n' bits available, n <= 56. Past the end it shifts in
+// zeros; the unary lookahead can run over the last byte without using it.
+static inline void br_fill(bit_reader_t *r, unsigned n)
+{
+    while (r->bits < n) {
+        uint8_t byte = 0;
+        if (r->p < r->end) {
+            byte = *r->p++;
+        } else {
+            r->past_end++;
+        }
+        r->acc = (r->acc << 8) | byte;
+        r->bits += 8;
+    }
+}
+
+static inline uint32_t br_get(bit_reader_t *r, unsigned n)
+{
+    br_fill(r, n);
+    r->bits -= n;
+    return (uint32_t)(r->acc >> r->bits) & (uint32_t)((1ULL << n) - 1);
+}
+
+// Prediction of x[i], with the order limited to the samples before it
+static inline int32_t predict(const int32_t *x, size_t i, unsigned order)
+{
+    if (order > i) {
+        order = (unsigned)i;
+    }
+    switch (order) {
+    case 1:
+        return x[i - 1];
+    case 2:
+        return 2 * x[i - 1] - x[i - 2];
+    default:
+        return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+    }
+}
+
+static void encoder_emit(ppg_encoder_t *enc, size_t len)
+{
+    if (enc->write) {
+        enc->write(enc->ctx, enc->out, len);
+    }
+    enc->offset += (uint32_t)len;
+    enc->stats.bytes += (uint32_t)len;
+}
+
+void ppg_encoder_init(ppg_encoder_t *enc, size_t block_size, stream_write_t write, void *ctx)
+{
+    memset(enc, 0, sizeof(*enc));
+    if (block_size < 2 || block_size > PPG_CODEC_MAX_BLOCK) {
+        block_size = PPG_CODEC_MAX_BLOCK;
+    }
+    enc->block_size = block_size;
+    enc->write = write;
+    enc->ctx = ctx;
+    enc->index.stride = 1;
+    
+    memcpy(enc->out, stream_magic, sizeof(stream_magic));
+    enc->out[4] = PPG_CODEC_VERSION;
+    put_u16(enc->out + 5, (uint16_t)block_size);
+    enc->out[7] = 0;
+    encoder_emit(enc, PPG_CODEC_HEADER);
+}
+
+void ppg_encoder_push(ppg_encoder_t *enc, const max30102_sample_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        // A block only holds consecutive sequence numbers
+        if (enc->started && samples[i].sequence != enc->next_sequence) {
+            ppg_encoder_flush(enc);
+        }
+        if (enc->count == 0) {
+            enc->first_sequence = samples[i].sequence;
+        }
+        
+        enc->red[enc->count] = (int32_t)(samples[i].red & SAMPLE_MASK);
+        enc->ir[enc->count] = (int32_t)(samples[i].ir & SAMPLE_MASK);
+        enc->count++;
+        enc->next_sequence = samples[i].sequence + 1;
+        enc->started = true;
+        
+        if (enc->count == enc->block_size) {
+            ppg_encoder_flush(enc);
+        }
+    }
+}
+
+// Records the block about to be written if it falls on the stride. A full
+// table drops every second entry and doubles the stride.
+static void index_add(ppg_encoder_t *enc)
+{
+    ppg_index_t *index = &enc->index;
+    if (enc->block_number % index->stride == 0) {
+        if (index->count == PPG_CODEC_INDEX_SIZE) {
+            for (size_t i = 0; i < PPG_CODEC_INDEX_SIZE / 2; i++) {
+                index->entries[i] = index->entries[2 * i];
+            }
+            index->count = PPG_CODEC_INDEX_SIZE / 2;
+            index->stride *= 2;
+        }
+        ppg_index_entry_t *entry = &index->entries[index->count++];
+        entry->first_sequence = enc->first_sequence;
+        entry->offset = enc->offset;
+    }
+    enc->block_number++;
+}
+
+// Fixed predictor with the smallest sum of absolute residuals
+static ppg_predictor_t choose_predictor(const int32_t *x, size_t n)
+{
+    uint32_t cost[4] = {0};
+    for (size_t i = 3; i < n; i++) {
+        int32_t d1 = x[i] - x[i - 1];
+        int32_t d2 = d1 - (x[i - 1] - x[i - 2]);
+        int32_t d3 = d2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+        cost[1] += (uint32_t)(d1 < 0 ? -d1 : d1);
+        cost[2] += (uint32_t)(d2 < 0 ? -d2 : d2);
+        cost[3] += (uint32_t)(d3 < 0 ? -d3 : d3);
+    }
+    ppg_predictor_t best = PPG_PREDICT_DELTA;
+    if (cost[2] < cost[best]) {
+        best = PPG_PREDICT_LINEAR;
+    }
+    if (cost[3] < cost[best]) {
+        best = PPG_PREDICT_QUADRATIC;
+    }
+    return best;
+}
+
+static void encode_channel(ppg_encoder_t *enc, bit_writer_t *w, const int32_t *x, size_t n, ppg_predictor_t order)
+{
+    for (size_t i = 1; i < n; i++) {
+        enc->residual[i] = zigzag32(x[i] - predict(x, i, order));
+    }
+    
+    for (size_t start = 1; start < n; start += PPG_CODEC_PARTITION) {
+        size_t end = start + PPG_CODEC_PARTITION < n ? start + PPG_CODEC_PARTITION : n;
+        uint64_t sum = 0;
+        for (size_t i = start; i < end; i++) {
+            sum += enc->residual[i];
+        }
+        // k near log2 of the mean residual, the Rice optimum for a
+        // geometric distribution
+        uint64_t m = end - start;
+        unsigned k = 0;
+        while (k < PPG_RICE_MAX_K && (m << (k + 1)) <= sum) {
+            k++;
+        }
+        bw_put(w, k, PPG_RICE_K_BITS);
+        
+        for (size_t i = start; i < end; i++) {
+            uint32_t v = enc->residual[i];
+            uint32_t q = v >> k;
+            if (q < PPG_RICE_ESCAPE) {
+                uint64_t unary = (2ULL << q) - 2;   // q ones and a zero
+                bw_put(w, (unary << k) | (v & ((1u << k) - 1)), q + 1 + k);
+            } else {
+                bw_put(w, (1u << PPG_RICE_ESCAPE) - 1, PPG_RICE_ESCAPE);
+                bw_put(w, v, PPG_RICE_RAW_BITS);
+                enc->stats.escapes++;
+            }
+        }
+    }
+}
+
+// Encodes and writes whatever is buffered as one block
+void ppg_encoder_flush(ppg_encoder_t *enc)
+{
+    if (enc->count == 0) {
+        return;
+    }
+    index_add(enc);
+    
+    size_t n = enc->count;
+    ppg_predictor_t red_order = choose_predictor(enc->red, n);
+    ppg_predictor_t ir_order = choose_predictor(enc->ir, n);
+    
+    uint8_t *payload = enc->out + PPG_BLOCK_HEADER;
+    put_u32(payload, enc->first_sequence);
+    put_u16(payload + 4, (uint16_t)n);
+    payload[6] = (uint8_t)(red_order | (ir_order << 4));
+    put_u24(payload + 7, (uint32_t)enc->red[0]);
+    put_u24(payload + 10, (uint32_t)enc->ir[0]);
+    
+    bit_writer_t w = {.p = payload + PPG_BLOCK_FIXED};
+    encode_channel(enc, &w, enc->red, n, red_order);
+    encode_channel(enc, &w, enc->ir, n, ir_order);
+    bw_flush(&w);
+    
+    size_t payload_len = (size_t)(w.p - payload);
+    enc->out[0] = PPG_BLOCK_SYNC;
+    put_u16(enc->out + 1, (uint16_t)payload_len);
+    size_t len = PPG_BLOCK_HEADER + payload_len;
+    put_u16(enc->out + len, stream_crc16(enc->out, len));
+    encoder_emit(enc, len + 2);
+    
+    enc->stats.blocks++;
+    enc->stats.samples += (uint32_t)n;
+    enc->stats.predictor[red_order]++;
+    enc->stats.predictor[ir_order]++;
+    enc->count = 0;
+}
+
+// Flushes the last block and writes the index and trailer. Nothing may be
+// pushed afterwards.
+void ppg_encoder_finish(ppg_encoder_t *enc)
+{
+    ppg_encoder_flush(enc);
+    
+    const ppg_index_t *index = &enc->index;
+    uint32_t index_offset = enc->offset;
+    uint8_t *payload = enc->out + PPG_BLOCK_HEADER;
+    put_u32(payload, index->stride);
+    put_u16(payload + 4, (uint16_t)index->count);
+    for (size_t i = 0; i < index->count; i++) {
+        put_u32(payload + 6 + i * 8, index->entries[i].first_sequence);
+        put_u32(payload + 10 + i * 8, index->entries[i].offset);
+    }
+    size_t payload_len = 6 + index->count * 8;
+    enc->out[0] = PPG_INDEX_SYNC;
+    put_u16(enc->out + 1, (uint16_t)payload_len);
+    size_t len = PPG_BLOCK_HEADER + payload_len;
+    put_u16(enc->out + len, stream_crc16(enc->out, len));
+    len += 2;
+    
+    put_u32(enc->out + len, index_offset);
+    memcpy(enc->out + len + 4, trailer_magic, sizeof(trailer_magic));
+    encoder_emit(enc, len + PPG_TRAILER_SIZE);
+}
+
+void ppg_encoder_get_stats(const ppg_encoder_t *enc, ppg_codec_stats_t *stats)
+{
+    if (stats) {
+        *stats = enc->stats;
+    }
+}
+
+// Checks the stream header
+max30102_err_t ppg_decode_header(const uint8_t *data, size_t len, size_t *block_size)
+{
+    if (len < PPG_CODEC_HEADER || memcmp(data, stream_magic, sizeof(stream_magic)) != 0 ||
+        data[4] != PPG_CODEC_VERSION) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    if (block_size) {
+        *block_size = get_u16(data + 5);
+    }
+    return MAX30102_OK;
+}
+
+// Reads a block's sequence range and size without decoding it or checking
+// its CRC. Returns MAX30102_ERR_NO_DATA if 'data' does not start with a
+// complete block, as at the index or the end of a truncated stream.
+max30102_err_t ppg_block_peek(const uint8_t *data, size_t len, uint32_t *first_sequence, size_t *count,
+                              size_t *size)
+{
+    if (len < PPG_BLOCK_HEADER + PPG_BLOCK_FIXED + 2 || data[0] != PPG_BLOCK_SYNC) {
+        return MAX30102_ERR_NO_DATA;
+    }
+    size_t payload_len = get_u16(data + 1);
+    if (payload_len < PPG_BLOCK_FIXED || PPG_BLOCK_HEADER + payload_len + 2 > len) {
+        return MAX30102_ERR_NO_DATA;
+    }
+    *first_sequence = get_u32(data + PPG_BLOCK_HEADER);
+    *count = get_u16(data + PPG_BLOCK_HEADER + 4);
+    *size = PPG_BLOCK_HEADER + payload_len + 2;
+    return MAX30102_OK;
+}
+
+static bool decode_channel(bit_reader_t *r, uint32_t *x, size_t n, ppg_predictor_t order)
+{
+    for (size_t start = 1; start < n; start += PPG_CODEC_PARTITION) {
+        size_t end = start + PPG_CODEC_PARTITION < n ? start + PPG_CODEC_PARTITION : n;
+        unsigned k = br_get(r, PPG_RICE_K_BITS);
+        if (k > PPG_RICE_MAX_K) {
+            return false;
+        }
+        
+        for (size_t i = start; i < end; i++) {
+            // Unary quotient: count the leading ones in the next 16 bits
+            br_fill(r, PPG_RICE_ESCAPE);
+            uint32_t window = (uint32_t)(r->acc >> (r->bits - PPG_RICE_ESCAPE)) & 0xFFFF;
+            uint32_t v;
+            if (window == 0xFFFF) {
+                r->bits -= PPG_RICE_ESCAPE;
+                v = br_get(r, PPG_RICE_RAW_BITS);
+            } else {
+                uint32_t q = (uint32_t)__builtin_clz(~window << 16);
+                r->bits -= q + 1;
+                v = (q << k) | (k ? br_get(r, k) : 0);
+            }
+            
+            x[i] = (uint32_t)(predict((const int32_t *)x, i, order) + unzigzag32(v));
+            if (x[i] > SAMPLE_MASK) {
+                return false;
+            }
+        }
+    }
+    // Every bit used came from the block
+    return r->past_end * 8 <= r->bits;
+}
+
+// Decodes the block at the start of 'data' and checks its CRC. 'size' gets
+// the block's length in bytes, to step to the next one.
+max30102_err_t ppg_decode_block(const uint8_t *data, size_t len, ppg_block_t *block, size_t *size)
+{
+    uint32_t first_sequence;
+    size_t count;
+    size_t block_len;
+    max30102_err_t err = ppg_block_peek(data, len, &first_sequence, &count, &block_len);
+    if (err != MAX30102_OK) {
+        return err;
+    }
+    
+    size_t crc_at = block_len - 2;
+    const uint8_t *payload = data + PPG_BLOCK_HEADER;
+    uint8_t orders = payload[6];
+    ppg_predictor_t red_order = (ppg_predictor_t)(orders & 0x0F);
+    ppg_predictor_t ir_order = (ppg_predictor_t)(orders >> 4);
+    if (stream_crc16(data, crc_at) != get_u16(data + crc_at) || count == 0 || count > PPG_CODEC_MAX_BLOCK ||
+        red_order < PPG_PREDICT_DELTA || red_order > PPG_PREDICT_QUADRATIC ||
+        ir_order < PPG_PREDICT_DELTA || ir_order > PPG_PREDICT_QUADRATIC) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    block->first_sequence = first_sequence;
+    block->count = count;
+    block->predictor[0] = red_order;
+    block->predictor[1] = ir_order;
+    block->red[0] = get_u24(payload + 7);
+    block->ir[0] = get_u24(payload + 10);
+    
+    bit_reader_t r = {.p = payload + PPG_BLOCK_FIXED, .end = data + crc_at};
+    if (block->red[0] > SAMPLE_MASK || block->ir[0] > SAMPLE_MASK ||
+        !decode_channel(&r, block->red, count, red_order) ||
+        !decode_channel(&r, block->ir, count, ir_order)) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    if (size) {
+        *size = block_len;
+    }
+    return MAX30102_OK;
+}
+
+// Loads the index of a complete stream from its trailer
+max30102_err_t ppg_read_index(const uint8_t *data, size_t len, ppg_index_t *index)
+{
+    if (len < PPG_CODEC_HEADER + PPG_TRAILER_SIZE ||
+        memcmp(data + len - 4, trailer_magic, sizeof(trailer_magic)) != 0) {
+        return MAX30102_ERR_NO_DATA;
+    }
+    size_t offset = get_u32(data + len - PPG_TRAILER_SIZE);
+    size_t end = len - PPG_TRAILER_SIZE;
+    if (offset < PPG_CODEC_HEADER || offset + PPG_BLOCK_HEADER + 6 + 2 > end || data[offset] != PPG_INDEX_SYNC) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    const uint8_t *record = data + offset;
+    size_t payload_len = get_u16(record + 1);
+    size_t crc_at = PPG_BLOCK_HEADER + payload_len;
+    if (offset + crc_at + 2 != end || stream_crc16(record, crc_at) != get_u16(record + crc_at)) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    const uint8_t *p = record + PPG_BLOCK_HEADER;
+    size_t count = get_u16(p + 4);
+    if (count > PPG_CODEC_INDEX_SIZE || payload_len != 6 + count * 8 || get_u32(p) == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    index->stride = get_u32(p);
+    index->count = count;
+    for (size_t i = 0; i < count; i++) {
+        index->entries[i].first_sequence = get_u32(p + 6 + i * 8);
+        index->entries[i].offset = get_u32(p + 10 + i * 8);
+    }
+    return MAX30102_OK;
+}
+
+// Finds the offset of the block holding 'sequence': the last index entry at
+// or before it, then forward over block headers. Returns
+// MAX30102_ERR_NO_DATA if the sequence is not in the stream.
+max30102_err_t ppg_find_block(const uint8_t *data, size_t len, const ppg_index_t *index, uint32_t sequence,
+                              size_t *offset)
+{
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((int32_t)(sequence - index->entries[mid].first_sequence) >= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return MAX30102_ERR_NO_DATA;
+    }
+    
+    size_t at = index->entries[lo - 1].offset;
+    while (at < len) {
+        uint32_t first;
+        size_t count;
+        size_t size;
+        if (ppg_block_peek(data + at, len - at, &first, &count, &size) != MAX30102_OK) {
+            break;
+        }
+        int32_t ahead = (int32_t)(sequence - first);
+        if (ahead < 0) {
+            break;      // In a gap between blocks
+        }
+        if ((uint32_t)ahead < count) {
+            *offset = at;
+            return MAX30102_OK;
+        }
+        at += size;
+    }
+    return MAX30102_ERR_NO_DATA;
+}
@@ -0,0 +1,142 @@
+#ifndef PPG_CODEC_H
+#define PPG_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "stream_codec.h"
+
+// Lossless compression for 18-bit red/IR sample streams, for storing or
+// shipping raw PPG at rates where the 36 bits a sample costs add up. Samples
+// are coded in fixed-size blocks of consecutive sequence numbers. Each block
+// picks, per channel, the fixed polynomial predictor (delta, linear or
+// quadratic) with the smallest residuals. It then Rice-codes the residuals,
+// choosing the Rice parameter separately for each partition of
+// PPG_CODEC_PARTITION residuals so it follows changes in signal and noise
+// level. Every block decodes on its own.
+//
+// A stream is an 8-byte header,
+//
+//   'H' 'R' 'M' 'P' | version | block size (u16) | reserved
+//
+// followed by blocks,
+//
+//   PPG_BLOCK_SYNC | payload length (u16) | payload | CRC-16 (u16)
+//
+//   payload: first sequence (u32) | count (u16) | predictors (u8, red in the
+//            low nibble) | first red (u24) | first IR (u24) | bitstream
+//
+// The bitstream holds the red then the IR residuals of samples 1..count-1,
+// MSB first, each partition as a 5-bit Rice parameter k and then, per
+// residual, the zigzagged value's quotient in unary and its low k bits. A
+// quotient of PPG_RICE_ESCAPE or more is sent as PPG_RICE_ESCAPE one bits
+// followed by the value in PPG_RICE_RAW_BITS bits, which bounds every block.
+//
+// ppg_encoder_finish() appends the block index and an 8-byte trailer,
+//
+//   PPG_INDEX_SYNC | length (u16) | stride (u32) | entries (u16) |
+//   entries * (first sequence (u32), offset (u32)) | CRC-16 (u16)
+//   index offset (u32) | 'H' 'R' 'M' 'I'
+//
+// so a reader can find the block holding any sequence number without
+// decoding the blocks before it. The encoder keeps the index in a fixed
+// table. When the table fills, every second entry is dropped and the stride
+// doubles, so a long stream is still covered, just more coarsely; a reader
+// walks at most 'stride' block headers from an entry. The encoder uses no
+// heap and does no I/O: full blocks go to a write callback.
+
+#define PPG_CODEC_VERSION       1
+#define PPG_CODEC_HEADER        8
+#define PPG_CODEC_MAX_BLOCK     256     // Samples per block
+#define PPG_CODEC_PARTITION     32      // Residuals per Rice parameter
+#define PPG_CODEC_INDEX_SIZE    128     // Index entries kept by the encoder
+
+#define PPG_BLOCK_SYNC          0xC5
+#define PPG_INDEX_SYNC          0xC6
+#define PPG_BLOCK_HEADER        3       // Sync and payload length
+#define PPG_BLOCK_FIXED         13      // Payload before the bitstream
+#define PPG_TRAILER_SIZE        8
+
+#define PPG_RICE_K_BITS         5
+#define PPG_RICE_MAX_K          22
+#define PPG_RICE_ESCAPE         16
+#define PPG_RICE_RAW_BITS       23      // Widest zigzagged quadratic residual of 18-bit input
+
+#define PPG_CODEC_MAX_PAYLOAD   (PPG_BLOCK_FIXED + \
+                                 (2 * ((PPG_CODEC_MAX_BLOCK + PPG_CODEC_PARTITION - 1) / PPG_CODEC_PARTITION * \
+                                       PPG_RICE_K_BITS + \
+                                       (PPG_CODEC_MAX_BLOCK - 1) * (PPG_RICE_ESCAPE + PPG_RICE_RAW_BITS)) + 7) / 8)
+#define PPG_CODEC_MAX_RECORD    (PPG_BLOCK_HEADER + PPG_CODEC_MAX_PAYLOAD + 2)
+#define PPG_INDEX_MAX_PAYLOAD   (6 + PPG_CODEC_INDEX_SIZE * 8)
+
+// Per-channel predictors
+typedef enum {
+    PPG_PREDICT_DELTA = 1,          // x[n-1]
+    PPG_PREDICT_LINEAR = 2,         // 2x[n-1] - x[n-2]
+    PPG_PREDICT_QUADRATIC = 3       // 3x[n-1] - 3x[n-2] + x[n-3]
+} ppg_predictor_t;
+
+typedef struct {
+    uint32_t first_sequence;
+    uint32_t offset;                // Byte offset of the block in the stream
+} ppg_index_entry_t;
+
+// Block index: entry i is block i * stride
+typedef struct {
+    uint32_t stride;
+    size_t count;
+    ppg_index_entry_t entries[PPG_CODEC_INDEX_SIZE];
+} ppg_index_t;
+
+// One decoded block
+typedef struct {
+    uint32_t first_sequence;
+    size_t count;
+    ppg_predictor_t predictor[2];   // Red, IR
+    uint32_t red[PPG_CODEC_MAX_BLOCK];
+    uint32_t ir[PPG_CODEC_MAX_BLOCK];
+} ppg_block_t;
+
+typedef struct {
+    uint32_t blocks;
+    uint32_t samples;
+    uint32_t bytes;                 // Including the header, index and trailer
+    uint32_t escapes;               // Residuals sent raw
+    uint32_t predictor[4];          // Channel-blocks per predictor
+} ppg_codec_stats_t;
+
+typedef struct {
+    stream_write_t write;
+    void *ctx;
+    size_t block_size;
+    size_t count;
+    uint32_t first_sequence;
+    uint32_t next_sequence;
+    bool started;
+    int32_t red[PPG_CODEC_MAX_BLOCK];
+    int32_t ir[PPG_CODEC_MAX_BLOCK];
+    uint32_t residual[PPG_CODEC_MAX_BLOCK];
+    uint8_t out[PPG_CODEC_MAX_RECORD];
+    uint32_t offset;                // Bytes written so far
+    uint32_t block_number;
+    ppg_index_t index;
+    ppg_codec_stats_t stats;
+} ppg_encoder_t;
+
+// Function prototypes
+void ppg_encoder_init(ppg_encoder_t *enc, size_t block_size, stream_write_t write, void *ctx);
+void ppg_encoder_push(ppg_encoder_t *enc, const max30102_sample_t *samples, size_t count);
+void ppg_encoder_flush(ppg_encoder_t *enc);
+void ppg_encoder_finish(ppg_encoder_t *enc);
+void ppg_encoder_get_stats(const ppg_encoder_t *enc, ppg_codec_stats_t *stats);
+
+max30102_err_t ppg_decode_header(const uint8_t *data, size_t len, size_t *block_size);
+max30102_err_t ppg_block_peek(const uint8_t *data, size_t len, uint32_t *first_sequence, size_t *count,
+                              size_t *size);
+max30102_err_t ppg_decode_block(const uint8_t *data, size_t len, ppg_block_t *block, size_t *size);
+max30102_err_t ppg_read_index(const uint8_t *data, size_t len, ppg_index_t *index);
+max30102_err_t ppg_find_block(const uint8_t *data, size_t len, const ppg_index_t *index, uint32_t sequence,
+                              size_t *offset);
+
+#endif // PPG_CODEC_H
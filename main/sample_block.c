@@ -0,0 +1,41 @@
+#include "sample_block.h"
+
+// Starts 'block' at samples[0] and takes samples while their sequence
+// numbers run on, up to SAMPLE_BLOCK_CAPACITY. The period comes from the
+// first and last timestamps taken. Returns the samples taken.
+size_t sample_block_pack(sample_block_t *block, const max30102_sample_t *samples, size_t count)
+{
+    size_t n = 0;
+    
+    while (n < count && n < SAMPLE_BLOCK_CAPACITY && samples[n].sequence == samples[0].sequence + (uint32_t)n) {
+        block->red[n] = samples[n].red;
+        block->ir[n] = samples[n].ir;
+        n++;
+    }
+    
+    block->sequence = n > 0 ? samples[0].sequence : 0;
+    block->count = (uint32_t)n;
+    block->timestamp_us = n > 0 ? samples[0].timestamp_us : 0;
+    block->period_ns = 0;
+    block->gap_estimated = false;
+    if (n > 1 && samples[0].timestamp_us != 0 && samples[n - 1].timestamp_us > samples[0].timestamp_us) {
+        block->period_ns = (uint32_t)((samples[n - 1].timestamp_us - samples[0].timestamp_us) * 1000 /
+                                      (int64_t)(n - 1));
+    }
+    return n;
+}
+
+// Writes up to 'count' samples starting at sample 'first'. Returns how many.
+size_t sample_block_unpack(const sample_block_t *block, size_t first, max30102_sample_t *samples, size_t count)
+{
+    if (first >= block->count) {
+        return 0;
+    }
+    if (count > block->count - first) {
+        count = block->count - first;
+    }
+    for (size_t i = 0; i < count; i++) {
+        sample_block_get(block, first + i, &samples[i]);
+    }
+    return count;
+}
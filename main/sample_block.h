@@ -0,0 +1,59 @@
+#ifndef SAMPLE_BLOCK_H
+#define SAMPLE_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// A run of consecutive samples in structure-of-arrays form. Red and IR
+// values sit in two arrays, and the sequence number and conversion time
+// are kept once for the whole block:
+//
+//   sequence(i) = sequence + i
+//   time(i)     = timestamp_us + i * period_ns / 1000
+//
+// That is 8 bytes per sample plus a 24-byte header, where a
+// max30102_sample_t array takes 24 bytes per sample. A sequence jump
+// always starts a new block, so a block never holds a gap. Every sample
+// in a block is valid. gap_estimated marks a block whose first sample
+// follows a gap the driver could only estimate (max30102_gap_t.saturated).
+// That flag travels with the block, because a consumer sees the gap only
+// as the jump.
+
+#define SAMPLE_BLOCK_CAPACITY   32      // Samples per block
+
+typedef struct {
+    uint32_t sequence;          // Sequence number of red[0]/ir[0]
+    uint32_t count;             // Samples held
+    uint32_t period_ns;         // Conversion interval, 0 if unknown
+    bool gap_estimated;         // The jump to 'sequence' has an estimated length
+    int64_t timestamp_us;       // Conversion time of the first sample, 0 if unknown
+    uint32_t red[SAMPLE_BLOCK_CAPACITY];
+    uint32_t ir[SAMPLE_BLOCK_CAPACITY];
+} sample_block_t;
+
+// Function prototypes
+size_t sample_block_pack(sample_block_t *block, const max30102_sample_t *samples, size_t count);
+size_t sample_block_unpack(const sample_block_t *block, size_t first, max30102_sample_t *samples, size_t count);
+
+// Conversion time of sample i, 0 if the block has none
+static inline int64_t sample_block_time_us(const sample_block_t *block, size_t i)
+{
+    if (block->timestamp_us == 0) {
+        return 0;
+    }
+    return block->timestamp_us + (int64_t)((uint64_t)i * block->period_ns / 1000);
+}
+
+// Sample i as a max30102_sample_t, for code that takes one sample at a time
+static inline void sample_block_get(const sample_block_t *block, size_t i, max30102_sample_t *sample)
+{
+    sample->red = block->red[i];
+    sample->ir = block->ir[i];
+    sample->valid = true;
+    sample->sequence = block->sequence + (uint32_t)i;
+    sample->timestamp_us = sample_block_time_us(block, i);
+}
+
+#endif // SAMPLE_BLOCK_H
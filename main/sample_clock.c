@@ -0,0 +1,195 @@
+#include "sample_clock.h"
+#include <string.h>
+
+#define ONE_PERIOD_Q16      ((int64_t)1 << SC_PERIOD_SHIFT)
+
+// Private function prototypes
+static void sc_start(sample_clock_t *clock, uint32_t sequence, int64_t capture_ns);
+static int64_t sc_predict_ns(const sample_clock_t *clock, uint32_t sequence);
+static void sc_close_epoch(sample_clock_t *clock, uint32_t sequence);
+static void sc_fit(sample_clock_t *clock);
+static void sc_fit_pass(sample_clock_t *clock, bool below_only);
+
+max30102_err_t sample_clock_init(sample_clock_t *clock, uint32_t sample_rate_hz)
+{
+    if (!clock || sample_rate_hz == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(clock, 0, sizeof(*clock));
+    clock->nominal_period_ns = 1000000000u / sample_rate_hz;
+    clock->epoch_samples = (uint32_t)((uint64_t)sample_rate_hz * SC_EPOCH_MS / 1000);
+    if (clock->epoch_samples == 0) {
+        clock->epoch_samples = 1;
+    }
+    sample_clock_reset(clock);
+    return MAX30102_OK;
+}
+
+// Forgets the model; the next observation starts a new one. Used when
+// sampling restarts or sequence numbers stop matching the sensor's count.
+void sample_clock_reset(sample_clock_t *clock)
+{
+    clock->started = false;
+    clock->period_q16 = (int64_t)clock->nominal_period_ns * ONE_PERIOD_Q16;
+    clock->point_count = 0;
+    clock->stats.odr_error_ppm = 0;
+    clock->stats.last_error_ns = 0;
+}
+
+static void sc_start(sample_clock_t *clock, uint32_t sequence, int64_t capture_ns)
+{
+    clock->started = true;
+    clock->period_q16 = (int64_t)clock->nominal_period_ns * ONE_PERIOD_Q16;
+    clock->anchor_sequence = sequence;
+    clock->anchor_ns = capture_ns;
+    clock->epoch_start = sequence;
+    clock->best_error_ns = INT64_MAX;
+    clock->point_count = 0;
+}
+
+static int64_t sc_predict_ns(const sample_clock_t *clock, uint32_t sequence)
+{
+    int64_t offset = (int32_t)(sequence - clock->anchor_sequence);
+    return clock->anchor_ns + ((offset * clock->period_q16) >> SC_PERIOD_SHIFT);
+}
+
+// 'newest_sequence' is the newest sample in the FIFO when its pointers were
+// read, and 'capture_us' the esp_timer time taken just before that read
+void sample_clock_update(sample_clock_t *clock, uint32_t newest_sequence, int64_t capture_us)
+{
+    int64_t capture_ns = capture_us * 1000;
+    clock->stats.updates++;
+    
+    if (!clock->started) {
+        sc_start(clock, newest_sequence, capture_ns);
+        return;
+    }
+    
+    // Until the slope has been measured, allow for the worst ODR error
+    int64_t error = capture_ns - sc_predict_ns(clock, newest_sequence);
+    int64_t tolerance = (int64_t)SC_RESYNC_US * 1000 + (clock->period_q16 >> SC_PERIOD_SHIFT);
+    if (clock->point_count < 2) {
+        tolerance += (capture_ns - clock->anchor_ns) / SC_MAX_ODR_ERROR_DIV;
+    }
+    if (error < -tolerance || error > tolerance) {
+        sc_start(clock, newest_sequence, capture_ns);
+        clock->stats.resyncs++;
+        return;
+    }
+    
+    if (error < clock->best_error_ns) {
+        clock->best_error_ns = error;
+        clock->best.sequence = newest_sequence;
+        clock->best.capture_ns = capture_ns;
+    }
+    if (newest_sequence - clock->epoch_start >= clock->epoch_samples) {
+        sc_close_epoch(clock, newest_sequence);
+    }
+}
+
+static void sc_close_epoch(sample_clock_t *clock, uint32_t sequence)
+{
+    if (clock->point_count == SC_HISTORY) {
+        memmove(&clock->points[0], &clock->points[1], (SC_HISTORY - 1) * sizeof(clock->points[0]));
+        clock->point_count--;
+    }
+    clock->points[clock->point_count++] = clock->best;
+    
+    clock->stats.last_error_ns = (int32_t)(clock->best_error_ns > INT32_MAX ? INT32_MAX : clock->best_error_ns);
+    clock->stats.epochs++;
+    clock->epoch_start = sequence;
+    clock->best_error_ns = INT64_MAX;
+    
+    sc_fit(clock);
+}
+
+// Least-squares line through the envelope points, then again through only
+// those on or below the first line. Each point sits above the true line by
+// the wakeup gap of its best drain; the second pass drops epochs with few
+// or late drains, which would otherwise pull the line up. Unlike a hull
+// edge, the result moves smoothly as points enter and leave the history.
+static void sc_fit(sample_clock_t *clock)
+{
+    sc_fit_pass(clock, false);
+    sc_fit_pass(clock, true);
+    
+    int64_t nominal_q16 = (int64_t)clock->nominal_period_ns * ONE_PERIOD_Q16;
+    clock->stats.odr_error_ppm = (int32_t)((clock->period_q16 - nominal_q16) * 1000000 / nominal_q16);
+}
+
+static void sc_fit_pass(sample_clock_t *clock, bool below_only)
+{
+    const sample_clock_point_t *points = clock->points;
+    uint32_t base = points[clock->point_count - 1].sequence;
+    int64_t base_ns = points[clock->point_count - 1].capture_ns;
+    
+    // Relative to the newest point, so sums stay well inside 64 bits
+    int64_t count = 0, sum_x = 0, sum_y = 0;
+    for (uint32_t k = 0; k < clock->point_count; k++) {
+        if (below_only && points[k].capture_ns > sc_predict_ns(clock, points[k].sequence)) {
+            continue;
+        }
+        sum_x += (int32_t)(points[k].sequence - base);
+        sum_y += points[k].capture_ns - base_ns;
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+    
+    int64_t mean_x = sum_x / count;
+    int64_t mean_y = sum_y / count;
+    int64_t sxx = 0, sxy = 0;
+    for (uint32_t k = 0; k < clock->point_count; k++) {
+        if (below_only && points[k].capture_ns > sc_predict_ns(clock, points[k].sequence)) {
+            continue;
+        }
+        int64_t dx = (int32_t)(points[k].sequence - base) - mean_x;
+        sxx += dx * dx;
+        sxy += dx * (points[k].capture_ns - base_ns - mean_y);
+    }
+    
+    // sxy << 16 can overflow, so divide in two steps. With one point the
+    // slope is kept and the line moves onto it.
+    int64_t nominal_q16 = (int64_t)clock->nominal_period_ns * ONE_PERIOD_Q16;
+    int64_t max_error_q16 = nominal_q16 / SC_MAX_ODR_ERROR_DIV;
+    int64_t period_q16 = clock->period_q16;
+    if (sxx > 0) {
+        int64_t slope_q16 = (sxy / sxx) * ONE_PERIOD_Q16 + (sxy % sxx) * ONE_PERIOD_Q16 / sxx;
+        if (slope_q16 - nominal_q16 <= max_error_q16 && nominal_q16 - slope_q16 <= max_error_q16) {
+            period_q16 = slope_q16;
+        }
+    }
+    
+    // Through the exact centroid, expressed at the newest point
+    clock->period_q16 = period_q16;
+    clock->anchor_sequence = base;
+    clock->anchor_ns = base_ns + (sum_y - ((sum_x * period_q16) >> SC_PERIOD_SHIFT)) / count;
+}
+
+// Conversion time of 'sequence', or 0 before the first observation
+int64_t sample_clock_time_us(const sample_clock_t *clock, uint32_t sequence)
+{
+    if (!clock->started) {
+        return 0;
+    }
+    return sc_predict_ns(clock, sequence) / 1000;
+}
+
+void sample_clock_stamp(const sample_clock_t *clock, max30102_sample_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        samples[i].timestamp_us = sample_clock_time_us(clock, samples[i].sequence);
+    }
+}
+
+uint32_t sample_clock_period_ns(const sample_clock_t *clock)
+{
+    return (uint32_t)((clock->period_q16 + ONE_PERIOD_Q16 / 2) >> SC_PERIOD_SHIFT);
+}
+
+void sample_clock_get_stats(const sample_clock_t *clock, sample_clock_stats_t *stats)
+{
+    *stats = clock->stats;
+}
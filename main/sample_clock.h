@@ -0,0 +1,79 @@
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Reconstructs when each sample was converted, on the esp_timer time base.
+// The sensor converts on its own oscillator at close to the configured
+// rate, so sample n was taken at
+//
+//   t(n) = anchor_ns + (n - anchor_sequence) * period
+//
+// Each drain gives one observation: the sequence number of the newest
+// sample in the FIFO when the pointers were read, and an esp_timer capture
+// taken just before that read. That sample was converted before the
+// capture, so every observation is an upper bound on the line. Wakeup
+// jitter only makes the bound looser, never wrong. The tightest bound of
+// each SC_EPOCH_MS epoch is kept for the last SC_HISTORY epochs and the
+// line is fitted to the tightest of those. Its slope is the sensor's actual
+// ODR, measured over the whole history rather than assumed from the config.
+//
+// Stamping is one multiply-add per sample at drain time. Times carry a
+// constant offset of about the bus latency; intervals are unaffected.
+
+#define SC_EPOCH_MS             1000    // Observation window per envelope point
+#define SC_HISTORY              32      // Envelope points in the fit
+#define SC_RESYNC_US            20000   // Larger model error means a restart
+#define SC_MAX_ODR_ERROR_DIV    16      // ODR may be off nominal by up to 1/16
+#define SC_PERIOD_SHIFT         16      // Period fraction bits
+
+// Tightest bound of one epoch
+typedef struct {
+    uint32_t sequence;
+    int64_t capture_ns;
+} sample_clock_point_t;
+
+// Clock counters
+typedef struct {
+    uint32_t updates;           // Drain observations
+    uint32_t epochs;            // Envelope points taken
+    uint32_t resyncs;           // Model restarted after a large error
+    int32_t odr_error_ppm;      // Measured period versus the nominal one
+    int32_t last_error_ns;      // Tightest bound versus the model, last epoch
+} sample_clock_stats_t;
+
+typedef struct {
+    uint32_t nominal_period_ns;
+    uint32_t epoch_samples;
+    
+    // Model
+    bool started;
+    int64_t period_q16;         // Sample period, ns << SC_PERIOD_SHIFT
+    uint32_t anchor_sequence;
+    int64_t anchor_ns;
+    
+    // Current epoch
+    uint32_t epoch_start;
+    int64_t best_error_ns;      // Tightest bound seen: capture minus model
+    sample_clock_point_t best;
+    
+    // Envelope history, oldest first
+    sample_clock_point_t points[SC_HISTORY];
+    uint32_t point_count;
+    
+    sample_clock_stats_t stats;
+} sample_clock_t;
+
+// Function prototypes
+max30102_err_t sample_clock_init(sample_clock_t *clock, uint32_t sample_rate_hz);
+void sample_clock_reset(sample_clock_t *clock);
+void sample_clock_update(sample_clock_t *clock, uint32_t newest_sequence, int64_t capture_us);
+int64_t sample_clock_time_us(const sample_clock_t *clock, uint32_t sequence);
+void sample_clock_stamp(const sample_clock_t *clock, max30102_sample_t *samples, size_t count);
+uint32_t sample_clock_period_ns(const sample_clock_t *clock);
+void sample_clock_get_stats(const sample_clock_t *clock, sample_clock_stats_t *stats);
+
+#endif // SAMPLE_CLOCK_H
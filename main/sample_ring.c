@@ -0,0 +1,235 @@
+#include "sample_ring.h"
+#include <string.h>
+
+#define SAMPLE_RING_BLOCK_MASK  (SAMPLE_RING_BLOCKS - 1)
+
+_Static_assert((SAMPLE_RING_BLOCKS & SAMPLE_RING_BLOCK_MASK) == 0, "SAMPLE_RING_BLOCKS must be a power of two");
+
+// Private function prototypes
+static sample_block_t *ring_block(sample_ring_t *ring, uint32_t slot);
+static size_t ring_readable(sample_ring_t *ring, uint32_t *tail);
+
+static sample_block_t *ring_block(sample_ring_t *ring, uint32_t slot)
+{
+    return &ring->blocks[(slot / SAMPLE_BLOCK_CAPACITY) & SAMPLE_RING_BLOCK_MASK];
+}
+
+void sample_ring_init(sample_ring_t *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->pushed, 0);
+    atomic_init(&ring->popped, 0);
+    atomic_init(&ring->drops, 0);
+    atomic_init(&ring->high_water, 0);
+    ring->cached_tail = 0;
+    ring->cached_head = 0;
+    ring->period_ns = 0;
+    ring->gap_end = 0;
+    ring->gap_estimated = false;
+}
+
+size_t sample_ring_push_block(sample_ring_t *ring, const max30102_sample_t *samples, size_t count)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t n;
+    
+    // Newly opened blocks take the spacing of the latest timestamped run
+    if (count > 1 && samples[0].timestamp_us != 0 && samples[count - 1].timestamp_us > samples[0].timestamp_us &&
+        samples[count - 1].sequence != samples[0].sequence) {
+        ring->period_ns = (uint32_t)((samples[count - 1].timestamp_us - samples[0].timestamp_us) * 1000 /
+                                     (int64_t)(samples[count - 1].sequence - samples[0].sequence));
+    }
+    
+    for (n = 0; n < count; n++) {
+        const max30102_sample_t *s = &samples[n];
+        uint32_t offset = head % SAMPLE_BLOCK_CAPACITY;
+        sample_block_t *block = ring_block(ring, head);
+        
+        // A sequence jump closes the block; its unused slots are skipped
+        if (offset > 0 && s->sequence != block->sequence + offset) {
+            head += SAMPLE_BLOCK_CAPACITY - offset;
+            offset = 0;
+            block = ring_block(ring, head);
+        }
+        
+        if (offset == 0) {
+            // A block is reopened only once the consumer has left it. Only
+            // look at the consumer's index when the cached view says no.
+            if (head + SAMPLE_BLOCK_CAPACITY - ring->cached_tail > SAMPLE_RING_CAPACITY) {
+                ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+                if (head + SAMPLE_BLOCK_CAPACITY - ring->cached_tail > SAMPLE_RING_CAPACITY) {
+                    break;
+                }
+            }
+            block->sequence = s->sequence;
+            block->timestamp_us = s->timestamp_us;
+            block->period_ns = ring->period_ns;
+            block->gap_estimated = ring->gap_estimated && s->sequence == ring->gap_end;
+            if (block->gap_estimated) {
+                ring->gap_estimated = false;
+            }
+        }
+        
+        block->red[offset] = s->red;
+        block->ir[offset] = s->ir;
+        block->count = offset + 1;
+        head++;
+    }
+    
+    // Counted before the samples are published, so pushed - popped never
+    // goes negative
+    atomic_fetch_add_explicit(&ring->pushed, (uint32_t)n, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    
+    if (n < count) {
+        atomic_fetch_add_explicit(&ring->drops, (uint32_t)(count - n), memory_order_relaxed);
+    }
+    
+    uint32_t fill = head - ring->cached_tail;
+    if (fill > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, fill, memory_order_relaxed);
+    }
+    
+    return n;
+}
+
+// Producer side: records a gap the driver reported. If its length was
+// estimated, the block that opens after it is flagged, whether the gap
+// comes before the next samples pushed (rollover) or after them.
+void sample_ring_note_gap(sample_ring_t *ring, const max30102_gap_t *gap)
+{
+    if (gap->count > 0 && gap->saturated) {
+        ring->gap_end = gap->sequence + gap->count;
+        ring->gap_estimated = true;
+    }
+}
+
+// Samples readable in place at *tail, all in one block. Steps *tail over
+// the unused end of a block the producer closed early.
+static size_t ring_readable(sample_ring_t *ring, uint32_t *tail)
+{
+    for (;;) {
+        if (ring->cached_head == *tail) {
+            ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        }
+        uint32_t available = ring->cached_head - *tail;
+        if (available == 0) {
+            return 0;
+        }
+        
+        // The producer may still be filling the block the head is in, but
+        // the count of a block it has moved past is final
+        uint32_t offset = *tail % SAMPLE_BLOCK_CAPACITY;
+        uint32_t block_left = SAMPLE_BLOCK_CAPACITY - offset;
+        if (available < block_left) {
+            return available;
+        }
+        uint32_t count = ring_block(ring, *tail)->count;
+        if (offset < count) {
+            return count - offset;
+        }
+        *tail += block_left;
+    }
+}
+
+size_t sample_ring_pop_block(sample_ring_t *ring, max30102_sample_t *samples, size_t max_samples)
+{
+    size_t n = 0;
+    const sample_block_t *block;
+    size_t first;
+    size_t available;
+    
+    while (n < max_samples && (available = sample_ring_peek(ring, &block, &first)) > 0) {
+        size_t taken = sample_block_unpack(block, first, samples + n,
+                                           (max_samples - n < available) ? max_samples - n : available);
+        sample_ring_consume(ring, taken);
+        n += taken;
+    }
+    return n;
+}
+
+// Pops up to 'max_samples' consecutive samples into 'block', stopping
+// early at a sequence jump. Returns the samples popped.
+size_t sample_ring_pop_run(sample_ring_t *ring, sample_block_t *block, size_t max_samples)
+{
+    const sample_block_t *src;
+    size_t first;
+    size_t available;
+    
+    if (max_samples > SAMPLE_BLOCK_CAPACITY) {
+        max_samples = SAMPLE_BLOCK_CAPACITY;
+    }
+    block->count = 0;
+    
+    while (block->count < max_samples && (available = sample_ring_peek(ring, &src, &first)) > 0) {
+        uint32_t sequence = src->sequence + (uint32_t)first;
+        if (block->count == 0) {
+            block->sequence = sequence;
+            block->timestamp_us = sample_block_time_us(src, first);
+            block->period_ns = src->period_ns;
+            block->gap_estimated = first == 0 && src->gap_estimated;
+        } else if (sequence != block->sequence + block->count) {
+            break;
+        }
+        
+        size_t n = max_samples - block->count;
+        if (n > available) {
+            n = available;
+        }
+        memcpy(&block->red[block->count], &src->red[first], n * sizeof(block->red[0]));
+        memcpy(&block->ir[block->count], &src->ir[first], n * sizeof(block->ir[0]));
+        block->count += (uint32_t)n;
+        sample_ring_consume(ring, n);
+    }
+    return block->count;
+}
+
+// Zero-copy read: points 'block' at the block holding the oldest queued
+// sample, sets 'first' to its index there and returns how many queued
+// samples follow it in that block. They stay valid until
+// sample_ring_consume() hands the slots back.
+size_t sample_ring_peek(sample_ring_t *ring, const sample_block_t **block, size_t *first)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t start = tail;
+    size_t available = ring_readable(ring, &tail);
+    
+    if (tail != start) {
+        // Hand the skipped slots back to the producer
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    *block = ring_block(ring, tail);
+    *first = tail % SAMPLE_BLOCK_CAPACITY;
+    return available;
+}
+
+// Releases 'count' samples read through sample_ring_peek()
+void sample_ring_consume(sample_ring_t *ring, size_t count)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + (uint32_t)count, memory_order_release);
+    atomic_store_explicit(&ring->popped, atomic_load_explicit(&ring->popped, memory_order_relaxed) + (uint32_t)count,
+                          memory_order_release);
+}
+
+size_t sample_ring_count(sample_ring_t *ring)
+{
+    // popped first: every sample it counts was counted in pushed before
+    uint32_t popped = atomic_load_explicit(&ring->popped, memory_order_acquire);
+    uint32_t pushed = atomic_load_explicit(&ring->pushed, memory_order_acquire);
+    return pushed - popped;
+}
+
+void sample_ring_get_stats(sample_ring_t *ring, sample_ring_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+    
+    stats->capacity = SAMPLE_RING_CAPACITY;
+    stats->count = (uint32_t)sample_ring_count(ring);
+    stats->pushed = atomic_load_explicit(&ring->pushed, memory_order_relaxed);
+    stats->drops = atomic_load_explicit(&ring->drops, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "max30102.h"
+#include "sample_block.h"
+
+// Single-producer/single-consumer ring of samples between the acquisition
+// task and a consumer task. Push never blocks: when the ring is full the
+// sample is dropped and counted, and the consumer sees the hole as a jump in
+// sequence numbers. Use one ring per consumer to fan out to several.
+//
+// Samples are stored in sample blocks (sample_block.h), 8 bytes each
+// instead of 24. Head and tail count slots, block * SAMPLE_BLOCK_CAPACITY
+// + offset. A sequence jump closes the producer's block early, and the
+// consumer skips the unused slots. A block is only reopened once the
+// consumer has left it, so the ring holds between SAMPLE_RING_CAPACITY -
+// SAMPLE_BLOCK_CAPACITY and SAMPLE_RING_CAPACITY samples.
+
+#define SAMPLE_RING_BLOCKS      8       // Must be a power of two
+#define SAMPLE_RING_CAPACITY    (SAMPLE_RING_BLOCKS * SAMPLE_BLOCK_CAPACITY)
+#define SAMPLE_RING_CACHE_LINE  64      // Keeps producer and consumer indices apart
+
+typedef struct {
+    // Written by the producer only
+    _Alignas(SAMPLE_RING_CACHE_LINE) atomic_uint head;
+    uint32_t cached_tail;           // Producer's last view of tail
+    uint32_t period_ns;             // Sample spacing seen in pushed timestamps
+    uint32_t gap_end;               // First sequence after the last estimated gap
+    bool gap_estimated;             // gap_end is set and no block has opened there yet
+    atomic_uint pushed;
+    atomic_uint drops;
+    atomic_uint high_water;
+    
+    // Written by the consumer only
+    _Alignas(SAMPLE_RING_CACHE_LINE) atomic_uint tail;
+    uint32_t cached_head;           // Consumer's last view of head
+    atomic_uint popped;
+    
+    _Alignas(SAMPLE_RING_CACHE_LINE) sample_block_t blocks[SAMPLE_RING_BLOCKS];
+} sample_ring_t;
+
+// Ring counters
+typedef struct {
+    uint32_t capacity;
+    uint32_t count;         // Samples currently queued
+    uint32_t pushed;        // Samples accepted
+    uint32_t drops;         // Samples dropped because the ring was full
+    uint32_t high_water;    // Highest fill level seen by the producer, in slots
+} sample_ring_stats_t;
+
+// Function prototypes
+void sample_ring_init(sample_ring_t *ring);
+size_t sample_ring_push_block(sample_ring_t *ring, const max30102_sample_t *samples, size_t count);
+void sample_ring_note_gap(sample_ring_t *ring, const max30102_gap_t *gap);
+size_t sample_ring_pop_block(sample_ring_t *ring, max30102_sample_t *samples, size_t max_samples);
+size_t sample_ring_pop_run(sample_ring_t *ring, sample_block_t *block, size_t max_samples);
+size_t sample_ring_peek(sample_ring_t *ring, const sample_block_t **block, size_t *first);
+void sample_ring_consume(sample_ring_t *ring, size_t count);
+size_t sample_ring_count(sample_ring_t *ring);
+void sample_ring_get_stats(sample_ring_t *ring, sample_ring_stats_t *stats);
+
+static inline bool sample_ring_push(sample_ring_t *ring, const max30102_sample_t *sample)
+{
+    return sample_ring_push_block(ring, sample, 1) == 1;
+}
+
+#endif // SAMPLE_RING_H
@@ -0,0 +1,188 @@
+#include "sensor_group.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "SENSOR_GROUP";
+
+// Private function prototypes
+static int64_t sensor_group_fill_time_us(const sensor_group_member_t *member, uint32_t fill);
+static int64_t sensor_group_member_due_us(const sensor_group_t *group, const sensor_group_member_t *member);
+static int sensor_group_pick(const sensor_group_t *group, int64_t now_us, uint32_t skip);
+
+// 'lookahead_us' is the servicing task's wakeup granularity, normally one
+// tick (portTICK_PERIOD_MS * 1000)
+max30102_err_t sensor_group_init(sensor_group_t *group, uint32_t batch, uint32_t lookahead_us)
+{
+    if (!group || batch == 0 || batch > MAX30102_FIFO_DEPTH) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    *group = (sensor_group_t){0};
+    group->batch = batch;
+    group->lookahead_us = lookahead_us;
+    return MAX30102_OK;
+}
+
+// Starts polling-mode acquisition on an initialized 'dev' and adds it to
+// the group. The member's index is what the sink is called with.
+max30102_err_t sensor_group_add(sensor_group_t *group, max30102_dev_t *dev,
+                                const max30102_config_t *config, size_t *index)
+{
+    if (!group || !dev || !config) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    if (group->count == SENSOR_GROUP_MAX_MEMBERS) {
+        ESP_LOGE(TAG, "Group full (%d members)", SENSOR_GROUP_MAX_MEMBERS);
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    uint32_t rate_hz = max30102_fifo_rate_hz(config);
+    if (rate_hz == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    sensor_group_member_t *member = &group->members[group->count];
+    *member = (sensor_group_member_t){.rate_hz = rate_hz};
+    max30102_err_t err = acquisition_start(&member->acq, dev, ACQUISITION_MODE_POLLING, config);
+    if (err != MAX30102_OK) {
+        return err;
+    }
+    
+    if (index) {
+        *index = group->count;
+    }
+    group->count++;
+    return MAX30102_OK;
+}
+
+// Time the member's FIFO is predicted to hold 'fill' samples. A member that
+// has not been read yet is taken to be there already.
+static int64_t sensor_group_fill_time_us(const sensor_group_member_t *member, uint32_t fill)
+{
+    const max30102_dev_t *dev = member->acq.dev;
+    if (dev->last_snapshot_us <= 0) {
+        return 0;
+    }
+    
+    int64_t needed = (int64_t)fill - (int64_t)dev->fifo_unread;
+    int64_t time_us = dev->last_snapshot_us;
+    if (needed > 0) {
+        time_us += (needed * 1000000 + member->rate_hz - 1) / member->rate_hz;
+    }
+    return time_us;
+}
+
+// Time the member's FIFO is predicted to hold a batch
+static int64_t sensor_group_member_due_us(const sensor_group_t *group, const sensor_group_member_t *member)
+{
+    int64_t due_us = sensor_group_fill_time_us(member, group->batch);
+    return due_us > member->retry_us ? due_us : member->retry_us;
+}
+
+// Of the members due by the next wakeup, the one whose FIFO fills first.
+// Slow members reach the batch as often as fast ones get close to
+// overflowing, so urgency is the overflow time, not the due time. -1 if no
+// member is due. Members set in 'skip' are passed over.
+static int sensor_group_pick(const sensor_group_t *group, int64_t now_us, uint32_t skip)
+{
+    int picked = -1;
+    int64_t earliest = INT64_MAX;
+    
+    for (size_t i = 0; i < group->count; i++) {
+        const sensor_group_member_t *member = &group->members[i];
+        if ((skip & (1u << i)) || sensor_group_member_due_us(group, member) > now_us + group->lookahead_us) {
+            continue;
+        }
+        int64_t full_us = sensor_group_fill_time_us(member, MAX30102_FIFO_DEPTH);
+        if (full_us < earliest) {
+            earliest = full_us;
+            picked = (int)i;
+        }
+    }
+    return picked;
+}
+
+// Returns the earliest due time in the group and, in 'index', the member
+// it belongs to. INT64_MAX if the group is empty.
+int64_t sensor_group_next_due_us(const sensor_group_t *group, size_t *index)
+{
+    int64_t earliest = INT64_MAX;
+    
+    for (size_t i = 0; i < group->count; i++) {
+        int64_t due_us = sensor_group_member_due_us(group, &group->members[i]);
+        if (due_us < earliest) {
+            earliest = due_us;
+            if (index) {
+                *index = i;
+            }
+        }
+    }
+    return earliest;
+}
+
+// Drains members that are due by the next wakeup, most urgent first, and
+// hands each drain to 'sink'. Each member is drained at most once per call
+// so a saturated bus cannot keep the caller here. 'samples' should hold at
+// least a full FIFO. On return 'next_due_us' is when to call again; if it
+// has already passed the caller should only yield.
+max30102_err_t sensor_group_service(sensor_group_t *group, max30102_sample_t *samples, size_t max_samples,
+                                    sensor_group_sink_t sink, void *ctx, int64_t *next_due_us)
+{
+    if (!group || !samples || max_samples == 0 || !next_due_us) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    group->stats.services++;
+    max30102_err_t result = MAX30102_OK;
+    uint32_t drained = 0;
+    
+    for (;;) {
+        int64_t now_us = esp_timer_get_time();
+        int index = sensor_group_pick(group, now_us, drained);
+        if (index < 0) {
+            break;
+        }
+        drained |= 1u << index;
+        
+        sensor_group_member_t *member = &group->members[index];
+        size_t count = 0;
+        max30102_gap_t gap;
+        max30102_err_t err = acquisition_drain(&member->acq, 0, samples, max_samples, &count, &gap);
+        group->stats.drains++;
+        
+        if (err != MAX30102_OK && err != MAX30102_ERR_NO_DATA) {
+            // Leave a sensor that stopped answering alone for a while
+            member->errors++;
+            member->retry_us = now_us + (int64_t)SENSOR_GROUP_RETRY_MS * 1000;
+            group->stats.errors++;
+            result = err;
+            if (member->acq.dev->log) {
+                DEFERRED_LOG(member->acq.dev->log, LOG_MSG_MEMBER_FAILED, index, err);
+            } else {
+                ESP_LOGW(TAG, "Member %d drain failed: %d", index, err);
+            }
+        } else {
+            member->retry_us = 0;
+        }
+        
+        if (gap.count > 0) {
+            group->stats.samples_lost += gap.count;
+        }
+        if (count > 0 || gap.count > 0) {
+            group->stats.samples += count;
+            if (sink) {
+                sink(ctx, (size_t)index, samples, count, gap.count > 0 ? &gap : NULL);
+            }
+        }
+    }
+    
+    *next_due_us = sensor_group_next_due_us(group, NULL);
+    return result;
+}
+
+void sensor_group_get_stats(const sensor_group_t *group, sensor_group_stats_t *stats)
+{
+    if (stats) {
+        *stats = group->stats;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef SENSOR_GROUP_H
+#define SENSOR_GROUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "max30102.h"
+#include "acquisition.h"
+
+// Drains the MAX30102s that share one bus from one task. Every drain costs
+// a pointer read, and behind a mux a channel select, on top of the data,
+// so a member is due once its FIFO is predicted to hold 'batch' samples.
+// Due members are drained in order of when their FIFO would overflow
+// (earliest deadline first). The prediction is what the last read left in
+// the FIFO plus the FIFO rate times the time since that read. On a
+// saturated bus the FIFO closest to overflow is still served first, so loss
+// is spread across the members instead of piling up on whichever is read
+// last.
+//
+// The task can only wake on a scheduler tick, so a member due before the
+// next tick is drained on the current wakeup rather than a tick late. The
+// default batch leaves the rest of the FIFO for a tick of lateness plus
+// the drains queued ahead of a member at 1000 Hz.
+//
+// Use one group per bus, serviced by one task. Buses transfer in parallel,
+// so aggregate throughput scales with the number of buses.
+
+#define SENSOR_GROUP_MAX_MEMBERS    8                           // One per mux channel
+#define SENSOR_GROUP_BATCH          12                          // Default burst size
+#define SENSOR_GROUP_RETRY_MS       100                         // Back-off after a bus error
+
+typedef struct {
+    acquisition_t acq;
+    uint32_t rate_hz;           // FIFO sample rate after averaging
+    int64_t retry_us;           // Not drained before this time after an error
+    uint32_t errors;
+} sensor_group_member_t;
+
+// Group counters
+typedef struct {
+    uint32_t services;          // Calls to sensor_group_service()
+    uint32_t drains;            // Member drains
+    uint32_t samples;           // Samples drained
+    uint32_t samples_lost;      // Samples covered by gap records
+    uint32_t errors;            // Drains that failed on the bus
+} sensor_group_stats_t;
+
+typedef struct {
+    sensor_group_member_t members[SENSOR_GROUP_MAX_MEMBERS];
+    size_t count;
+    uint32_t batch;
+    int64_t lookahead_us;       // Wakeup granularity of the servicing task
+    sensor_group_stats_t stats;
+} sensor_group_t;
+
+// Receives one drain of member 'index'. 'gap' is NULL if nothing was lost.
+typedef void (*sensor_group_sink_t)(void *ctx, size_t index, const max30102_sample_t *samples,
+                                    size_t count, const max30102_gap_t *gap);
+
+// Function prototypes
+max30102_err_t sensor_group_init(sensor_group_t *group, uint32_t batch, uint32_t lookahead_us);
+max30102_err_t sensor_group_add(sensor_group_t *group, max30102_dev_t *dev,
+                                const max30102_config_t *config, size_t *index);
+int64_t sensor_group_next_due_us(const sensor_group_t *group, size_t *index);
+max30102_err_t sensor_group_service(sensor_group_t *group, max30102_sample_t *samples, size_t max_samples,
+                                    sensor_group_sink_t sink, void *ctx, int64_t *next_due_us);
+void sensor_group_get_stats(const sensor_group_t *group, sensor_group_stats_t *stats);
+
+#endif // SENSOR_GROUP_H
@@ -0,0 +1,184 @@
+#include "signal_quality.h"
+#include <string.h>
+#include "dsp_filters.h"
+
+#define SQ_FULL_SCALE_COUNTS    (1u << 18)
+
+// Private function prototypes
+static void sq_evaluate(signal_quality_t *sq, uint32_t sequence);
+static void sq_clear_window(signal_quality_t *sq);
+
+max30102_err_t signal_quality_init(signal_quality_t *sq, uint32_t sample_rate_hz, uint8_t adc_range)
+{
+    if (!sq || sample_rate_hz == 0) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(sq, 0, sizeof(*sq));
+    sq->window = sample_rate_hz * SQ_WINDOW_MS / 1000;
+    if (sq->window == 0) {
+        sq->window = 1;
+    }
+    sq->full_scale_na = 2048u << ((adc_range >> 5) & 0x03);
+    
+    // DC tracker time constant of about 1 s, as in spo2_estimator
+    while ((1u << sq->dc_shift) < sample_rate_hz) {
+        sq->dc_shift++;
+    }
+    
+    signal_quality_reset(sq);
+    return MAX30102_OK;
+}
+
+// Starts over with the gate open, as after init
+void signal_quality_reset(signal_quality_t *sq)
+{
+    sq->started = false;
+    sq->open = true;
+    sq->good_windows = 0;
+    sq->last = (signal_quality_result_t){0};
+    sq_clear_window(sq);
+}
+
+static void sq_clear_window(signal_quality_t *sq)
+{
+    sq->n = 0;
+    sq->clipped = 0;
+    sq->sum_ir_raw = 0;
+    sq->sum_red = 0;
+    sq->sum_ir = 0;
+    sq->sum_red2 = 0;
+    sq->sum_ir2 = 0;
+    sq->sum_red_ir = 0;
+}
+
+// Adds one sample. Returns true when it completed a window, after which
+// the gate and the result reflect that window.
+bool signal_quality_process(signal_quality_t *sq, const max30102_sample_t *sample)
+{
+    sq->stats.samples++;
+    
+    if (!sq->started) {
+        sq->started = true;
+        sq->dc_acc_red = (int32_t)sample->red << sq->dc_shift;
+        sq->dc_acc_ir = (int32_t)sample->ir << sq->dc_shift;
+    }
+    
+    sq->dc_acc_red += (int32_t)sample->red - (sq->dc_acc_red >> sq->dc_shift);
+    sq->dc_acc_ir += (int32_t)sample->ir - (sq->dc_acc_ir >> sq->dc_shift);
+    int64_t red = (int32_t)sample->red - (sq->dc_acc_red >> sq->dc_shift);
+    int64_t ir = (int32_t)sample->ir - (sq->dc_acc_ir >> sq->dc_shift);
+    
+    sq->n++;
+    sq->clipped += (sample->red >= SQ_CLIP_LEVEL || sample->ir >= SQ_CLIP_LEVEL);
+    sq->sum_ir_raw += sample->ir;
+    sq->sum_red += red;
+    sq->sum_ir += ir;
+    sq->sum_red2 += red * red;
+    sq->sum_ir2 += ir * ir;
+    sq->sum_red_ir += red * ir;
+    
+    if (sq->n < sq->window) {
+        return false;
+    }
+    sq_evaluate(sq, sample->sequence);
+    sq_clear_window(sq);
+    return true;
+}
+
+// Once per window: the checks, the index and the gate
+static void sq_evaluate(signal_quality_t *sq, uint32_t sequence)
+{
+    signal_quality_result_t *r = &sq->last;
+    int64_t n = sq->n;
+    
+    *r = (signal_quality_result_t){0};
+    r->sequence = sequence;
+    
+    uint32_t dc = (uint32_t)(sq->sum_ir_raw / (uint64_t)n);
+    r->dc_permille = (uint16_t)((uint64_t)dc * 1000 / SQ_FULL_SCALE_COUNTS);
+    r->dc_na = (uint32_t)(((uint64_t)dc * sq->full_scale_na) >> 18);
+    
+    if (r->dc_na < SQ_MIN_DC_NA) {
+        r->flags |= SQ_FLAG_NO_CONTACT;
+    }
+    if ((uint64_t)sq->clipped * 1000 > (uint64_t)n * SQ_MAX_CLIPPED_PERMILLE ||
+        r->dc_permille > SQ_MAX_DC_PERMILLE) {
+        r->flags |= SQ_FLAG_SATURATED;
+    }
+    
+    // Without light, or with the ADC railed, the AC terms mean nothing
+    if (r->flags == 0) {
+        int64_t var_red = sq->sum_red2 - sq->sum_red * sq->sum_red / n;
+        int64_t var_ir = sq->sum_ir2 - sq->sum_ir * sq->sum_ir / n;
+        int64_t cov = sq->sum_red_ir - sq->sum_red * sq->sum_ir / n;
+        uint32_t sd_red = dsp_isqrt64(var_red > 0 ? (uint64_t)var_red : 0);
+        uint32_t sd_ir = dsp_isqrt64(var_ir > 0 ? (uint64_t)var_ir : 0);
+        
+        // Peak-to-peak of a sine is 2 sqrt(2) times its RMS
+        uint64_t rms_ir = dsp_isqrt64((var_ir > 0 ? (uint64_t)var_ir : 0) / (uint64_t)n);
+        uint64_t perfusion = dc ? rms_ir * 2828 * 10 / dc : 0;
+        r->perfusion_x100 = (uint16_t)(perfusion > UINT16_MAX ? UINT16_MAX : perfusion);
+        
+        int64_t correlation = 0;
+        if (sd_red > 0 && sd_ir > 0) {
+            correlation = cov / (int64_t)sd_red * 100 / (int64_t)sd_ir;
+        }
+        r->correlation = (int8_t)(correlation > 100 ? 100 : correlation < -100 ? -100 : correlation);
+        
+        if (r->perfusion_x100 < SQ_MIN_PERFUSION_X100) {
+            r->flags |= SQ_FLAG_LOW_PERFUSION;
+        } else if (r->perfusion_x100 > SQ_MAX_PERFUSION_X100) {
+            r->flags |= SQ_FLAG_MOTION;
+        }
+        if (r->correlation < SQ_MIN_CORRELATION) {
+            r->flags |= SQ_FLAG_UNCORRELATED;
+        }
+        if ((r->flags & ~SQ_FLAG_UNCORRELATED) == 0 && r->correlation > 0) {
+            r->index = (uint8_t)r->correlation;
+        }
+    }
+    
+    sq->stats.windows++;
+    for (int i = 0; i < SQ_FLAG_COUNT; i++) {
+        if (r->flags & (1u << i)) {
+            sq->stats.flag_windows[i]++;
+        }
+    }
+    
+    if (r->flags == 0) {
+        if (sq->good_windows < SQ_OPEN_WINDOWS) {
+            sq->good_windows++;
+        }
+        if (!sq->open && sq->good_windows >= SQ_OPEN_WINDOWS) {
+            sq->open = true;
+        }
+    } else {
+        sq->stats.poor_windows++;
+        sq->good_windows = 0;
+        if (sq->open) {
+            sq->open = false;
+            sq->stats.gate_closes++;
+        }
+    }
+}
+
+// Whether analysis should run on the samples that follow
+bool signal_quality_gate_open(const signal_quality_t *sq)
+{
+    return sq->open;
+}
+
+void signal_quality_get(const signal_quality_t *sq, signal_quality_result_t *result)
+{
+    if (result) {
+        *result = sq->last;
+    }
+}
+
+void signal_quality_get_stats(const signal_quality_t *sq, signal_quality_stats_t *stats)
+{
+    if (stats) {
+        *stats = sq->stats;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef SIGNAL_QUALITY_H
+#define SIGNAL_QUALITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Signal-quality index for gating heart-rate and SpO2 analysis. Per input
+// sample it runs a DC tracker on both channels and adds the DC-removed
+// values, their squares and their product to running sums, a fixed handful
+// of integer operations. Every SQ_WINDOW_MS the sums are turned into a
+// verdict on the window and cleared:
+//
+//   DC level      IR photocurrent from the ADC range; too little light
+//                 means no finger, too close to full scale leaves no
+//                 headroom for the pulse
+//   clipping      samples at the 18-bit ceiling on either channel
+//   perfusion     IR AC/DC, peak-to-peak estimated from the RMS; too low is
+//                 a weak pulse, too high is motion
+//   correlation   red against IR; the pulse moves both channels together,
+//                 sensor noise and ambient light do not
+//
+// The index is the red/IR correlation in percent, or 0 if any other check
+// failed. The gate closes after one poor window and opens again after
+// SQ_OPEN_WINDOWS good ones, so the analysis it guards restarts on a
+// signal that has held up for a while.
+
+#define SQ_WINDOW_MS            1000
+#define SQ_CLIP_LEVEL           0x3FF00     // Within 256 counts of the 18-bit ceiling
+#define SQ_MAX_CLIPPED_PERMILLE 10          // Clipped samples per window
+#define SQ_MIN_DC_NA            300         // IR photocurrent below which no finger is assumed
+#define SQ_MAX_DC_PERMILLE      900         // IR DC as a share of full scale
+#define SQ_MIN_PERFUSION_X100   5           // Perfusion index in 0.01 % steps
+#define SQ_MAX_PERFUSION_X100   1500
+#define SQ_MIN_CORRELATION      60          // Percent; also the lowest passing index
+#define SQ_OPEN_WINDOWS         2
+
+// Why a window failed
+#define SQ_FLAG_NO_CONTACT      0x01        // IR DC below SQ_MIN_DC_NA
+#define SQ_FLAG_SATURATED       0x02        // Clipping or DC near full scale
+#define SQ_FLAG_LOW_PERFUSION   0x04
+#define SQ_FLAG_MOTION          0x08        // Perfusion too high to be a pulse
+#define SQ_FLAG_UNCORRELATED    0x10        // Red and IR do not move together
+#define SQ_FLAG_COUNT           5
+
+// Verdict on the last complete window
+typedef struct {
+    uint32_t sequence;          // Last sample of the window
+    uint8_t index;              // 0-100, SQ_MIN_CORRELATION and up passes
+    uint8_t flags;              // SQ_FLAG_*
+    int8_t correlation;         // Red/IR, percent
+    uint16_t perfusion_x100;    // IR perfusion index in 0.01 % steps
+    uint16_t dc_permille;       // IR DC as a share of full scale
+    uint32_t dc_na;             // IR DC photocurrent
+} signal_quality_result_t;
+
+// Estimator counters
+typedef struct {
+    uint32_t samples;
+    uint32_t windows;
+    uint32_t poor_windows;
+    uint32_t gate_closes;
+    uint32_t flag_windows[SQ_FLAG_COUNT];  // Windows failed per SQ_FLAG_* bit
+} signal_quality_stats_t;
+
+typedef struct {
+    // Configuration, fixed at init
+    uint32_t window;                // Samples per window
+    uint32_t full_scale_na;         // ADC range
+    uint8_t dc_shift;               // DC tracker time constant, 2^dc_shift samples
+    
+    // DC trackers, level << dc_shift
+    int32_t dc_acc_red;
+    int32_t dc_acc_ir;
+    bool started;
+    
+    // Window sums
+    uint32_t n;
+    uint32_t clipped;
+    uint64_t sum_ir_raw;
+    int64_t sum_red;
+    int64_t sum_ir;
+    int64_t sum_red2;
+    int64_t sum_ir2;
+    int64_t sum_red_ir;
+    
+    // Gate
+    bool open;
+    uint8_t good_windows;
+    
+    signal_quality_result_t last;
+    signal_quality_stats_t stats;
+} signal_quality_t;
+
+// Function prototypes
+max30102_err_t signal_quality_init(signal_quality_t *sq, uint32_t sample_rate_hz, uint8_t adc_range);
+void signal_quality_reset(signal_quality_t *sq);
+bool signal_quality_process(signal_quality_t *sq, const max30102_sample_t *sample);
+bool signal_quality_gate_open(const signal_quality_t *sq);
+void signal_quality_get(const signal_quality_t *sq, signal_quality_result_t *result);
+void signal_quality_get_stats(const signal_quality_t *sq, signal_quality_stats_t *stats);
+
+#endif // SIGNAL_QUALITY_H
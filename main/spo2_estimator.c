@@ -0,0 +1,226 @@
+#include "spo2_estimator.h"
+#include <string.h>
+#include "dsp_filters.h"
+
+#define SPO2_CAL_SIZE       (SPO2_CAL_STEPS * SPO2_CAL_MAX_R + 1)
+#define SPO2_CAL_FRAC_BITS  (16 - 5)    // R is Q16 and SPO2_CAL_STEPS is 2^5
+
+_Static_assert(SPO2_CAL_STEPS == 32, "SPO2_CAL_FRAC_BITS assumes 32 steps per unit of R");
+
+// Calibration curve in 0.1 % steps, evaluated by the compiler and clamped to 0-100 %
+#define SPO2_CAL_R(i)       ((double)(i) / SPO2_CAL_STEPS)
+#define SPO2_CAL_PCT(i)     (SPO2_CAL_A * SPO2_CAL_R(i) * SPO2_CAL_R(i) + SPO2_CAL_B * SPO2_CAL_R(i) + SPO2_CAL_C)
+#define CAL(i)              ((uint16_t)(SPO2_CAL_PCT(i) > 100.0 ? 1000 : \
+                                        SPO2_CAL_PCT(i) < 0.0 ? 0 : SPO2_CAL_PCT(i) * 10.0 + 0.5))
+
+static const uint16_t spo2_cal_x10[SPO2_CAL_SIZE] = {
+    CAL(0),  CAL(1),  CAL(2),  CAL(3),  CAL(4),  CAL(5),  CAL(6),  CAL(7),
+    CAL(8),  CAL(9),  CAL(10), CAL(11), CAL(12), CAL(13), CAL(14), CAL(15),
+    CAL(16), CAL(17), CAL(18), CAL(19), CAL(20), CAL(21), CAL(22), CAL(23),
+    CAL(24), CAL(25), CAL(26), CAL(27), CAL(28), CAL(29), CAL(30), CAL(31),
+    CAL(32), CAL(33), CAL(34), CAL(35), CAL(36), CAL(37), CAL(38), CAL(39),
+    CAL(40), CAL(41), CAL(42), CAL(43), CAL(44), CAL(45), CAL(46), CAL(47),
+    CAL(48), CAL(49), CAL(50), CAL(51), CAL(52), CAL(53), CAL(54), CAL(55),
+    CAL(56), CAL(57), CAL(58), CAL(59), CAL(60), CAL(61), CAL(62), CAL(63),
+    CAL(64),
+};
+
+_Static_assert(sizeof(spo2_cal_x10) / sizeof(spo2_cal_x10[0]) == SPO2_CAL_SIZE,
+               "Calibration table does not match SPO2_CAL_STEPS * SPO2_CAL_MAX_R");
+
+// Private function prototypes
+static void spo2_step(spo2_estimator_t *est, int32_t red, int32_t ir);
+static void spo2_clear_window(spo2_estimator_t *est);
+static uint64_t spo2_ratio_q16(uint64_t num, uint64_t den);
+
+max30102_err_t spo2_estimator_init(spo2_estimator_t *est, uint32_t sample_rate_hz)
+{
+    if (!est || sample_rate_hz < SPO2_MIN_RATE_HZ) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    memset(est, 0, sizeof(*est));
+    est->sample_rate_hz = sample_rate_hz;
+    est->decimation = (sample_rate_hz >= 2 * SPO2_INTERNAL_RATE_HZ) ? sample_rate_hz / SPO2_INTERNAL_RATE_HZ : 1;
+    est->decimation_recip = (int32_t)(((1u << 16) + est->decimation / 2) / est->decimation);
+    
+    // DC tracker time constant of about 1 s
+    uint32_t rate = sample_rate_hz / est->decimation;
+    while ((1u << est->dc_shift) < rate) {
+        est->dc_shift++;
+    }
+    
+    est->min_beat = rate * 60 / SPO2_MAX_BPM;
+    est->max_beat = rate * 60 / SPO2_MIN_BPM;
+    
+    spo2_estimator_reset(est);
+    return MAX30102_OK;
+}
+
+void spo2_estimator_reset(spo2_estimator_t *est)
+{
+    est->box_red = 0;
+    est->box_ir = 0;
+    est->box_count = 0;
+    est->started = false;
+    est->beat_open = false;
+    memset(&est->beat, 0, sizeof(est->beat));
+    spo2_clear_window(est);
+    est->last = (spo2_result_t){0};
+}
+
+static void spo2_clear_window(spo2_estimator_t *est)
+{
+    memset(&est->total, 0, sizeof(est->total));
+    est->window_head = 0;
+    est->window_count = 0;
+}
+
+void spo2_estimator_process(spo2_estimator_t *est, const max30102_sample_t *sample)
+{
+    est->stats.samples++;
+    
+    if (est->started && sample->sequence - est->last_sequence > est->sample_rate_hz) {
+        // More than a second lost: restart from the next beat
+        spo2_estimator_reset(est);
+    }
+    if (!est->started) {
+        est->started = true;
+        est->dc_acc_red = (int32_t)(sample->red << SPO2_SIGNAL_SHIFT) << est->dc_shift;
+        est->dc_acc_ir = (int32_t)(sample->ir << SPO2_SIGNAL_SHIFT) << est->dc_shift;
+    }
+    est->last_sequence = sample->sequence;
+    
+    est->box_red += sample->red;
+    est->box_ir += sample->ir;
+    if (++est->box_count < est->decimation) {
+        return;
+    }
+    
+    int32_t red = (int32_t)(((int64_t)est->box_red * est->decimation_recip) >> (16 - SPO2_SIGNAL_SHIFT));
+    int32_t ir = (int32_t)(((int64_t)est->box_ir * est->decimation_recip) >> (16 - SPO2_SIGNAL_SHIFT));
+    est->box_red = 0;
+    est->box_ir = 0;
+    est->box_count = 0;
+    
+    spo2_step(est, red, ir);
+}
+
+// One decimated sample per channel, in counts << SPO2_SIGNAL_SHIFT
+static void spo2_step(spo2_estimator_t *est, int32_t red, int32_t ir)
+{
+    est->dc_acc_red += red - (est->dc_acc_red >> est->dc_shift);
+    est->dc_acc_ir += ir - (est->dc_acc_ir >> est->dc_shift);
+    int32_t ac_red = red - (est->dc_acc_red >> est->dc_shift);
+    int32_t ac_ir = ir - (est->dc_acc_ir >> est->dc_shift);
+    
+    est->beat.n++;
+    est->beat.dc_red += (uint32_t)red;
+    est->beat.dc_ir += (uint32_t)ir;
+    est->beat.ac2_red += (uint64_t)((int64_t)ac_red * ac_red);
+    est->beat.ac2_ir += (uint64_t)((int64_t)ac_ir * ac_ir);
+}
+
+bool spo2_estimator_beat(spo2_estimator_t *est, spo2_result_t *result)
+{
+    spo2_beat_sums_t beat = est->beat;
+    memset(&est->beat, 0, sizeof(est->beat));
+    est->stats.beats++;
+    
+    // Samples before the first boundary are not a whole beat
+    if (!est->beat_open) {
+        est->beat_open = true;
+        return false;
+    }
+    
+    if (beat.n < est->min_beat || beat.n > est->max_beat) {
+        est->stats.beats_rejected++;
+        spo2_clear_window(est);
+        return false;
+    }
+    
+    // Slide the window: add the new beat, drop the oldest
+    spo2_beat_sums_t *slot = &est->window[est->window_head];
+    if (est->window_count == SPO2_WINDOW_BEATS) {
+        est->total.n -= slot->n;
+        est->total.dc_red -= slot->dc_red;
+        est->total.dc_ir -= slot->dc_ir;
+        est->total.ac2_red -= slot->ac2_red;
+        est->total.ac2_ir -= slot->ac2_ir;
+    } else {
+        est->window_count++;
+    }
+    *slot = beat;
+    est->total.n += beat.n;
+    est->total.dc_red += beat.dc_red;
+    est->total.dc_ir += beat.dc_ir;
+    est->total.ac2_red += beat.ac2_red;
+    est->total.ac2_ir += beat.ac2_ir;
+    est->window_head = (est->window_head + 1) % SPO2_WINDOW_BEATS;
+    
+    if (est->window_count < SPO2_WINDOW_BEATS) {
+        return false;
+    }
+    
+    // R^2 = (sum ac_red^2 / sum ac_ir^2) * (sum dc_ir / sum dc_red)^2; the
+    // sample counts cancel
+    uint64_t ac_ratio = spo2_ratio_q16(est->total.ac2_red, est->total.ac2_ir);
+    uint64_t dc_ratio = spo2_ratio_q16(est->total.dc_ir, est->total.dc_red);
+    uint64_t r2_q32;
+    if (ac_ratio >= (1ull << 24) || dc_ratio >= (1ull << 20)) {
+        r2_q32 = UINT64_MAX;    // Far outside the calibration range
+    } else {
+        r2_q32 = ac_ratio * ((dc_ratio * dc_ratio) >> 16);
+    }
+    uint32_t ratio_q16 = dsp_isqrt64(r2_q32);
+    
+    uint64_t ratio_x1000 = ((uint64_t)ratio_q16 * 1000 + 0x8000) >> 16;
+    est->last.spo2_x10 = spo2_calibrate_x10(ratio_q16);
+    est->last.ratio_x1000 = (uint16_t)(ratio_x1000 > UINT16_MAX ? UINT16_MAX : ratio_x1000);
+    if (ratio_q16 >= ((uint32_t)SPO2_CAL_MAX_R << 16)) {
+        est->stats.out_of_range++;
+    }
+    est->stats.estimates++;
+    
+    if (result) {
+        *result = est->last;
+    }
+    return true;
+}
+
+uint16_t spo2_calibrate_x10(uint32_t ratio_q16)
+{
+    uint32_t index = ratio_q16 >> SPO2_CAL_FRAC_BITS;
+    if (index >= SPO2_CAL_SIZE - 1) {
+        return spo2_cal_x10[SPO2_CAL_SIZE - 1];
+    }
+    
+    // Linear interpolation between table entries
+    int32_t frac = (int32_t)(ratio_q16 & ((1u << SPO2_CAL_FRAC_BITS) - 1));
+    int32_t lo = spo2_cal_x10[index];
+    int32_t hi = spo2_cal_x10[index + 1];
+    return (uint16_t)(lo + (((hi - lo) * frac + (1 << (SPO2_CAL_FRAC_BITS - 1))) >> SPO2_CAL_FRAC_BITS));
+}
+
+// num / den in Q16, keeping as many significant bits as fit
+static uint64_t spo2_ratio_q16(uint64_t num, uint64_t den)
+{
+    while (num >= (1ull << 47)) {
+        num >>= 1;
+        den >>= 1;
+    }
+    if (den == 0) {
+        return UINT64_MAX;
+    }
+    return (num << 16) / den;
+}
+
+uint16_t spo2_estimator_spo2_x10(const spo2_estimator_t *est)
+{
+    return est->last.spo2_x10;
+}
+
+void spo2_estimator_get_stats(const spo2_estimator_t *est, spo2_stats_t *stats)
+{
+    *stats = est->stats;
+}
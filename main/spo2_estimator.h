@@ -0,0 +1,98 @@
+#ifndef SPO2_ESTIMATOR_H
+#define SPO2_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+
+// Streaming SpO2 from the ratio of ratios R = (AC_red / DC_red) / (AC_ir / DC_ir).
+// Samples are boxcar-decimated to about SPO2_INTERNAL_RATE_HZ. For each
+// decimated sample the DC level and the squared DC-removed signal of both
+// channels are added to the current beat. spo2_estimator_beat() closes the
+// beat and slides a window of the last SPO2_WINDOW_BEATS beats by adding the
+// new beat's sums and subtracting the oldest. Per sample this is a fixed
+// handful of integer operations. R and the calibration lookup are done once
+// per beat.
+
+#define SPO2_INTERNAL_RATE_HZ   100
+#define SPO2_MIN_RATE_HZ        25
+#define SPO2_WINDOW_BEATS       4       // Beats in the sliding window
+#define SPO2_MIN_BPM            30      // Beats outside this range restart the window
+#define SPO2_MAX_BPM            240
+#define SPO2_SIGNAL_SHIFT       4       // Fraction bits carried through DC removal
+
+// Calibration: SpO2 (%) = A*R^2 + B*R + C, tabulated at compile time in
+// steps of 1/SPO2_CAL_STEPS over 0 <= R <= SPO2_CAL_MAX_R
+#define SPO2_CAL_A              (-45.060)
+#define SPO2_CAL_B              30.354
+#define SPO2_CAL_C              94.845
+#define SPO2_CAL_STEPS          32
+#define SPO2_CAL_MAX_R          2
+
+// Per-beat sums
+typedef struct {
+    uint32_t n;
+    uint64_t dc_red;        // Sum of red levels
+    uint64_t dc_ir;
+    uint64_t ac2_red;       // Sum of squared DC-removed red, Q(2*SPO2_SIGNAL_SHIFT)
+    uint64_t ac2_ir;
+} spo2_beat_sums_t;
+
+// Estimate after a beat
+typedef struct {
+    uint16_t spo2_x10;      // SpO2 in 0.1 % steps
+    uint16_t ratio_x1000;   // R
+} spo2_result_t;
+
+// Estimator counters
+typedef struct {
+    uint32_t samples;
+    uint32_t beats;
+    uint32_t estimates;
+    uint32_t beats_rejected;    // Beats too short or too long to use
+    uint32_t out_of_range;      // R beyond the calibration table
+} spo2_stats_t;
+
+typedef struct {
+    // Configuration, fixed at init
+    uint32_t sample_rate_hz;
+    uint32_t decimation;
+    int32_t decimation_recip;       // Q16 reciprocal of decimation
+    uint8_t dc_shift;
+    uint32_t min_beat;              // Decimated samples per beat
+    uint32_t max_beat;
+    
+    // Decimation
+    uint32_t box_red;
+    uint32_t box_ir;
+    uint32_t box_count;
+    uint32_t last_sequence;
+    bool started;
+    
+    // DC trackers, level << dc_shift
+    int32_t dc_acc_red;
+    int32_t dc_acc_ir;
+    
+    // Current beat and sliding window
+    spo2_beat_sums_t beat;
+    spo2_beat_sums_t window[SPO2_WINDOW_BEATS];
+    spo2_beat_sums_t total;
+    uint8_t window_head;
+    uint8_t window_count;
+    bool beat_open;                 // A beat boundary has been seen
+    
+    spo2_result_t last;
+    spo2_stats_t stats;
+} spo2_estimator_t;
+
+// Function prototypes
+max30102_err_t spo2_estimator_init(spo2_estimator_t *est, uint32_t sample_rate_hz);
+void spo2_estimator_reset(spo2_estimator_t *est);
+void spo2_estimator_process(spo2_estimator_t *est, const max30102_sample_t *sample);
+bool spo2_estimator_beat(spo2_estimator_t *est, spo2_result_t *result);
+uint16_t spo2_estimator_spo2_x10(const spo2_estimator_t *est);
+uint16_t spo2_calibrate_x10(uint32_t ratio_q16);
+void spo2_estimator_get_stats(const spo2_estimator_t *est, spo2_stats_t *stats);
+
+#endif // SPO2_ESTIMATOR_H
@@ -0,0 +1,535 @@
+#include "stream_codec.h"
+#include <string.h>
+
+#define SAMPLE_MASK     0x03FFFF    // 18-bit ADC values
+
+_Static_assert(STREAM_MAX_BLOCK <= 255, "Sample count is sent as one byte");
+
+// CRC-16/CCITT (poly 0x1021, MSB first)
+static const uint16_t crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+// Private function prototypes
+static void put_u16(uint8_t *p, uint16_t v);
+static void put_u24(uint8_t *p, uint32_t v);
+static void put_u32(uint8_t *p, uint32_t v);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u24(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+static size_t finish_frame(uint8_t *frame, stream_frame_type_t type, size_t payload_len);
+static uint8_t bit_width(uint32_t v);
+static bool decode_payload(stream_decoder_t *dec, uint8_t type, const uint8_t *payload, size_t len);
+static void encoder_emit(stream_encoder_t *enc, size_t len);
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u24(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u24(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint8_t bit_width(uint32_t v)
+{
+    return v ? (uint8_t)(32 - __builtin_clz(v)) : 0;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+uint16_t stream_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 8) ^ crc16_table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
+
+// Writes the header and CRC around a payload already placed after the header
+static size_t finish_frame(uint8_t *frame, stream_frame_type_t type, size_t payload_len)
+{
+    frame[0] = STREAM_SYNC_0;
+    frame[1] = STREAM_SYNC_1;
+    frame[2] = STREAM_VERSION;
+    frame[3] = (uint8_t)type;
+    put_u16(&frame[4], (uint16_t)payload_len);
+    
+    size_t len = STREAM_HEADER_SIZE + payload_len;
+    put_u16(&frame[len], stream_crc16(&frame[2], len - 2));
+    return len + STREAM_CRC_SIZE;
+}
+
+size_t stream_encode_samples(uint8_t *frame, const max30102_sample_t *samples, size_t count)
+{
+    if (count == 0 || count > STREAM_MAX_BLOCK) {
+        return 0;
+    }
+    
+    uint32_t red[STREAM_MAX_BLOCK];
+    uint32_t ir[STREAM_MAX_BLOCK];
+    for (size_t i = 0; i < count; i++) {
+        red[i] = samples[i].red;
+        ir[i] = samples[i].ir;
+    }
+    return stream_encode_arrays(frame, samples[0].sequence, red, ir, count);
+}
+
+// Sample frame from red and IR arrays, sample i numbered sequence + i
+size_t stream_encode_arrays(uint8_t *frame, uint32_t sequence, const uint32_t *red, const uint32_t *ir,
+                            size_t count)
+{
+    if (count == 0 || count > STREAM_MAX_BLOCK) {
+        return 0;
+    }
+    
+    uint32_t red_deltas[STREAM_MAX_BLOCK];
+    uint32_t ir_deltas[STREAM_MAX_BLOCK];
+    uint32_t red_any = 0, ir_any = 0;
+    
+    // Zigzag deltas; OR-ing them gives the highest bit in use for each channel
+    for (size_t i = 1; i < count; i++) {
+        red_deltas[i] = zigzag((int32_t)(red[i] & SAMPLE_MASK) - (int32_t)(red[i - 1] & SAMPLE_MASK));
+        ir_deltas[i] = zigzag((int32_t)(ir[i] & SAMPLE_MASK) - (int32_t)(ir[i - 1] & SAMPLE_MASK));
+        red_any |= red_deltas[i];
+        ir_any |= ir_deltas[i];
+    }
+    uint8_t red_width = bit_width(red_any);
+    uint8_t ir_width = bit_width(ir_any);
+    
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sequence);
+    payload[4] = (uint8_t)count;
+    payload[5] = red_width;
+    payload[6] = ir_width;
+    put_u24(&payload[7], red[0] & SAMPLE_MASK);
+    put_u24(&payload[10], ir[0] & SAMPLE_MASK);
+    
+    // Pack red then IR for each sample, LSB first
+    uint8_t *out = &payload[STREAM_SAMPLE_FIXED];
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for (size_t i = 1; i < count; i++) {
+        acc |= (uint64_t)red_deltas[i] << bits;
+        bits += red_width;
+        acc |= (uint64_t)ir_deltas[i] << bits;
+        bits += ir_width;
+        while (bits >= 8) {
+            *out++ = (uint8_t)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) {
+        *out++ = (uint8_t)acc;
+    }
+    
+    return finish_frame(frame, STREAM_FRAME_SAMPLES, (size_t)(out - payload));
+}
+
+size_t stream_encode_gap(uint8_t *frame, uint32_t sequence, uint32_t count, bool estimated)
+{
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sequence);
+    put_u32(&payload[4], count);
+    payload[8] = estimated ? STREAM_GAP_ESTIMATED : 0;
+    return finish_frame(frame, STREAM_FRAME_GAP, 9);
+}
+
+size_t stream_encode_info(uint8_t *frame, uint32_t sample_rate_hz)
+{
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sample_rate_hz);
+    return finish_frame(frame, STREAM_FRAME_INFO, 4);
+}
+
+size_t stream_encode_beat(uint8_t *frame, uint32_t sequence, uint32_t interval_us, uint16_t bpm_x10)
+{
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sequence);
+    put_u32(&payload[4], interval_us);
+    put_u16(&payload[8], bpm_x10);
+    return finish_frame(frame, STREAM_FRAME_BEAT, 10);
+}
+
+size_t stream_encode_spo2(uint8_t *frame, uint32_t sequence, uint16_t spo2_x10, uint16_t ratio_x1000)
+{
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sequence);
+    put_u16(&payload[4], spo2_x10);
+    put_u16(&payload[6], ratio_x1000);
+    return finish_frame(frame, STREAM_FRAME_SPO2, 8);
+}
+
+size_t stream_encode_spectral(uint8_t *frame, uint32_t sequence, uint16_t bpm_x10, uint8_t confidence)
+{
+    uint8_t *payload = &frame[STREAM_HEADER_SIZE];
+    put_u32(&payload[0], sequence);
+    put_u16(&payload[4], bpm_x10);
+    payload[6] = confidence;
+    return finish_frame(frame, STREAM_FRAME_SPECTRAL, 7);
+}
+
+static void encoder_emit(stream_encoder_t *enc, size_t len)
+{
+    enc->write(enc->ctx, enc->frame, len);
+    enc->stats.frames++;
+    enc->stats.bytes += (uint32_t)len;
+}
+
+void stream_encoder_init(stream_encoder_t *enc, size_t block_size, stream_write_t write, void *ctx)
+{
+    memset(enc, 0, sizeof(*enc));
+    if (block_size == 0 || block_size > STREAM_MAX_BLOCK) {
+        block_size = STREAM_MAX_BLOCK;
+    }
+    enc->block_size = block_size;
+    enc->write = write;
+    enc->ctx = ctx;
+}
+
+void stream_encoder_push(stream_encoder_t *enc, const max30102_sample_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        // A block only holds consecutive sequence numbers; a jump closes it
+        // and is sent as a gap frame
+        if (enc->started && samples[i].sequence != enc->next_sequence) {
+            stream_encoder_flush(enc);
+            stream_encoder_gap(enc, enc->next_sequence, samples[i].sequence - enc->next_sequence, false);
+        }
+        
+        enc->red[enc->count] = samples[i].red;
+        enc->ir[enc->count] = samples[i].ir;
+        enc->count++;
+        enc->next_sequence = samples[i].sequence + 1;
+        enc->started = true;
+        
+        if (enc->count == enc->block_size) {
+            stream_encoder_flush(enc);
+        }
+    }
+}
+
+// As stream_encoder_push(), copying a sample block's arrays in runs
+void stream_encoder_push_block(stream_encoder_t *enc, const sample_block_t *block)
+{
+    if (block->count == 0) {
+        return;
+    }
+    if (enc->started && block->sequence != enc->next_sequence) {
+        stream_encoder_flush(enc);
+        stream_encoder_gap(enc, enc->next_sequence, block->sequence - enc->next_sequence, block->gap_estimated);
+    }
+    
+    size_t done = 0;
+    while (done < block->count) {
+        size_t n = enc->block_size - enc->count;
+        if (n > block->count - done) {
+            n = block->count - done;
+        }
+        memcpy(&enc->red[enc->count], &block->red[done], n * sizeof(enc->red[0]));
+        memcpy(&enc->ir[enc->count], &block->ir[done], n * sizeof(enc->ir[0]));
+        enc->count += n;
+        done += n;
+        enc->next_sequence = block->sequence + (uint32_t)done;
+        enc->started = true;
+        
+        if (enc->count == enc->block_size) {
+            stream_encoder_flush(enc);
+        }
+    }
+}
+
+void stream_encoder_gap(stream_encoder_t *enc, uint32_t sequence, uint32_t count, bool estimated)
+{
+    stream_encoder_flush(enc);
+    encoder_emit(enc, stream_encode_gap(enc->frame, sequence, count, estimated));
+    enc->stats.gaps++;
+    enc->stats.samples_lost += count;
+}
+
+void stream_encoder_info(stream_encoder_t *enc, uint32_t sample_rate_hz)
+{
+    stream_encoder_flush(enc);
+    encoder_emit(enc, stream_encode_info(enc->frame, sample_rate_hz));
+}
+
+// Beat, SpO2 and spectral frames are sent without flushing the open block,
+// so they can arrive before the samples they refer to
+void stream_encoder_beat(stream_encoder_t *enc, uint32_t sequence, uint32_t interval_us, uint16_t bpm_x10)
+{
+    encoder_emit(enc, stream_encode_beat(enc->frame, sequence, interval_us, bpm_x10));
+}
+
+void stream_encoder_spo2(stream_encoder_t *enc, uint32_t sequence, uint16_t spo2_x10, uint16_t ratio_x1000)
+{
+    encoder_emit(enc, stream_encode_spo2(enc->frame, sequence, spo2_x10, ratio_x1000));
+}
+
+void stream_encoder_spectral(stream_encoder_t *enc, uint32_t sequence, uint16_t bpm_x10, uint8_t confidence)
+{
+    encoder_emit(enc, stream_encode_spectral(enc->frame, sequence, bpm_x10, confidence));
+}
+
+void stream_encoder_flush(stream_encoder_t *enc)
+{
+    if (enc->count == 0) {
+        return;
+    }
+    encoder_emit(enc, stream_encode_arrays(enc->frame, enc->next_sequence - (uint32_t)enc->count, enc->red, enc->ir,
+                                           enc->count));
+    enc->stats.samples += (uint32_t)enc->count;
+    enc->count = 0;
+}
+
+void stream_encoder_get_stats(const stream_encoder_t *enc, stream_stats_t *stats)
+{
+    *stats = enc->stats;
+}
+
+void stream_decoder_init(stream_decoder_t *dec, stream_frame_cb_t callback, void *ctx)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->callback = callback;
+    dec->ctx = ctx;
+}
+
+// Validates and unpacks one payload into dec->frame
+static bool decode_payload(stream_decoder_t *dec, uint8_t type, const uint8_t *payload, size_t len)
+{
+    stream_frame_t *frame = &dec->frame;
+    frame->type = (stream_frame_type_t)type;
+    
+    switch (type) {
+    case STREAM_FRAME_SAMPLES: {
+        if (len < STREAM_SAMPLE_FIXED) {
+            return false;
+        }
+        uint32_t count = payload[4];
+        uint8_t red_width = payload[5];
+        uint8_t ir_width = payload[6];
+        if (count == 0 || count > STREAM_MAX_BLOCK ||
+            red_width > STREAM_DELTA_BITS || ir_width > STREAM_DELTA_BITS ||
+            len != STREAM_SAMPLE_FIXED + ((count - 1) * (red_width + ir_width) + 7) / 8) {
+            return false;
+        }
+            
+        uint32_t sequence = get_u32(&payload[0]);
+        uint32_t red = get_u24(&payload[7]);
+        uint32_t ir = get_u24(&payload[10]);
+        uint32_t red_mask = (1u << red_width) - 1;
+        uint32_t ir_mask = (1u << ir_width) - 1;
+        const uint8_t *in = &payload[STREAM_SAMPLE_FIXED];
+        uint64_t acc = 0;
+        unsigned bits = 0;
+            
+        frame->block.first_sequence = sequence;
+        frame->block.count = count;
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) {
+                while (bits < (unsigned)(red_width + ir_width)) {
+                    acc |= (uint64_t)*in++ << bits;
+                    bits += 8;
+                }
+                red += (uint32_t)unzigzag((uint32_t)acc & red_mask);
+                acc >>= red_width;
+                ir += (uint32_t)unzigzag((uint32_t)acc & ir_mask);
+                acc >>= ir_width;
+                bits -= red_width + ir_width;
+            }
+            frame->block.samples[i] = (max30102_sample_t){
+                .red = red & SAMPLE_MASK,
+                .ir = ir & SAMPLE_MASK,
+                .valid = true,
+                .sequence = sequence + i,
+            };
+        }
+        dec->stats.samples += count;
+        return true;
+    }
+    case STREAM_FRAME_GAP:
+        if (len != 9) {
+            return false;
+        }
+        frame->gap.sequence = get_u32(&payload[0]);
+        frame->gap.count = get_u32(&payload[4]);
+        frame->gap.saturated = (payload[8] & STREAM_GAP_ESTIMATED) != 0;
+        dec->stats.gaps++;
+        dec->stats.samples_lost += frame->gap.count;
+        return true;
+    case STREAM_FRAME_INFO:
+        if (len != 4) {
+            return false;
+        }
+        frame->info.sample_rate_hz = get_u32(&payload[0]);
+        return true;
+    case STREAM_FRAME_BEAT:
+        if (len != 10) {
+            return false;
+        }
+        frame->beat.sequence = get_u32(&payload[0]);
+        frame->beat.interval_us = get_u32(&payload[4]);
+        frame->beat.bpm_x10 = get_u16(&payload[8]);
+        return true;
+    case STREAM_FRAME_SPO2:
+        if (len != 8) {
+            return false;
+        }
+        frame->spo2.sequence = get_u32(&payload[0]);
+        frame->spo2.spo2_x10 = get_u16(&payload[4]);
+        frame->spo2.ratio_x1000 = get_u16(&payload[6]);
+        return true;
+    case STREAM_FRAME_SPECTRAL:
+        if (len != 7) {
+            return false;
+        }
+        frame->spectral.sequence = get_u32(&payload[0]);
+        frame->spectral.bpm_x10 = get_u16(&payload[4]);
+        frame->spectral.confidence = payload[6];
+        return true;
+    default:
+        return false;   // Unknown type from a newer encoder
+    }
+}
+
+void stream_decoder_feed(stream_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    while (len > 0 || dec->len > 0) {
+        // Top up the buffer
+        size_t take = sizeof(dec->buf) - dec->len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(&dec->buf[dec->len], data, take);
+        dec->len += take;
+        data += take;
+        len -= take;
+        
+        // Find the sync pattern
+        size_t start = 0;
+        while (start + 1 < dec->len &&
+               !(dec->buf[start] == STREAM_SYNC_0 && dec->buf[start + 1] == STREAM_SYNC_1)) {
+            start++;
+        }
+        if (start + 1 == dec->len && dec->buf[start] != STREAM_SYNC_0) {
+            start++;
+        }
+        if (start > 0) {
+            dec->stats.bytes_skipped += (uint32_t)start;
+            dec->len -= start;
+            memmove(dec->buf, &dec->buf[start], dec->len);
+        }
+        
+        if (dec->len < STREAM_HEADER_SIZE) {
+            if (len == 0) {
+                return;
+            }
+            continue;
+        }
+        
+        size_t skip;
+        size_t payload_len = get_u16(&dec->buf[4]);
+        if (dec->buf[2] != STREAM_VERSION || payload_len > STREAM_MAX_PAYLOAD) {
+            dec->stats.bytes_skipped++;     // False sync
+            skip = 1;
+        } else {
+            size_t frame_len = STREAM_HEADER_SIZE + payload_len + STREAM_CRC_SIZE;
+            if (dec->len < frame_len) {
+                if (len == 0) {
+                    return;
+                }
+                continue;
+            }
+            
+            uint16_t crc = get_u16(&dec->buf[STREAM_HEADER_SIZE + payload_len]);
+            if (crc != stream_crc16(&dec->buf[2], STREAM_HEADER_SIZE - 2 + payload_len)) {
+                dec->stats.crc_errors++;
+                dec->stats.bytes_skipped++;
+                skip = 1;
+            } else if (!decode_payload(dec, dec->buf[3], &dec->buf[STREAM_HEADER_SIZE], payload_len)) {
+                dec->stats.bytes_skipped += (uint32_t)frame_len;    // Intact but not understood
+                skip = frame_len;
+            } else {
+                dec->stats.frames++;
+                dec->stats.bytes += (uint32_t)frame_len;
+                if (dec->callback) {
+                    dec->callback(dec->ctx, &dec->frame);
+                }
+                skip = frame_len;
+            }
+        }
+        
+        dec->len -= skip;
+        memmove(dec->buf, &dec->buf[skip], dec->len);
+    }
+}
+
+void stream_decoder_get_stats(const stream_decoder_t *dec, stream_stats_t *stats)
+{
+    *stats = dec->stats;
+}
@@ -0,0 +1,145 @@
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "sample_block.h"
+
+// Framed binary sample stream. Every frame is
+//
+//   0xA5 0x5A | version | type | payload length (u16) | payload | CRC-16 (u16)
+//
+// with multi-byte fields little-endian and the CRC (CCITT, poly 0x1021, init
+// 0xFFFF) taken over version..payload. A sample frame carries a block of
+// consecutive sequence numbers: the first red/IR pair verbatim, then the
+// zigzag-encoded deltas bit-packed at the narrowest width that fits the
+// block. The decoder resynchronizes on the sync bytes and CRC, so log text
+// interleaved on the same serial link is skipped.
+
+#define STREAM_SYNC_0           0xA5
+#define STREAM_SYNC_1           0x5A
+#define STREAM_VERSION          1
+
+#define STREAM_MAX_BLOCK        64      // Samples per frame
+#define STREAM_HEADER_SIZE      6
+#define STREAM_CRC_SIZE         2
+#define STREAM_SAMPLE_FIXED     13      // Sample payload before the packed deltas
+#define STREAM_DELTA_BITS       19      // Widest zigzag delta of an 18-bit value
+#define STREAM_MAX_PAYLOAD      (STREAM_SAMPLE_FIXED + \
+                                 ((STREAM_MAX_BLOCK - 1) * 2 * STREAM_DELTA_BITS + 7) / 8)
+#define STREAM_MAX_FRAME        (STREAM_HEADER_SIZE + STREAM_MAX_PAYLOAD + STREAM_CRC_SIZE)
+
+// Frame types
+typedef enum {
+    STREAM_FRAME_SAMPLES = 0x01,    // Block of consecutive samples
+    STREAM_FRAME_GAP = 0x02,        // Samples lost before reaching the encoder
+    STREAM_FRAME_INFO = 0x03,       // Stream parameters
+    STREAM_FRAME_BEAT = 0x04,       // Detected heartbeat
+    STREAM_FRAME_SPO2 = 0x05,       // SpO2 estimate
+    STREAM_FRAME_SPECTRAL = 0x06    // Spectral heart-rate readout
+} stream_frame_type_t;
+
+#define STREAM_GAP_ESTIMATED    0x01    // Gap flag: count is an estimate
+
+// Decoded frame
+typedef struct {
+    stream_frame_type_t type;
+    union {
+        struct {
+            uint32_t first_sequence;
+            uint32_t count;
+            max30102_sample_t samples[STREAM_MAX_BLOCK];
+        } block;
+        max30102_gap_t gap;
+        struct {
+            uint32_t sample_rate_hz;
+        } info;
+        struct {
+            uint32_t sequence;      // Sample nearest the peak
+            uint32_t interval_us;
+            uint16_t bpm_x10;
+        } beat;
+        struct {
+            uint32_t sequence;      // Sample at the end of the beat window
+            uint16_t spo2_x10;
+            uint16_t ratio_x1000;
+        } spo2;
+        struct {
+            uint32_t sequence;      // Sample at the end of the analysis window
+            uint16_t bpm_x10;
+            uint8_t confidence;     // Percent
+        } spectral;
+    };
+} stream_frame_t;
+
+// Output callback: writes one complete frame to the link
+typedef void (*stream_write_t)(void *ctx, const uint8_t *data, size_t len);
+
+// Frame callback for the decoder
+typedef void (*stream_frame_cb_t)(void *ctx, const stream_frame_t *frame);
+
+// Stream counters
+typedef struct {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t samples;
+    uint32_t gaps;
+    uint32_t samples_lost;      // Samples covered by gap frames
+    uint32_t crc_errors;        // Decoder: frames rejected by the CRC
+    uint32_t bytes_skipped;     // Decoder: bytes discarded while resynchronizing
+} stream_stats_t;
+
+// Streaming encoder: collects samples into blocks and emits a frame whenever
+// a block fills, the sequence jumps, or the caller flushes
+typedef struct {
+    stream_write_t write;
+    void *ctx;
+    size_t block_size;
+    size_t count;
+    uint32_t next_sequence;
+    bool started;
+    uint32_t red[STREAM_MAX_BLOCK];     // Open block, sequence next_sequence - count on
+    uint32_t ir[STREAM_MAX_BLOCK];
+    uint8_t frame[STREAM_MAX_FRAME];
+    stream_stats_t stats;
+} stream_encoder_t;
+
+// Streaming decoder: accepts arbitrary chunks of the byte stream
+typedef struct {
+    stream_frame_cb_t callback;
+    void *ctx;
+    size_t len;
+    uint8_t buf[STREAM_MAX_FRAME];
+    stream_frame_t frame;
+    stream_stats_t stats;
+} stream_decoder_t;
+
+// Function prototypes
+uint16_t stream_crc16(const uint8_t *data, size_t len);
+size_t stream_encode_samples(uint8_t *frame, const max30102_sample_t *samples, size_t count);
+size_t stream_encode_arrays(uint8_t *frame, uint32_t sequence, const uint32_t *red, const uint32_t *ir,
+                            size_t count);
+size_t stream_encode_gap(uint8_t *frame, uint32_t sequence, uint32_t count, bool estimated);
+size_t stream_encode_info(uint8_t *frame, uint32_t sample_rate_hz);
+size_t stream_encode_beat(uint8_t *frame, uint32_t sequence, uint32_t interval_us, uint16_t bpm_x10);
+size_t stream_encode_spo2(uint8_t *frame, uint32_t sequence, uint16_t spo2_x10, uint16_t ratio_x1000);
+size_t stream_encode_spectral(uint8_t *frame, uint32_t sequence, uint16_t bpm_x10, uint8_t confidence);
+
+void stream_encoder_init(stream_encoder_t *enc, size_t block_size, stream_write_t write, void *ctx);
+void stream_encoder_push(stream_encoder_t *enc, const max30102_sample_t *samples, size_t count);
+void stream_encoder_push_block(stream_encoder_t *enc, const sample_block_t *block);
+void stream_encoder_gap(stream_encoder_t *enc, uint32_t sequence, uint32_t count, bool estimated);
+void stream_encoder_info(stream_encoder_t *enc, uint32_t sample_rate_hz);
+void stream_encoder_beat(stream_encoder_t *enc, uint32_t sequence, uint32_t interval_us, uint16_t bpm_x10);
+void stream_encoder_spo2(stream_encoder_t *enc, uint32_t sequence, uint16_t spo2_x10, uint16_t ratio_x1000);
+void stream_encoder_spectral(stream_encoder_t *enc, uint32_t sequence, uint16_t bpm_x10, uint8_t confidence);
+void stream_encoder_flush(stream_encoder_t *enc);
+void stream_encoder_get_stats(const stream_encoder_t *enc, stream_stats_t *stats);
+
+void stream_decoder_init(stream_decoder_t *dec, stream_frame_cb_t callback, void *ctx);
+void stream_decoder_feed(stream_decoder_t *dec, const uint8_t *data, size_t len);
+void stream_decoder_get_stats(const stream_decoder_t *dec, stream_stats_t *stats);
+
+#endif // STREAM_CODEC_H
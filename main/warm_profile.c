@@ -0,0 +1,107 @@
+#include "warm_profile.h"
+#include <string.h>
+#include "stream_codec.h"
+
+static const uint8_t profile_magic[4] = {'H', 'R', 'M', 'W'};
+
+// Private function prototypes
+static void put_u16(uint8_t *p, uint16_t v);
+static void put_u32(uint8_t *p, uint32_t v);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+static void put_config(uint8_t *p, const max30102_config_t *config);
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+// 9 bytes, in max30102_config_t order
+static void put_config(uint8_t *p, const max30102_config_t *config)
+{
+    p[0] = config->mode;
+    p[1] = config->sample_rate;
+    p[2] = config->pulse_width;
+    p[3] = config->adc_range;
+    p[4] = config->sample_avg;
+    p[5] = config->led1_power;
+    p[6] = config->led2_power;
+    p[7] = config->rollover_enable ? 1 : 0;
+    p[8] = config->almost_full_threshold;
+}
+
+// Identifies a configuration, for telling whether a profile was saved by
+// a build with the same one
+uint16_t warm_profile_fingerprint(const max30102_config_t *config)
+{
+    uint8_t buf[9];
+    put_config(buf, config);
+    return stream_crc16(buf, sizeof(buf));
+}
+
+// Returns the bytes written, WARM_PROFILE_SIZE, or 0 if 'len' is too small
+size_t warm_profile_encode(const warm_profile_t *profile, uint8_t *buf, size_t len)
+{
+    if (!profile || !buf || len < WARM_PROFILE_SIZE) {
+        return 0;
+    }
+    
+    memcpy(buf, profile_magic, sizeof(profile_magic));
+    buf[4] = WARM_PROFILE_VERSION;
+    buf[5] = WARM_PROFILE_PAYLOAD;
+    
+    uint8_t *p = &buf[6];
+    put_u16(&p[0], profile->base_fingerprint);
+    put_u32(&p[2], profile->boot_count);
+    put_u32(&p[6], profile->hr.interval_us);
+    put_u32(&p[10], (uint32_t)profile->hr.amp);
+    
+    put_u16(&buf[6 + WARM_PROFILE_PAYLOAD], stream_crc16(buf, 6 + WARM_PROFILE_PAYLOAD));
+    return WARM_PROFILE_SIZE;
+}
+
+// MAX30102_ERR_INVALID_PARAM for a truncated, corrupt or other-version
+// profile; 'profile' is only written on success
+max30102_err_t warm_profile_decode(const uint8_t *buf, size_t len, warm_profile_t *profile)
+{
+    if (!buf || !profile || len != WARM_PROFILE_SIZE || memcmp(buf, profile_magic, sizeof(profile_magic)) != 0 ||
+        buf[4] != WARM_PROFILE_VERSION || buf[5] != WARM_PROFILE_PAYLOAD ||
+        get_u16(&buf[6 + WARM_PROFILE_PAYLOAD]) != stream_crc16(buf, 6 + WARM_PROFILE_PAYLOAD)) {
+        return MAX30102_ERR_INVALID_PARAM;
+    }
+    
+    const uint8_t *p = &buf[6];
+    warm_profile_t decoded;
+    decoded.base_fingerprint = get_u16(&p[0]);
+    decoded.boot_count = get_u32(&p[2]);
+    decoded.hr.interval_us = get_u32(&p[6]);
+    decoded.hr.amp = (int32_t)get_u32(&p[10]);
+    
+    *profile = decoded;
+    return MAX30102_OK;
+}
+
+// True if 'profile' is at most WARM_PROFILE_MAX_AGE boots older than
+// 'boot_count'. One from a later boot than 'boot_count' means the counter
+// was lost, so its age is unknown and it is stale too.
+bool warm_profile_fresh(const warm_profile_t *profile, uint32_t boot_count)
+{
+    return boot_count - profile->boot_count <= WARM_PROFILE_MAX_AGE;
+}
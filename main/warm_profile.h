@@ -0,0 +1,48 @@
+#ifndef WARM_PROFILE_H
+#define WARM_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "max30102.h"
+#include "hr_detector.h"
+
+// Warm-start profile: what a boot can reuse from the last run that had a
+// good signal. It marks the sensor as configured, so the driver can check
+// it with one register read instead of a reset, and holds the heart-rate
+// detector's warm state (hr_detector.h). The firmware keeps it in NVS. The
+// serialized form is
+//
+//   "HRMW" | version (u8) | payload length (u8) | payload | CRC-16
+//
+// with the CRC from stream_crc16() over everything before it, and
+// multi-byte fields little-endian. A profile with any other version is
+// rejected rather than migrated, so bump WARM_PROFILE_VERSION whenever
+// the payload changes. The marker is a fingerprint of the configuration
+// the firmware was built with, which is the only one it ever writes to the
+// sensor. A profile saved under a different build configuration does not
+// apply, so the configuration itself is not stored. It records the boot it
+// was saved in: one more than WARM_PROFILE_MAX_AGE boots old is stale, as
+// the heart rate it holds may no longer be the wearer's.
+//
+// The DC trackers are not stored: they start from the first sample, which
+// is a closer estimate than a level saved on an earlier boot.
+
+#define WARM_PROFILE_VERSION    3
+#define WARM_PROFILE_PAYLOAD    14
+#define WARM_PROFILE_MAX_AGE    4       // Boots a profile stays usable after the one that saved it
+#define WARM_PROFILE_SIZE       (4 + 2 + WARM_PROFILE_PAYLOAD + 2)
+
+typedef struct {
+    uint16_t base_fingerprint;      // warm_profile_fingerprint() of the build's configuration
+    uint32_t boot_count;            // Boot the profile was saved in
+    hr_warm_state_t hr;
+} warm_profile_t;
+
+// Function prototypes
+uint16_t warm_profile_fingerprint(const max30102_config_t *config);
+size_t warm_profile_encode(const warm_profile_t *profile, uint8_t *buf, size_t len);
+max30102_err_t warm_profile_decode(const uint8_t *buf, size_t len, warm_profile_t *profile);
+bool warm_profile_fresh(const warm_profile_t *profile, uint32_t boot_count);
+
+#endif // WARM_PROFILE_H